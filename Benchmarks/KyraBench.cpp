@@ -0,0 +1,275 @@
+#include <benchmark/benchmark.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "AST.hpp"
+#include "Aliases.hpp"
+#include "CompilerInstance.hpp"
+#include "Error.hpp"
+#include "NodeCounter.hpp"
+#include "ProgramGenerator.hpp"
+#include "TAST.hpp"
+#include "TimeTrace.hpp"
+#include "Token.hpp"
+
+using namespace Kyra;
+
+// The print runtime (Runtime/Print.ll), compiled for the host
+extern "C" void kyra_print_i32(int32_t value);
+extern "C" void kyra_flush();
+
+namespace {
+const std::filesystem::path input_path = "generated.ky";
+
+template <typename T>
+T expect_result(CompilerInstance& instance, ErrorOr<T>&& error_or_result) {
+	if(error_or_result.is_error()) {
+		std::cerr << "The generated program is invalid: ";
+		instance.print_error(error_or_result.get_exception(), std::cerr);
+		std::exit(1);
+	}
+	return std::move(error_or_result).get_result();
+}
+
+// The output of every phase for one generated program, so each benchmark only measures its own phase
+struct Input {
+	explicit Input(std::string generated_source) :
+		source(std::move(generated_source)),
+		tokens(expect_result(instance, instance.get_lexer().scan_input(source, input_path))),
+		statements(expect_result(instance, instance.get_parser().parse_tokens(tokens))),
+		typed_statements(expect_result(instance, instance.get_type_checker().check_statements(statements))),
+		node_count(NodeCounter().count(statements)) {}
+
+	// Every phase runs on the instance the input was prepared with, so declarations stay valid
+	mutable CompilerInstance instance;
+	const std::string source;
+	const std::vector<Token> tokens;
+	const std::vector<RefPtr<Untyped::Statement>> statements;
+	const std::vector<RefPtr<Typed::Statement>> typed_statements;
+	const unsigned node_count;
+};
+
+ProgramGenerator::Options get_generator_options(const benchmark::State& state) {
+	ProgramGenerator::Options options;
+	options.functions = state.range(0);
+	options.overloads = state.range(1);
+	options.expression_depth = state.range(2);
+	return options;
+}
+
+const Input& get_input(const ProgramGenerator::Options& options) {
+	static std::map<std::tuple<unsigned, unsigned, unsigned>, OwnPtr<Input>> inputs;
+	OwnPtr<Input>& input = inputs[{options.functions, options.overloads, options.expression_depth}];
+	if(input != nullptr)
+		return *input;
+
+	input = mk_own<Input>(ProgramGenerator(options).generate());
+	return *input;
+}
+
+// The state of one benchmark run, so phases can exclude their setup from the measurement
+struct Run {
+	benchmark::State& state;
+	// Allocated while the timing was paused
+	TimeTrace::AllocationCounters untimed_allocations;
+};
+
+// Pauses the timing and the allocation counting of a run while it exists
+class Untimed {
+public:
+	explicit Untimed(Run& run) : m_run(run), m_start(TimeTrace::get_allocation_counters()) { run.state.PauseTiming(); }
+	Untimed(const Untimed&) = delete;
+	Untimed(Untimed&&) = delete;
+	~Untimed() {
+		const TimeTrace::AllocationCounters end = TimeTrace::get_allocation_counters();
+		m_run.untimed_allocations.allocations += end.allocations - m_start.allocations;
+		m_run.untimed_allocations.allocated_bytes += end.allocated_bytes - m_start.allocated_bytes;
+		m_run.state.ResumeTiming();
+	}
+
+	Untimed& operator=(const Untimed&) = delete;
+	Untimed& operator=(Untimed&&) = delete;
+
+private:
+	Run& m_run;
+	const TimeTrace::AllocationCounters m_start;
+};
+
+template <typename Phase>
+void run_phase(benchmark::State& state, const Phase& phase) {
+	const Input& input = get_input(get_generator_options(state));
+	Run run{state, {}};
+	const TimeTrace::AllocationCounters start = TimeTrace::get_allocation_counters();
+	for(auto _ : state)
+		phase(run, input);
+	const TimeTrace::AllocationCounters end = TimeTrace::get_allocation_counters();
+	const uint64_t allocations = end.allocations - start.allocations - run.untimed_allocations.allocations;
+	const uint64_t allocated_bytes =
+		end.allocated_bytes - start.allocated_bytes - run.untimed_allocations.allocated_bytes;
+
+	state.SetBytesProcessed(state.iterations() * input.source.size());
+	state.counters["tokens/s"] =
+		benchmark::Counter(input.tokens.size(), benchmark::Counter::kIsIterationInvariantRate);
+	state.counters["nodes/s"] = benchmark::Counter(input.node_count, benchmark::Counter::kIsIterationInvariantRate);
+	state.counters["allocations"] = benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+	state.counters["bytes_allocated"] = benchmark::Counter(allocated_bytes, benchmark::Counter::kAvgIterations);
+}
+
+void lex(Run&, const Input& input) {
+	benchmark::DoNotOptimize(input.instance.get_lexer().scan_input(input.source, input_path));
+}
+
+void parse(Run&, const Input& input) {
+	benchmark::DoNotOptimize(input.instance.get_parser().parse_tokens(input.tokens));
+}
+
+void type_check(Run& run, const Input& input) {
+	// Every run declares all functions again, so it needs a fresh instance. Otherwise the scopes would keep growing.
+	std::optional<Untimed> untimed(run);
+	auto instance = mk_own<CompilerInstance>(input.instance.get_builtin_scope());
+	untimed.reset();
+	// The type checker takes ownership of the statements, so only the top-level vector (not the nodes) is copied
+	auto typed_statements = instance->get_type_checker().check_statements(input.statements);
+	benchmark::DoNotOptimize(typed_statements);
+	// The typed AST and the instance are destroyed (in this order) with the timing paused as well
+	untimed.emplace(run);
+}
+
+void generate_code(Run&, const Input& input) {
+	input.instance.get_code_gen().gen_code(input.typed_statements, input_path, {});
+	input.instance.get_code_gen().print_module(llvm::nulls());
+	benchmark::ClobberMemory();
+}
+
+// Sends everything written to stdout to /dev/null while it exists, so printing can be measured without a terminal
+class DiscardedStdout {
+public:
+	DiscardedStdout() : m_stdout(dup(STDOUT_FILENO)) {
+		std::fflush(stdout);
+		const int null_fd = open("/dev/null", O_WRONLY);
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+	}
+	DiscardedStdout(const DiscardedStdout&) = delete;
+	DiscardedStdout(DiscardedStdout&&) = delete;
+	~DiscardedStdout() {
+		std::fflush(stdout);
+		dup2(m_stdout, STDOUT_FILENO);
+		close(m_stdout);
+	}
+
+	DiscardedStdout& operator=(const DiscardedStdout&) = delete;
+	DiscardedStdout& operator=(DiscardedStdout&&) = delete;
+
+private:
+	const int m_stdout;
+};
+
+// Values of every length and sign, like the output of a typical program
+int32_t get_printed_value(int64_t index) { return static_cast<int32_t>(index * 7919 - 100000000); }
+
+// What print used to call for every value
+void print_with_printf(benchmark::State& state) {
+	const DiscardedStdout discarded_stdout;
+	for(auto _ : state) {
+		for(int64_t i = 0; i < state.range(0); ++i)
+			std::printf("%d\n", get_printed_value(i));
+		std::fflush(stdout);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void print_with_runtime(benchmark::State& state) {
+	const DiscardedStdout discarded_stdout;
+	for(auto _ : state) {
+		for(int64_t i = 0; i < state.range(0); ++i)
+			kyra_print_i32(get_printed_value(i));
+		kyra_flush();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+std::optional<unsigned> parse_size(std::string_view argument, std::string_view name) {
+	if(!argument.starts_with(name))
+		return {};
+	return std::stoul(std::string(argument.substr(name.size())));
+}
+}
+
+// Usage: kyra_bench [--functions=N] [--overloads=K] [--depth=D] [benchmark options]
+// Without any sizes a small matrix of sizes is run. Results are written to kyra-bench.json unless --benchmark_out is
+// given.
+int main(int argc, char** argv) {
+	std::vector<unsigned> functions = {16, 64, 256, 1024};
+	std::vector<unsigned> overloads = {1, 4};
+	std::vector<unsigned> depths = {4, 16};
+	std::vector<char*> arguments = {argv[0]};
+	bool has_output_file = false;
+	for(int i = 1; i < argc; ++i) {
+		const std::string_view argument(argv[i]);
+		if(std::optional<unsigned> size = parse_size(argument, "--functions="); size.has_value())
+			functions = {*size};
+		else if(std::optional<unsigned> size = parse_size(argument, "--overloads="); size.has_value())
+			overloads = {*size};
+		else if(std::optional<unsigned> size = parse_size(argument, "--depth="); size.has_value())
+			depths = {*size};
+		else {
+			has_output_file |= argument.starts_with("--benchmark_out=");
+			arguments.push_back(argv[i]);
+		}
+	}
+	std::string output_file_argument = "--benchmark_out=kyra-bench.json";
+	std::string output_format_argument = "--benchmark_out_format=json";
+	if(!has_output_file) {
+		arguments.push_back(output_file_argument.data());
+		arguments.push_back(output_format_argument.data());
+	}
+
+	int benchmark_argc = arguments.size();
+	benchmark::Initialize(&benchmark_argc, arguments.data());
+	if(benchmark::ReportUnrecognizedArguments(benchmark_argc, arguments.data()))
+		return 1;
+
+	const std::pair<const char*, void (*)(Run&, const Input&)> phases[] = {
+		{"Lexer::scan_input", lex},
+		{"Parser::parse_tokens", parse},
+		{"TypeChecker::check_statements", type_check},
+		{"CodeGen::gen_code", generate_code},
+	};
+	for(const auto& [name, phase] : phases) {
+		benchmark::internal::Benchmark* benchmark =
+			benchmark::RegisterBenchmark(name, [phase = phase](benchmark::State& state) { run_phase(state, phase); });
+		benchmark->ArgNames({"functions", "overloads", "depth"})->Unit(benchmark::kMicrosecond);
+		for(unsigned function_count : functions) {
+			for(unsigned overload_count : overloads) {
+				for(unsigned depth : depths)
+					benchmark->Args({function_count, overload_count, depth});
+			}
+		}
+	}
+
+	// Values printed per iteration. Every print is a call here, in generated code the runtime is inlined as well.
+	benchmark::RegisterBenchmark("printf", print_with_printf)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+	benchmark::RegisterBenchmark("Runtime::kyra_print_i32", print_with_runtime)
+		->Arg(1 << 20)
+		->Unit(benchmark::kMillisecond);
+
+	TimeTrace::start_counting_allocations();
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,197 @@
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "AST.hpp"
+#include "Aliases.hpp"
+#include "CompilerInstance.hpp"
+#include "Error.hpp"
+#include "TAST.hpp"
+#include "Token.hpp"
+#include "TypedASTCache.hpp"
+
+using namespace Kyra;
+
+namespace {
+// Uses every kind of node the cache stores
+const char* const test_program = R"(val size: i32 = 4;
+var values: [i32; 4] = [1, 2, 3, 4];
+extern fun abs(val x: i32): i32;
+fun square(val n: i32): i32 { return n * n; }
+fun square(val n: i64): i64 { return n * n; }
+memo fun cube(val n: i32): i32 { return n * n * n; }
+fun sum(): i32 {
+	var total: i32 = 0;
+	for i in 0..size { total = total + square(values[i]); }
+	return total;
+}
+values[0] = abs(0 - 10);
+print sum();
+val wide: i64 = 3000000;
+print square(wide);
+print cube(5);
+var doubled: [i32; 4];
+parallel for i in 0..size { doubled[i] = values[i] * 2; }
+print doubled[3];
+{ var nested: i32 = 2; nested = nested * size; print nested; }
+)";
+
+unsigned failures = 0;
+
+void check(bool condition, std::string_view description) {
+	if(condition)
+		return;
+	std::cerr << "FAILED: " << description << '\n';
+	++failures;
+}
+
+std::string read_file(const std::filesystem::path& path) {
+	std::ifstream input(path, std::ios::binary);
+	return std::string((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::filesystem::path& path, std::string_view content) {
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	output << content;
+}
+
+std::string print_module(CompilerInstance& instance) {
+	std::string module;
+	llvm::raw_string_ostream output(module);
+	instance.get_code_gen().print_module(output);
+	return std::move(output.str());
+}
+
+// The IR of the freshly checked program, or nothing if it does not compile
+std::optional<std::string> check_and_write(CompilerInstance& instance, const std::filesystem::path& source_path,
+	std::string_view source, bool is_lazy, const std::filesystem::path& cache_path) {
+	// The untyped AST refers to the tokens, so they have to outlive the type checking
+	ErrorOr<std::vector<Token>> tokens = instance.get_lexer().scan_input(source, source_path);
+	if(tokens.is_error())
+		return {};
+	ErrorOr<std::vector<RefPtr<Untyped::Statement>>> statements =
+		instance.get_parser().parse_tokens(tokens.get_result());
+	if(statements.is_error())
+		return {};
+	ErrorOr<std::vector<RefPtr<Typed::Statement>>> typed_statements =
+		instance.get_type_checker().check_statements(std::move(statements).get_result(), is_lazy);
+	if(typed_statements.is_error())
+		return {};
+	CodeGen::Options options;
+	options.lazy = is_lazy;
+	instance.get_code_gen().gen_code(typed_statements.get_result(), source_path, options);
+	if(!TypedASTCache::write(cache_path, source, is_lazy, {}, typed_statements.get_result(),
+		   instance.get_declarations()))
+		return {};
+	return print_module(instance);
+}
+
+// Loading the cache has to give the same typed AST (it is written to the same bytes again) and the same IR
+void test_round_trip(const std::filesystem::path& directory, bool is_lazy) {
+	const std::filesystem::path source_path = directory / "program.ky";
+	const std::filesystem::path cache_path = directory / "program.kyc";
+	const std::string source = test_program;
+
+	CompilerInstance fresh_instance;
+	const std::optional<std::string> fresh_module =
+		check_and_write(fresh_instance, source_path, source, is_lazy, cache_path);
+	check(fresh_module.has_value(), "The test program compiles and its cache is written");
+	if(!fresh_module.has_value())
+		return;
+
+	CompilerInstance cached_instance(fresh_instance.get_builtin_scope());
+	std::optional<TypedASTCache> cache =
+		TypedASTCache::load(cache_path, source, is_lazy, source_path, *fresh_instance.get_builtin_scope());
+	check(cache.has_value(), "The cache that was just written is loaded");
+	if(!cache.has_value())
+		return;
+	cached_instance.get_declarations() = cache->take_declarations();
+	const std::vector<RefPtr<Typed::Statement>> statements = cache->take_statements();
+
+	const std::filesystem::path rewritten_path = directory / "rewritten.kyc";
+	check(TypedASTCache::write(rewritten_path, source, is_lazy, {}, statements, cached_instance.get_declarations()),
+		"The loaded typed AST is written again");
+	check(read_file(rewritten_path) == read_file(cache_path), "The loaded typed AST matches the checked one");
+
+	CodeGen::Options options;
+	options.lazy = is_lazy;
+	cached_instance.get_code_gen().gen_code(statements, source_path, options);
+	check(print_module(cached_instance) == *fresh_module, "The IR of the loaded typed AST matches a fresh check");
+}
+
+// Nothing but the unchanged file is accepted, a damaged cache must never be compiled
+void test_rejections(const std::filesystem::path& directory) {
+	const std::filesystem::path source_path = directory / "program.ky";
+	const std::filesystem::path cache_path = directory / "program.kyc";
+	const std::filesystem::path damaged_path = directory / "damaged.kyc";
+	const std::string source = test_program;
+	CompilerInstance instance;
+	const RefPtr<TypeScope> scope = instance.get_builtin_scope();
+	const auto is_loaded = [&](const std::filesystem::path& path, std::string_view loaded_source, bool is_lazy) {
+		return TypedASTCache::load(path, loaded_source, is_lazy, source_path, *scope).has_value();
+	};
+
+	if(!check_and_write(instance, source_path, source, false, cache_path).has_value()) {
+		check(false, "The test program compiles and its cache is written");
+		return;
+	}
+	const std::string content = read_file(cache_path);
+	check(is_loaded(cache_path, source, false), "The unchanged cache is loaded");
+
+	check(!is_loaded(directory / "missing.kyc", source, false), "A missing cache is rejected");
+	std::string changed_source = source;
+	changed_source.back() = ' ';
+	check(!is_loaded(cache_path, changed_source, false), "A cache of another source is rejected");
+	check(!is_loaded(cache_path, source, true), "A cache with another lazy setting is rejected");
+
+	unsigned accepted_truncations = 0;
+	for(size_t size = 0; size < content.size(); ++size) {
+		write_file(damaged_path, std::string_view(content).substr(0, size));
+		accepted_truncations += is_loaded(damaged_path, source, false);
+	}
+	check(accepted_truncations == 0, "Every truncated cache is rejected");
+
+	write_file(damaged_path, content + '\0');
+	check(!is_loaded(damaged_path, source, false), "A cache with trailing bytes is rejected");
+
+	unsigned accepted_corruptions = 0;
+	for(size_t position = 0; position < content.size(); ++position) {
+		std::string corrupted = content;
+		corrupted[position] = static_cast<char>(corrupted[position] ^ 0x01);
+		write_file(damaged_path, corrupted);
+		accepted_corruptions += is_loaded(damaged_path, source, false);
+	}
+	check(accepted_corruptions == 0, "Every cache with a flipped bit is rejected");
+}
+}
+
+// Tests for the typed AST cache (see kyra --ast-cache). Exits with 1 if any check fails.
+int main() {
+	const std::filesystem::path directory =
+		std::filesystem::temp_directory_path() / ("kyra-cache-test-" + std::to_string(getpid()));
+	std::filesystem::create_directories(directory);
+
+	test_round_trip(directory, false);
+	test_round_trip(directory, true);
+	test_rejections(directory);
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+	if(failures != 0) {
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	std::cout << "All checks passed\n";
+	return 0;
+}
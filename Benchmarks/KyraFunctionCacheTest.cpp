@@ -0,0 +1,159 @@
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "CodeGen.hpp"
+#include "CompilerInstance.hpp"
+#include "FunctionCache.hpp"
+
+using namespace Kyra;
+
+namespace {
+// Top-level functions that read and assign globals, call overloads, memoize and run parallel loops
+const char* const test_program = R"(val size: i32 = 4;
+var values: [i32; 4] = [1, 2, 3, 4];
+var total: i32 = 0;
+fun square(val n: i32): i32 { return n * n; }
+fun square(val n: i64): i64 { return n * n; }
+memo fun cube(val n: i32): i32 { return n * n * n; }
+fun add(val n: i32): i32 { total = total + n; return total; }
+fun sum(): i32 {
+	var result: i32 = 0;
+	for i in 0..size { result = result + square(values[i]); }
+	return result;
+}
+fun quad(val n: i32): i32 { return square(square(n)); }
+fun doubled(): i32 {
+	var copy: [i32; 4];
+	parallel for i in 0..size { copy[i] = square(values[i]) * 2; }
+	return copy[3];
+}
+print sum();
+print cube(5);
+print add(3);
+print quad(2);
+print doubled();
+print square(i64(3000000));
+)";
+const size_t function_count = 7;
+
+unsigned failures = 0;
+
+void check(bool condition, std::string_view description) {
+	if(condition)
+		return;
+	std::cerr << "FAILED: " << description << '\n';
+	++failures;
+}
+
+std::string replace(std::string source, std::string_view from, std::string_view to) {
+	const size_t position = source.find(from);
+	if(position == std::string::npos) {
+		check(false, "The test program contains the text to replace");
+		return source;
+	}
+	return source.replace(position, from.size(), to);
+}
+
+struct Result {
+	// Nothing if it did not compile
+	std::optional<std::string> module;
+	std::string diagnostics;
+};
+
+Result generate(CompilerInstance& instance, const std::filesystem::path& source_path, const std::string& source,
+	bool is_lazy, FunctionCache* function_cache) {
+	CodeGen::Options options;
+	options.lazy = is_lazy;
+	std::ostringstream diagnostics;
+	std::optional<llvm::orc::ThreadSafeModule> module =
+		instance.generate_module(source_path, source, options, diagnostics, function_cache);
+	if(!module.has_value())
+		return {{}, diagnostics.str()};
+	std::string printed_module;
+	llvm::raw_string_ostream output(printed_module);
+	module->withModuleDo([&](llvm::Module& llvm_module) { llvm_module.print(output, nullptr); });
+	return {std::move(output.str()), diagnostics.str()};
+}
+
+// Every compilation that reuses functions has to give the same IR and diagnostics as a fresh one
+class Session {
+public:
+	Session(const std::filesystem::path& source_path, bool is_lazy) : m_source_path(source_path), m_is_lazy(is_lazy) {}
+
+	// Returns how many functions were reused
+	size_t compile(const std::string& source, std::string_view description) {
+		const Result result = generate(m_instance, m_source_path, source, m_is_lazy, &m_function_cache);
+		CompilerInstance fresh_instance(m_instance.get_builtin_scope());
+		const Result fresh_result = generate(fresh_instance, m_source_path, source, m_is_lazy, nullptr);
+		check(result.module == fresh_result.module, std::string(description) + ": the IR matches a fresh compilation");
+		check(result.diagnostics == fresh_result.diagnostics,
+			std::string(description) + ": the diagnostics match a fresh compilation");
+		return m_function_cache.get_reused_summaries().size();
+	}
+
+private:
+	const std::filesystem::path m_source_path;
+	const bool m_is_lazy;
+	CompilerInstance m_instance;
+	FunctionCache m_function_cache;
+};
+
+void test_reuse(const std::filesystem::path& source_path, bool is_lazy) {
+	const std::string source = test_program;
+	Session session(source_path, is_lazy);
+	check(session.compile(source, "First compilation") == 0, "Nothing is reused by the first compilation");
+	check(session.compile(source, "Unchanged program") == function_count,
+		"All functions of an unchanged program are reused");
+
+	const std::string edited_sum = replace(source, "result + square", "result + 2 * square");
+	check(session.compile(edited_sum, "Edited function") == function_count - 1,
+		"Only the edited function is checked again");
+	check(session.compile(edited_sum, "Edited function again") == function_count,
+		"The entry of the edited function replaces the old one");
+
+	// Everything that calls square has to see the new overload
+	const std::string overload = "fun square(val a: i32, val b: i32): i32 { return a * b; }\n";
+	const std::string overloaded =
+		replace(replace(edited_sum, "memo fun cube", overload + "memo fun cube"), "print cube(5);",
+			"print cube(5);\nprint square(2, 3);");
+	const size_t overloaded_count = function_count + 1;
+	check(session.compile(overloaded, "New overload") == overloaded_count - 4,
+		"Adding an overload checks the functions that call it again");
+
+	// Callers keep their code, but not the attributes that depend on what square does
+	const std::string printing = replace(overloaded, "{ return n * n; }", "{ print n; return n * n; }");
+	check(session.compile(printing, "Changed effects") == overloaded_count - 1,
+		"Changing the body of a callee does not check its callers again");
+
+	// The race is only found through the summary of doubled, but the error has to point at the call all the same
+	session.compile(replace(printing, "{ print n;", "{ total = total + 1; print n;"), "Race with a reused function");
+	check(session.compile(printing, "Fixed race") == overloaded_count,
+		"A compilation that failed leaves the entries alone");
+
+	check(session.compile(replace(printing, "val size: i32 = 4", "val size: i32 = 3"), "Changed constant") == 0,
+		"Code that folded a constant whose value changed is not reused");
+	check(session.compile(replace(printing, "val size: i32 = 4", "var size: i32 = 4"), "Changed mutability") ==
+			overloaded_count - 2,
+		"Making a constant mutable checks its users again");
+}
+}
+
+// Tests for the function cache (see ModuleCache). Exits with 1 if any check fails.
+int main() {
+	const std::filesystem::path source_path = std::filesystem::temp_directory_path() / "kyra-function-cache-test.ky";
+	test_reuse(source_path, false);
+	test_reuse(source_path, true);
+	if(failures != 0) {
+		std::cerr << failures << " checks failed\n";
+		return 1;
+	}
+	std::cout << "All checks passed\n";
+	return 0;
+}
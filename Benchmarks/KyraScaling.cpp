@@ -0,0 +1,200 @@
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "AST.hpp"
+#include "Aliases.hpp"
+#include "CompilerInstance.hpp"
+#include "Error.hpp"
+#include "ProgramGenerator.hpp"
+#include "TAST.hpp"
+#include "Token.hpp"
+
+using namespace Kyra;
+
+namespace {
+const std::filesystem::path input_path = "generated.ky";
+
+enum Phase { Lexing, Parsing, TypeChecking, CodeGeneration, PhaseCount };
+const char* const phase_names[PhaseCount] = {"Lexer", "Parser", "TypeChecker", "CodeGen"};
+
+struct Axis {
+	const char* name;
+	unsigned ProgramGenerator::Options::*parameter;
+	// The size of the first step, every further step doubles it
+	unsigned start;
+};
+
+const Axis axes[] = {
+	{"nesting", &ProgramGenerator::Options::block_depth, 32},
+	{"overloads", &ProgramGenerator::Options::overloads, 16},
+	{"statements", &ProgramGenerator::Options::statements, 32},
+	{"identifiers", &ProgramGenerator::Options::globals, 512},
+};
+
+struct Arguments {
+	std::optional<std::string> axis;
+	unsigned steps{5};
+	unsigned repetitions{5};
+	// A linear phase stays clearly below this even with the fixed costs of a small program, a quadratic one does not
+	double default_bound{1.25};
+	// Keyed by "<axis>/<phase>"
+	std::map<std::string, double> bounds;
+};
+
+struct Measurement {
+	unsigned size{0};
+	unsigned tokens{0};
+	double seconds[PhaseCount];
+};
+
+template <typename T>
+T expect_result(CompilerInstance& instance, ErrorOr<T>&& error_or_result) {
+	if(error_or_result.is_error()) {
+		std::cerr << "The generated program is invalid: ";
+		instance.print_error(error_or_result.get_exception(), std::cerr);
+		std::exit(1);
+	}
+	return std::move(error_or_result).get_result();
+}
+
+template <typename Callback>
+auto time(double& fastest_seconds, const Callback& callback) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	auto result = callback();
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+	fastest_seconds = std::min(fastest_seconds, duration.count());
+	return result;
+}
+
+// The fastest of all repetitions is the one that was disturbed the least
+Measurement measure(unsigned size, const std::string& source, unsigned repetitions) {
+	Measurement measurement;
+	measurement.size = size;
+	std::fill(std::begin(measurement.seconds), std::end(measurement.seconds), std::numeric_limits<double>::max());
+	for(unsigned repetition = 0; repetition < repetitions; ++repetition) {
+		// A fresh instance for every repetition, so no state accumulates between them
+		CompilerInstance instance;
+		const std::vector<Token> tokens = time(measurement.seconds[Lexing],
+			[&]() { return expect_result(instance, instance.get_lexer().scan_input(source, input_path)); });
+		std::vector<RefPtr<Untyped::Statement>> statements = time(measurement.seconds[Parsing],
+			[&]() { return expect_result(instance, instance.get_parser().parse_tokens(tokens)); });
+		const std::vector<RefPtr<Typed::Statement>> typed_statements =
+			time(measurement.seconds[TypeChecking], [&]() {
+				return expect_result(instance, instance.get_type_checker().check_statements(std::move(statements)));
+			});
+		time(measurement.seconds[CodeGeneration], [&]() {
+			instance.get_code_gen().gen_code(typed_statements, input_path, {});
+			instance.get_code_gen().print_module(llvm::nulls());
+			return 0;
+		});
+		measurement.tokens = tokens.size();
+	}
+	return measurement;
+}
+
+// The slope of the least squares line through (log size, log time), so time ~ size^exponent. The generator adds the
+// same number of tokens for every unit of an axis, so this is also how the time grows with the program.
+double fit_exponent(const std::vector<Measurement>& measurements, Phase phase) {
+	double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+	for(const Measurement& measurement : measurements) {
+		const double x = std::log(measurement.size);
+		const double y = std::log(measurement.seconds[phase]);
+		sum_x += x;
+		sum_y += y;
+		sum_xx += x * x;
+		sum_xy += x * y;
+	}
+	const double n = measurements.size();
+	return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+std::optional<Arguments> parse_arguments(int argc, char** argv) {
+	Arguments arguments;
+	for(int i = 1; i < argc; ++i) {
+		const std::string_view argument(argv[i]);
+		const std::string value(argument.substr(argument.find('=') + 1));
+		if(argument.starts_with("--axis="))
+			arguments.axis = value;
+		else if(argument.starts_with("--steps="))
+			arguments.steps = std::stoul(value);
+		else if(argument.starts_with("--repetitions="))
+			arguments.repetitions = std::stoul(value);
+		else if(argument.starts_with("--max-exponent="))
+			arguments.default_bound = std::stod(value);
+		else if(argument.starts_with("--bound=") && value.find('=') != std::string::npos)
+			arguments.bounds[value.substr(0, value.find('='))] = std::stod(value.substr(value.find('=') + 1));
+		else {
+			std::cerr << "Unknown argument " << argument << '\n';
+			return {};
+		}
+	}
+	if(arguments.steps < 2)
+		return {};
+	return arguments;
+}
+}
+
+// Compiles generated programs at doubling sizes along every axis and fits how the time of every phase grows with the
+// size. Exits with 1 if a phase grows faster than its bound.
+int main(int argc, char** argv) {
+	const std::optional<Arguments> arguments = parse_arguments(argc, argv);
+	if(!arguments.has_value()) {
+		std::cerr << "Usage: kyra_scaling [--axis=<nesting|overloads|statements|identifiers>] [--steps=N (>= 2)] "
+					 "[--repetitions=N] [--max-exponent=X] [--bound=<axis>/<phase>=X]...\n";
+		return 1;
+	}
+
+	bool exceeded_bound = false;
+	char line[128];
+	for(const Axis& axis : axes) {
+		if(arguments->axis.has_value() && *arguments->axis != axis.name)
+			continue;
+
+		std::vector<Measurement> measurements;
+		std::cout << "Axis " << axis.name << '\n';
+		std::snprintf(line, sizeof(line), "%10s %10s %12s %12s %12s %12s\n", "size", "tokens", phase_names[0],
+			phase_names[1], phase_names[2], phase_names[3]);
+		std::cout << line;
+		for(unsigned step = 0; step < arguments->steps; ++step) {
+			ProgramGenerator::Options options;
+			options.functions = 8;
+			options.expression_depth = 2;
+			options.*axis.parameter = axis.start << step;
+			const Measurement& measurement = measurements.emplace_back(
+				measure(options.*axis.parameter, ProgramGenerator(options).generate(), arguments->repetitions));
+			std::snprintf(line, sizeof(line), "%10u %10u %10.3fms %10.3fms %10.3fms %10.3fms\n", measurement.size,
+				measurement.tokens, measurement.seconds[Lexing] * 1000,
+				measurement.seconds[Parsing] * 1000, measurement.seconds[TypeChecking] * 1000,
+				measurement.seconds[CodeGeneration] * 1000);
+			std::cout << line;
+		}
+
+		for(unsigned phase = 0; phase < PhaseCount; ++phase) {
+			const std::string key = std::string(axis.name) + '/' + phase_names[phase];
+			const double bound =
+				arguments->bounds.contains(key) ? arguments->bounds.at(key) : arguments->default_bound;
+			const double exponent = fit_exponent(measurements, static_cast<Phase>(phase));
+			const bool is_within_bound = exponent <= bound;
+			exceeded_bound |= !is_within_bound;
+			std::snprintf(line, sizeof(line), "  %-24s exponent %5.2f (bound %4.2f) %s\n", key.c_str(), exponent, bound,
+				is_within_bound ? "ok" : "EXCEEDED");
+			std::cout << line;
+		}
+		std::cout << '\n';
+	}
+	return exceeded_bound ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+#include "NodeCounter.hpp"
+
+namespace Kyra {
+using namespace Untyped;
+
+unsigned NodeCounter::count(const std::vector<RefPtr<Statement>>& statements) {
+	m_count = 0;
+	for(const RefPtr<Statement>& statement : statements)
+		dispatch(*statement);
+	return m_count;
+}
+
+void NodeCounter::visit(const ExpressionStatement& expresion_statement) {
+	++m_count;
+	dispatch(expresion_statement.get_expression());
+}
+
+void NodeCounter::visit(const Declaration& declaration) {
+	++m_count;
+	dispatch(declaration.get_type());
+	if(const Expression* initializer = declaration.get_initializer(); initializer != nullptr)
+		dispatch(*initializer);
+}
+
+void NodeCounter::visit(const Function& function) {
+	++m_count;
+	for(const Function::Parameter& parameter : function.get_parameters())
+		dispatch(*parameter.type);
+	dispatch(function.get_return_type());
+	dispatch(function.get_implementation());
+}
+
+void NodeCounter::visit(const ExternFunction&) { ++m_count; }
+
+void NodeCounter::visit(const Import&) { ++m_count; }
+
+void NodeCounter::visit(const Print& print_statement) {
+	++m_count;
+	dispatch(print_statement.get_expression());
+}
+
+void NodeCounter::visit(const Return& return_statement) {
+	++m_count;
+	dispatch(return_statement.get_expression());
+}
+
+void NodeCounter::visit(const Block& block) {
+	++m_count;
+	for(const RefPtr<Statement>& statement : block.get_body())
+		dispatch(*statement);
+}
+
+void NodeCounter::visit(const For& for_statement) {
+	++m_count;
+	dispatch(for_statement.get_begin());
+	dispatch(for_statement.get_end());
+	dispatch(for_statement.get_body());
+}
+
+void NodeCounter::visit(const IntLiteral&) { ++m_count; }
+
+void NodeCounter::visit(const ArrayLiteral& array_literal) {
+	++m_count;
+	for(const RefPtr<Expression>& element : array_literal.get_elements())
+		dispatch(*element);
+}
+
+void NodeCounter::visit(const Assignment& assignment) {
+	++m_count;
+	dispatch(assignment.get_rhs());
+}
+
+void NodeCounter::visit(const IndexAssignment& index_assignment) {
+	++m_count;
+	dispatch(index_assignment.get_lhs());
+	dispatch(index_assignment.get_rhs());
+}
+
+void NodeCounter::visit(const BinaryExpression& binary_expression) {
+	++m_count;
+	dispatch(binary_expression.get_lhs());
+	dispatch(binary_expression.get_rhs());
+}
+
+void NodeCounter::visit(const TypeIndicator&) { ++m_count; }
+
+void NodeCounter::visit(const Call& call) {
+	++m_count;
+	for(const Call::Argument& argument : call.get_arguments())
+		dispatch(*argument.value);
+}
+
+void NodeCounter::visit(const Index& index) {
+	++m_count;
+	dispatch(index.get_array());
+	dispatch(index.get_index());
+}
+
+void NodeCounter::visit(const Group& group) {
+	++m_count;
+	dispatch(group.get_content());
+}
+
+void NodeCounter::visit(const VarQuery&) { ++m_count; }
+}
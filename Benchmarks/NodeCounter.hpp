@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "AST.hpp"
+#include "Aliases.hpp"
+
+namespace Kyra {
+
+// Counts the nodes of an untyped AST, which is the unit the throughput of the later phases is measured in
+class NodeCounter : public Untyped::ASTVisitor<NodeCounter> {
+public:
+	unsigned count(const std::vector<RefPtr<Untyped::Statement>>& statements);
+
+	void visit(const Untyped::ExpressionStatement& expresion_statement);
+	void visit(const Untyped::Declaration& declaration);
+	void visit(const Untyped::Function& function);
+	void visit(const Untyped::ExternFunction& extern_function);
+	void visit(const Untyped::Import& import);
+	void visit(const Untyped::Print& print_statement);
+	void visit(const Untyped::Return& return_statement);
+	void visit(const Untyped::Block& block);
+	void visit(const Untyped::For& for_statement);
+	void visit(const Untyped::IntLiteral& literal);
+	void visit(const Untyped::ArrayLiteral& array_literal);
+
+	void visit(const Untyped::Assignment& assignment);
+	void visit(const Untyped::IndexAssignment& index_assignment);
+	void visit(const Untyped::BinaryExpression& binary_expression);
+	void visit(const Untyped::TypeIndicator& type);
+	void visit(const Untyped::Call& call);
+	void visit(const Untyped::Index& index);
+	void visit(const Untyped::Group& group);
+	void visit(const Untyped::VarQuery& var_query);
+
+private:
+	unsigned m_count{0};
+};
+}
@@ -0,0 +1,15 @@
+# Compiles a program whose only failing bounds check is in a call with an unused result with opt -O2, and checks that
+# the executable still fails. The call may only be removed if the analysis wrongly considers the function pure.
+# Expects KYRA, OPT, LLC, CC, PROGRAM and DIRECTORY to be defined.
+get_filename_component(name ${PROGRAM} NAME_WE)
+set(output_base ${DIRECTORY}/${name})
+file(MAKE_DIRECTORY ${DIRECTORY})
+execute_process(COMMAND ${KYRA} ${PROGRAM} OUTPUT_FILE ${output_base}.ll COMMAND_ERROR_IS_FATAL ANY)
+execute_process(COMMAND ${OPT} -O2 -S ${output_base}.ll -o ${output_base}.opt.ll COMMAND_ERROR_IS_FATAL ANY)
+execute_process(COMMAND ${LLC} -relocation-model=pic -filetype=obj ${output_base}.opt.ll -o ${output_base}.o
+	COMMAND_ERROR_IS_FATAL ANY)
+execute_process(COMMAND ${CC} ${output_base}.o -o ${output_base} COMMAND_ERROR_IS_FATAL ANY)
+execute_process(COMMAND ${output_base} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+if (NOT result EQUAL 1 OR NOT error MATCHES "out of bounds")
+	message(FATAL_ERROR "${name} exited with ${result} and printed '${output}' instead of failing the bounds check")
+endif ()
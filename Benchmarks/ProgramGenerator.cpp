@@ -0,0 +1,80 @@
+#include "ProgramGenerator.hpp"
+
+namespace Kyra {
+
+ProgramGenerator::ProgramGenerator(const Options& options) : m_options(options) {}
+
+std::string ProgramGenerator::generate() const {
+	std::string program;
+	for(unsigned global = 0; global < m_options.globals; ++global)
+		program += "var g" + std::to_string(global) + ": i32 = " + std::to_string(global) + ";\n";
+	// The arguments the overloads are called with
+	for(unsigned overload = 2; overload <= m_options.overloads; ++overload)
+		program += "var o" + std::to_string(overload) + ": [i32; " + std::to_string(overload) + "];\n";
+	for(unsigned function = 0; function < m_options.functions; ++function) {
+		for(unsigned overload = 1; overload <= m_options.overloads; ++overload)
+			generate_function(program, function, overload);
+	}
+	for(unsigned function = 0; function < m_options.functions; ++function) {
+		for(unsigned overload = 1; overload <= m_options.overloads; ++overload) {
+			program += "print ";
+			generate_call(program, function, overload);
+			program += ";\n";
+		}
+	}
+	return program;
+}
+
+void ProgramGenerator::generate_function(std::string& program, unsigned function, unsigned overload) const {
+	program += "fun f" + std::to_string(function) + "(var p0: i32";
+	// Every overload has the same number of tokens, so the program only grows linearly with the overloads
+	if(overload > 1)
+		program += ", var o: [i32; " + std::to_string(overload) + ']';
+	program += "): i32 {\n";
+	for(unsigned statement = 0; statement < m_options.statements; ++statement)
+		program += "\tvar s" + std::to_string(statement) + ": i32 = p0 + " + std::to_string(statement) + ";\n";
+	generate_blocks(program);
+	program += "\treturn ";
+	generate_expression(program, function, m_options.expression_depth);
+	program += ";\n}\n";
+}
+
+void ProgramGenerator::generate_blocks(std::string& program) const {
+	if(m_options.block_depth == 0)
+		return;
+	program += '\t';
+	// Looking up the parameter has to walk through all the scopes of the enclosing blocks
+	for(unsigned depth = 0; depth < m_options.block_depth; ++depth)
+		program += "{ var b: i32 = p0; ";
+	for(unsigned depth = 0; depth < m_options.block_depth; ++depth)
+		program += "} ";
+	program += '\n';
+}
+
+void ProgramGenerator::generate_expression(std::string& program, unsigned function, unsigned depth) const {
+	if(depth == 0) {
+		// Calling the previous function builds up a call graph that is as deep as there are functions
+		if(function > 0)
+			program += "f" + std::to_string(function - 1) + "(p0)";
+		else
+			program += "p0";
+		return;
+	}
+	static const char* const operators[] = {" + ", " * ", " - "};
+	program += '(';
+	if(depth % 2 == 0)
+		program += "p0";
+	else
+		program += std::to_string(depth);
+	program += operators[depth % 3];
+	generate_expression(program, function, depth - 1);
+	program += ')';
+}
+
+void ProgramGenerator::generate_call(std::string& program, unsigned function, unsigned overload) const {
+	program += "f" + std::to_string(function) + "(1";
+	if(overload > 1)
+		program += ", o" + std::to_string(overload);
+	program += ')';
+}
+}
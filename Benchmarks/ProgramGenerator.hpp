@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+namespace Kyra {
+
+// Generates valid Kyra programs whose size can be scaled along independent axes
+class ProgramGenerator {
+public:
+	struct Options {
+		// Distinct function names, every function calls the previous one
+		unsigned functions{16};
+		// Overloads per function name, which differ in the length of an array parameter
+		unsigned overloads{1};
+		// Nesting depth of the expression every function returns
+		unsigned expression_depth{4};
+		// Nesting depth of the blocks inside every function, each of them reads a parameter
+		unsigned block_depth{0};
+		// Local declarations at the beginning of every function
+		unsigned statements{0};
+		// Top-level declarations in front of the functions
+		unsigned globals{0};
+	};
+
+	explicit ProgramGenerator(const Options& options);
+
+	std::string generate() const;
+
+private:
+	Options m_options;
+
+	void generate_function(std::string& program, unsigned function, unsigned overload) const;
+	void generate_blocks(std::string& program) const;
+	void generate_expression(std::string& program, unsigned function, unsigned depth) const;
+	void generate_call(std::string& program, unsigned function, unsigned overload) const;
+};
+}
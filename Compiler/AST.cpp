@@ -5,26 +5,27 @@
 namespace Kyra {
 namespace Untyped {
 
-ASTNode::ASTNode(const SourceRange& source_range) : m_source_range(source_range){};
+ASTNode::ASTNode(const SourceRange& source_range, NodeKind node_kind) :
+	m_source_range(source_range), m_node_kind(node_kind) {}
 
 const SourceRange& ASTNode::get_source_range() const { return m_source_range; }
 
-Statement::Statement(const SourceRange& source_range) : ASTNode(source_range) {}
+ASTNode::NodeKind ASTNode::get_node_kind() const { return m_node_kind; }
 
-Expression::Expression(const SourceRange& source_range) : ASTNode(source_range) {}
+Statement::Statement(const SourceRange& source_range, NodeKind node_kind) : ASTNode(source_range, node_kind) {}
+
+Expression::Expression(const SourceRange& source_range, NodeKind node_kind) : ASTNode(source_range, node_kind) {}
 
 ExpressionStatement::ExpressionStatement(const SourceRange& source_range, RefPtr<Expression> expression) :
-	Statement(source_range), m_expression(std::move(expression)) {}
+	Statement(source_range, NodeKind::ExpressionStatement), m_expression(std::move(expression)) {}
 
 const Expression& ExpressionStatement::get_expression() const { return *m_expression; }
 
 RefPtr<Expression> ExpressionStatement::get_expression_shared() const { return m_expression; }
 
-void ExpressionStatement::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
-
 Declaration::Declaration(const SourceRange& source_range, Kind declaration_kind, const Token& identifier,
 	RefPtr<TypeIndicator> type, RefPtr<Expression> initializer) :
-	Statement(source_range),
+	Statement(source_range, NodeKind::Declaration),
 	m_declaration_kind(declaration_kind), m_identifier(identifier), m_type(std::move(type)),
 	m_initializer(std::move(initializer)) {}
 
@@ -40,14 +41,26 @@ const Expression* Declaration::get_initializer() const { return m_initializer.ge
 
 RefPtr<Expression> Declaration::get_initializer_shared() const { return m_initializer; }
 
-void Declaration::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
-
 Block::Block(const SourceRange& source_range, const std::vector<RefPtr<Statement>>& body) :
-	Statement(source_range), m_body(body) {}
+	Statement(source_range, NodeKind::Block), m_body(body) {}
 
 const std::vector<RefPtr<Statement>>& Block::get_body() const { return m_body; }
 
-void Block::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+For::For(const SourceRange& source_range, const Token& variable, RefPtr<Expression> begin, RefPtr<Expression> end,
+	RefPtr<Block> body, bool is_parallel) :
+	Statement(source_range, NodeKind::For),
+	m_variable(variable), m_begin(std::move(begin)), m_end(std::move(end)), m_body(std::move(body)),
+	m_is_parallel(is_parallel) {}
+
+const Token& For::get_variable() const { return m_variable; }
+
+const Expression& For::get_begin() const { return *m_begin; }
+
+const Expression& For::get_end() const { return *m_end; }
+
+const Block& For::get_body() const { return *m_body; }
+
+bool For::is_parallel() const { return m_is_parallel; }
 
 Function::Parameter::Parameter(
 	const Token& identifier, RefPtr<TypeIndicator> type, Declaration::Kind declaration_kind) :
@@ -55,10 +68,10 @@ Function::Parameter::Parameter(
 	type(std::move(type)), kind(declaration_kind) {}
 
 Function::Function(const SourceRange& source_range, const Token& identifier, RefPtr<Block> body,
-	RefPtr<TypeIndicator> return_type, const std::vector<Parameter>& parameters) :
-	Statement(source_range),
+	RefPtr<TypeIndicator> return_type, const std::vector<Parameter>& parameters, bool is_memoized) :
+	Statement(source_range, NodeKind::Function),
 	m_identifier(identifier), m_implementation(std::move(body)), m_return_type(std::move(return_type)),
-	m_parameters(parameters) {}
+	m_parameters(parameters), m_is_memoized(is_memoized) {}
 
 const Token& Function::get_identifier() const { return m_identifier; }
 
@@ -72,35 +85,50 @@ RefPtr<TypeIndicator> Function::get_return_type_shared() const { return m_return
 
 const std::vector<Function::Parameter>& Function::get_parameters() const { return m_parameters; }
 
-void Function::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+bool Function::is_memoized() const { return m_is_memoized; }
+
+ExternFunction::ExternFunction(const SourceRange& source_range, const Token& identifier,
+	RefPtr<TypeIndicator> return_type, const std::vector<Function::Parameter>& parameters) :
+	Statement(source_range, NodeKind::ExternFunction),
+	m_identifier(identifier), m_return_type(std::move(return_type)), m_parameters(parameters) {}
+
+const Token& ExternFunction::get_identifier() const { return m_identifier; }
+
+const TypeIndicator& ExternFunction::get_return_type() const { return *m_return_type; }
+
+const std::vector<Function::Parameter>& ExternFunction::get_parameters() const { return m_parameters; }
+
+Import::Import(const SourceRange& source_range, const Token& module_name) :
+	Statement(source_range, NodeKind::Import), m_module_name(module_name) {}
+
+const Token& Import::get_module_name() const { return m_module_name; }
 
 Print::Print(const SourceRange& source_range, RefPtr<Expression> expression) :
-	Statement(source_range), m_expression(std::move(expression)) {}
+	Statement(source_range, NodeKind::Print), m_expression(std::move(expression)) {}
 
 const Expression& Print::get_expression() const { return *m_expression; }
 
 RefPtr<Expression> Print::get_expression_shared() const { return m_expression; }
 
-void Print::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
-
 Return::Return(const SourceRange& source_range, RefPtr<Expression> expression) :
-	Statement(source_range), m_expression(std::move(expression)) {}
+	Statement(source_range, NodeKind::Return), m_expression(std::move(expression)) {}
 
 const Expression& Return::get_expression() const { return *m_expression; }
 
 RefPtr<Expression> Return::get_expression_shared() const { return m_expression; }
 
-void Return::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+IntLiteral::IntLiteral(const SourceRange& source_range, uint64_t literal_value) :
+	Expression(source_range, NodeKind::IntLiteral), m_value(literal_value) {}
 
-IntLiteral::IntLiteral(const SourceRange& source_range, int literal_value) :
-	Expression(source_range), m_value(literal_value) {}
+uint64_t IntLiteral::get_literal_value() const { return m_value; }
 
-int IntLiteral::get_literal_value() const { return m_value; }
+ArrayLiteral::ArrayLiteral(const SourceRange& source_range, const std::vector<RefPtr<Expression>>& elements) :
+	Expression(source_range, NodeKind::ArrayLiteral), m_elements(elements) {}
 
-void IntLiteral::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+const std::vector<RefPtr<Expression>>& ArrayLiteral::get_elements() const { return m_elements; }
 
 Assignment::Assignment(const SourceRange& source_range, const Token& lhs, RefPtr<Expression> rhs) :
-	Expression(source_range), m_lhs(lhs), m_rhs(std::move(rhs)) {}
+	Expression(source_range, NodeKind::Assignment), m_lhs(lhs), m_rhs(std::move(rhs)) {}
 
 const Token& Assignment::get_lhs() const { return m_lhs; }
 
@@ -108,11 +136,16 @@ const Expression& Assignment::get_rhs() const { return *m_rhs; }
 
 RefPtr<Expression> Assignment::get_rhs_shared() const { return m_rhs; }
 
-void Assignment::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+IndexAssignment::IndexAssignment(const SourceRange& source_range, RefPtr<Index> lhs, RefPtr<Expression> rhs) :
+	Expression(source_range, NodeKind::IndexAssignment), m_lhs(std::move(lhs)), m_rhs(std::move(rhs)) {}
+
+const Index& IndexAssignment::get_lhs() const { return *m_lhs; }
+
+const Expression& IndexAssignment::get_rhs() const { return *m_rhs; }
 
 BinaryExpression::BinaryExpression(
 	const SourceRange& source_range, RefPtr<Expression> lhs, RefPtr<Expression> rhs, Token oper) :
-	Expression(source_range),
+	Expression(source_range, NodeKind::BinaryExpression),
 	m_lhs(std::move(lhs)), m_rhs(std::move(rhs)), m_operator(oper) {}
 
 const Expression& BinaryExpression::get_lhs() const { return *m_lhs; }
@@ -125,40 +158,46 @@ RefPtr<Expression> BinaryExpression::get_rhs_shared() const { return m_rhs; }
 
 const Token& BinaryExpression::get_operator() const { return m_operator; }
 
-void BinaryExpression::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
-
 TypeIndicator::TypeIndicator(const SourceRange& source_range, const Token& type) :
-	Expression(source_range), m_type(type) {}
+	Expression(source_range, NodeKind::TypeIndicator), m_type(type) {}
+
+TypeIndicator::TypeIndicator(const SourceRange& source_range, const Token& left_bracket,
+	RefPtr<TypeIndicator> element_type, uint64_t length) :
+	Expression(source_range, NodeKind::TypeIndicator),
+	m_type(left_bracket), m_element_type(std::move(element_type)), m_length(length) {}
 
 const Token& TypeIndicator::get_type() const { return m_type; }
 
-void TypeIndicator::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+const TypeIndicator* TypeIndicator::get_element_type() const { return m_element_type.get(); }
+
+uint64_t TypeIndicator::get_length() const { return m_length; }
 
 Call::Argument::Argument(RefPtr<Expression> value) : value(std::move(value)) {}
 
 Call::Call(const SourceRange& source_range, const Token& function_name, const std::vector<Argument>& arguments) :
-	Expression(source_range), m_function_name(function_name), m_arguments(arguments) {}
+	Expression(source_range, NodeKind::Call), m_function_name(function_name), m_arguments(arguments) {}
 
 const Token& Call::get_function_name() const { return m_function_name; }
 
 const std::vector<Call::Argument>& Call::get_arguments() const { return m_arguments; }
 
-void Call::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
-
 Group::Group(const SourceRange& source_range, RefPtr<Expression> content) :
-	Expression(source_range), m_content(std::move(content)) {}
+	Expression(source_range, NodeKind::Group), m_content(std::move(content)) {}
 
 const Expression& Group::get_content() const { return *m_content; }
 
 RefPtr<Expression> Group::get_content_shared() const { return m_content; }
 
-void Group::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
+Index::Index(const SourceRange& source_range, RefPtr<Expression> array, RefPtr<Expression> index) :
+	Expression(source_range, NodeKind::Index), m_array(std::move(array)), m_index(std::move(index)) {}
+
+const Expression& Index::get_array() const { return *m_array; }
+
+const Expression& Index::get_index() const { return *m_index; }
 
 VarQuery::VarQuery(const SourceRange& source_range, const Token& identifier) :
-	Expression(source_range), m_identifier(identifier) {}
+	Expression(source_range, NodeKind::VarQuery), m_identifier(identifier) {}
 
 const Token& VarQuery::get_identifier() const { return m_identifier; }
-
-void VarQuery::accept(ASTVisitor& visitor) const { visitor.visit(*this); }
 }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <type_traits>
 #include <vector>
 
@@ -11,31 +12,52 @@ namespace Kyra {
 namespace Untyped {
 
 class TypeIndicator;
-class ASTVisitor;
-
 class ASTNode {
 public:
+	// Identifies the concrete node, so visitors can dispatch without virtual calls
+	enum class NodeKind {
+		ExpressionStatement,
+		Declaration,
+		Function,
+		ExternFunction,
+		Import,
+		Print,
+		Return,
+		Block,
+		For,
+		IntLiteral,
+		ArrayLiteral,
+		Assignment,
+		IndexAssignment,
+		BinaryExpression,
+		TypeIndicator,
+		Call,
+		Index,
+		Group,
+		VarQuery
+	};
+
 	virtual ~ASTNode() = default;
 
 	const SourceRange& get_source_range() const;
-
-	virtual void accept(ASTVisitor& visitor) const = 0;
+	NodeKind get_node_kind() const;
 
 protected:
-	ASTNode(const SourceRange& source_range);
+	ASTNode(const SourceRange& source_range, NodeKind node_kind);
 
 private:
 	const SourceRange m_source_range;
+	const NodeKind m_node_kind;
 };
 
 class Statement : public ASTNode {
 protected:
-	explicit Statement(const SourceRange& source_range);
+	Statement(const SourceRange& source_range, NodeKind node_kind);
 };
 
 class Expression : public ASTNode {
 protected:
-	explicit Expression(const SourceRange& source_range);
+	Expression(const SourceRange& source_range, NodeKind node_kind);
 };
 
 class ExpressionStatement : public Statement {
@@ -45,8 +67,6 @@ public:
 	const Expression& get_expression() const;
 	RefPtr<Expression> get_expression_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
@@ -65,8 +85,6 @@ public:
 	const Expression* get_initializer() const;
 	RefPtr<Expression> get_initializer_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	const Kind m_declaration_kind;
 	const Token m_identifier;
@@ -80,12 +98,12 @@ public:
 
 	const std::vector<RefPtr<Statement>>& get_body() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	const std::vector<RefPtr<Statement>> m_body;
 };
 
+// A memoized function remembers the results of previous calls and returns them again for the same arguments. It has to
+// be pure and can only take integers.
 class Function : public Statement {
 public:
 	struct Parameter {
@@ -96,7 +114,7 @@ public:
 	};
 
 	Function(const SourceRange& source_range, const Token& identifier, RefPtr<Block> body,
-		RefPtr<TypeIndicator> return_type, const std::vector<Parameter>& parameters);
+		RefPtr<TypeIndicator> return_type, const std::vector<Parameter>& parameters, bool is_memoized);
 
 	const Token& get_identifier() const;
 	const Block& get_implementation() const;
@@ -104,14 +122,41 @@ public:
 	const TypeIndicator& get_return_type() const;
 	RefPtr<TypeIndicator> get_return_type_shared() const;
 	const std::vector<Parameter>& get_parameters() const;
-
-	void accept(ASTVisitor& visitor) const override;
+	bool is_memoized() const;
 
 private:
 	const Token m_identifier;
 	RefPtr<Block> m_implementation;
 	RefPtr<TypeIndicator> m_return_type;
 	const std::vector<Parameter> m_parameters;
+	const bool m_is_memoized;
+};
+
+// Declares a function that follows the C calling convention and is defined outside of Kyra, e.g. in the C library
+class ExternFunction : public Statement {
+public:
+	ExternFunction(const SourceRange& source_range, const Token& identifier, RefPtr<TypeIndicator> return_type,
+		const std::vector<Function::Parameter>& parameters);
+
+	const Token& get_identifier() const;
+	const TypeIndicator& get_return_type() const;
+	const std::vector<Function::Parameter>& get_parameters() const;
+
+private:
+	const Token m_identifier;
+	RefPtr<TypeIndicator> m_return_type;
+	const std::vector<Function::Parameter> m_parameters;
+};
+
+// Makes the functions of another module visible, which is looked up next to the importing file
+class Import : public Statement {
+public:
+	Import(const SourceRange& source_range, const Token& module_name);
+
+	const Token& get_module_name() const;
+
+private:
+	const Token m_module_name;
 };
 
 class Print : public Statement {
@@ -121,8 +166,6 @@ public:
 	const Expression& get_expression() const;
 	RefPtr<Expression> get_expression_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
@@ -134,24 +177,53 @@ public:
 	const Expression& get_expression() const;
 	RefPtr<Expression> get_expression_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
 
+// Iterates over the half-open range [begin, end). The variable is a value that is only visible inside the body. A
+// parallel loop runs its iterations on several threads in no particular order, so its body must not assign variables
+// that are declared outside of it.
+class For : public Statement {
+public:
+	For(const SourceRange& source_range, const Token& variable, RefPtr<Expression> begin, RefPtr<Expression> end,
+		RefPtr<Block> body, bool is_parallel);
+
+	const Token& get_variable() const;
+	const Expression& get_begin() const;
+	const Expression& get_end() const;
+	const Block& get_body() const;
+	bool is_parallel() const;
+
+private:
+	const Token m_variable;
+	RefPtr<Expression> m_begin;
+	RefPtr<Expression> m_end;
+	RefPtr<Block> m_body;
+	const bool m_is_parallel;
+};
+
 class IntLiteral : public Expression {
 public:
-	IntLiteral(const SourceRange& source_range, int literal_value);
+	IntLiteral(const SourceRange& source_range, uint64_t literal_value);
+
+	uint64_t get_literal_value() const;
+
+private:
+	const uint64_t m_value;
+};
 
-	int get_literal_value() const;
+class ArrayLiteral : public Expression {
+public:
+	ArrayLiteral(const SourceRange& source_range, const std::vector<RefPtr<Expression>>& elements);
 
-	void accept(ASTVisitor& visitor) const override;
+	const std::vector<RefPtr<Expression>>& get_elements() const;
 
 private:
-	const int m_value;
+	const std::vector<RefPtr<Expression>> m_elements;
 };
 
+class Index;
 class Assignment : public Expression {
 public:
 	Assignment(const SourceRange& source_range, const Token& lhs, RefPtr<Expression> rhs);
@@ -160,13 +232,24 @@ public:
 	const Expression& get_rhs() const;
 	RefPtr<Expression> get_rhs_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	const Token m_lhs;
 	RefPtr<Expression> m_rhs;
 };
 
+// Assigns to a single element of an array, e.g. a[i] = x
+class IndexAssignment : public Expression {
+public:
+	IndexAssignment(const SourceRange& source_range, RefPtr<Index> lhs, RefPtr<Expression> rhs);
+
+	const Index& get_lhs() const;
+	const Expression& get_rhs() const;
+
+private:
+	RefPtr<Index> m_lhs;
+	RefPtr<Expression> m_rhs;
+};
+
 class BinaryExpression : public Expression {
 public:
 	BinaryExpression(const SourceRange& source_range, RefPtr<Expression> lhs, RefPtr<Expression> rhs, Token oper);
@@ -177,8 +260,6 @@ public:
 	RefPtr<Expression> get_rhs_shared() const;
 	const Token& get_operator() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_lhs;
 	RefPtr<Expression> m_rhs;
@@ -188,13 +269,19 @@ private:
 class TypeIndicator : public Expression {
 public:
 	TypeIndicator(const SourceRange& source_range, const Token& type);
+	// An array type, e.g. [i32; 4]. The token is the opening bracket.
+	TypeIndicator(const SourceRange& source_range, const Token& left_bracket, RefPtr<TypeIndicator> element_type,
+		uint64_t length);
 
 	const Token& get_type() const;
-
-	void accept(ASTVisitor& visitor) const override;
+	// nullptr if this is not an array type
+	const TypeIndicator* get_element_type() const;
+	uint64_t get_length() const;
 
 private:
 	const Token m_type;
+	RefPtr<TypeIndicator> m_element_type;
+	const uint64_t m_length{0};
 };
 
 class Call : public Expression {
@@ -209,13 +296,23 @@ public:
 	const Token& get_function_name() const;
 	const std::vector<Argument>& get_arguments() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	const Token m_function_name;
 	const std::vector<Argument> m_arguments;
 };
 
+class Index : public Expression {
+public:
+	Index(const SourceRange& source_range, RefPtr<Expression> array, RefPtr<Expression> index);
+
+	const Expression& get_array() const;
+	const Expression& get_index() const;
+
+private:
+	RefPtr<Expression> m_array;
+	RefPtr<Expression> m_index;
+};
+
 class Group : public Expression {
 public:
 	Group(const SourceRange& source_range, RefPtr<Expression> content);
@@ -223,8 +320,6 @@ public:
 	const Expression& get_content() const;
 	RefPtr<Expression> get_content_shared() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_content;
 };
@@ -235,30 +330,51 @@ public:
 
 	const Token& get_identifier() const;
 
-	void accept(ASTVisitor& visitor) const override;
-
 private:
 	const Token m_identifier;
 };
 
+// Visitors derive from ASTVisitor<Derived, StatementResult, ExpressionResult> and implement visit for every node.
+// dispatch calls the matching visit of the derived class directly and returns its result.
+template <typename Derived, typename StatementResult = void, typename ExpressionResult = void>
 class ASTVisitor {
 public:
-	virtual ~ASTVisitor() = default;
-
-	virtual void visit(const ExpressionStatement& expresion_statement) = 0;
-	virtual void visit(const Declaration& declaration) = 0;
-	virtual void visit(const Function& function) = 0;
-	virtual void visit(const Print& print_statement) = 0;
-	virtual void visit(const Return& return_statement) = 0;
-	virtual void visit(const Block& block) = 0;
-	virtual void visit(const IntLiteral& literal) = 0;
-
-	virtual void visit(const Assignment& assignment) = 0;
-	virtual void visit(const BinaryExpression& binary_expression) = 0;
-	virtual void visit(const TypeIndicator& type) = 0;
-	virtual void visit(const Call& call) = 0;
-	virtual void visit(const Group& group) = 0;
-	virtual void visit(const VarQuery& var_query) = 0;
+	StatementResult dispatch(const Statement& statement) {
+		Derived& derived = static_cast<Derived&>(*this);
+		switch(statement.get_node_kind()) {
+			case ASTNode::NodeKind::ExpressionStatement:
+				return derived.visit(static_cast<const ExpressionStatement&>(statement));
+			case ASTNode::NodeKind::Declaration: return derived.visit(static_cast<const Declaration&>(statement));
+			case ASTNode::NodeKind::Function: return derived.visit(static_cast<const Function&>(statement));
+			case ASTNode::NodeKind::ExternFunction:
+				return derived.visit(static_cast<const ExternFunction&>(statement));
+			case ASTNode::NodeKind::Import: return derived.visit(static_cast<const Import&>(statement));
+			case ASTNode::NodeKind::Print: return derived.visit(static_cast<const Print&>(statement));
+			case ASTNode::NodeKind::Return: return derived.visit(static_cast<const Return&>(statement));
+			case ASTNode::NodeKind::Block: return derived.visit(static_cast<const Block&>(statement));
+			case ASTNode::NodeKind::For: return derived.visit(static_cast<const For&>(statement));
+			default: assert_not_reached();
+		}
+	}
+
+	ExpressionResult dispatch(const Expression& expression) {
+		Derived& derived = static_cast<Derived&>(*this);
+		switch(expression.get_node_kind()) {
+			case ASTNode::NodeKind::IntLiteral: return derived.visit(static_cast<const IntLiteral&>(expression));
+			case ASTNode::NodeKind::ArrayLiteral: return derived.visit(static_cast<const ArrayLiteral&>(expression));
+			case ASTNode::NodeKind::Assignment: return derived.visit(static_cast<const Assignment&>(expression));
+			case ASTNode::NodeKind::IndexAssignment:
+				return derived.visit(static_cast<const IndexAssignment&>(expression));
+			case ASTNode::NodeKind::BinaryExpression:
+				return derived.visit(static_cast<const BinaryExpression&>(expression));
+			case ASTNode::NodeKind::TypeIndicator: return derived.visit(static_cast<const TypeIndicator&>(expression));
+			case ASTNode::NodeKind::Call: return derived.visit(static_cast<const Call&>(expression));
+			case ASTNode::NodeKind::Index: return derived.visit(static_cast<const Index&>(expression));
+			case ASTNode::NodeKind::Group: return derived.visit(static_cast<const Group&>(expression));
+			case ASTNode::NodeKind::VarQuery: return derived.visit(static_cast<const VarQuery&>(expression));
+			default: assert_not_reached();
+		}
+	}
 };
 }
 }
@@ -5,14 +5,14 @@ using namespace Untyped;
 
 void ASTPrinter::print(const Statement& statement) {
 	m_indent = 0;
-	statement.accept(*this);
+	dispatch(statement);
 	std::cout.flush();
 }
 
 void ASTPrinter::visit(const ExpressionStatement& expresion_statement) {
 	print_with_indent("Expression Statement:");
 	++m_indent;
-	expresion_statement.get_expression().accept(*this);
+	dispatch(expresion_statement.get_expression());
 	--m_indent;
 }
 
@@ -20,29 +20,38 @@ void ASTPrinter::visit(const Declaration& declaration) {
 	print_with_indent("Declaration of ", declaration.get_identifier().get_lexeme(), ":");
 	if(const Expression* init = declaration.get_initializer(); init != nullptr) {
 		++m_indent;
-		init->accept(*this);
+		dispatch(*init);
 		--m_indent;
 	}
 }
 
 void ASTPrinter::visit(const Function& function) {
-	print_with_indent("Function ", function.get_identifier().get_lexeme(), ":");
+	print_with_indent(
+		function.is_memoized() ? "Memo Function " : "Function ", function.get_identifier().get_lexeme(), ":");
 	++m_indent;
-	function.get_implementation().accept(*this);
+	dispatch(function.get_implementation());
 	--m_indent;
 }
 
+void ASTPrinter::visit(const ExternFunction& extern_function) {
+	print_with_indent("Extern Function ", extern_function.get_identifier().get_lexeme());
+}
+
+void ASTPrinter::visit(const Import& import) {
+	print_with_indent("Import of ", import.get_module_name().get_lexeme());
+}
+
 void ASTPrinter::visit(const Print& print_statement) {
 	print_with_indent("Print");
 	++m_indent;
-	print_statement.get_expression().accept(*this);
+	dispatch(print_statement.get_expression());
 	--m_indent;
 }
 
 void ASTPrinter::visit(const Return& return_statement) {
 	print_with_indent("Return");
 	++m_indent;
-	return_statement.get_expression().accept(*this);
+	dispatch(return_statement.get_expression());
 	--m_indent;
 }
 
@@ -50,36 +59,80 @@ void ASTPrinter::visit(const Block& block) {
 	print_with_indent("Block");
 	++m_indent;
 	for(const RefPtr<Statement>& statement : block.get_body())
-		statement->accept(*this);
+		dispatch(*statement);
+	--m_indent;
+}
+
+void ASTPrinter::visit(const For& for_statement) {
+	print_with_indent(
+		for_statement.is_parallel() ? "Parallel For " : "For ", for_statement.get_variable().get_lexeme(), ":");
+	++m_indent;
+	dispatch(for_statement.get_begin());
+	dispatch(for_statement.get_end());
+	dispatch(for_statement.get_body());
 	--m_indent;
 }
 
 void ASTPrinter::visit(const IntLiteral&) { print_with_indent("Literal"); }
 
+void ASTPrinter::visit(const ArrayLiteral& array_literal) {
+	print_with_indent("Array Literal:");
+	++m_indent;
+	for(const RefPtr<Expression>& element : array_literal.get_elements())
+		dispatch(*element);
+	--m_indent;
+}
+
 void ASTPrinter::visit(const Assignment& assignment) {
 	print_with_indent("Assignment to ", assignment.get_lhs().get_lexeme(), ":");
 	++m_indent;
-	assignment.get_rhs().accept(*this);
+	dispatch(assignment.get_rhs());
+	--m_indent;
+}
+
+void ASTPrinter::visit(const IndexAssignment& index_assignment) {
+	print_with_indent("Assignment to an element:");
+	++m_indent;
+	dispatch(index_assignment.get_lhs());
+	dispatch(index_assignment.get_rhs());
 	--m_indent;
 }
 
 void ASTPrinter::visit(const BinaryExpression& binary_expression) {
 	print_with_indent("Binary Expression:");
 	++m_indent;
-	binary_expression.get_lhs().accept(*this);
+	dispatch(binary_expression.get_lhs());
 	print_with_indent(binary_expression.get_operator().get_lexeme());
-	binary_expression.get_rhs().accept(*this);
+	dispatch(binary_expression.get_rhs());
 	--m_indent;
 }
 
-void ASTPrinter::visit(const TypeIndicator& type) { print_with_indent("Type ", type.get_type().get_lexeme(), ""); }
+void ASTPrinter::visit(const TypeIndicator& type) {
+	if(const TypeIndicator* element_type = type.get_element_type(); element_type != nullptr) {
+		const std::string length = std::to_string(type.get_length());
+		print_with_indent("Array Type of ", length, ":");
+		++m_indent;
+		dispatch(*element_type);
+		--m_indent;
+		return;
+	}
+	print_with_indent("Type ", type.get_type().get_lexeme(), "");
+}
 
 void ASTPrinter::visit(const Call& call) { print_with_indent("Call to ", call.get_function_name().get_lexeme()); }
 
+void ASTPrinter::visit(const Index& index) {
+	print_with_indent("Index:");
+	++m_indent;
+	dispatch(index.get_array());
+	dispatch(index.get_index());
+	--m_indent;
+}
+
 void ASTPrinter::visit(const Group& group) {
 	print_with_indent("Group:");
 	++m_indent;
-	group.get_content().accept(*this);
+	dispatch(group.get_content());
 	--m_indent;
 }
 
@@ -8,13 +8,8 @@
 
 namespace Kyra {
 
-class ASTPrinter : public Untyped::ASTVisitor {
+class ASTPrinter : public Untyped::ASTVisitor<ASTPrinter> {
 public:
-	static ASTPrinter& the() {
-		static ASTPrinter instance;
-		return instance;
-	}
-
 	ASTPrinter() = default;
 	ASTPrinter(const ASTPrinter&) = delete;
 	ASTPrinter(ASTPrinter&&) noexcept = default;
@@ -24,20 +19,26 @@ public:
 
 	void print(const Untyped::Statement& statement);
 
-	void visit(const Untyped::ExpressionStatement& expresion_statement) override;
-	void visit(const Untyped::Declaration& declaration) override;
-	void visit(const Untyped::Function& function) override;
-	void visit(const Untyped::Print& print_statement) override;
-	void visit(const Untyped::Return& return_statement) override;
-	void visit(const Untyped::Block& block) override;
-	void visit(const Untyped::IntLiteral& literal) override;
-
-	void visit(const Untyped::Assignment& assignment) override;
-	void visit(const Untyped::BinaryExpression& binary_expression) override;
-	void visit(const Untyped::TypeIndicator& type) override;
-	void visit(const Untyped::Call& call) override;
-	void visit(const Untyped::Group& group) override;
-	void visit(const Untyped::VarQuery& var_query) override;
+	void visit(const Untyped::ExpressionStatement& expresion_statement);
+	void visit(const Untyped::Declaration& declaration);
+	void visit(const Untyped::Function& function);
+	void visit(const Untyped::ExternFunction& extern_function);
+	void visit(const Untyped::Import& import);
+	void visit(const Untyped::Print& print_statement);
+	void visit(const Untyped::Return& return_statement);
+	void visit(const Untyped::Block& block);
+	void visit(const Untyped::For& for_statement);
+	void visit(const Untyped::IntLiteral& literal);
+	void visit(const Untyped::ArrayLiteral& array_literal);
+
+	void visit(const Untyped::Assignment& assignment);
+	void visit(const Untyped::IndexAssignment& index_assignment);
+	void visit(const Untyped::BinaryExpression& binary_expression);
+	void visit(const Untyped::TypeIndicator& type);
+	void visit(const Untyped::Call& call);
+	void visit(const Untyped::Index& index);
+	void visit(const Untyped::Group& group);
+	void visit(const Untyped::VarQuery& var_query);
 
 private:
 	unsigned m_indent;
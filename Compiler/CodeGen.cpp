@@ -1,16 +1,47 @@
 #include "CodeGen.hpp"
 
+#include <llvm/ADT/SetVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 
+#include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <string_view>
 
+#include "CompilerInstance.hpp"
+#include "EffectAnalysis.hpp"
+#include "ModuleInterface.hpp"
 #include "Plattform.hpp"
+#include "RuntimeBitcode.hpp"
+#include "TimeTrace.hpp"
 #include "Token.hpp"
 
 using namespace llvm;
@@ -19,19 +50,12 @@ namespace Kyra {
 namespace Utils {
 
 Constant* construct_string(Module& module, std::string_view string, std::string_view twine = "") {
-	static std::map<std::string_view, Constant*> string_cache;
-	if(const auto& it = string_cache.find(string); it != string_cache.end())
-		return it->second;
-
 	Constant* string_constant = ConstantDataArray::getString(module.getContext(), string);
 	Constant* global_string_variable = new GlobalVariable(
 		module, string_constant->getType(), true, GlobalValue::PrivateLinkage, string_constant, twine);
 	Constant* zero_constant = Constant::getNullValue(IntegerType::get(module.getContext(), C_INT_BIT_WIDTH));
-	Constant* string_ptr = ConstantExpr::getGetElementPtr(
+	return ConstantExpr::getGetElementPtr(
 		string_constant->getType(), global_string_variable, (Constant* [2]){zero_constant, zero_constant}, true);
-
-	string_cache.try_emplace(string, string_ptr);
-	return string_ptr;
 }
 
 PointerType* get_ptr_type(Type* underlying_type, unsigned indirections = 1) {
@@ -49,20 +73,211 @@ ConstantInt* get_integer_constant(const Module& module, int constant, unsigned w
 Type* get_llvm_type_for(LLVMContext& context, const DeclaredType& type) {
 	switch(type.get_kind()) {
 		case DeclaredType::Integer: return get_integer_type(context, static_cast<const IntType&>(type).get_width());
+		case DeclaredType::Array: {
+			const auto& array_type = static_cast<const Kyra::ArrayType&>(type);
+			return llvm::ArrayType::get(
+				get_llvm_type_for(context, *array_type.get_element_type()), array_type.get_length());
+		}
+		case DeclaredType::Vector: {
+			const auto& vector_type = static_cast<const VectorType&>(type);
+			return FixedVectorType::get(
+				get_llvm_type_for(context, *vector_type.get_element_type()), vector_type.get_lanes());
+		}
 		case DeclaredType::Function:
 		default: assert_not_reached();
 	}
 }
 
+llvm::FunctionType* get_llvm_function_type(LLVMContext& context, const FunctionType& type) {
+	std::vector<Type*> params;
+	for(const RefPtr<AppliedType>& param_type : type.get_parameter())
+		params.push_back(get_llvm_type_for(context, param_type->get_declared_type()));
+	return llvm::FunctionType::get(get_llvm_type_for(context, *type.get_returned_type()), params, false);
+}
+
 Constant* get_zero_init_for(const Module& module, const DeclaredType& type) {
 	switch(type.get_kind()) {
 		case DeclaredType::Integer:
 			return get_integer_constant(module, 0, static_cast<const IntType&>(type).get_width());
+		case DeclaredType::Array:
+		case DeclaredType::Vector: return Constant::getNullValue(get_llvm_type_for(module.getContext(), type));
 		case DeclaredType::Function:
 		default: assert_not_reached();
 	}
 }
 
+OwnPtr<Module> parse_runtime(LLVMContext& context) {
+	std::string_view bitcode = Runtime::get_bitcode();
+	MemoryBufferRef buffer(StringRef(bitcode.data(), bitcode.size()), "KyraRuntime");
+	SMDiagnostic error;
+	OwnPtr<Module> runtime = parseIR(buffer, error, context);
+	assert(runtime != nullptr && "the embedded runtime could not be parsed");
+	return runtime;
+}
+
+void link_runtime(Module& module, const Module& runtime) {
+	// Linking consumes the runtime, so every module gets its own copy of the parsed one
+	// Only pull in the parts of the runtime the module actually uses
+	OwnPtr<Module> runtime_copy = CloneModule(runtime);
+	// The runtime is written for any target, so it takes on the one of the module
+	runtime_copy->setTargetTriple(module.getTargetTriple());
+	runtime_copy->setDataLayout(module.getDataLayout());
+	[[maybe_unused]] bool failed = Linker::linkModules(module, std::move(runtime_copy), Linker::Flags::LinkOnlyNeeded);
+	assert(!failed && "the embedded runtime could not be linked");
+	// Every module carries its own copy of the runtime. Once modules are linked together only one copy is kept, so all
+	// of them share the same output buffer. Functions that are inlined everywhere can still be removed.
+	for(Function& function : module.functions()) {
+		if(!function.isDeclaration() && function.getName().startswith("kyra_"))
+			function.setLinkage(GlobalValue::LinkOnceODRLinkage);
+	}
+}
+
+void add_function_attributes(Function& function, const EffectAnalysis::FunctionInfo& info) {
+	// Kyra functions are only ever called from Kyra code, so they do not need to follow the C calling convention
+	function.setCallingConv(CallingConv::Fast);
+	// Kyra has no exceptions
+	function.addFnAttr(Attribute::NoUnwind);
+	// A failing bounds check writes the output and exits
+	if(!(info.effects & (EffectAnalysis::WritesMemory | EffectAnalysis::PerformsIO | EffectAnalysis::Memoizes |
+			EffectAnalysis::MayFail))) {
+		if(info.effects & EffectAnalysis::ReadsMemory)
+			function.addFnAttr(Attribute::ReadOnly);
+		else
+			function.addFnAttr(Attribute::ReadNone);
+	}
+	if(!(info.effects & (EffectAnalysis::PerformsIO | EffectAnalysis::MayDiverge | EffectAnalysis::MayFail)))
+		function.addFnAttr(Attribute::WillReturn);
+	if(!info.is_recursive)
+		function.addFnAttr(Attribute::NoRecurse);
+}
+
+// C functions keep the C calling convention, which leaves it to the caller or the callee to widen integers that are
+// narrower than an int, depending on their signedness
+void add_c_function_attributes(Function& function, const FunctionType& type) {
+	const auto get_extension = [](const DeclaredType& integer_type) {
+		const auto& int_type = static_cast<const IntType&>(integer_type);
+		if(int_type.get_width() >= C_INT_BIT_WIDTH)
+			return Attribute::None;
+		return int_type.is_signed() ? Attribute::SExt : Attribute::ZExt;
+	};
+	for(unsigned i = 0; i < type.get_parameter().size(); ++i) {
+		if(const Attribute::AttrKind extension = get_extension(type.get_parameter()[i]->get_declared_type());
+			extension != Attribute::None)
+			function.addParamAttr(i, extension);
+	}
+	if(const Attribute::AttrKind extension = get_extension(*type.get_returned_type()); extension != Attribute::None)
+		function.addRetAttr(extension);
+	// Kyra has no exceptions, so nothing could unwind through it anyway
+	function.addFnAttr(Attribute::NoUnwind);
+}
+
+// The feature levels of x86-64 functions can be cloned for, in the order Runtime/CPU.ll numbers them (starting at 1).
+// Every level includes the features of the ones below.
+struct FeatureLevel {
+	std::string_view name;
+	const char* features;
+};
+const FeatureLevel feature_levels[] = {
+	{"sse4.2", "+sse4.2,+popcnt"},
+	{"avx2", "+sse4.2,+popcnt,+avx,+avx2,+fma,+bmi,+bmi2"},
+	{"avx512", "+sse4.2,+popcnt,+avx,+avx2,+fma,+bmi,+bmi2,+avx512f,+avx512dq,+avx512bw,+avx512vl"},
+};
+
+std::string get_target_triple(const CodeGen::Options& options) {
+	Triple triple(sys::getDefaultTargetTriple());
+	if(!options.target_architecture.empty())
+		triple.setArchName(options.target_architecture);
+	return triple.str();
+}
+
+// Empty if the target is not available, which leaves the choice to whoever compiles the module
+std::string get_data_layout(const std::string& target_triple) {
+	std::string error;
+	const Target* target = TargetRegistry::lookupTarget(target_triple, error);
+	if(target == nullptr)
+		return {};
+	const OwnPtr<TargetMachine> target_machine(
+		target->createTargetMachine(target_triple, "", "", TargetOptions(), None));
+	return target_machine->createDataLayout().getStringRepresentation();
+}
+
+// The host might support features its CPU name does not imply, e.g. if LLVM does not know the CPU yet
+std::string get_host_features() {
+	StringMap<bool> host_features;
+	std::string features;
+	if(!sys::getHostCPUFeatures(host_features))
+		return features;
+	for(const StringMapEntry<bool>& feature : host_features) {
+		if(!features.empty())
+			features += ',';
+		features += (feature.getValue() ? '+' : '-') + feature.getKey().str();
+	}
+	return features;
+}
+
+// Loops and vector operations are where wider vectors and newer instructions pay off
+bool is_hot(const Function& function) {
+	SmallVector<std::pair<const BasicBlock*, const BasicBlock*>> back_edges;
+	FindFunctionBackedges(function, back_edges);
+	if(!back_edges.empty())
+		return true;
+	for(const BasicBlock& basic_block : function) {
+		for(const Instruction& instruction : basic_block) {
+			if(instruction.getType()->isVectorTy() ||
+				std::any_of(instruction.op_begin(), instruction.op_end(),
+					[](const Use& operand) { return operand->getType()->isVectorTy(); }))
+				return true;
+		}
+	}
+	return false;
+}
+
+// Adds the global (or the globals inside of a constant expression) an operand refers to
+void collect_globals(Value& operand, SetVector<GlobalValue*>& globals) {
+	if(auto* global = dyn_cast<GlobalValue>(&operand))
+		globals.insert(global);
+	else if(auto* constant = dyn_cast<Constant>(&operand)) {
+		for(Value* constant_operand : constant->operands())
+			collect_globals(*constant_operand, globals);
+	}
+}
+
+// The functions can be in different modules of the same context. The map has to hold everything the source refers to
+// that is not a constant and not part of the source. Unlike CloneFunctionInto, this maps the arguments, blocks and
+// instructions without value handles or a ValueMapper for each instruction, but it does not support debug info.
+void clone_function_into(Function& target, const Function& source, ValueToValueMapTy& map) {
+	DenseMap<const Value*, Value*> local_map;
+	auto target_argument = target.arg_begin();
+	for(const Argument& argument : source.args()) {
+		target_argument->setName(argument.getName());
+		local_map[&argument] = &*target_argument++;
+	}
+	for(const BasicBlock& block : source) {
+		BasicBlock* copy = BasicBlock::Create(target.getContext(), block.getName(), &target);
+		local_map[&block] = copy;
+		for(const Instruction& instruction : block) {
+			Instruction* copied_instruction = instruction.clone();
+			copied_instruction->setName(instruction.getName());
+			copy->getInstList().push_back(copied_instruction);
+			local_map[&instruction] = copied_instruction;
+		}
+	}
+	for(Instruction& instruction : instructions(target)) {
+		for(Use& operand : instruction.operands()) {
+			if(isa<ConstantData>(operand.get()) || isa<MetadataAsValue>(operand.get()))
+				continue;
+			if(Value* value = local_map.lookup(operand.get()); value != nullptr)
+				operand.set(value);
+			else
+				operand.set(MapValue(cast<Constant>(operand.get()), map));
+		}
+		if(auto* phi = dyn_cast<PHINode>(&instruction)) {
+			for(unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+				phi->setIncomingBlock(i, cast<BasicBlock>(local_map.lookup(phi->getIncomingBlock(i))));
+		}
+	}
+}
+
 template <typename Lambda>
 void generate_on_basic_block(
 	IRBuilder<>& ir_builder, BasicBlock* basic_block, Lambda lambda, bool reset_insert_point = false) {
@@ -76,7 +291,17 @@ void generate_on_basic_block(
 
 namespace PredefFunctionNames {
 static const char* const main = "main";
-static const char* const printf = "printf";
+static const char* const print_i32 = "kyra_print_i32";
+static const char* const print_i64 = "kyra_print_i64";
+static const char* const print_u64 = "kyra_print_u64";
+static const char* const flush = "kyra_flush";
+static const char* const index_out_of_bounds = "kyra_index_out_of_bounds";
+static const char* const parallel_for = "kyra_parallel_for";
+static const char* const instrument_start = "kyra_instrument_start";
+static const char* const instrument_enter = "kyra_instrument_enter";
+static const char* const instrument_exit = "kyra_instrument_exit";
+static const char* const instrument_report = "kyra_instrument_report";
+static const char* const cpu_level = "kyra_cpu_level";
 }
 
 namespace PredefFunctions {
@@ -87,172 +312,1450 @@ Function* main(Module& module) {
 	llvm::FunctionType* main_function_type =
 		llvm::FunctionType::get(Utils::get_integer_type(module.getContext(), C_INT_BIT_WIDTH), false);
 	Function* main_function =
-		Function::Create(main_function_type, Function::LinkOnceAnyLinkage, PredefFunctionNames::main, module);
+		Function::Create(main_function_type, Function::ExternalLinkage, PredefFunctionNames::main, module);
 
 	return main_function;
 }
 
-Function* printf(Module& module) {
-	if(Function* print_function = module.getFunction(PredefFunctionNames::printf))
+Function* flush(Module& module) {
+	if(Function* flush_function = module.getFunction(PredefFunctionNames::flush))
+		return flush_function;
+
+	llvm::FunctionType* flush_function_type = llvm::FunctionType::get(Type::getVoidTy(module.getContext()), false);
+	Function* flush_function =
+		Function::Create(flush_function_type, Function::ExternalLinkage, PredefFunctionNames::flush, module);
+	// Output is buffered by the runtime, so it has to be flushed before the program exits
+	appendToGlobalDtors(module, flush_function, 0);
+
+	return flush_function;
+}
+
+// The runtime prints 32-bit values and signed and unsigned 64-bit values, see PredefFunctionNames
+Function* print(Module& module, const char* name, unsigned width) {
+	if(Function* print_function = module.getFunction(name))
 		return print_function;
 
-	llvm::FunctionType* print_function_type =
-		llvm::FunctionType::get(Utils::get_integer_type(module.getContext(), C_INT_BIT_WIDTH),
-			Utils::get_ptr_type(Utils::get_integer_type(module.getContext(), C_CHAR_BIT_WIDTH)), true);
-	Function* print_function =
-		Function::Create(print_function_type, Function::ExternalLinkage, PredefFunctionNames::printf, module);
+	llvm::FunctionType* print_function_type = llvm::FunctionType::get(
+		Type::getVoidTy(module.getContext()), Utils::get_integer_type(module.getContext(), width), false);
+	Function* print_function = Function::Create(print_function_type, Function::ExternalLinkage, name, module);
+	flush(module);
 
 	return print_function;
 }
+
+Function* index_out_of_bounds(Module& module) {
+	if(Function* bounds_function = module.getFunction(PredefFunctionNames::index_out_of_bounds))
+		return bounds_function;
+
+	Type* i64 = Utils::get_integer_type(module.getContext(), 64);
+	llvm::FunctionType* bounds_function_type =
+		llvm::FunctionType::get(Type::getVoidTy(module.getContext()), {i64, i64}, false);
+	Function* bounds_function = Function::Create(
+		bounds_function_type, Function::ExternalLinkage, PredefFunctionNames::index_out_of_bounds, module);
+	bounds_function->addFnAttr(Attribute::NoReturn);
+	bounds_function->addFnAttr(Attribute::Cold);
+	bounds_function->addFnAttr(Attribute::NoUnwind);
+
+	return bounds_function;
+}
+
+// The outlined body of a parallel loop runs the iterations [first, last) with the values it captured in the context
+llvm::FunctionType* parallel_body_type(LLVMContext& context) {
+	Type* i64 = Utils::get_integer_type(context, 64);
+	return llvm::FunctionType::get(Type::getVoidTy(context), {i64, i64, Type::getInt8PtrTy(context)}, false);
+}
+
+Function* parallel_for(Module& module) {
+	if(Function* parallel_function = module.getFunction(PredefFunctionNames::parallel_for))
+		return parallel_function;
+
+	LLVMContext& context = module.getContext();
+	Type* i64 = Utils::get_integer_type(context, 64);
+	llvm::FunctionType* parallel_function_type = llvm::FunctionType::get(
+		Type::getVoidTy(context), {i64, parallel_body_type(context)->getPointerTo(), Type::getInt8PtrTy(context)}, false);
+	Function* parallel_function = Function::Create(
+		parallel_function_type, Function::ExternalLinkage, PredefFunctionNames::parallel_for, module);
+	parallel_function->addFnAttr(Attribute::NoUnwind);
+
+	return parallel_function;
+}
+
+// Declares the runtime function with the name, e.g. for code that was generated for another module. Returns nullptr if
+// it is none of the runtime functions that Kyra code calls.
+Function* declare(Module& module, StringRef name) {
+	if(name == PredefFunctionNames::print_i32)
+		return print(module, PredefFunctionNames::print_i32, C_INT_BIT_WIDTH);
+	if(name == PredefFunctionNames::print_i64)
+		return print(module, PredefFunctionNames::print_i64, 64);
+	if(name == PredefFunctionNames::print_u64)
+		return print(module, PredefFunctionNames::print_u64, 64);
+	if(name == PredefFunctionNames::flush)
+		return flush(module);
+	if(name == PredefFunctionNames::index_out_of_bounds)
+		return index_out_of_bounds(module);
+	if(name == PredefFunctionNames::parallel_for)
+		return parallel_for(module);
+	return nullptr;
+}
+
+Function* instrument_report(Module& module) {
+	if(Function* report_function = module.getFunction(PredefFunctionNames::instrument_report))
+		return report_function;
+
+	llvm::FunctionType* report_function_type = llvm::FunctionType::get(Type::getVoidTy(module.getContext()), false);
+	Function* report_function = Function::Create(
+		report_function_type, Function::ExternalLinkage, PredefFunctionNames::instrument_report, module);
+	appendToGlobalDtors(module, report_function, 0);
+
+	return report_function;
+}
+
+Function* instrument_start(Module& module) {
+	if(Function* start_function = module.getFunction(PredefFunctionNames::instrument_start))
+		return start_function;
+
+	LLVMContext& context = module.getContext();
+	llvm::FunctionType* start_function_type = llvm::FunctionType::get(Type::getVoidTy(context),
+		{Utils::get_integer_type(context, C_INT_BIT_WIDTH), Utils::get_ptr_type(Type::getInt8Ty(context), 2)}, false);
+	Function* start_function =
+		Function::Create(start_function_type, Function::ExternalLinkage, PredefFunctionNames::instrument_start, module);
+	// The collected numbers are reported once the program exits
+	instrument_report(module);
+
+	return start_function;
+}
+
+Function* instrument_enter(Module& module) {
+	if(Function* enter_function = module.getFunction(PredefFunctionNames::instrument_enter))
+		return enter_function;
+
+	llvm::FunctionType* enter_function_type = llvm::FunctionType::get(Type::getVoidTy(module.getContext()),
+		Utils::get_integer_type(module.getContext(), C_INT_BIT_WIDTH), false);
+	return Function::Create(
+		enter_function_type, Function::ExternalLinkage, PredefFunctionNames::instrument_enter, module);
+}
+
+Function* instrument_exit(Module& module) {
+	if(Function* exit_function = module.getFunction(PredefFunctionNames::instrument_exit))
+		return exit_function;
+
+	llvm::FunctionType* exit_function_type = llvm::FunctionType::get(Type::getVoidTy(module.getContext()),
+		Utils::get_integer_type(module.getContext(), C_INT_BIT_WIDTH), false);
+	return Function::Create(
+		exit_function_type, Function::ExternalLinkage, PredefFunctionNames::instrument_exit, module);
+}
+
+// Returns the highest feature level the CPU supports, see Utils::feature_levels
+Function* cpu_level(Module& module) {
+	if(Function* level_function = module.getFunction(PredefFunctionNames::cpu_level))
+		return level_function;
+
+	llvm::FunctionType* level_function_type =
+		llvm::FunctionType::get(Utils::get_integer_type(module.getContext(), C_INT_BIT_WIDTH), false);
+	Function* level_function =
+		Function::Create(level_function_type, Function::ExternalLinkage, PredefFunctionNames::cpu_level, module);
+	level_function->addFnAttr(Attribute::NoUnwind);
+
+	return level_function;
+}
 }
 
 using namespace Typed;
 
-void CodeGen::gen_code(const std::vector<RefPtr<Statement>>& statements) {
-	llvm_context = mk_own<LLVMContext>();
-	// TODO: set filename as module name
-	llvm_module = mk_own<Module>("Kyra", *llvm_context);
+CodeGen::CodeGen(CompilerInstance& instance) :
+	m_instance(instance), m_llvm_context(mk_own<LLVMContext>()), llvm_context(m_llvm_context.getContext()) {}
+
+void CodeGen::initialize_targets() {
+	InitializeAllTargetInfos();
+	InitializeAllTargets();
+	InitializeAllTargetMCs();
+}
+
+bool CodeGen::check_target(const Options& options, std::ostream& error_output) {
+	const Triple triple(Utils::get_target_triple(options));
+	if(triple.getArch() == Triple::UnknownArch) {
+		error_output << "Unknown architecture " << options.target_architecture << '\n';
+		return false;
+	}
+	std::string error;
+	const Target* target = TargetRegistry::lookupTarget(triple.str(), error);
+	if(target == nullptr) {
+		error_output << error << '\n';
+		return false;
+	}
+	if(options.target_cpu == "native") {
+		if(triple.getArch() != Triple(sys::getDefaultTargetTriple()).getArch()) {
+			error_output << "The native CPU can only be targeted on the architecture of the host\n";
+			return false;
+		}
+	} else if(!options.target_cpu.empty()) {
+		const OwnPtr<MCSubtargetInfo> subtarget(target->createMCSubtargetInfo(triple.str(), "", ""));
+		if(!subtarget->isCPUStringValid(options.target_cpu)) {
+			error_output << "Unknown CPU " << options.target_cpu << " for " << triple.getArchName().str() << '\n';
+			return false;
+		}
+	}
+	for(const std::string& level : options.multiversion_levels) {
+		if(triple.getArch() != Triple::x86_64) {
+			error_output << "Functions can only be cloned for feature levels of x86-64\n";
+			return false;
+		}
+		if(std::none_of(std::begin(Utils::feature_levels), std::end(Utils::feature_levels),
+			   [&](const Utils::FeatureLevel& feature_level) { return feature_level.name == level; })) {
+			error_output << "Unknown feature level " << level << '\n';
+			return false;
+		}
+	}
+	return true;
+}
+
+void CodeGen::gen_code(const std::vector<RefPtr<Statement>>& statements, const std::filesystem::path& file_path,
+	const Options& options) {
+	m_options = options;
+	m_declarations.clear();
+	if(!m_options.repl) {
+		m_exported_symbols.clear();
+		m_c_functions.clear();
+	}
+	m_ssa_declarations.clear();
+	m_loop_variable_bounds.clear();
+	m_debug_file = nullptr;
+	m_debug_scopes.clear();
+	m_debug_variables.clear();
+	// The context is kept for the next run, so types and constants it already knows do not have to be created again
+	di_builder = nullptr;
+	ir_builder = nullptr;
+	llvm_module = mk_own<Module>(file_path.filename().string(), *llvm_context);
+	llvm_module->setSourceFileName(file_path.string());
+	const std::string target_triple = Utils::get_target_triple(m_options);
+	if(target_triple != m_target_triple) {
+		m_target_triple = target_triple;
+		m_data_layout = Utils::get_data_layout(target_triple);
+	}
+	llvm_module->setTargetTriple(target_triple);
+	llvm_module->setDataLayout(m_data_layout);
+	// A module with a summary takes part in ThinLTO, unless it says otherwise
+	if(m_options.output == Options::Output::Bitcode)
+		llvm_module->addModuleFlag(Module::Error, "ThinLTO", uint32_t(0));
 	ir_builder = mk_own<IRBuilder<>>(*llvm_context);
+	{
+		const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "Effect analysis");
+		// Functions taken from the function cache are only known by their summaries
+		if(const FunctionCache* function_cache = m_instance.get_function_cache(); function_cache != nullptr)
+			m_instance.get_effect_analysis().analyze(statements, false, function_cache->get_reused_summaries());
+		else
+			m_instance.get_effect_analysis().analyze(statements, m_options.repl);
+	}
+	m_module_name = file_path.stem().string();
+	// Entries of the REPL are run, even if they only declare functions
+	m_is_library = !m_options.repl && ModuleInterface::is_library(statements);
+	// Instrumentation is started and reported by main, which libraries do not have
+	if(m_is_library)
+		m_options.instrument_functions = false;
 
-	BasicBlock* main_entry = BasicBlock::Create(llvm_module->getContext());
-	PredefFunctions::main(*llvm_module)->getBasicBlockList().push_back(main_entry);
-	Utils::generate_on_basic_block(
-		*ir_builder, main_entry,
-		[&]() {
-			for(const RefPtr<Statement>& statement : statements)
-				statement->accept(*this);
-			ir_builder->CreateRet(Utils::get_integer_constant(*llvm_module, 0, C_INT_BIT_WIDTH));
-		},
-		true);
-	verifyFunction(*PredefFunctions::main(*llvm_module), &errs());
+	llvm::Function* main_function = PredefFunctions::main(*llvm_module);
+	if(m_options.debug_info != Options::DebugInfo::None) {
+		di_builder = mk_own<DIBuilder>(*llvm_module);
+		const std::filesystem::path absolute_path = std::filesystem::absolute(file_path);
+		m_debug_file =
+			di_builder->createFile(absolute_path.filename().string(), absolute_path.parent_path().string());
+		// There is no language code for Kyra, but debuggers know how to deal with C
+		di_builder->createCompileUnit(dwarf::DW_LANG_C, m_debug_file, "Kyra", false, "", 0, "",
+			m_options.debug_info == Options::DebugInfo::Full ? DICompileUnit::FullDebug
+															 : DICompileUnit::LineTablesOnly);
+		llvm_module->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+		llvm_module->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+		m_debug_scopes.push_back(create_debug_function(PredefFunctionNames::main, *main_function, 1, {}));
+		ir_builder->SetCurrentDebugLocation(DILocation::get(*llvm_context, 1, 1, m_debug_scopes.back()));
+	}
+	m_instrumented_function_names.clear();
+	m_instrumented_functions.clear();
+	if(m_options.instrument_functions)
+		instrument_entry(*main_function, PredefFunctionNames::main);
+
+	{
+		const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "IR generation");
+		BasicBlock* main_entry = BasicBlock::Create(llvm_module->getContext());
+		main_function->getBasicBlockList().push_back(main_entry);
+		Utils::generate_on_basic_block(
+			*ir_builder, main_entry,
+			[&]() {
+				for(const RefPtr<Statement>& statement : statements)
+					dispatch(*statement);
+				instrument_exit();
+				// The output of an entry is shown right after it ran, not once the session ends
+				if(m_options.repl)
+					ir_builder->CreateCall(PredefFunctions::flush(*llvm_module));
+				ir_builder->CreateRet(Utils::get_integer_constant(*llvm_module, 0, C_INT_BIT_WIDTH));
+			},
+			true);
+		if(m_options.instrument_functions)
+			start_instrumentation(*main_entry);
+		if(di_builder != nullptr)
+			di_builder->finalize();
+		verifyFunction(*main_function, &errs());
+		// main is still needed as the insertion point for the top-level, but a library must not define it
+		if(m_is_library)
+			main_function->eraseFromParent();
+		// All entries end up in the same JIT, where only one of them could be called main
+		else if(m_options.repl)
+			main_function->setName(m_module_name);
+		// The runtime is not linked in yet, so only Kyra functions are cloned
+		if(!m_options.multiversion_levels.empty())
+			multiversion_hot_functions();
+	}
+	if(!m_options.repl) {
+		const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "Runtime linking");
+		if(m_runtime == nullptr)
+			m_runtime = Utils::parse_runtime(*llvm_context);
+		Utils::link_runtime(*llvm_module, *m_runtime);
+	}
+	add_target_attributes();
+	const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "Verification");
 	verifyModule(*llvm_module, &errs());
-	llvm_module->print(outs(), nullptr);
+}
+
+void CodeGen::print_module(raw_ostream& output) const {
+	assert(llvm_module != nullptr);
+	const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "Printing IR");
+	llvm_module->print(output, nullptr);
+}
+
+void CodeGen::write_bitcode(raw_ostream& output) const {
+	assert(llvm_module != nullptr);
+	const TimeTrace::Scope scope(m_instance.get_time_trace(), "Phase", "Writing bitcode");
+	ProfileSummaryInfo profile_summary(*llvm_module);
+	const ModuleSummaryIndex summary = buildModuleSummaryIndex(*llvm_module, nullptr, &profile_summary);
+	WriteBitcodeToFile(*llvm_module, output, false, &summary);
+}
+
+orc::ThreadSafeModule CodeGen::take_module() {
+	assert(llvm_module != nullptr);
+	di_builder = nullptr;
+	return orc::ThreadSafeModule(std::move(llvm_module), m_llvm_context);
+}
+
+orc::ThreadSafeModule CodeGen::generate_runtime() {
+	if(m_runtime == nullptr)
+		m_runtime = Utils::parse_runtime(*llvm_context);
+	return orc::ThreadSafeModule(CloneModule(*m_runtime), m_llvm_context);
 }
 
 void CodeGen::visit(const ExpressionStatement& expresion_statement) {
-	expresion_statement.get_expression().accept(*this);
+	dispatch(expresion_statement.get_expression());
 }
 
 void CodeGen::visit(const Declaration& declaration) {
-	auto [name, type] = DeclarationDumpster::the().retrieve(declaration.get_declaration_id());
+	declid_t id = declaration.get_declaration_id();
+	auto [name, type] = m_instance.get_declarations().retrieve(id);
 	Type* llvm_type = Utils::get_llvm_type_for(llvm_module->getContext(), type->get_declared_type());
+	assert(!m_declarations.contains(id));
 
-	Value* var = nullptr;
-	if(ir_builder->GetInsertBlock()->getParent() == PredefFunctions::main(*llvm_module)) {
-		var = new GlobalVariable(*llvm_module, llvm_type, false, GlobalValue::PrivateLinkage,
-			Utils::get_zero_init_for(*llvm_module, type->get_declared_type()), name + ".ptr");
-	} else
-		var = ir_builder->CreateAlloca(llvm_type, nullptr, name + ".ptr");
+	emit_location(declaration);
+	const unsigned line = declaration.get_source_range().get_start().line;
 
-	assert(!m_declarations.contains(declaration.get_declaration_id()));
-	m_declarations[declaration.get_declaration_id()] = {var, 1};
+	Constant* zero_init = Utils::get_zero_init_for(*llvm_module, type->get_declared_type());
+	const bool is_array = type->get_declared_type().get_kind() == DeclaredType::Array;
+	if(!is_generating_top_level()) {
+		Value* variable = create_entry_alloca(llvm_type, name + ".ptr");
+		m_declarations[id] = {variable, 1};
+		describe_variable(id, variable, line);
+		// Arrays start out zeroed, even if they are declared in a loop
+		if(is_array)
+			ir_builder->CreateStore(zero_init, variable);
+		return;
+	}
+	const EffectAnalysis& effect_analysis = m_instance.get_effect_analysis();
+	// Later entries of the REPL can only reach the declaration through an exported global. Constants are exported
+	// with their value as the initializer.
+	GlobalVariable* exported_variable = nullptr;
+	if(m_options.repl) {
+		exported_variable = new GlobalVariable(
+			*llvm_module, llvm_type, false, GlobalValue::ExternalLinkage, zero_init, m_module_name + '.' + name);
+		m_exported_symbols[id] = exported_variable->getName().str();
+	}
+	// Top-level code is inside of main, so declarations that are not visible to functions can be kept in registers, as
+	// long as no loop needs their value from a previous iteration. Arrays are indexed through their address, so they
+	// always live in memory. Constants are folded into their users, no matter where they are used.
+	if(!is_array && !effect_analysis.is_assigned_in_loop(id) &&
+		((!effect_analysis.is_used_by_functions(id) && exported_variable == nullptr) ||
+			effect_analysis.is_constant(id))) {
+		m_ssa_declarations.insert(id);
+		m_declarations[id] = {zero_init, 0};
+		describe_value(id, zero_init, line);
+		return;
+	}
+	GlobalVariable* variable = exported_variable != nullptr
+		? exported_variable
+		: new GlobalVariable(*llvm_module, llvm_type, false, GlobalValue::PrivateLinkage, zero_init, name + ".ptr");
+	m_declarations[id] = {variable, 1};
+	describe_variable(id, variable, line);
+	if(is_array)
+		ir_builder->CreateStore(zero_init, variable);
 }
 
 void CodeGen::visit(const Function& function) {
-	auto [name, type] = DeclarationDumpster::the().retrieve(function.get_function_declaration_id());
+	FunctionCache* function_cache = m_instance.get_function_cache();
+	if(!function.has_implementation()) {
+		// Nothing can call it, unless its code is taken from the function cache
+		if(function_cache != nullptr) {
+			const declid_t id = function.get_function_declaration_id();
+			if(const FunctionCache::ReusedFunction* reused_function = function_cache->find_reused_function(id))
+				reuse_function_code(function, *reused_function);
+		}
+		return;
+	}
+	auto [name, type] = m_instance.get_declarations().retrieve(function.get_function_declaration_id());
+	const TimeTrace::Scope scope(m_instance.get_time_trace(), "Function", "Code generation", name);
 	const FunctionType& function_type = static_cast<const FunctionType&>(type->get_declared_type());
-	Type* return_type = Utils::get_llvm_type_for(llvm_module->getContext(), *function_type.get_returned_type());
-	std::vector<Type*> params;
-	for(const RefPtr<AppliedType>& param_type : function_type.get_parameter()) {
-		Type* llvm_param_type = Utils::get_llvm_type_for(llvm_module->getContext(), param_type->get_declared_type());
-		params.push_back(llvm_param_type);
+	llvm::FunctionType* llvm_function_type = Utils::get_llvm_function_type(llvm_module->getContext(), function_type);
+	// Libraries and entries of the REPL export their top-level functions, everything else stays private to the module
+	const GlobalValue::LinkageTypes linkage = (m_is_library || m_options.repl) && is_generating_top_level()
+		? GlobalValue::ExternalLinkage
+		: GlobalValue::PrivateLinkage;
+	const std::string symbol_name = ModuleInterface::mangle(m_module_name, name, function_type);
+	if(m_options.repl && linkage == GlobalValue::ExternalLinkage)
+		m_exported_symbols[function.get_function_declaration_id()] = symbol_name;
+	// Everything the function creates comes after what the module has so far
+	FunctionCache::Entry* cache_entry =
+		function_cache != nullptr ? function_cache->find_new_entry(function.get_function_declaration_id()) : nullptr;
+	llvm::Function& last_function = llvm_module->getFunctionList().back();
+	GlobalVariable* last_variable = llvm_module->global_empty() ? nullptr : &llvm_module->getGlobalList().back();
+	if(cache_entry != nullptr) {
+		m_first_function_declaration = function.get_parameters().empty() ? function.get_function_declaration_id()
+																		 : function.get_parameters().front();
+		m_outside_declarations.clear();
 	}
-	llvm::FunctionType* llvm_function_type = llvm::FunctionType::get(return_type, params, false);
-	llvm::Function* llvm_function =
-		llvm::Function::Create(llvm_function_type, llvm::Function::PrivateLinkage, name, *llvm_module);
+	// Callers of a memoized function (including itself) call the thunk, which is the one that gets exported
+	llvm::Function* llvm_function = llvm::Function::Create(llvm_function_type,
+		function.is_memoized() ? GlobalValue::PrivateLinkage : linkage,
+		function.is_memoized() ? symbol_name + ".memo" : symbol_name, *llvm_module);
+	EffectAnalysis::FunctionInfo info = m_instance.get_effect_analysis().get_function_info(function.get_function_declaration_id());
+	// The instrumentation updates the counters on every call
+	if(m_options.instrument_functions)
+		info.effects |= EffectAnalysis::WritesMemory;
+	Utils::add_function_attributes(*llvm_function, info);
 	assert(!m_declarations.contains(function.get_function_declaration_id()));
-	m_declarations[function.get_function_declaration_id()] = {llvm_function, 1};
+	m_declarations[function.get_function_declaration_id()] = {
+		function.is_memoized() ? generate_memo_thunk(*llvm_function, linkage, symbol_name) : llvm_function, 1};
 
 	for(unsigned i = 0; i < function.get_parameters().size(); ++i) {
 		Argument* arg = llvm_function->getArg(i);
 		declid_t id = function.get_parameters().at(i);
 		assert(!m_declarations.contains(id));
 		m_declarations[id] = {arg, 0};
-		std::string_view name = DeclarationDumpster::the().retrieve(id).name;
+		std::string_view name = m_instance.get_declarations().retrieve(id).name;
 		arg->setName(name);
 	}
 
+	const unsigned line = function.get_source_range().get_start().line;
+	const DebugLoc caller_location = ir_builder->getCurrentDebugLocation();
+	if(di_builder != nullptr) {
+		std::vector<RefPtr<DeclaredType>> signature = {function_type.get_returned_type()};
+		for(const RefPtr<AppliedType>& param_type : function_type.get_parameter())
+			signature.push_back(param_type->get_declared_type_shared());
+		m_debug_scopes.push_back(create_debug_function(name, *llvm_function, line, signature));
+	}
+
 	BasicBlock* entry = BasicBlock::Create(llvm_module->getContext());
 	llvm_function->getBasicBlockList().push_back(entry);
 	Utils::generate_on_basic_block(
-		*ir_builder, entry, [&]() { function.get_implementation().accept(*this); }, true);
+		*ir_builder, entry,
+		[&]() {
+			emit_location(function);
+			if(m_options.instrument_functions) {
+				std::string display_name = std::string(name) + '(';
+				for(const RefPtr<AppliedType>& param_type : function_type.get_parameter()) {
+					if(display_name.back() != '(')
+						display_name += ", ";
+					display_name += param_type->get_declared_type().get_name();
+				}
+				instrument_entry(*llvm_function, display_name + ')');
+			}
+			for(unsigned i = 0; i < function.get_parameters().size(); ++i) {
+				const declid_t id = function.get_parameters().at(i);
+				Argument* arg = llvm_function->getArg(i);
+				// Arrays are indexed through their address and loops need the value of the previous iteration
+				if(arg->getType()->isArrayTy() || m_instance.get_effect_analysis().is_assigned_in_loop(id)) {
+					AllocaInst* variable = create_entry_alloca(arg->getType(), arg->getName() + ".ptr");
+					ir_builder->CreateStore(arg, variable);
+					m_declarations.at(id) = {variable, 1};
+					describe_variable(id, variable, line);
+				} else
+					describe_value(id, arg, line, i + 1);
+			}
+			dispatch(function.get_implementation());
+		},
+		true);
+
+	if(di_builder != nullptr)
+		m_debug_scopes.pop_back();
+	ir_builder->SetCurrentDebugLocation(caller_location);
+	if(cache_entry != nullptr) {
+		m_first_function_declaration = 0;
+		store_function_code(
+			function.get_function_declaration_id(), *llvm_function, *cache_entry, last_function, last_variable);
+	}
+}
+
+void CodeGen::visit(const ExternalFunction& external_function) {
+	auto [name, type] = m_instance.get_declarations().retrieve(external_function.get_function_declaration_id());
+	llvm::FunctionType* llvm_function_type = Utils::get_llvm_function_type(
+		llvm_module->getContext(), static_cast<const FunctionType&>(type->get_declared_type()));
+	llvm::Function* llvm_function = llvm::Function::Create(
+		llvm_function_type, GlobalValue::ExternalLinkage, external_function.get_symbol_name(), *llvm_module);
+	if(external_function.is_c_function()) {
+		Utils::add_c_function_attributes(*llvm_function, static_cast<const FunctionType&>(type->get_declared_type()));
+		m_c_functions.insert(external_function.get_function_declaration_id());
+	} else {
+		// Without the body, recursion can only be ruled out for functions that cannot diverge
+		EffectAnalysis::FunctionInfo info;
+		info.effects = external_function.get_effects();
+		info.is_recursive = info.effects & EffectAnalysis::MayDiverge;
+		Utils::add_function_attributes(*llvm_function, info);
+	}
+	m_declarations[external_function.get_function_declaration_id()] = {llvm_function, 1};
+	if(m_options.repl)
+		m_exported_symbols[external_function.get_function_declaration_id()] = external_function.get_symbol_name();
 }
 
 void CodeGen::visit(const Print& print_statement) {
-	Constant* format_string = Utils::construct_string(*llvm_module, "%d\n", "printf.format");
-	Value* printee = visit_with_return(print_statement.get_expression());
-	ir_builder->CreateCall(PredefFunctions::printf(*llvm_module), {format_string, printee});
+	Value* printee = dispatch(print_statement.get_expression());
+	const auto& type = static_cast<const IntType&>(print_statement.get_expression().get_type().get_declared_type());
+	emit_location(print_statement);
+	// Narrower values are widened to the next width the runtime can print without changing their value
+	const char* print_name = PredefFunctionNames::print_i32;
+	unsigned print_width = C_INT_BIT_WIDTH;
+	if(type.get_width() == 64 && !type.is_signed()) {
+		print_name = PredefFunctionNames::print_u64;
+		print_width = 64;
+	} else if(type.get_width() == 64 || (type.get_width() == 32 && !type.is_signed())) {
+		print_name = PredefFunctionNames::print_i64;
+		print_width = 64;
+	}
+	Type* print_type = Utils::get_integer_type(llvm_module->getContext(), print_width);
+	if(type.is_signed())
+		printee = ir_builder->CreateSExt(printee, print_type);
+	else
+		printee = ir_builder->CreateZExt(printee, print_type);
+	ir_builder->CreateCall(PredefFunctions::print(*llvm_module, print_name, print_width), {printee});
 }
 
 void CodeGen::visit(const Return& return_statement) {
-	Value* return_value = visit_with_return(return_statement.get_expression());
+	Value* return_value = dispatch(return_statement.get_expression());
+	emit_location(return_statement);
+	instrument_exit();
 	ir_builder->CreateRet(return_value);
 }
 
 void CodeGen::visit(const Block& block) {
-	for(const RefPtr<Statement>& statement : block.get_body())
-		statement->accept(*this);
+	for(const RefPtr<Statement>& statement : block.get_body()) {
+		dispatch(*statement);
+		// Everything after a return is unreachable
+		if(ir_builder->GetInsertBlock()->getTerminator() != nullptr)
+			break;
+	}
 }
 
-void CodeGen::visit(const IntLiteral& literal) {
+void CodeGen::visit(const For& for_statement) {
+	Value* begin = dispatch(for_statement.get_begin());
+	Value* end = dispatch(for_statement.get_end());
+	const auto& type = static_cast<const IntType&>(for_statement.get_begin().get_type().get_declared_type());
+	emit_location(for_statement);
+	// With constant bounds that are not negative, the variable stays in [0, end)
+	const auto* constant_begin = dyn_cast<ConstantInt>(begin);
+	const auto* constant_end = dyn_cast<ConstantInt>(end);
+	if(constant_begin != nullptr && constant_end != nullptr &&
+		(!type.is_signed() || (!constant_begin->isNegative() && !constant_end->isNegative())))
+		m_loop_variable_bounds[for_statement.get_variable()] = constant_end->getZExtValue();
+	if(for_statement.is_parallel())
+		generate_parallel_loop(for_statement, begin, end);
+	else
+		generate_loop(for_statement, begin, end);
+}
+
+Value* CodeGen::visit(const IntLiteral& literal) {
 	unsigned width = static_cast<const IntType&>(literal.get_type().get_declared_type()).get_width();
-	ConstantInt* literal_value = Utils::get_integer_constant(*llvm_module, literal.get_value(), width);
-	return_from_visit(literal_value);
+	// The type checker made sure that the value fits into the type
+	return ConstantInt::get(Utils::get_integer_type(llvm_module->getContext(), width), literal.get_value());
 }
 
-void CodeGen::visit(const Assignment& assignment) {
-	Value* new_value = visit_with_return(assignment.get_rhs());
-	auto [variable, indirections] = m_declarations.at(assignment.get_lhs());
-	auto [name, type] = DeclarationDumpster::the().retrieve(assignment.get_lhs());
+Value* CodeGen::visit(const ArrayLiteral& array_literal) {
+	Type* type = Utils::get_llvm_type_for(llvm_module->getContext(), array_literal.get_type().get_declared_type());
+	Value* array = UndefValue::get(type);
+	const std::vector<RefPtr<Expression>>& elements = array_literal.get_elements();
+	for(unsigned i = 0; i < elements.size(); ++i) {
+		Value* element = dispatch(*elements.at(i));
+		emit_location(array_literal);
+		array = ir_builder->CreateInsertValue(array, element, i);
+	}
+	return array;
+}
+
+Value* CodeGen::visit(const Assignment& assignment) {
+	Value* new_value = dispatch(assignment.get_rhs());
+	auto [variable, indirections] = get_declaration(assignment.get_lhs());
+	auto [name, type] = m_instance.get_declarations().retrieve(assignment.get_lhs());
+	emit_location(assignment);
+	const unsigned line = assignment.get_source_range().get_start().line;
+	if(m_ssa_declarations.contains(assignment.get_lhs())) {
+		assert(!m_instance.get_effect_analysis().is_constant(assignment.get_lhs()) || isa<Constant>(new_value));
+		if(isa<Instruction>(new_value) && !new_value->hasName())
+			new_value->setName(name);
+		if(const auto it = m_exported_symbols.find(assignment.get_lhs()); it != m_exported_symbols.end())
+			llvm_module->getNamedGlobal(it->second)->setInitializer(cast<Constant>(new_value));
+		m_declarations.at(assignment.get_lhs()) = {new_value, 0};
+		describe_value(assignment.get_lhs(), new_value, line);
+		return new_value;
+	}
 	assert(indirections == 0 || indirections == 1);
 	if(indirections == 0) {
-		Value* new_variable = ir_builder->CreateAlloca(
-			Utils::get_llvm_type_for(llvm_module->getContext(), type->get_declared_type()), nullptr, name + ".ptr");
+		Value* new_variable = create_entry_alloca(
+			Utils::get_llvm_type_for(llvm_module->getContext(), type->get_declared_type()), name + ".ptr");
 		m_declarations.at(assignment.get_lhs()) = {new_variable, 1};
 		variable = new_variable;
+		// The parameter was described as a value so far, so keep on doing that
+		describe_value(assignment.get_lhs(), new_value, line);
 	}
 	ir_builder->CreateStore(new_value, variable);
-	return_from_visit(new_value);
+	return new_value;
+}
+
+Value* CodeGen::visit(const IndexAssignment& index_assignment) {
+	Value* element = get_element_address(index_assignment.get_lhs());
+	Value* new_value = dispatch(index_assignment.get_rhs());
+	emit_location(index_assignment);
+	ir_builder->CreateStore(new_value, element);
+	return new_value;
 }
 
-void CodeGen::visit(const BinaryExpression& binary_expression) {
-	Value* lhs = visit_with_return(binary_expression.get_lhs());
-	Value* rhs = visit_with_return(binary_expression.get_rhs());
-	Value* result = nullptr;
+Value* CodeGen::visit(const BinaryExpression& binary_expression) {
+	Value* lhs = dispatch(binary_expression.get_lhs());
+	Value* rhs = dispatch(binary_expression.get_rhs());
+	const DeclaredType& declared_type = binary_expression.get_type().get_declared_type();
+	// Operators of vectors work lane by lane
+	const IntType& type = declared_type.get_kind() == DeclaredType::Vector
+		? *static_cast<const VectorType&>(declared_type).get_element_type()
+		: static_cast<const IntType&>(declared_type);
+	emit_location(binary_expression);
 	switch(binary_expression.get_operator().get_type()) {
-		case TokenType::PLUS: result = ir_builder->CreateAdd(lhs, rhs); break;
-		case TokenType::MINUS: result = ir_builder->CreateSub(lhs, rhs); break;
-		case TokenType::STAR: result = ir_builder->CreateMul(lhs, rhs); break;
-		case TokenType::SLASH: result = ir_builder->CreateSDiv(lhs, rhs); break;
+		case TokenType::PLUS: return ir_builder->CreateAdd(lhs, rhs);
+		case TokenType::MINUS: return ir_builder->CreateSub(lhs, rhs);
+		case TokenType::STAR: return ir_builder->CreateMul(lhs, rhs);
+		case TokenType::SLASH:
+			return type.is_signed() ? ir_builder->CreateSDiv(lhs, rhs) : ir_builder->CreateUDiv(lhs, rhs);
 		default: assert_not_reached();
 	}
-	return_from_visit(result);
 }
 
-void CodeGen::visit(const Call& call) {
-	auto [function, indirections] = m_declarations.at(call.get_function_declaration_id());
+Value* CodeGen::visit(const Call& call) {
+	auto [function, indirections] = get_declaration(call.get_function_declaration_id());
 	assert(indirections == 1);
 	llvm::Function* llvm_function = cast<llvm::Function>(function);
 	std::vector<Value*> arguments;
 	for(const RefPtr<Expression>& arg : call.get_arguments())
-		arguments.push_back(visit_with_return(*arg));
-	Value* result = ir_builder->CreateCall(llvm_function, arguments);
-	return_from_visit(result);
+		arguments.push_back(dispatch(*arg));
+	emit_location(call);
+	CallInst* result = ir_builder->CreateCall(llvm_function, arguments);
+	result->setCallingConv(llvm_function->getCallingConv());
+	return result;
 }
 
-void CodeGen::visit(const VarQuery& var_query) {
-	auto [variable, indirections] = m_declarations.at(var_query.get_declaration_id());
+Value* CodeGen::visit(const Conversion& conversion) {
+	Value* value = dispatch(conversion.get_value());
+	const auto& source_type = static_cast<const IntType&>(conversion.get_value().get_type().get_declared_type());
+	const auto& target_type = static_cast<const IntType&>(conversion.get_type().get_declared_type());
+	Type* llvm_target_type = Utils::get_llvm_type_for(llvm_module->getContext(), target_type);
+	emit_location(conversion);
+	if(target_type.get_width() < source_type.get_width())
+		return ir_builder->CreateTrunc(value, llvm_target_type);
+	// Widening keeps the value of the source, conversions between types of the same width only reinterpret the bits
+	if(source_type.is_signed())
+		return ir_builder->CreateSExt(value, llvm_target_type);
+	return ir_builder->CreateZExt(value, llvm_target_type);
+}
+
+Value* CodeGen::visit(const VectorOperation& vector_operation) {
+	using Operation = VectorOperation::Operation;
+	std::vector<Value*> operands;
+	for(const RefPtr<Expression>& operand : vector_operation.get_operands())
+		operands.push_back(dispatch(*operand));
+	emit_location(vector_operation);
+	const DeclaredType& operand_type = vector_operation.get_operands().front()->get_type().get_declared_type();
+	switch(vector_operation.get_operation()) {
+		case Operation::Splat: {
+			const auto& type = static_cast<const VectorType&>(vector_operation.get_type().get_declared_type());
+			return ir_builder->CreateVectorSplat(type.get_lanes(), operands.front());
+		}
+		case Operation::FromArray: {
+			const auto& type = static_cast<const VectorType&>(vector_operation.get_type().get_declared_type());
+			Value* vector = UndefValue::get(Utils::get_llvm_type_for(llvm_module->getContext(), type));
+			for(unsigned lane = 0; lane < type.get_lanes(); ++lane) {
+				Value* element = ir_builder->CreateExtractValue(operands.front(), lane);
+				vector = ir_builder->CreateInsertElement(vector, element, lane);
+			}
+			return vector;
+		}
+		default: break;
+	}
+	const auto& type = static_cast<const VectorType&>(operand_type);
+	switch(vector_operation.get_operation()) {
+		case Operation::Extract:
+			return ir_builder->CreateExtractElement(operands.at(0),
+				get_checked_index(*vector_operation.get_operands().at(1), operands.at(1), type.get_lanes()));
+		case Operation::Insert:
+			return ir_builder->CreateInsertElement(operands.at(0), operands.at(2),
+				get_checked_index(*vector_operation.get_operands().at(1), operands.at(1), type.get_lanes()));
+		case Operation::Shuffle: {
+			// A shuffle of a single vector takes no lanes from the second operand
+			Value* second = operands.size() > 1 ? operands.at(1) : PoisonValue::get(operands.front()->getType());
+			return ir_builder->CreateShuffleVector(operands.front(), second, vector_operation.get_mask());
+		}
+		case Operation::ReduceAdd: return ir_builder->CreateAddReduce(operands.front());
+		case Operation::ReduceMul: return ir_builder->CreateMulReduce(operands.front());
+		case Operation::ReduceMin:
+			return ir_builder->CreateIntMinReduce(operands.front(), type.get_element_type()->is_signed());
+		case Operation::ReduceMax:
+			return ir_builder->CreateIntMaxReduce(operands.front(), type.get_element_type()->is_signed());
+		default: assert_not_reached();
+	}
+}
+
+Value* CodeGen::visit(const Index& index) {
+	Value* element = get_element_address(index);
+	Type* type = Utils::get_llvm_type_for(llvm_module->getContext(), index.get_type().get_declared_type());
+	return ir_builder->CreateLoad(type, element);
+}
+
+Value* CodeGen::visit(const VarQuery& var_query) {
+	auto [variable, indirections] = get_declaration(var_query.get_declaration_id());
 	const DeclaredType& type = var_query.get_type().get_declared_type();
+	emit_location(var_query);
 	Value* loaded_variable = variable;
 	// Load indirections away
 	for(unsigned i = indirections; i > 0; --i) {
 		Type* expected_type = Utils::get_llvm_type_for(llvm_module->getContext(), type);
 		if(i > 1)
 			expected_type = Utils::get_ptr_type(expected_type, i - 1);
-		std::string_view name = DeclarationDumpster::the().retrieve(var_query.get_declaration_id()).name;
-		loaded_variable = ir_builder->CreateLoad(expected_type, variable, name);
+		std::string_view name = m_instance.get_declarations().retrieve(var_query.get_declaration_id()).name;
+		LoadInst* load = ir_builder->CreateLoad(expected_type, variable, name);
+		// Top-level values are initialized before any function that can see them is called
+		if(isa<GlobalVariable>(variable) && !var_query.get_type().is_mutable() && !is_generating_top_level())
+			load->setMetadata(LLVMContext::MD_invariant_load, MDNode::get(llvm_module->getContext(), {}));
+		loaded_variable = load;
+	}
+	return loaded_variable;
+}
+
+std::pair<Value*, unsigned>& CodeGen::get_declaration(declid_t id) {
+	if(id < m_first_function_declaration)
+		m_outside_declarations.insert(id);
+	if(const auto it = m_declarations.find(id); it != m_declarations.end())
+		return it->second;
+	const RefPtr<AppliedType>& type = m_instance.get_declarations().retrieve(id).type;
+	const std::string& symbol_name = m_exported_symbols.at(id);
+	if(type->get_declared_type().get_kind() == DeclaredType::Function) {
+		const auto& function_type = static_cast<const FunctionType&>(type->get_declared_type());
+		llvm::Function* function = llvm::Function::Create(
+			Utils::get_llvm_function_type(llvm_module->getContext(), function_type), GlobalValue::ExternalLinkage,
+			symbol_name, *llvm_module);
+		if(m_c_functions.contains(id)) {
+			Utils::add_c_function_attributes(*function, function_type);
+			return m_declarations[id] = {function, 1};
+		}
+		// The entry might have imported it, so recursion is only ruled out like for an ExternalFunction
+		EffectAnalysis::FunctionInfo info = m_instance.get_effect_analysis().get_function_info(id);
+		info.is_recursive |= (info.effects & EffectAnalysis::MayDiverge) != 0;
+		Utils::add_function_attributes(*function, info);
+		return m_declarations[id] = {function, 1};
+	}
+	GlobalVariable* variable = new GlobalVariable(*llvm_module,
+		Utils::get_llvm_type_for(llvm_module->getContext(), type->get_declared_type()), false,
+		GlobalValue::ExternalLinkage, nullptr, symbol_name);
+	return m_declarations[id] = {variable, 1};
+}
+
+void CodeGen::store_function_code(declid_t function, llvm::Function& implementation, FunctionCache::Entry& entry,
+	llvm::Function& last_function, GlobalVariable* last_variable) {
+	const DeclarationDumpster& declarations = m_instance.get_declarations();
+	auto module = mk_own<Module>(implementation.getName(), *llvm_context);
+	ValueToValueMapTy map;
+	// Outside declarations are only declared in the module of the entry, constants stay what they were folded into
+	std::vector<FunctionCache::External> externals;
+	for(const declid_t id : m_outside_declarations) {
+		auto* value = dyn_cast<Constant>(m_declarations.at(id).first);
+		if(value == nullptr)
+			return;
+		if(const auto* outside_function = dyn_cast<llvm::Function>(value)) {
+			llvm::Function* declaration = llvm::Function::Create(outside_function->getFunctionType(),
+				GlobalValue::ExternalLinkage, outside_function->getName(), *module);
+			declaration->setCallingConv(outside_function->getCallingConv());
+			map[outside_function] = value = declaration;
+		} else if(const auto* variable = dyn_cast<GlobalVariable>(value)) {
+			map[variable] = value = new GlobalVariable(*module, variable->getValueType(), variable->isConstant(),
+				GlobalValue::ExternalLinkage, nullptr, variable->getName());
+		}
+		externals.push_back({FunctionCache::make_reference(id, declarations), value});
+	}
+
+	std::vector<llvm::Function*> created_functions;
+	for(auto it = std::next(last_function.getIterator()); it != llvm_module->end(); ++it)
+		created_functions.push_back(&*it);
+	std::set<const GlobalVariable*> created_variables;
+	for(auto it = last_variable != nullptr ? std::next(last_variable->getIterator()) : llvm_module->global_begin();
+		it != llvm_module->global_end(); ++it)
+		created_variables.insert(&*it);
+	const auto is_runtime_function = [&](llvm::Function& declaration) {
+		return declaration.isIntrinsic() ||
+			PredefFunctions::declare(*llvm_module, declaration.getName()) == &declaration;
+	};
+	SetVector<GlobalValue*> globals;
+	for(llvm::Function* created_function : created_functions) {
+		if(created_function->isDeclaration() && !is_runtime_function(*created_function))
+			return;
+		llvm::Function* copy = llvm::Function::Create(created_function->getFunctionType(),
+			created_function->getLinkage(), created_function->getName(), *module);
+		copy->copyAttributesFrom(created_function);
+		map[created_function] = copy;
+		for(Instruction& instruction : instructions(*created_function)) {
+			for(Value* operand : instruction.operands())
+				Utils::collect_globals(*operand, globals);
+		}
+	}
+	// Runtime functions and intrinsics can already be declared before, but variables have to be created by the function
+	// (e.g. the table of a memoized function)
+	std::vector<std::pair<GlobalVariable*, GlobalVariable*>> variables;
+	for(size_t i = 0; i < globals.size(); ++i) {
+		GlobalValue* global = globals[i];
+		if(map.count(global) != 0)
+			continue;
+		if(auto* declaration = dyn_cast<llvm::Function>(global); declaration != nullptr) {
+			if(!is_runtime_function(*declaration))
+				return;
+			llvm::Function* copy = llvm::Function::Create(
+				declaration->getFunctionType(), declaration->getLinkage(), declaration->getName(), *module);
+			copy->copyAttributesFrom(declaration);
+			map[declaration] = copy;
+			continue;
+		}
+		auto* variable = dyn_cast<GlobalVariable>(global);
+		if(variable == nullptr || !created_variables.contains(variable))
+			return;
+		auto* copy = new GlobalVariable(*module, variable->getValueType(), variable->isConstant(),
+			variable->getLinkage(), nullptr, variable->getName(), nullptr, variable->getThreadLocalMode());
+		copy->copyAttributesFrom(variable);
+		map[variable] = copy;
+		variables.emplace_back(variable, copy);
+		if(variable->hasInitializer())
+			Utils::collect_globals(*variable->getInitializer(), globals);
+	}
+	for(auto [variable, copy] : variables) {
+		if(variable->hasInitializer())
+			copy->setInitializer(MapValue(variable->getInitializer(), map));
+	}
+	for(llvm::Function* created_function : created_functions) {
+		if(!created_function->isDeclaration())
+			Utils::clone_function_into(*cast<llvm::Function>(map[created_function]), *created_function, map);
+	}
+
+	const EffectAnalysis::FunctionSummary& summary = m_instance.get_effect_analysis().get_function_summary(function);
+	entry.effects = summary.effects;
+	entry.callees = FunctionCache::make_references(summary.callees, declarations);
+	entry.used_declarations = FunctionCache::make_references(summary.used_declarations, declarations);
+	entry.assigned_declarations = FunctionCache::make_references(summary.assigned_declarations, declarations);
+	entry.parallel_callees = FunctionCache::make_references(summary.parallel_callees, declarations);
+	entry.implementation = cast<llvm::Function>(map[&implementation]);
+	entry.entry_point = cast<llvm::Function>(map[m_declarations.at(function).first]);
+	entry.externals = std::move(externals);
+	entry.module = std::move(module);
+}
+
+void CodeGen::reuse_function_code(const Function& function, const FunctionCache::ReusedFunction& reused_function) {
+	const declid_t id = function.get_function_declaration_id();
+	const FunctionCache::Entry& entry = reused_function.entry;
+	ValueToValueMapTy map;
+	bool fits = true;
+	for(size_t i = 0; i < entry.externals.size() && fits; ++i) {
+		const auto it = m_declarations.find(reused_function.externals.at(i));
+		if(it == m_declarations.end()) {
+			fits = false;
+			break;
+		}
+		auto [value, indirections] = it->second;
+		Constant* stand_in = entry.externals.at(i).value;
+		if(const auto* declaration = dyn_cast<llvm::Function>(stand_in)) {
+			const auto* outside_function = dyn_cast<llvm::Function>(value);
+			fits = outside_function != nullptr &&
+				outside_function->getFunctionType() == declaration->getFunctionType() &&
+				outside_function->getCallingConv() == declaration->getCallingConv();
+		} else if(const auto* declaration = dyn_cast<GlobalVariable>(stand_in)) {
+			const auto* variable = dyn_cast<GlobalVariable>(value);
+			fits = variable != nullptr && variable->getValueType() == declaration->getValueType() &&
+				variable->isConstant() == declaration->isConstant();
+		} else
+			fits = value == stand_in && indirections == 0;
+		map[stand_in] = value;
+	}
+	auto [name, type] = m_instance.get_declarations().retrieve(id);
+	const auto& function_type = static_cast<const FunctionType&>(type->get_declared_type());
+	if(!fits) {
+		m_instance.get_function_cache()->reject_reused_function();
+		// The module is generated again without reusing anything, until then the callers only need something to call
+		llvm::Function* declaration = llvm::Function::Create(
+			Utils::get_llvm_function_type(llvm_module->getContext(), function_type), GlobalValue::ExternalLinkage,
+			ModuleInterface::mangle(m_module_name, name, function_type), *llvm_module);
+		declaration->setCallingConv(CallingConv::Fast);
+		m_declarations[id] = {declaration, 1};
+		return;
 	}
-	return_from_visit(loaded_variable);
+
+	const TimeTrace::Scope scope(m_instance.get_time_trace(), "Function", "Code reuse", name);
+	for(llvm::Function& cached_function : *entry.module) {
+		if(map.count(&cached_function) != 0)
+			continue;
+		if(cached_function.isIntrinsic()) {
+			map[&cached_function] = cast<llvm::Function>(
+				llvm_module->getOrInsertFunction(cached_function.getName(), cached_function.getFunctionType())
+					.getCallee());
+		} else if(cached_function.isDeclaration())
+			map[&cached_function] = PredefFunctions::declare(*llvm_module, cached_function.getName());
+		else {
+			llvm::Function* copy = llvm::Function::Create(cached_function.getFunctionType(),
+				cached_function.getLinkage(), cached_function.getName(), *llvm_module);
+			copy->copyAttributesFrom(&cached_function);
+			map[&cached_function] = copy;
+		}
+	}
+	for(GlobalVariable& cached_variable : entry.module->globals()) {
+		if(map.count(&cached_variable) != 0)
+			continue;
+		auto* copy = new GlobalVariable(*llvm_module, cached_variable.getValueType(), cached_variable.isConstant(),
+			cached_variable.getLinkage(), nullptr, cached_variable.getName(), nullptr,
+			cached_variable.getThreadLocalMode());
+		copy->copyAttributesFrom(&cached_variable);
+		map[&cached_variable] = copy;
+	}
+	for(GlobalVariable& cached_variable : entry.module->globals()) {
+		if(cached_variable.hasInitializer()) {
+			cast<GlobalVariable>(map[&cached_variable])
+				->setInitializer(MapValue(cached_variable.getInitializer(), map));
+		}
+	}
+	for(llvm::Function& cached_function : *entry.module) {
+		if(!cached_function.isDeclaration())
+			Utils::clone_function_into(*cast<llvm::Function>(map[&cached_function]), cached_function, map);
+	}
+	// The effects of the functions it calls may have changed, and so may its own
+	auto* implementation = cast<llvm::Function>(map[entry.implementation]);
+	implementation->setAttributes(AttributeList());
+	Utils::add_function_attributes(*implementation, m_instance.get_effect_analysis().get_function_info(id));
+	auto* entry_point = cast<llvm::Function>(map[entry.entry_point]);
+	entry_point->setLinkage(m_is_library ? GlobalValue::ExternalLinkage : GlobalValue::PrivateLinkage);
+	m_declarations[id] = {entry_point, 1};
+}
+
+void CodeGen::multiversion_hot_functions() {
+	std::vector<llvm::Function*> hot_functions;
+	for(llvm::Function& function : *llvm_module) {
+		if(!function.isDeclaration() && Utils::is_hot(function))
+			hot_functions.push_back(&function);
+	}
+	if(hot_functions.empty())
+		return;
+	std::vector<unsigned> levels;
+	for(unsigned level = 0; level < std::size(Utils::feature_levels); ++level) {
+		if(std::find(m_options.multiversion_levels.begin(), m_options.multiversion_levels.end(),
+			   Utils::feature_levels[level].name) != m_options.multiversion_levels.end())
+			levels.push_back(level);
+	}
+
+	llvm::Function* resolver =
+		llvm::Function::Create(llvm::FunctionType::get(Type::getVoidTy(*llvm_context), false),
+			GlobalValue::InternalLinkage, "kyra.multiversion.resolve", *llvm_module);
+	resolver->addFnAttr(Attribute::NoUnwind);
+	IRBuilder<> resolver_builder(BasicBlock::Create(*llvm_context, "", resolver));
+	Value* cpu_level = resolver_builder.CreateCall(PredefFunctions::cpu_level(*llvm_module));
+	for(llvm::Function* function : hot_functions) {
+		const std::string name = function->getName().str();
+		ValueToValueMapTy default_map;
+		llvm::Function* default_version = CloneFunction(function, default_map);
+		default_version->setName(name + ".default");
+		default_version->setLinkage(GlobalValue::InternalLinkage);
+		Value* version = default_version;
+		for(const unsigned level : levels) {
+			ValueToValueMapTy clone_map;
+			llvm::Function* clone = CloneFunction(function, clone_map);
+			clone->setName(name + '.' + std::string(Utils::feature_levels[level].name));
+			clone->setLinkage(GlobalValue::InternalLinkage);
+			clone->addFnAttr("target-features", Utils::feature_levels[level].features);
+			Value* is_supported = resolver_builder.CreateICmpUGE(
+				cpu_level, Utils::get_integer_constant(*llvm_module, level + 1, C_INT_BIT_WIDTH));
+			version = resolver_builder.CreateSelect(is_supported, clone, version);
+		}
+		// Until the resolver ran, e.g. while other constructors run, the baseline is called
+		auto* dispatch = new GlobalVariable(*llvm_module, function->getType(), false, GlobalValue::InternalLinkage,
+			default_version, name + ".dispatch");
+		resolver_builder.CreateStore(version, dispatch);
+
+		// The original keeps its symbol, calling convention and attributes, so neither its callers nor other modules
+		// notice the dispatch
+		const GlobalValue::LinkageTypes linkage = function->getLinkage();
+		function->deleteBody();
+		function->setLinkage(linkage);
+		IRBuilder<> builder(BasicBlock::Create(*llvm_context, "", function));
+		LoadInst* target = builder.CreateLoad(function->getType(), dispatch);
+		// The pointer does not change after the program was loaded, which is what keeps readnone functions readnone
+		target->setMetadata(LLVMContext::MD_invariant_load, MDNode::get(*llvm_context, {}));
+		std::vector<Value*> arguments;
+		for(Argument& argument : function->args())
+			arguments.push_back(&argument);
+		CallInst* call = builder.CreateCall(function->getFunctionType(), target, arguments);
+		call->setCallingConv(function->getCallingConv());
+		call->setTailCallKind(CallInst::TCK_MustTail);
+		if(function->getReturnType()->isVoidTy())
+			builder.CreateRetVoid();
+		else
+			builder.CreateRet(call);
+	}
+	resolver_builder.CreateRetVoid();
+	appendToGlobalCtors(*llvm_module, resolver, 0);
+}
+
+void CodeGen::add_target_attributes() {
+	std::string cpu = m_options.target_cpu;
+	// clang marks every function with the baseline CPU, and LLVM only inlines a C function into a Kyra function that
+	// has at least the same features. The JIT and llc pick the CPU themselves.
+	if(cpu.empty() && m_options.output != Options::Output::IR && Triple(m_target_triple).getArch() == Triple::x86_64)
+		cpu = "x86-64";
+	if(cpu.empty())
+		return;
+	const bool is_native = cpu == "native";
+	if(is_native)
+		cpu = sys::getHostCPUName().str();
+	const std::string features = is_native ? Utils::get_host_features() : "";
+	for(llvm::Function& function : *llvm_module) {
+		if(function.isDeclaration())
+			continue;
+		function.addFnAttr("target-cpu", cpu);
+		if(features.empty())
+			continue;
+		// The features of a clone come last, so they win over the ones of the host
+		const std::string clone_features = function.getFnAttribute("target-features").getValueAsString().str();
+		function.addFnAttr("target-features", clone_features.empty() ? features : features + ',' + clone_features);
+	}
+}
+
+bool CodeGen::is_generating_top_level() const {
+	return ir_builder->GetInsertBlock()->getParent() == PredefFunctions::main(*llvm_module);
+}
+
+AllocaInst* CodeGen::create_entry_alloca(Type* type, const Twine& name) {
+	BasicBlock& entry = ir_builder->GetInsertBlock()->getParent()->getEntryBlock();
+	// Keep the allocas in the order they were created in
+	BasicBlock::iterator insert_point = entry.begin();
+	while(insert_point != entry.end() && isa<AllocaInst>(*insert_point))
+		++insert_point;
+	IRBuilder<> entry_builder(&entry, insert_point);
+	return entry_builder.CreateAlloca(type, nullptr, name);
+}
+
+Value* CodeGen::get_address(const Expression& expression) {
+	if(expression.get_node_kind() == TASTNode::NodeKind::Index)
+		return get_element_address(static_cast<const Index&>(expression));
+	if(expression.get_node_kind() == TASTNode::NodeKind::VarQuery) {
+		auto [variable, indirections] = get_declaration(static_cast<const VarQuery&>(expression).get_declaration_id());
+		if(indirections == 1)
+			return variable;
+	}
+	// Values that do not live in memory (e.g. returned arrays) are stored into a temporary first
+	Value* value = dispatch(expression);
+	AllocaInst* temporary = create_entry_alloca(value->getType(), "temporary");
+	ir_builder->CreateStore(value, temporary);
+	return temporary;
+}
+
+Value* CodeGen::get_element_address(const Index& index) {
+	Value* array = get_address(index.get_array());
+	const DeclaredType& array_type = index.get_array().get_type().get_declared_type();
+	Value* position = dispatch(index.get_index());
+	emit_location(index);
+	position = get_checked_index(
+		index.get_index(), position, static_cast<const Kyra::ArrayType&>(array_type).get_length());
+	return ir_builder->CreateInBoundsGEP(Utils::get_llvm_type_for(llvm_module->getContext(), array_type), array,
+		{ConstantInt::get(position->getType(), 0), position});
+}
+
+Value* CodeGen::get_checked_index(const Expression& index, Value* position, uint64_t length) {
+	const auto& index_type = static_cast<const IntType&>(index.get_type().get_declared_type());
+	// Negative indices become huge unsigned ones, so a single unsigned comparison checks both bounds
+	Type* i64 = Utils::get_integer_type(llvm_module->getContext(), 64);
+	position = index_type.is_signed() ? ir_builder->CreateSExt(position, i64) : ir_builder->CreateZExt(position, i64);
+	if(!is_in_bounds(index, position, length))
+		check_bounds(position, length);
+	return position;
+}
+
+bool CodeGen::is_in_bounds(const Expression& index, Value* position, uint64_t length) const {
+	if(const auto* constant = dyn_cast<ConstantInt>(position); constant != nullptr)
+		return constant->getZExtValue() < length;
+	if(index.get_node_kind() != TASTNode::NodeKind::VarQuery)
+		return false;
+	const auto it = m_loop_variable_bounds.find(static_cast<const VarQuery&>(index).get_declaration_id());
+	return it != m_loop_variable_bounds.end() && it->second <= length;
+}
+
+void CodeGen::check_bounds(Value* position, uint64_t length) {
+	LLVMContext& context = llvm_module->getContext();
+	llvm::Function* function = ir_builder->GetInsertBlock()->getParent();
+	Value* length_value = ConstantInt::get(position->getType(), length);
+	Value* is_in_bounds = ir_builder->CreateICmpULT(position, length_value, "bounds.check");
+	BasicBlock* in_bounds = BasicBlock::Create(context, "bounds.ok", function);
+	BasicBlock* out_of_bounds = BasicBlock::Create(context, "bounds.fail", function);
+	ir_builder->CreateCondBr(is_in_bounds, in_bounds, out_of_bounds, MDBuilder(context).createBranchWeights(2000, 1));
+
+	ir_builder->SetInsertPoint(out_of_bounds);
+	ir_builder->CreateCall(PredefFunctions::index_out_of_bounds(*llvm_module), {position, length_value});
+	ir_builder->CreateUnreachable();
+	ir_builder->SetInsertPoint(in_bounds);
+}
+
+llvm::Function* CodeGen::generate_memo_thunk(
+	llvm::Function& implementation, GlobalValue::LinkageTypes linkage, const std::string& symbol_name) {
+	LLVMContext& context = llvm_module->getContext();
+	llvm::Function* thunk =
+		llvm::Function::Create(implementation.getFunctionType(), linkage, symbol_name, *llvm_module);
+	thunk->setCallingConv(implementation.getCallingConv());
+	thunk->addFnAttr(Attribute::NoUnwind);
+	// An entry holds whether it is used, the arguments and the result. Every thread has its own table, so calls from
+	// parallel loops do not race.
+	std::vector<Type*> entry_fields = {Type::getInt1Ty(context)};
+	for(Argument& argument : thunk->args())
+		entry_fields.push_back(argument.getType());
+	entry_fields.push_back(thunk->getReturnType());
+	StructType* entry_type = StructType::get(context, entry_fields);
+	const uint64_t table_size = PowerOf2Ceil(std::max(m_options.memo_table_size, 1u));
+	llvm::ArrayType* table_type = llvm::ArrayType::get(entry_type, table_size);
+	auto* table = new GlobalVariable(*llvm_module, table_type, false, GlobalValue::PrivateLinkage,
+		Constant::getNullValue(table_type), symbol_name + ".table", nullptr, GlobalValue::GeneralDynamicTLSModel);
+
+	// The table uses open addressing with linear probing, but only probes a few entries. If all of them are used by
+	// other arguments, the result is not remembered.
+	const uint64_t probe_count = std::min<uint64_t>(table_size, 8);
+	BasicBlock* entry = BasicBlock::Create(context, "entry", thunk);
+	BasicBlock* probe = BasicBlock::Create(context, "probe", thunk);
+	BasicBlock* compare = BasicBlock::Create(context, "compare", thunk);
+	BasicBlock* next_probe = BasicBlock::Create(context, "probe.next", thunk);
+	BasicBlock* hit = BasicBlock::Create(context, "hit", thunk);
+	BasicBlock* miss = BasicBlock::Create(context, "miss", thunk);
+	BasicBlock* check_entry = BasicBlock::Create(context, "check.entry", thunk);
+	BasicBlock* remember = BasicBlock::Create(context, "remember", thunk);
+	BasicBlock* exit = BasicBlock::Create(context, "exit", thunk);
+	IRBuilder<> builder(entry);
+	Type* i64 = Utils::get_integer_type(context, 64);
+	// Fibonacci hashing, the high bits of the product depend on all bits of the arguments
+	Value* hash = ConstantInt::get(i64, 0);
+	for(Argument& argument : thunk->args()) {
+		hash = builder.CreateXor(hash, builder.CreateZExt(&argument, i64));
+		hash = builder.CreateMul(hash, ConstantInt::get(i64, 0x9E3779B97F4A7C15));
+	}
+	Value* first_index =
+		table_size == 1 ? ConstantInt::get(i64, 0) : builder.CreateLShr(hash, 64 - Log2_64(table_size));
+	builder.CreateBr(probe);
+
+	builder.SetInsertPoint(probe);
+	PHINode* probe_number = builder.CreatePHI(i64, 2, "probe.number");
+	probe_number->addIncoming(ConstantInt::get(i64, 0), entry);
+	Value* index = builder.CreateAnd(builder.CreateAdd(first_index, probe_number), table_size - 1);
+	Value* entry_address = builder.CreateInBoundsGEP(table_type, table, {ConstantInt::get(i64, 0), index});
+	const auto get_field_address = [&](unsigned field) {
+		return builder.CreateStructGEP(entry_type, entry_address, field);
+	};
+	Value* is_used = builder.CreateLoad(builder.getInt1Ty(), get_field_address(0));
+	builder.CreateCondBr(is_used, compare, miss);
+
+	builder.SetInsertPoint(compare);
+	Value* is_match = builder.getTrue();
+	for(Argument& argument : thunk->args()) {
+		Value* key = builder.CreateLoad(argument.getType(), get_field_address(argument.getArgNo() + 1));
+		is_match = builder.CreateAnd(is_match, builder.CreateICmpEQ(key, &argument));
+	}
+	builder.CreateCondBr(is_match, hit, next_probe);
+
+	builder.SetInsertPoint(next_probe);
+	Value* next_probe_number = builder.CreateAdd(probe_number, ConstantInt::get(i64, 1));
+	probe_number->addIncoming(next_probe_number, next_probe);
+	builder.CreateCondBr(builder.CreateICmpEQ(next_probe_number, ConstantInt::get(i64, probe_count)), miss, probe);
+
+	const unsigned result_field = thunk->arg_size() + 1;
+	builder.SetInsertPoint(hit);
+	builder.CreateRet(builder.CreateLoad(thunk->getReturnType(), get_field_address(result_field)));
+
+	builder.SetInsertPoint(miss);
+	PHINode* free_entry = builder.CreatePHI(entry_address->getType(), 2, "free.entry");
+	free_entry->addIncoming(entry_address, probe);
+	free_entry->addIncoming(Constant::getNullValue(entry_address->getType()), next_probe);
+	std::vector<Value*> arguments;
+	for(Argument& argument : thunk->args())
+		arguments.push_back(&argument);
+	CallInst* result = builder.CreateCall(&implementation, arguments);
+	result->setCallingConv(implementation.getCallingConv());
+	builder.CreateCondBr(builder.CreateIsNotNull(free_entry), check_entry, exit);
+
+	// A call the implementation made could have used the entry in the meantime
+	builder.SetInsertPoint(check_entry);
+	Value* is_taken = builder.CreateLoad(builder.getInt1Ty(), builder.CreateStructGEP(entry_type, free_entry, 0));
+	builder.CreateCondBr(is_taken, exit, remember);
+
+	builder.SetInsertPoint(remember);
+	for(Argument& argument : thunk->args())
+		builder.CreateStore(&argument, builder.CreateStructGEP(entry_type, free_entry, argument.getArgNo() + 1));
+	builder.CreateStore(result, builder.CreateStructGEP(entry_type, free_entry, result_field));
+	builder.CreateStore(builder.getTrue(), builder.CreateStructGEP(entry_type, free_entry, 0));
+	builder.CreateBr(exit);
+
+	builder.SetInsertPoint(exit);
+	builder.CreateRet(result);
+	return thunk;
+}
+
+void CodeGen::generate_loop(const For& for_statement, Value* begin, Value* end) {
+	const declid_t id = for_statement.get_variable();
+	const auto& type = static_cast<const IntType&>(for_statement.get_begin().get_type().get_declared_type());
+	LLVMContext& context = llvm_module->getContext();
+	llvm::Function* function = ir_builder->GetInsertBlock()->getParent();
+	BasicBlock* preheader = ir_builder->GetInsertBlock();
+	BasicBlock* header = BasicBlock::Create(context, "for.header", function);
+	BasicBlock* body = BasicBlock::Create(context, "for.body", function);
+	BasicBlock* exit = BasicBlock::Create(context, "for.exit");
+	ir_builder->CreateBr(header);
+
+	ir_builder->SetInsertPoint(header);
+	PHINode* variable = ir_builder->CreatePHI(begin->getType(), 2, m_instance.get_declarations().retrieve(id).name);
+	variable->addIncoming(begin, preheader);
+	Value* is_in_range = type.is_signed() ? ir_builder->CreateICmpSLT(variable, end, "for.condition")
+										  : ir_builder->CreateICmpULT(variable, end, "for.condition");
+	ir_builder->CreateCondBr(is_in_range, body, exit);
+
+	ir_builder->SetInsertPoint(body);
+	m_ssa_declarations.insert(id);
+	m_declarations[id] = {variable, 0};
+	describe_value(id, variable, for_statement.get_source_range().get_start().line);
+	dispatch(for_statement.get_body());
+	// The body does not loop back if it returned
+	if(ir_builder->GetInsertBlock()->getTerminator() == nullptr) {
+		// The variable is below end, so the increment cannot overflow
+		Value* next = ir_builder->CreateAdd(variable, ConstantInt::get(variable->getType(), 1), "for.next",
+			!type.is_signed(), type.is_signed());
+		variable->addIncoming(next, ir_builder->GetInsertBlock());
+		ir_builder->CreateBr(header);
+	}
+
+	function->getBasicBlockList().push_back(exit);
+	ir_builder->SetInsertPoint(exit);
+}
+
+void CodeGen::generate_parallel_loop(const For& for_statement, Value* begin, Value* end) {
+	LLVMContext& context = llvm_module->getContext();
+	const auto& type = static_cast<const IntType&>(for_statement.get_begin().get_type().get_declared_type());
+	// The body gets the first index and the locals it uses through a context. Globals and constants are used directly.
+	std::vector<declid_t> captures;
+	std::vector<Value*> context_values = {begin};
+	for(const declid_t id : m_instance.get_effect_analysis().get_parallel_captures(for_statement.get_variable())) {
+		Value* value = get_declaration(id).first;
+		if(isa<Constant>(value))
+			continue;
+		captures.push_back(id);
+		context_values.push_back(value);
+	}
+	std::vector<Type*> context_fields;
+	for(Value* value : context_values)
+		context_fields.push_back(value->getType());
+	StructType* context_type = StructType::get(context, context_fields);
+	AllocaInst* context_variable = create_entry_alloca(context_type, "parallel.context");
+	for(unsigned i = 0; i < context_values.size(); ++i)
+		ir_builder->CreateStore(context_values.at(i), ir_builder->CreateStructGEP(context_type, context_variable, i));
+
+	// The runtime hands out chunks of [0, count), which are offsets from the first index. end - begin fits into the
+	// width of the variable as an unsigned number if the range is not empty.
+	Type* i64 = Utils::get_integer_type(context, 64);
+	Value* is_empty = type.is_signed() ? ir_builder->CreateICmpSGE(begin, end) : ir_builder->CreateICmpUGE(begin, end);
+	Value* count = ir_builder->CreateZExt(ir_builder->CreateSub(end, begin), i64);
+	count = ir_builder->CreateSelect(is_empty, ConstantInt::get(i64, 0), count, "parallel.count");
+	llvm::Function* body = generate_parallel_body(for_statement, context_type, captures);
+	ir_builder->CreateCall(PredefFunctions::parallel_for(*llvm_module),
+		{count, body, ir_builder->CreateBitCast(context_variable, Type::getInt8PtrTy(context))});
+}
+
+llvm::Function* CodeGen::generate_parallel_body(
+	const For& for_statement, StructType* context_type, const std::vector<declid_t>& captures) {
+	LLVMContext& context = llvm_module->getContext();
+	llvm::Function* caller = ir_builder->GetInsertBlock()->getParent();
+	llvm::Function* body = llvm::Function::Create(PredefFunctions::parallel_body_type(context),
+		GlobalValue::InternalLinkage, caller->getName() + ".parallel", *llvm_module);
+	body->addFnAttr(Attribute::NoUnwind);
+	body->getArg(0)->setName("first");
+	body->getArg(1)->setName("last");
+	body->getArg(2)->setName("context");
+
+	const DebugLoc caller_location = ir_builder->getCurrentDebugLocation();
+	if(di_builder != nullptr) {
+		const unsigned line = for_statement.get_source_range().get_start().line;
+		m_debug_scopes.push_back(create_debug_function(body->getName(), *body, line, {}));
+	}
+	// The captured declarations refer to the values loaded from the context while the body is generated
+	std::vector<std::pair<Value*, unsigned>> caller_declarations;
+	BasicBlock* entry = BasicBlock::Create(context);
+	body->getBasicBlockList().push_back(entry);
+	Utils::generate_on_basic_block(
+		*ir_builder, entry,
+		[&]() {
+			emit_location(for_statement);
+			Value* context_variable = ir_builder->CreateBitCast(body->getArg(2), context_type->getPointerTo());
+			const auto load_field = [&](unsigned index) -> Value* {
+				return ir_builder->CreateLoad(context_type->getElementType(index),
+					ir_builder->CreateStructGEP(context_type, context_variable, index));
+			};
+			for(unsigned i = 0; i < captures.size(); ++i) {
+				std::pair<Value*, unsigned>& declaration = m_declarations.at(captures.at(i));
+				caller_declarations.push_back(declaration);
+				declaration.first = load_field(i + 1);
+			}
+			Value* begin = load_field(0);
+			Value* first = ir_builder->CreateAdd(begin, ir_builder->CreateTrunc(body->getArg(0), begin->getType()));
+			Value* last = ir_builder->CreateAdd(begin, ir_builder->CreateTrunc(body->getArg(1), begin->getType()));
+			generate_loop(for_statement, first, last);
+			ir_builder->CreateRetVoid();
+		},
+		true);
+	for(unsigned i = 0; i < captures.size(); ++i)
+		m_declarations.at(captures.at(i)) = caller_declarations.at(i);
+
+	if(di_builder != nullptr)
+		m_debug_scopes.pop_back();
+	ir_builder->SetCurrentDebugLocation(caller_location);
+	return body;
+}
+
+void CodeGen::emit_location(const TASTNode& node) {
+	if(di_builder == nullptr)
+		return;
+	const SourceRange::Position& start = node.get_source_range().get_start();
+	ir_builder->SetCurrentDebugLocation(
+		DILocation::get(*llvm_context, start.line, start.index - start.line_start_index + 1, m_debug_scopes.back()));
+}
+
+DIType* CodeGen::get_debug_type(const DeclaredType& type) {
+	switch(type.get_kind()) {
+		case DeclaredType::Integer:
+			return di_builder->createBasicType(type.get_name(), static_cast<const IntType&>(type).get_width(),
+				static_cast<const IntType&>(type).is_signed() ? dwarf::DW_ATE_signed : dwarf::DW_ATE_unsigned);
+		case DeclaredType::Array: {
+			const auto& array_type = static_cast<const Kyra::ArrayType&>(type);
+			DIType* element_type = get_debug_type(*array_type.get_element_type());
+			const uint64_t size = element_type->getSizeInBits() * array_type.get_length();
+			return di_builder->createArrayType(size, 0, element_type,
+				di_builder->getOrCreateArray({di_builder->getOrCreateSubrange(0, array_type.get_length())}));
+		}
+		case DeclaredType::Vector: {
+			const auto& vector_type = static_cast<const VectorType&>(type);
+			DIType* element_type = get_debug_type(*vector_type.get_element_type());
+			const uint64_t size = element_type->getSizeInBits() * vector_type.get_lanes();
+			return di_builder->createVectorType(size, 0, element_type,
+				di_builder->getOrCreateArray({di_builder->getOrCreateSubrange(0, vector_type.get_lanes())}));
+		}
+		case DeclaredType::Function:
+		default: assert_not_reached();
+	}
+}
+
+DISubprogram* CodeGen::create_debug_function(std::string_view name, llvm::Function& function, unsigned line,
+	const std::vector<RefPtr<DeclaredType>>& signature) {
+	std::vector<Metadata*> types;
+	// Line tables do not need any type information
+	if(m_options.debug_info == Options::DebugInfo::Full) {
+		for(const RefPtr<DeclaredType>& type : signature)
+			types.push_back(get_debug_type(*type));
+	}
+	DISubroutineType* function_type = di_builder->createSubroutineType(di_builder->getOrCreateTypeArray(types));
+	DISubprogram::DISPFlags flags = DISubprogram::SPFlagDefinition;
+	if(function.hasLocalLinkage())
+		flags |= DISubprogram::SPFlagLocalToUnit;
+	DISubprogram* subprogram = di_builder->createFunction(m_debug_file, name, function.getName(), m_debug_file, line,
+		function_type, line, DINode::FlagPrototyped, flags);
+	function.setSubprogram(subprogram);
+	return subprogram;
+}
+
+void CodeGen::describe_value(declid_t declaration, Value* value, unsigned line, unsigned argument_number) {
+	if(m_options.debug_info != Options::DebugInfo::Full)
+		return;
+	DILocalVariable*& variable = m_debug_variables[declaration];
+	if(variable == nullptr) {
+		auto [name, type] = m_instance.get_declarations().retrieve(declaration);
+		DIType* debug_type = get_debug_type(type->get_declared_type());
+		if(argument_number > 0) {
+			variable = di_builder->createParameterVariable(
+				m_debug_scopes.back(), name, argument_number, m_debug_file, line, debug_type);
+		} else
+			variable = di_builder->createAutoVariable(m_debug_scopes.back(), name, m_debug_file, line, debug_type);
+	}
+	di_builder->insertDbgValueIntrinsic(value, variable, di_builder->createExpression(),
+		ir_builder->getCurrentDebugLocation().get(), ir_builder->GetInsertBlock());
+}
+
+void CodeGen::describe_variable(declid_t declaration, Value* variable, unsigned line) {
+	if(m_options.debug_info != Options::DebugInfo::Full)
+		return;
+	auto [name, type] = m_instance.get_declarations().retrieve(declaration);
+	DIType* debug_type = get_debug_type(type->get_declared_type());
+	if(GlobalVariable* global = dyn_cast<GlobalVariable>(variable); global != nullptr) {
+		global->addDebugInfo(di_builder->createGlobalVariableExpression(
+			m_debug_file, name, global->getName(), m_debug_file, line, debug_type, global->hasLocalLinkage()));
+		return;
+	}
+	DILocalVariable* local =
+		di_builder->createAutoVariable(m_debug_scopes.back(), name, m_debug_file, line, debug_type);
+	di_builder->insertDeclare(variable, local, di_builder->createExpression(),
+		ir_builder->getCurrentDebugLocation().get(), ir_builder->GetInsertBlock());
+}
+
+void CodeGen::instrument_entry(const llvm::Function& function, std::string display_name) {
+	const unsigned index = m_instrumented_function_names.size();
+	m_instrumented_function_names.push_back(std::move(display_name));
+	m_instrumented_functions.try_emplace(&function, index);
+	// The runtime only knows about the functions once main started, so main is entered in start_instrumentation
+	if(&function == PredefFunctions::main(*llvm_module))
+		return;
+	ir_builder->CreateCall(PredefFunctions::instrument_enter(*llvm_module),
+		{Utils::get_integer_constant(*llvm_module, index, C_INT_BIT_WIDTH)});
+}
+
+void CodeGen::instrument_exit() {
+	if(!m_options.instrument_functions)
+		return;
+	const unsigned index = m_instrumented_functions.at(ir_builder->GetInsertBlock()->getParent());
+	ir_builder->CreateCall(PredefFunctions::instrument_exit(*llvm_module),
+		{Utils::get_integer_constant(*llvm_module, index, C_INT_BIT_WIDTH)});
+}
+
+void CodeGen::start_instrumentation(BasicBlock& main_entry) {
+	PointerType* string_type = Utils::get_ptr_type(Type::getInt8Ty(*llvm_context));
+	std::vector<Constant*> names;
+	for(const std::string& name : m_instrumented_function_names)
+		names.push_back(Utils::construct_string(*llvm_module, name, "kyra.instrument.name"));
+	llvm::ArrayType* name_table_type = llvm::ArrayType::get(string_type, names.size());
+	GlobalVariable* name_table = new GlobalVariable(*llvm_module, name_table_type, true,
+		GlobalValue::PrivateLinkage, ConstantArray::get(name_table_type, names), "kyra.instrument.names");
+
+	// The number of functions is only known once everything was generated
+	IRBuilder<> entry_builder(&main_entry, main_entry.begin());
+	entry_builder.SetCurrentDebugLocation(ir_builder->getCurrentDebugLocation());
+	Value* count = Utils::get_integer_constant(*llvm_module, names.size(), C_INT_BIT_WIDTH);
+	Value* name_table_ptr = entry_builder.CreateConstInBoundsGEP2_32(name_table_type, name_table, 0, 0);
+	entry_builder.CreateCall(PredefFunctions::instrument_start(*llvm_module), {count, name_table_ptr});
+	const unsigned main_index = m_instrumented_functions.at(main_entry.getParent());
+	entry_builder.CreateCall(PredefFunctions::instrument_enter(*llvm_module),
+		{Utils::get_integer_constant(*llvm_module, main_index, C_INT_BIT_WIDTH)});
 }
 
 }
@@ -1,54 +1,185 @@
 #pragma once
 
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
 
+#include <filesystem>
 #include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "Aliases.hpp"
+#include "FunctionCache.hpp"
 #include "TAST.hpp"
 #include "Type.hpp"
 
 namespace Kyra {
+class CompilerInstance;
 
-class CodeGen : public Typed::TASTVisitor {
-	VISIT_RETURN_TYPE(llvm::Value*)
-
+class CodeGen : public Typed::TASTVisitor<CodeGen, void, llvm::Value*> {
 public:
-	static CodeGen& the() {
-		static CodeGen instance;
-		return instance;
-	}
+	struct Options {
+		enum class DebugInfo { None, LineTablesOnly, Full };
+		enum class Output { IR, Bitcode, ThinLTOBitcode };
+
+		DebugInfo debug_info{DebugInfo::None};
+		// Count and time every call of a Kyra function, see Runtime/Instrument.ll
+		bool instrument_functions{false};
+		// Entries in the result table of every memoized function (one table per thread), rounded up to a power of two
+		unsigned memo_table_size{4096};
+		// Only check and generate the bodies of functions that are reachable from the top-level code, see TypeChecker
+		bool lazy{false};
+		// Load the typed AST of an unchanged module from its cache instead of checking it again, see TypedASTCache
+		bool cache_typed_ast{false};
+		// The module is an entry of the REPL. Everything it declares on the top-level is exported, so the later entries
+		// (which are modules of their own) can use it, and its top-level code is run by the name of the module.
+		bool repl{false};
+		// The architecture of the target triple (e.g. aarch64), empty for the one of the host
+		std::string target_architecture;
+		// The CPU functions are generated for (e.g. skylake), native for the one of the host and empty for the baseline
+		// of the architecture
+		std::string target_cpu;
+		// The x86-64 feature levels (sse4.2, avx2 or avx512) hot functions are cloned for. Calls of such a function go
+		// through a pointer, which is set to the best clone the machine supports once the program is loaded.
+		std::vector<std::string> multiversion_levels;
+		// What a compiled module is written as. Bitcode can be linked with C that was compiled by clang -flto (or
+		// -flto=thin for ThinLTOBitcode), so LLVM can inline across both languages.
+		Output output{Output::IR};
+	};
+
+	// Makes all architectures LLVM was built with available as targets
+	static void initialize_targets();
+	// Whether the target the options describe exists and supports the feature levels
+	static bool check_target(const Options& options, std::ostream& error_output);
 
-	CodeGen() = default;
+	explicit CodeGen(CompilerInstance& instance);
 	CodeGen(const CodeGen&) = delete;
-	CodeGen(CodeGen&&) noexcept = default;
+	CodeGen(CodeGen&&) = delete;
 
 	CodeGen& operator=(const CodeGen&) = delete;
-	CodeGen& operator=(CodeGen&&) noexcept = default;
+	CodeGen& operator=(CodeGen&&) = delete;
 
-	void gen_code(const std::vector<RefPtr<Typed::Statement>>& statements);
+	void gen_code(const std::vector<RefPtr<Typed::Statement>>& statements, const std::filesystem::path& file_path,
+		const Options& options);
+	void print_module(llvm::raw_ostream& output) const;
+	// Includes the summary the linker needs for (Thin)LTO
+	void write_bitcode(llvm::raw_ostream& output) const;
+	// Hands the generated module over, e.g. to a JIT. The context stays shared with this CodeGen, so the module must not
+	// be touched while the next one is generated.
+	llvm::orc::ThreadSafeModule take_module();
+	// The runtime as a module of its own. Entries of the REPL only declare the parts they use, so it is compiled once
+	// for the whole session instead of once per entry.
+	llvm::orc::ThreadSafeModule generate_runtime();
 
-	void visit(const Typed::ExpressionStatement& expresion_statement) override;
-	void visit(const Typed::Declaration& declaration) override;
-	void visit(const Typed::Function& function) override;
-	void visit(const Typed::Print& print_statement) override;
-	void visit(const Typed::Return& return_statement) override;
-	void visit(const Typed::Block& block) override;
-	void visit(const Typed::IntLiteral& literal) override;
+	void visit(const Typed::ExpressionStatement& expresion_statement);
+	void visit(const Typed::Declaration& declaration);
+	void visit(const Typed::Function& function);
+	void visit(const Typed::ExternalFunction& external_function);
+	void visit(const Typed::Print& print_statement);
+	void visit(const Typed::Return& return_statement);
+	void visit(const Typed::Block& block);
+	void visit(const Typed::For& for_statement);
+	llvm::Value* visit(const Typed::IntLiteral& literal);
+	llvm::Value* visit(const Typed::ArrayLiteral& array_literal);
 
-	void visit(const Typed::Assignment& assignment) override;
-	void visit(const Typed::BinaryExpression& binary_expression) override;
-	void visit(const Typed::Call& call) override;
-	void visit(const Typed::VarQuery& var_query) override;
+	llvm::Value* visit(const Typed::Assignment& assignment);
+	llvm::Value* visit(const Typed::IndexAssignment& index_assignment);
+	llvm::Value* visit(const Typed::BinaryExpression& binary_expression);
+	llvm::Value* visit(const Typed::Call& call);
+	llvm::Value* visit(const Typed::Conversion& conversion);
+	llvm::Value* visit(const Typed::VectorOperation& vector_operation);
+	llvm::Value* visit(const Typed::Index& index);
+	llvm::Value* visit(const Typed::VarQuery& var_query);
 
 private:
-	OwnPtr<llvm::LLVMContext> llvm_context;
+	CompilerInstance& m_instance;
+	Options m_options;
+	// Symbol names are mangled with the name of the module
+	std::string m_module_name;
+	bool m_is_library{false};
+	llvm::orc::ThreadSafeContext m_llvm_context;
+	llvm::LLVMContext* llvm_context;
 	OwnPtr<llvm::Module> llvm_module;
+	// Parsed once per context and copied into every module
+	OwnPtr<llvm::Module> m_runtime;
+	// The data layout of the last target triple, which takes a target machine to find out
+	std::string m_target_triple;
+	std::string m_data_layout;
 	OwnPtr<llvm::IRBuilder<>> ir_builder;
+	// Only present if debug info is emitted
+	OwnPtr<llvm::DIBuilder> di_builder;
 
 	std::map<declid_t, std::pair<llvm::Value*, unsigned>> m_declarations;
+	// The symbols of everything the entries of the REPL declared on the top-level, kept for all later entries
+	std::map<declid_t, std::string> m_exported_symbols;
+	// Called with the C calling convention, kept like the exported symbols
+	std::set<declid_t> m_c_functions;
+	// Declarations whose current value is tracked directly instead of being stored in memory
+	std::set<declid_t> m_ssa_declarations;
+	// Loop variables that are known to stay below a bound, so indexing with them needs no bounds check
+	std::map<declid_t, uint64_t> m_loop_variable_bounds;
+	// While a function that is kept in the FunctionCache is generated, everything with a smaller id is declared outside
+	// of it (0 otherwise). The code of the function is connected to the outside declarations it uses again once it is
+	// reused.
+	declid_t m_first_function_declaration{0};
+	std::set<declid_t> m_outside_declarations;
+
+	llvm::DIFile* m_debug_file{nullptr};
+	std::vector<llvm::DIScope*> m_debug_scopes;
+	std::map<declid_t, llvm::DILocalVariable*> m_debug_variables;
+
+	// The index of an instrumented function is its position in the name table that is handed to the runtime
+	std::vector<std::string> m_instrumented_function_names;
+	std::map<const llvm::Function*, unsigned> m_instrumented_functions;
+
+	// Declarations of earlier entries of the REPL are declared in the module when they are first used
+	std::pair<llvm::Value*, unsigned>& get_declaration(declid_t id);
+	bool is_generating_top_level() const;
+	// Allocas in the entry block are only allocated once per call, even if they are created inside of a loop
+	llvm::AllocaInst* create_entry_alloca(llvm::Type* type, const llvm::Twine& name);
+	llvm::Value* get_address(const Typed::Expression& expression);
+	llvm::Value* get_element_address(const Typed::Index& index);
+	// Widens the index to 64 bits and checks it against the length, unless it is known to be in bounds
+	llvm::Value* get_checked_index(const Typed::Expression& index, llvm::Value* position, uint64_t length);
+	bool is_in_bounds(const Typed::Expression& index, llvm::Value* position, uint64_t length) const;
+	void check_bounds(llvm::Value* position, uint64_t length);
+	// Wraps the implementation of a memoized function into a function that looks the arguments up in a table first
+	// Copies the generated function and everything it created (e.g. the bodies of its parallel loops) into its entry.
+	// Nothing is kept if it uses something that cannot be resolved again, e.g. a runtime function it cannot declare.
+	void store_function_code(declid_t function, llvm::Function& implementation, FunctionCache::Entry& entry,
+		llvm::Function& last_function, llvm::GlobalVariable* last_variable);
+	// Inserts the code of the entry into the module. If a declaration it uses changed (e.g. a constant that has another
+	// value now), the function is only declared and the cache is told to compile the module again.
+	void reuse_function_code(const Typed::Function& function, const FunctionCache::ReusedFunction& reused_function);
+	llvm::Function* generate_memo_thunk(
+		llvm::Function& implementation, llvm::GlobalValue::LinkageTypes linkage, const std::string& symbol_name);
+	void generate_loop(const Typed::For& for_statement, llvm::Value* begin, llvm::Value* end);
+	// Outlines the body into a function that runs a chunk of the iterations and hands it to the runtime
+	void generate_parallel_loop(const Typed::For& for_statement, llvm::Value* begin, llvm::Value* end);
+	llvm::Function* generate_parallel_body(const Typed::For& for_statement, llvm::StructType* context_type,
+		const std::vector<declid_t>& captures);
+
+	// Clones the functions with loops or vector operations for every feature level and turns the originals into
+	// trampolines that call the clone a resolver picked before main
+	void multiversion_hot_functions();
+	void add_target_attributes();
+
+	void emit_location(const Typed::TASTNode& node);
+	llvm::DIType* get_debug_type(const DeclaredType& type);
+	llvm::DISubprogram* create_debug_function(std::string_view name, llvm::Function& function, unsigned line,
+		const std::vector<RefPtr<DeclaredType>>& signature);
+	void describe_value(declid_t declaration, llvm::Value* value, unsigned line, unsigned argument_number = 0);
+	void describe_variable(declid_t declaration, llvm::Value* variable, unsigned line);
+
+	void instrument_entry(const llvm::Function& function, std::string display_name);
+	void instrument_exit();
+	void start_instrumentation(llvm::BasicBlock& main_entry);
 };
 }
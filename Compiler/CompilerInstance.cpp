@@ -0,0 +1,285 @@
+#include "CompilerInstance.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "AST.hpp"
+#include "TAST.hpp"
+#include "Token.hpp"
+
+namespace Kyra {
+
+CompilerInstance::CompilerInstance(RefPtr<TypeScope> builtin_scope) :
+	m_builtin_scope(std::move(builtin_scope)), m_type_checker(*this), m_code_gen(*this) {}
+
+bool CompilerInstance::compile(const std::filesystem::path& file_path, std::string source,
+	const CodeGen::Options& options, llvm::raw_ostream& output, std::ostream& error_output) {
+	if(!generate(file_path, std::move(source), options, error_output))
+		return false;
+	if(options.output == CodeGen::Options::Output::IR)
+		m_code_gen.print_module(output);
+	else
+		m_code_gen.write_bitcode(output);
+	return true;
+}
+
+std::optional<int> CompilerInstance::run(const std::filesystem::path& file_path, std::string source,
+	const CodeGen::Options& options, const JIT::Environment& environment, std::ostream& error_output) {
+	std::vector<llvm::orc::ThreadSafeModule> modules;
+	std::set<std::filesystem::path> generated_paths;
+	if(!generate_with_imports(file_path, std::move(source), options, modules, generated_paths, error_output))
+		return {};
+	const TimeTrace::Scope scope(m_time_trace, "Phase", "Running");
+	return JIT::run(std::move(modules), environment);
+}
+
+std::optional<llvm::orc::ThreadSafeModule> CompilerInstance::generate_module(const std::filesystem::path& file_path,
+	std::string source, const CodeGen::Options& options, std::ostream& error_output, FunctionCache* function_cache) {
+	// Debug info and instrumentation refer to where a function is in the module, which changes with every edit
+	if(options.debug_info != CodeGen::Options::DebugInfo::None || options.instrument_functions)
+		function_cache = nullptr;
+	if(function_cache == nullptr) {
+		if(!generate(file_path, std::move(source), options, error_output))
+			return {};
+		return m_code_gen.take_module();
+	}
+
+	m_function_cache = function_cache;
+	function_cache->start_compilation(true);
+	std::ostringstream diagnostics;
+	bool successful = generate(file_path, source, options, diagnostics);
+	// Reused functions are not checked, so an error they are involved in (e.g. a race with a changed callee) is only
+	// reported where a fresh compilation would report it if everything is compiled again
+	if(!function_cache->get_reused_summaries().empty() && (!successful || function_cache->has_rejected_functions())) {
+		function_cache->start_compilation(false);
+		diagnostics.str("");
+		successful = generate(file_path, std::move(source), options, diagnostics);
+	}
+	error_output << diagnostics.str();
+	if(successful)
+		function_cache->finish_compilation();
+	m_function_cache = nullptr;
+	if(!successful)
+		return {};
+	return m_code_gen.take_module();
+}
+
+std::vector<std::filesystem::path> CompilerInstance::get_imported_interfaces() const {
+	std::vector<std::filesystem::path> paths;
+	for(const auto& [interface_path, interface] : m_interfaces)
+		paths.push_back(interface_path);
+	return paths;
+}
+
+bool CompilerInstance::generate_with_imports(const std::filesystem::path& file_path, std::string source,
+	const CodeGen::Options& options, std::vector<llvm::orc::ThreadSafeModule>& modules,
+	std::set<std::filesystem::path>& generated_paths, std::ostream& error_output) {
+	generated_paths.insert(file_path);
+	if(!generate(file_path, std::move(source), options, error_output))
+		return false;
+	modules.push_back(m_code_gen.take_module());
+	return generate_imports(options, modules, generated_paths, error_output);
+}
+
+bool CompilerInstance::generate_entry(const std::filesystem::path& file_path, std::string source,
+	const RefPtr<TypeScope>& scope, std::vector<llvm::orc::ThreadSafeModule>& modules,
+	std::set<std::filesystem::path>& generated_paths, std::ostream& error_output) {
+	// Unlike generate, everything of the earlier entries is kept, as the later ones refer to it
+	const std::string_view stored_source = m_sources.emplace_back(std::move(source));
+	m_sources_by_path[file_path] = stored_source;
+	ErrorOr<std::vector<Token>> error_or_tokens = m_lexer.scan_input(stored_source, file_path);
+	if(error_or_tokens.is_error()) {
+		print_error(error_or_tokens.get_exception(), error_output);
+		return false;
+	}
+	const std::vector<Token> tokens = std::move(error_or_tokens).get_result();
+	ErrorOr<std::vector<RefPtr<Untyped::Statement>>> error_or_statements = m_parser.parse_tokens(tokens);
+	if(error_or_statements.is_error()) {
+		print_error(error_or_statements.get_exception(), error_output);
+		return false;
+	}
+	ErrorOr<std::vector<RefPtr<Typed::Statement>>> error_or_typed_statements =
+		m_type_checker.check_entry(std::move(error_or_statements).get_result(), scope);
+	if(error_or_typed_statements.is_error()) {
+		print_error(error_or_typed_statements.get_exception(), error_output);
+		return false;
+	}
+
+	CodeGen::Options options;
+	options.repl = true;
+	m_code_gen.gen_code(error_or_typed_statements.get_result(), file_path, options);
+	modules.push_back(m_code_gen.take_module());
+	// Imported modules are libraries, which are generated as usual
+	return generate_imports({}, modules, generated_paths, error_output);
+}
+
+bool CompilerInstance::generate_imports(const CodeGen::Options& options,
+	std::vector<llvm::orc::ThreadSafeModule>& modules, std::set<std::filesystem::path>& generated_paths,
+	std::ostream& error_output) {
+	for(const auto& [interface_path, interface] : m_interfaces) {
+		const std::filesystem::path source_path = std::filesystem::path(interface_path).replace_extension(".ky");
+		if(generated_paths.contains(source_path))
+			continue;
+		std::ifstream input(source_path);
+		if(!input) {
+			error_output << "Could not read the imported module " << source_path << '\n';
+			return false;
+		}
+		std::string imported_source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+		CompilerInstance instance(m_builtin_scope);
+		if(!instance.generate_with_imports(
+			   source_path, std::move(imported_source), options, modules, generated_paths, error_output))
+			return false;
+	}
+	return true;
+}
+
+bool CompilerInstance::generate(const std::filesystem::path& file_path, std::string source,
+	const CodeGen::Options& options, std::ostream& error_output) {
+	// Nothing of a previous compilation is referenced anymore
+	m_declarations = DeclarationDumpster();
+	m_typed_ast_cache.reset();
+	m_sources.clear();
+	m_sources_by_path.clear();
+	m_interfaces.clear();
+	const std::string_view stored_source = m_sources.emplace_back(std::move(source));
+	m_sources_by_path[file_path] = stored_source;
+
+	std::vector<RefPtr<Typed::Statement>> typed_statements;
+	if(options.cache_typed_ast && load_typed_ast_cache(file_path, stored_source, options)) {
+		m_declarations = m_typed_ast_cache->take_declarations();
+		typed_statements = m_typed_ast_cache->take_statements();
+	} else {
+		// Every phase hands its output on to the next one. The tokens and the untyped AST (which refers to the tokens)
+		// are freed once the program is type checked.
+		ErrorOr<std::vector<Token>> error_or_tokens = [&]() {
+			const TimeTrace::Scope scope(m_time_trace, "Phase", "Lexing");
+			return m_lexer.scan_input(stored_source, file_path);
+		}();
+		if(error_or_tokens.is_error()) {
+			print_error(error_or_tokens.get_exception(), error_output);
+			return false;
+		}
+		const std::vector<Token> tokens = std::move(error_or_tokens).get_result();
+
+		ErrorOr<std::vector<RefPtr<Untyped::Statement>>> error_or_statements = [&]() {
+			const TimeTrace::Scope scope(m_time_trace, "Phase", "Parsing");
+			return m_parser.parse_tokens(tokens);
+		}();
+		if(error_or_statements.is_error()) {
+			print_error(error_or_statements.get_exception(), error_output);
+			return false;
+		}
+
+		ErrorOr<std::vector<RefPtr<Typed::Statement>>> error_or_typed_statements = [&]() {
+			const TimeTrace::Scope scope(m_time_trace, "Phase", "Type checking");
+			return m_type_checker.check_statements(std::move(error_or_statements).get_result(), options.lazy);
+		}();
+		if(error_or_typed_statements.is_error()) {
+			print_error(error_or_typed_statements.get_exception(), error_output);
+			return false;
+		}
+		typed_statements = std::move(error_or_typed_statements).get_result();
+		// Reused functions have no implementation in the typed AST, so it could not be loaded by itself
+		const bool has_reused_functions =
+			m_function_cache != nullptr && !m_function_cache->get_reused_summaries().empty();
+		if(options.cache_typed_ast && !has_reused_functions) {
+			const TimeTrace::Scope scope(m_time_trace, "Phase", "Writing typed AST");
+			// Without a cache the next compilation only takes longer
+			TypedASTCache::write(TypedASTCache::get_path_for(file_path), stored_source, options.lazy,
+				get_imported_interfaces(), typed_statements, m_declarations);
+		}
+	}
+
+	const TimeTrace::Scope scope(m_time_trace, "Phase", "Code generation");
+	m_code_gen.gen_code(typed_statements, file_path, options);
+	if(ModuleInterface::is_library(typed_statements))
+		return write_interface(file_path, typed_statements, error_output);
+	return true;
+}
+
+bool CompilerInstance::load_typed_ast_cache(
+	const std::filesystem::path& file_path, std::string_view source, const CodeGen::Options& options) {
+	const TimeTrace::Scope scope(m_time_trace, "Phase", "Loading typed AST");
+	std::optional<TypedASTCache> cache = TypedASTCache::load(
+		TypedASTCache::get_path_for(file_path), source, options.lazy, file_path, *m_builtin_scope);
+	if(!cache.has_value())
+		return false;
+	// The interfaces are loaded as if the module was type checked, so its imports can still be generated to run it
+	for(const std::filesystem::path& interface_path : cache->get_interface_paths()) {
+		if(load_interface(interface_path) == nullptr) {
+			m_interfaces.clear();
+			return false;
+		}
+	}
+	m_typed_ast_cache.emplace(std::move(*cache));
+	return true;
+}
+
+bool CompilerInstance::write_interface(const std::filesystem::path& file_path,
+	const std::vector<RefPtr<Typed::Statement>>& statements, std::ostream& error_output) {
+	std::vector<ModuleInterface::Function> functions;
+	for(const RefPtr<Typed::Statement>& statement : statements) {
+		// Imported functions are not exported again
+		if(statement->get_node_kind() != Typed::TASTNode::NodeKind::Function)
+			continue;
+		const auto* function = static_cast<const Typed::Function*>(statement.get());
+		const declid_t id = function->get_function_declaration_id();
+		const DeclarationDumpster::Element& declaration = m_declarations.retrieve(id);
+		functions.push_back({declaration.name,
+			std::static_pointer_cast<FunctionType>(declaration.type->get_declared_type_shared()),
+			m_effect_analysis.get_function_info(id).effects});
+	}
+	const std::filesystem::path interface_path = ModuleInterface::get_path_for(file_path);
+	if(!ModuleInterface::write(interface_path, file_path.stem().string(), functions)) {
+		error_output << "Could not write the module interface " << interface_path << '\n';
+		return false;
+	}
+	return true;
+}
+
+void CompilerInstance::print_error(const ErrorException& exception, std::ostream& stream) {
+	const std::filesystem::path& file_path = exception.get_source_range().get_file_path();
+	auto it = m_sources_by_path.find(file_path);
+	if(it == m_sources_by_path.end()) {
+		std::ifstream input(file_path);
+		const std::string& source = m_sources.emplace_back(
+			(std::istreambuf_iterator<char>(input)), (std::istreambuf_iterator<char>()));
+		it = m_sources_by_path.try_emplace(file_path, source).first;
+	}
+	exception.print(stream, it->second);
+}
+
+const ModuleInterface* CompilerInstance::load_interface(const std::filesystem::path& path) {
+	if(auto it = m_interfaces.find(path); it != m_interfaces.end())
+		return &it->second;
+	std::optional<ModuleInterface> interface = ModuleInterface::load(path, *m_builtin_scope);
+	if(!interface.has_value())
+		return nullptr;
+	return &m_interfaces.emplace(path, std::move(*interface)).first->second;
+}
+
+std::string_view CompilerInstance::get_source_text(const SourceRange& source_range) const {
+	const size_t start = source_range.get_start().index;
+	return m_sources_by_path.at(source_range.get_file_path()).substr(start, source_range.get_end().index - start);
+}
+
+Lexer& CompilerInstance::get_lexer() { return m_lexer; }
+
+Parser& CompilerInstance::get_parser() { return m_parser; }
+
+TypeChecker& CompilerInstance::get_type_checker() { return m_type_checker; }
+
+EffectAnalysis& CompilerInstance::get_effect_analysis() { return m_effect_analysis; }
+
+CodeGen& CompilerInstance::get_code_gen() { return m_code_gen; }
+
+DeclarationDumpster& CompilerInstance::get_declarations() { return m_declarations; }
+
+TimeTrace& CompilerInstance::get_time_trace() { return m_time_trace; }
+
+RefPtr<TypeScope> CompilerInstance::get_builtin_scope() const { return m_builtin_scope; }
+
+FunctionCache* CompilerInstance::get_function_cache() { return m_function_cache; }
+}
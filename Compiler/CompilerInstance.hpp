@@ -0,0 +1,118 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <filesystem>
+#include <list>
+#include <map>
+#include <optional>
+#include <set>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "CodeGen.hpp"
+#include "EffectAnalysis.hpp"
+#include "Error.hpp"
+#include "FunctionCache.hpp"
+#include "JIT.hpp"
+#include "Lexer.hpp"
+#include "ModuleInterface.hpp"
+#include "Parser.hpp"
+#include "TimeTrace.hpp"
+#include "Type.hpp"
+#include "TypeChecker.hpp"
+#include "TypedASTCache.hpp"
+
+namespace Kyra {
+
+// Owns all state of a compilation. Instances do not share anything but the builtin types, so each of them can be used by
+// a different thread at the same time. An instance can be reused for further compilations, which saves setting up LLVM
+// and the builtin types again.
+class CompilerInstance {
+public:
+	// Builtin types are never modified, so instances (even on different threads) can share them
+	explicit CompilerInstance(RefPtr<TypeScope> builtin_scope = TypeScope::create_builtin_scope());
+	CompilerInstance(const CompilerInstance&) = delete;
+	CompilerInstance(CompilerInstance&&) = delete;
+
+	CompilerInstance& operator=(const CompilerInstance&) = delete;
+	CompilerInstance& operator=(CompilerInstance&&) = delete;
+
+	// Runs all phases and prints the generated module to the output. Errors are printed to the error output.
+	bool compile(const std::filesystem::path& file_path, std::string source, const CodeGen::Options& options,
+		llvm::raw_ostream& output, std::ostream& error_output);
+	// Compiles the source and all modules it imports and runs it right away. Returns the exit code of the program, or
+	// nothing if it did not compile.
+	std::optional<int> run(const std::filesystem::path& file_path, std::string source, const CodeGen::Options& options,
+		const JIT::Environment& environment, std::ostream& error_output);
+	// Runs all phases and hands the generated module over, e.g. to keep it for later. The modules it imports are not
+	// generated. Returns nothing if it did not compile. The unchanged functions of the last compilation the function
+	// cache saw are reused, unless the module is generated with debug info or instrumentation.
+	std::optional<llvm::orc::ThreadSafeModule> generate_module(const std::filesystem::path& file_path,
+		std::string source, const CodeGen::Options& options, std::ostream& error_output,
+		FunctionCache* function_cache = nullptr);
+	// Generates an entry of the REPL, which can use everything the earlier entries declared in the scope. Its module is
+	// added to the modules, followed by the modules it imports that are not generated yet. An entry that does not
+	// compile declares nothing. The instance must not be used for anything else in between entries.
+	bool generate_entry(const std::filesystem::path& file_path, std::string source, const RefPtr<TypeScope>& scope,
+		std::vector<llvm::orc::ThreadSafeModule>& modules, std::set<std::filesystem::path>& generated_paths,
+		std::ostream& error_output);
+	// The interfaces of all modules the last compilation imported
+	std::vector<std::filesystem::path> get_imported_interfaces() const;
+
+	// Errors can only be printed for sources this instance compiled or that can still be read from disk
+	void print_error(const ErrorException& exception, std::ostream& stream);
+	// Interfaces are loaded once per compilation. Returns nullptr if there is no valid interface at the path.
+	const ModuleInterface* load_interface(const std::filesystem::path& path);
+	// The part of a source this instance compiled that the range covers
+	std::string_view get_source_text(const SourceRange& source_range) const;
+
+	Lexer& get_lexer();
+	Parser& get_parser();
+	TypeChecker& get_type_checker();
+	EffectAnalysis& get_effect_analysis();
+	CodeGen& get_code_gen();
+	DeclarationDumpster& get_declarations();
+	TimeTrace& get_time_trace();
+	RefPtr<TypeScope> get_builtin_scope() const;
+	// nullptr unless the current compilation uses a function cache
+	FunctionCache* get_function_cache();
+
+private:
+	TimeTrace m_time_trace;
+	DeclarationDumpster m_declarations;
+	RefPtr<TypeScope> m_builtin_scope;
+	// Tokens and declarations refer to the sources, so they have to stay alive as long as the instance
+	std::list<std::string> m_sources;
+	std::map<std::filesystem::path, std::string_view> m_sources_by_path;
+	// Declarations of imported functions refer to the names in the interfaces
+	std::map<std::filesystem::path, ModuleInterface> m_interfaces;
+	// Nothing if the module was type checked. Otherwise the typed AST and the declarations refer to it.
+	std::optional<TypedASTCache> m_typed_ast_cache;
+	FunctionCache* m_function_cache{nullptr};
+
+	Lexer m_lexer;
+	Parser m_parser;
+	TypeChecker m_type_checker;
+	EffectAnalysis m_effect_analysis;
+	CodeGen m_code_gen;
+
+	bool generate(const std::filesystem::path& file_path, std::string source, const CodeGen::Options& options,
+		std::ostream& error_output);
+	// Imported modules are only known by their interfaces, so they are compiled again (each by its own instance) to run
+	// them. Every module is only generated once.
+	bool generate_with_imports(const std::filesystem::path& file_path, std::string source,
+		const CodeGen::Options& options, std::vector<llvm::orc::ThreadSafeModule>& modules,
+		std::set<std::filesystem::path>& generated_paths, std::ostream& error_output);
+	bool generate_imports(const CodeGen::Options& options, std::vector<llvm::orc::ThreadSafeModule>& modules,
+		std::set<std::filesystem::path>& generated_paths, std::ostream& error_output);
+	// Skips lexing, parsing and type checking if the cache of the module is still valid
+	bool load_typed_ast_cache(
+		const std::filesystem::path& file_path, std::string_view source, const CodeGen::Options& options);
+	bool write_interface(const std::filesystem::path& file_path,
+		const std::vector<RefPtr<Typed::Statement>>& statements, std::ostream& error_output);
+};
+}
@@ -0,0 +1,351 @@
+#include "Driver.hpp"
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+#include "ModuleCache.hpp"
+#include "TimeTrace.hpp"
+#include "WorkStealingPool.hpp"
+
+namespace Kyra::Driver {
+namespace {
+void write_to(int fd, std::string_view string) {
+	while(!string.empty()) {
+		const ssize_t written = write(fd, string.data(), string.size());
+		if(written <= 0)
+			return;
+		string.remove_prefix(written);
+	}
+}
+
+int compile(CompilerInstance& instance, const Arguments& arguments, const JIT::Environment& environment,
+	std::ostream& error_output) {
+	const TimeTrace::Scope total_scope(instance.get_time_trace(), "Phase", "Total");
+	const std::filesystem::path& source_file_path = arguments.source_file_paths.front();
+	if(!std::filesystem::exists(source_file_path))
+		return 1;
+
+	std::string source_code;
+	{
+		const TimeTrace::Scope scope(instance.get_time_trace(), "Phase", "Reading source");
+		std::ifstream input_file_stream(source_file_path);
+		source_code = std::string(
+			(std::istreambuf_iterator<char>(input_file_stream)), (std::istreambuf_iterator<char>()));
+		input_file_stream.close();
+	}
+
+	if(arguments.run) {
+		const std::optional<int> exit_code = instance.run(
+			source_file_path, std::move(source_code), arguments.codegen_options, environment, error_output);
+		return exit_code.value_or(1);
+	}
+	llvm::raw_fd_ostream output(environment.output_fd, false);
+	const bool successful =
+		instance.compile(source_file_path, std::move(source_code), arguments.codegen_options, output, error_output);
+	return successful ? 0 : 1;
+}
+
+bool compile_to_file(const RefPtr<TypeScope>& builtin_scope, const std::filesystem::path& source_file_path,
+	const std::filesystem::path& output_file_path, const CodeGen::Options& options, std::ostream& error_output) {
+	std::ifstream input_file_stream(source_file_path);
+	if(!input_file_stream) {
+		error_output << "Could not read the file\n";
+		return false;
+	}
+	std::string source_code(
+		(std::istreambuf_iterator<char>(input_file_stream)), (std::istreambuf_iterator<char>()));
+
+	// Every file gets its own instance, so nothing of one compilation can leak into another
+	CompilerInstance instance(builtin_scope);
+	std::string ir;
+	llvm::raw_string_ostream ir_stream(ir);
+	std::error_code error;
+	if(!instance.compile(source_file_path, std::move(source_code), options, ir_stream, error_output)) {
+		// An outdated output must not be mistaken for the result of this compilation
+		std::filesystem::remove(output_file_path, error);
+		return false;
+	}
+	std::filesystem::create_directories(output_file_path.parent_path(), error);
+	std::ofstream output(output_file_path, std::ios::trunc | std::ios::binary);
+	output << ir;
+	if(!output) {
+		error_output << "Could not write " << output_file_path.string() << '\n';
+		return false;
+	}
+	return true;
+}
+
+int compile_batch(const RefPtr<TypeScope>& builtin_scope, const Arguments& arguments,
+	const JIT::Environment& environment) {
+	struct Result {
+		bool is_done{false};
+		bool successful{false};
+		std::string diagnostics;
+	};
+	const size_t file_count = arguments.source_file_paths.size();
+	std::vector<Result> results(file_count);
+	std::mutex results_mutex;
+	size_t next_result = 0;
+	size_t failed_files = 0;
+
+	const WorkStealingPool pool(arguments.jobs != 0 ? arguments.jobs : std::thread::hardware_concurrency());
+	pool.run(file_count, [&](size_t index) {
+		std::ostringstream diagnostics;
+		const bool successful = compile_to_file(builtin_scope, arguments.source_file_paths[index],
+			arguments.output_file_paths[index], arguments.codegen_options, diagnostics);
+
+		const std::scoped_lock lock(results_mutex);
+		results[index] = {true, successful, diagnostics.str()};
+		// Diagnostics are grouped by file and printed in the order of the files, no matter which one finished first
+		for(; next_result < file_count && results[next_result].is_done; ++next_result) {
+			Result& result = results[next_result];
+			if(!result.successful)
+				++failed_files;
+			if(!result.diagnostics.empty()) {
+				write_to(environment.output_fd, arguments.source_file_paths[next_result].string() + ":\n");
+				write_to(environment.output_fd, result.diagnostics);
+			}
+			result.diagnostics = {};
+		}
+	});
+
+	if(failed_files == 0)
+		return 0;
+	write_to(environment.error_fd,
+		std::to_string(failed_files) + " of " + std::to_string(file_count) + " files failed to compile\n");
+	return 1;
+}
+
+std::map<std::filesystem::path, std::filesystem::file_time_type> get_write_times(
+	const std::vector<std::filesystem::path>& paths) {
+	std::map<std::filesystem::path, std::filesystem::file_time_type> write_times;
+	for(const std::filesystem::path& path : paths) {
+		std::error_code error;
+		write_times[path] = std::filesystem::last_write_time(path, error);
+	}
+	return write_times;
+}
+
+// Never returns. The instance is reused for every compilation, and the cache only compiles the modules whose sources
+// or imported interfaces changed.
+int watch(CompilerInstance& instance, const Arguments& arguments, const JIT::Environment& environment) {
+	ModuleCache cache(instance, arguments.source_file_paths.front(), arguments.codegen_options);
+	while(true) {
+		std::ostringstream diagnostics;
+		const bool successful = cache.update(diagnostics);
+		write_to(environment.output_fd, diagnostics.str());
+		write_to(environment.error_fd,
+			"Compiled " + std::to_string(cache.get_compiled_modules()) + " of " +
+				std::to_string(cache.get_source_paths().size()) + " modules, reused " +
+				std::to_string(cache.get_reused_functions()) + " unchanged functions\n");
+		if(successful && arguments.run) {
+			const int exit_code = JIT::run(cache.clone_modules(), environment);
+			write_to(environment.error_fd, "Exited with " + std::to_string(exit_code) + '\n');
+		} else if(successful) {
+			llvm::raw_fd_ostream output(environment.output_fd, false);
+			cache.print_root_module(output);
+		}
+
+		// Modules that could not be read are watched as well, so they are picked up once they exist
+		const std::map<std::filesystem::path, std::filesystem::file_time_type> write_times =
+			get_write_times(cache.get_source_paths());
+		while(get_write_times(cache.get_source_paths()) == write_times)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+// Relative paths keep their directories, so files with the same name in different directories do not collide
+std::filesystem::path get_output_file_path(
+	const std::filesystem::path& output_directory, std::string_view argument, CodeGen::Options::Output output) {
+	std::filesystem::path relative_path = std::filesystem::path(argument).lexically_normal();
+	if(relative_path.is_absolute() || *relative_path.begin() == "..")
+		relative_path = relative_path.filename();
+	return (output_directory / relative_path).replace_extension(output == CodeGen::Options::Output::IR ? ".ll" : ".bc");
+}
+
+bool read_response_file(const std::filesystem::path& path, std::vector<std::string>& source_files) {
+	std::ifstream input(path);
+	if(!input)
+		return false;
+	for(std::string line; std::getline(input, line);) {
+		if(!line.empty())
+			source_files.push_back(std::move(line));
+	}
+	return true;
+}
+
+// The value of a --name=N argument. Anything but a whole number that fits into an unsigned and is not zero is rejected.
+std::optional<unsigned> parse_count(std::string_view argument) {
+	const std::string_view value = argument.substr(argument.find('=') + 1);
+	unsigned count = 0;
+	const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), count);
+	if(error != std::errc() || end != value.data() + value.size() || count == 0)
+		return {};
+	return count;
+}
+}
+
+const char* const usage = "Usage: kyra [--server[=<socket>] | --connect[=<socket>]] [--run] [-g | -gline-tables-only] "
+						  "[--instrument=functions] [--memo-table-size=N] [--lazy] [--ast-cache] "
+						  "[--march=<architecture>] [--mcpu=<cpu | native>] [--multiversion=<level>[,<level>...]] "
+						  "[--emit=ir | --emit=bc | --emit=thin-bc] [--watch | --time-trace[=<file>]] <file>\n"
+						  "       kyra [--server[=<socket>] | --connect[=<socket>]] [-g | -gline-tables-only] "
+						  "[--march=<architecture>] [--mcpu=<cpu | native>] [--multiversion=<level>[,<level>...]] "
+						  "[--emit=ir | --emit=bc | --emit=thin-bc] --output-dir=<directory> [--jobs=N] "
+						  "<file | @response-file>...\n"
+						  "       kyra repl\n";
+
+std::optional<Arguments> parse_arguments(const std::vector<std::string>& arguments, std::ostream& error_output,
+	const std::filesystem::path& working_directory) {
+	Arguments parsed_arguments;
+	std::vector<std::string> source_files;
+	bool time_trace = false;
+	for(const std::string_view argument : arguments) {
+		if(argument == "-g")
+			parsed_arguments.codegen_options.debug_info = CodeGen::Options::DebugInfo::Full;
+		else if(argument == "-gline-tables-only")
+			parsed_arguments.codegen_options.debug_info = CodeGen::Options::DebugInfo::LineTablesOnly;
+		else if(argument == "--instrument=functions")
+			parsed_arguments.codegen_options.instrument_functions = true;
+		else if(argument == "--lazy")
+			parsed_arguments.codegen_options.lazy = true;
+		else if(argument == "--ast-cache")
+			parsed_arguments.codegen_options.cache_typed_ast = true;
+		else if(argument.starts_with("--memo-table-size=")) {
+			const std::optional<unsigned> memo_table_size = parse_count(argument);
+			if(!memo_table_size.has_value()) {
+				error_output << "--memo-table-size needs a positive number\n";
+				return {};
+			}
+			parsed_arguments.codegen_options.memo_table_size = *memo_table_size;
+		} else if(argument.starts_with("--march="))
+			parsed_arguments.codegen_options.target_architecture = argument.substr(argument.find('=') + 1);
+		else if(argument.starts_with("--mcpu="))
+			parsed_arguments.codegen_options.target_cpu = argument.substr(argument.find('=') + 1);
+		else if(argument == "--emit=ir")
+			parsed_arguments.codegen_options.output = CodeGen::Options::Output::IR;
+		else if(argument == "--emit=bc")
+			parsed_arguments.codegen_options.output = CodeGen::Options::Output::Bitcode;
+		else if(argument == "--emit=thin-bc")
+			parsed_arguments.codegen_options.output = CodeGen::Options::Output::ThinLTOBitcode;
+		else if(argument.starts_with("--multiversion=")) {
+			std::string_view levels = argument.substr(argument.find('=') + 1);
+			while(!levels.empty()) {
+				const size_t comma = levels.find(',');
+				parsed_arguments.codegen_options.multiversion_levels.emplace_back(levels.substr(0, comma));
+				levels.remove_prefix(comma == std::string_view::npos ? levels.size() : comma + 1);
+			}
+		} else if(argument == "--run")
+			parsed_arguments.run = true;
+		else if(argument == "--watch")
+			parsed_arguments.watch = true;
+		else if(argument == "--time-trace")
+			time_trace = true;
+		else if(argument.starts_with("--time-trace=")) {
+			time_trace = true;
+			parsed_arguments.time_trace_path =
+				working_directory / argument.substr(std::string_view("--time-trace=").size());
+		} else if(argument.starts_with("--output-dir="))
+			parsed_arguments.output_directory = working_directory / argument.substr(argument.find('=') + 1);
+		else if(argument.starts_with("--jobs=")) {
+			const std::optional<unsigned> jobs = parse_count(argument);
+			if(!jobs.has_value()) {
+				error_output << "--jobs needs a positive number\n";
+				return {};
+			}
+			parsed_arguments.jobs = *jobs;
+		} else if(argument.starts_with('@')) {
+			if(!read_response_file(working_directory / argument.substr(1), source_files)) {
+				error_output << "Could not read the response file " << argument.substr(1) << '\n';
+				return {};
+			}
+		} else if(!argument.starts_with('-'))
+			source_files.emplace_back(argument);
+		else {
+			error_output << "Unknown argument " << argument << '\n';
+			return {};
+		}
+	}
+	if(source_files.empty())
+		return {};
+	for(const std::string& source_file : source_files)
+		parsed_arguments.source_file_paths.push_back(working_directory / source_file);
+
+	if(parsed_arguments.output_directory.empty()) {
+		if(source_files.size() > 1) {
+			error_output << "Compiling several files needs an output directory\n";
+			return {};
+		}
+	} else {
+		if(parsed_arguments.run || parsed_arguments.watch || time_trace) {
+			error_output << "--run, --watch and --time-trace cannot be used with an output directory\n";
+			return {};
+		}
+		std::set<std::filesystem::path> output_file_paths;
+		for(const std::string& source_file : source_files) {
+			const std::filesystem::path& output_file_path = parsed_arguments.output_file_paths.emplace_back(
+				get_output_file_path(
+					parsed_arguments.output_directory, source_file, parsed_arguments.codegen_options.output));
+			if(!output_file_paths.insert(output_file_path).second) {
+				error_output << "Several files would be compiled to " << output_file_path.string() << '\n';
+				return {};
+			}
+		}
+	}
+
+	if((parsed_arguments.run || parsed_arguments.watch) &&
+		parsed_arguments.codegen_options.output != CodeGen::Options::Output::IR) {
+		error_output << "--emit cannot be used with --run or --watch\n";
+		return {};
+	}
+	// The JIT only runs code for the host
+	if(parsed_arguments.run && !parsed_arguments.codegen_options.target_architecture.empty()) {
+		error_output << "--march cannot be used with --run\n";
+		return {};
+	}
+	if(!CodeGen::check_target(parsed_arguments.codegen_options, error_output))
+		return {};
+	if(parsed_arguments.watch && time_trace) {
+		error_output << "--time-trace cannot be used with --watch\n";
+		return {};
+	}
+	if(time_trace && parsed_arguments.time_trace_path.empty()) {
+		parsed_arguments.time_trace_path = working_directory /
+			parsed_arguments.source_file_paths.front().filename().replace_extension(".time-trace.json");
+	}
+	return parsed_arguments;
+}
+
+int execute(CompilerInstance& instance, const Arguments& arguments, const JIT::Environment& environment) {
+	if(!arguments.output_directory.empty())
+		return compile_batch(instance.get_builtin_scope(), arguments, environment);
+	if(arguments.watch)
+		return watch(instance, arguments, environment);
+	TimeTrace& time_trace = instance.get_time_trace();
+	if(!arguments.time_trace_path.empty())
+		time_trace.enable();
+	// Diagnostics go to the same place as the IR, like they always did
+	std::ostringstream diagnostics;
+	const int exit_code = compile(instance, arguments, environment, diagnostics);
+	write_to(environment.output_fd, diagnostics.str());
+	if(time_trace.is_enabled()) {
+		std::ofstream trace_file(arguments.time_trace_path);
+		time_trace.write_chrome_trace(trace_file);
+		std::ostringstream summary;
+		time_trace.print_summary(summary);
+		write_to(environment.error_fd, summary.str());
+	}
+	return exit_code;
+}
+}
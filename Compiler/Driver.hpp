@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "CodeGen.hpp"
+#include "CompilerInstance.hpp"
+#include "JIT.hpp"
+
+namespace Kyra::Driver {
+
+struct Arguments {
+	std::vector<std::filesystem::path> source_file_paths;
+	// Empty if the IR is written to the output. Otherwise every source file is compiled to its own file in the output
+	// directory, see output_file_paths.
+	std::filesystem::path output_directory;
+	std::vector<std::filesystem::path> output_file_paths;
+	// How many files are compiled at the same time, 0 uses one thread per core
+	unsigned jobs{0};
+	CodeGen::Options codegen_options;
+	// Run the program instead of printing its IR
+	bool run{false};
+	// Compile (or run) the program again whenever one of its sources changes, see ModuleCache
+	bool watch{false};
+	// Empty if no time trace should be recorded
+	std::filesystem::path time_trace_path;
+};
+
+extern const char* const usage;
+
+// Relative paths are resolved against the working directory, unless it is empty. An argument @<file> adds the files
+// listed in it (one per line).
+std::optional<Arguments> parse_arguments(const std::vector<std::string>& arguments, std::ostream& error_output,
+	const std::filesystem::path& working_directory = {});
+
+// Compiles or runs the source files. Everything but the files in the output directory (the IR, diagnostics and the
+// output of the program) goes to the file descriptors of the environment. Returns the exit code of kyra.
+int execute(CompilerInstance& instance, const Arguments& arguments, const JIT::Environment& environment);
+}
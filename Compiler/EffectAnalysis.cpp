@@ -0,0 +1,378 @@
+#include "EffectAnalysis.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace Kyra {
+using namespace Typed;
+
+void EffectAnalysis::analyze(const std::vector<RefPtr<Statement>>& statements, bool keep_earlier_functions,
+	const std::map<declid_t, FunctionSummary>& summarized_functions) {
+	if(!keep_earlier_functions)
+		m_functions.clear();
+	m_summaries.clear();
+	m_summarized_functions = &summarized_functions;
+	m_analyzed_functions.clear();
+	m_enclosing_functions.clear();
+	m_constant_declarations.clear();
+	m_declarations_used_by_functions.clear();
+	m_declarations_assigned_in_loops.clear();
+	m_loop_depths.clear();
+	m_loop_depth = 0;
+	m_parallel_captures.clear();
+	m_enclosing_parallel_loops.clear();
+	m_parallel_calls.clear();
+	m_loop_variable_bounds.clear();
+	for(const RefPtr<Statement>& statement : statements)
+		dispatch(*statement);
+	m_summarized_functions = nullptr;
+	propagate_effects();
+}
+
+const EffectAnalysis::FunctionInfo& EffectAnalysis::get_function_info(declid_t function) const {
+	return m_functions.at(function);
+}
+
+const EffectAnalysis::FunctionSummary& EffectAnalysis::get_function_summary(declid_t function) const {
+	return m_summaries.at(function);
+}
+
+bool EffectAnalysis::is_constant(declid_t declaration) const { return m_constant_declarations.contains(declaration); }
+
+bool EffectAnalysis::is_used_by_functions(declid_t declaration) const {
+	return m_declarations_used_by_functions.contains(declaration);
+}
+
+bool EffectAnalysis::is_assigned_in_loop(declid_t declaration) const {
+	return m_declarations_assigned_in_loops.contains(declaration);
+}
+
+const std::set<declid_t>& EffectAnalysis::get_parallel_captures(declid_t loop_variable) const {
+	return m_parallel_captures.at(loop_variable);
+}
+
+std::optional<SourceRange> EffectAnalysis::find_racing_call() const {
+	for(const ParallelCall& call : m_parallel_calls) {
+		const std::set<declid_t>& assigned = m_functions.at(call.function).assigned_declarations;
+		// Declarations are numbered in the order they are checked, so the ones from outside of the loop have smaller
+		// ids than its variable. The innermost loop has the largest variable, which covers the loops around it.
+		if(!assigned.empty() && *assigned.begin() < call.loop_variable)
+			return call.source_range;
+	}
+	return {};
+}
+
+void EffectAnalysis::visit(const ExpressionStatement& expresion_statement) {
+	dispatch(expresion_statement.get_expression());
+}
+
+void EffectAnalysis::visit(const Declaration& declaration) {
+	if(FunctionInfo* function = current_function(); function != nullptr)
+		function->owned_declarations.insert(declaration.get_declaration_id());
+	m_loop_depths[declaration.get_declaration_id()] = m_loop_depth;
+}
+
+void EffectAnalysis::visit(const Function& function) {
+	const declid_t id = function.get_function_declaration_id();
+	if(!function.has_implementation()) {
+		if(const auto it = m_summarized_functions->find(id); it != m_summarized_functions->end())
+			add_summarized_function(id, it->second, function.get_source_range());
+		return;
+	}
+	FunctionInfo& info = m_functions[id];
+	m_analyzed_functions.insert(id);
+	info.owned_declarations.insert(function.get_parameters().begin(), function.get_parameters().end());
+	if(function.is_memoized())
+		info.effects |= Memoizes;
+	m_enclosing_functions.push_back(id);
+	// Loops around the function do not repeat its body, and parallel loops do not outline it
+	const unsigned loop_depth = std::exchange(m_loop_depth, 0);
+	std::vector<declid_t> parallel_loops = std::exchange(m_enclosing_parallel_loops, {});
+	dispatch(function.get_implementation());
+	m_enclosing_parallel_loops = std::move(parallel_loops);
+	m_loop_depth = loop_depth;
+	m_enclosing_functions.pop_back();
+	// Nothing is propagated yet, so the effects are still the ones of the function itself
+	FunctionSummary& summary = m_summaries[id];
+	summary.effects = info.effects;
+	summary.callees = info.callees;
+	summary.assigned_declarations = info.assigned_declarations;
+}
+
+void EffectAnalysis::visit(const ExternalFunction& external_function) {
+	// The effects were analyzed when the imported module was compiled
+	m_functions[external_function.get_function_declaration_id()].effects = external_function.get_effects();
+	m_analyzed_functions.insert(external_function.get_function_declaration_id());
+}
+
+void EffectAnalysis::visit(const Print& print_statement) {
+	if(FunctionInfo* function = current_function(); function != nullptr)
+		function->effects |= PerformsIO;
+	dispatch(print_statement.get_expression());
+}
+
+void EffectAnalysis::visit(const Return& return_statement) { dispatch(return_statement.get_expression()); }
+
+void EffectAnalysis::visit(const Block& block) {
+	for(const RefPtr<Statement>& statement : block.get_body())
+		dispatch(*statement);
+}
+
+void EffectAnalysis::visit(const For& for_statement) {
+	if(FunctionInfo* function = current_function(); function != nullptr)
+		function->owned_declarations.insert(for_statement.get_variable());
+	dispatch(for_statement.get_begin());
+	dispatch(for_statement.get_end());
+	if(for_statement.get_begin().get_node_kind() == TASTNode::NodeKind::IntLiteral &&
+		for_statement.get_end().get_node_kind() == TASTNode::NodeKind::IntLiteral)
+		m_loop_variable_bounds[for_statement.get_variable()] =
+			static_cast<const IntLiteral&>(for_statement.get_end()).get_value();
+	++m_loop_depth;
+	m_loop_depths[for_statement.get_variable()] = m_loop_depth;
+	if(for_statement.is_parallel()) {
+		m_parallel_captures[for_statement.get_variable()];
+		m_enclosing_parallel_loops.push_back(for_statement.get_variable());
+	}
+	dispatch(for_statement.get_body());
+	if(for_statement.is_parallel())
+		m_enclosing_parallel_loops.pop_back();
+	--m_loop_depth;
+}
+
+void EffectAnalysis::visit(const IntLiteral&) {}
+
+void EffectAnalysis::visit(const ArrayLiteral& array_literal) {
+	for(const RefPtr<Expression>& element : array_literal.get_elements())
+		dispatch(*element);
+}
+
+void EffectAnalysis::visit(const Assignment& assignment) {
+	assign(assignment.get_lhs());
+	if(!is_owned_by_current_function(assignment.get_lhs()))
+		current_function()->assigned_declarations.insert(assignment.get_lhs());
+	m_is_constant_expression = true;
+	dispatch(assignment.get_rhs());
+	// Values can only be assigned once, so this is the initializer. Arrays are always kept in memory, so they are
+	// never folded.
+	if(m_is_constant_expression && current_function() == nullptr && !assignment.get_type().is_mutable() &&
+		assignment.get_type().get_declared_type().get_kind() != DeclaredType::Array)
+		m_constant_declarations.insert(assignment.get_lhs());
+	m_is_constant_expression = false;
+}
+
+void EffectAnalysis::visit(const IndexAssignment& index_assignment) {
+	// Assigning an element writes to the variable the (possibly nested) array belongs to
+	const Expression* array = &index_assignment.get_lhs();
+	while(array->get_node_kind() == TASTNode::NodeKind::Index) {
+		const auto* index = static_cast<const Index*>(array);
+		dispatch(index->get_index());
+		array = &index->get_array();
+		check_index(index->get_index(),
+			static_cast<const ArrayType&>(array->get_type().get_declared_type()).get_length());
+	}
+	const declid_t root = static_cast<const VarQuery*>(array)->get_declaration_id();
+	assign(root);
+	capture(root);
+	dispatch(index_assignment.get_rhs());
+}
+
+void EffectAnalysis::visit(const BinaryExpression& binary_expression) {
+	dispatch(binary_expression.get_lhs());
+	dispatch(binary_expression.get_rhs());
+}
+
+void EffectAnalysis::visit(const Call& call) {
+	if(FunctionInfo* function = current_function(); function != nullptr)
+		function->callees.insert(call.get_function_declaration_id());
+	// Calls from functions declared inside of a parallel loop are found through the call of that function
+	if(!m_enclosing_parallel_loops.empty()) {
+		m_parallel_calls.push_back(
+			{m_enclosing_parallel_loops.back(), call.get_function_declaration_id(), call.get_source_range()});
+		if(!m_enclosing_functions.empty())
+			m_summaries[m_enclosing_functions.back()].parallel_callees.insert(call.get_function_declaration_id());
+	}
+	m_is_constant_expression = false;
+	for(const RefPtr<Expression>& argument : call.get_arguments())
+		dispatch(*argument);
+}
+
+void EffectAnalysis::visit(const Conversion& conversion) { dispatch(conversion.get_value()); }
+
+void EffectAnalysis::visit(const VectorOperation& vector_operation) {
+	for(const RefPtr<Expression>& operand : vector_operation.get_operands())
+		dispatch(*operand);
+	// Lanes are checked like indices
+	if(vector_operation.get_operation() == VectorOperation::Operation::Extract ||
+		vector_operation.get_operation() == VectorOperation::Operation::Insert) {
+		const Expression& vector = *vector_operation.get_operands().at(0);
+		check_index(*vector_operation.get_operands().at(1),
+			static_cast<const VectorType&>(vector.get_type().get_declared_type()).get_lanes());
+	}
+	// Reductions are calls to intrinsics, which are not folded into constants
+	switch(vector_operation.get_operation()) {
+		case VectorOperation::Operation::ReduceAdd:
+		case VectorOperation::Operation::ReduceMul:
+		case VectorOperation::Operation::ReduceMin:
+		case VectorOperation::Operation::ReduceMax: m_is_constant_expression = false; break;
+		default: break;
+	}
+}
+
+void EffectAnalysis::visit(const Index& index) {
+	dispatch(index.get_array());
+	dispatch(index.get_index());
+	check_index(index.get_index(),
+		static_cast<const ArrayType&>(index.get_array().get_type().get_declared_type()).get_length());
+}
+
+void EffectAnalysis::visit(const VarQuery& var_query) {
+	capture(var_query.get_declaration_id());
+	// Constants get folded, so reading them does not access memory
+	if(is_constant(var_query.get_declaration_id()))
+		return;
+	m_is_constant_expression = false;
+	access_from_current_function(var_query.get_declaration_id(), ReadsMemory);
+}
+
+EffectAnalysis::FunctionInfo* EffectAnalysis::current_function() {
+	if(m_enclosing_functions.empty())
+		return nullptr;
+	return &m_functions.at(m_enclosing_functions.back());
+}
+
+bool EffectAnalysis::is_owned_by_current_function(declid_t declaration) {
+	// Top-level code is not a function, so everything it touches is its own
+	const FunctionInfo* function = current_function();
+	return function == nullptr || function->owned_declarations.contains(declaration);
+}
+
+void EffectAnalysis::access_from_current_function(declid_t declaration, Effect effect) {
+	if(is_owned_by_current_function(declaration))
+		return;
+	current_function()->effects |= effect;
+	m_declarations_used_by_functions.insert(declaration);
+	m_summaries[m_enclosing_functions.back()].used_declarations.insert(declaration);
+}
+
+void EffectAnalysis::assign(declid_t declaration) {
+	access_from_current_function(declaration, WritesMemory);
+	// Imported declarations are not part of the analyzed program, so they are not declared in a loop either
+	const auto it = m_loop_depths.find(declaration);
+	if(m_loop_depth > (it == m_loop_depths.end() ? 0 : it->second))
+		m_declarations_assigned_in_loops.insert(declaration);
+}
+
+void EffectAnalysis::capture(declid_t declaration) {
+	// Declarations are numbered in the order they are checked, so the ones from outside of a loop have smaller ids than
+	// its variable
+	for(declid_t loop_variable : m_enclosing_parallel_loops) {
+		if(declaration < loop_variable)
+			m_parallel_captures.at(loop_variable).insert(declaration);
+	}
+}
+
+// CodeGen leaves out the bounds check of an index it can prove to be in bounds. It folds more constants than this
+// analysis does, so an index whose check might be emitted is always treated as one that can fail.
+void EffectAnalysis::check_index(const Expression& index, uint64_t length) {
+	FunctionInfo* function = current_function();
+	if(function == nullptr)
+		return;
+	if(index.get_node_kind() == TASTNode::NodeKind::IntLiteral &&
+		static_cast<const IntLiteral&>(index).get_value() < length)
+		return;
+	if(index.get_node_kind() == TASTNode::NodeKind::VarQuery) {
+		const auto it = m_loop_variable_bounds.find(static_cast<const VarQuery&>(index).get_declaration_id());
+		if(it != m_loop_variable_bounds.end() && it->second <= length)
+			return;
+	}
+	function->effects |= MayFail;
+}
+
+void EffectAnalysis::add_summarized_function(
+	declid_t function, const FunctionSummary& summary, const SourceRange& source_range) {
+	FunctionInfo& info = m_functions[function];
+	info.effects = summary.effects;
+	info.callees = summary.callees;
+	info.assigned_declarations = summary.assigned_declarations;
+	m_analyzed_functions.insert(function);
+	m_summaries[function] = summary;
+	m_declarations_used_by_functions.insert(summary.used_declarations.begin(), summary.used_declarations.end());
+	// Only top-level functions are summarized, so everything their callees assign is declared outside of their loops
+	for(declid_t callee : summary.parallel_callees)
+		m_parallel_calls.push_back({std::numeric_limits<declid_t>::max(), callee, source_range});
+}
+
+void EffectAnalysis::propagate_effects() {
+	// Tarjan's algorithm yields the strongly connected components of the call graph in reverse topological order, so
+	// the effects of all callees are known once a component is completed.
+	std::map<declid_t, unsigned> index;
+	std::map<declid_t, unsigned> low_link;
+	std::vector<declid_t> stack;
+	std::set<declid_t> on_stack;
+	unsigned next_index = 0;
+
+	std::function<void(declid_t)> connect = [&](declid_t function) {
+		index[function] = low_link[function] = next_index++;
+		stack.push_back(function);
+		on_stack.insert(function);
+		for(declid_t callee : m_functions.at(function).callees) {
+			// Functions of earlier programs cannot call the new ones, so their effects are final
+			if(!m_analyzed_functions.contains(callee))
+				continue;
+			if(!index.contains(callee)) {
+				connect(callee);
+				low_link[function] = std::min(low_link[function], low_link[callee]);
+			} else if(on_stack.contains(callee))
+				low_link[function] = std::min(low_link[function], index[callee]);
+		}
+		if(low_link[function] != index[function])
+			return;
+
+		std::vector<declid_t> component;
+		declid_t popped = 0;
+		do {
+			popped = stack.back();
+			stack.pop_back();
+			on_stack.erase(popped);
+			component.push_back(popped);
+		} while(popped != function);
+
+		unsigned effects = None;
+		std::set<declid_t> assigned_declarations;
+		bool is_recursive = component.size() > 1;
+		for(declid_t member : component) {
+			const FunctionInfo& info = m_functions.at(member);
+			effects |= info.effects;
+			assigned_declarations.insert(info.assigned_declarations.begin(), info.assigned_declarations.end());
+			is_recursive |= info.callees.contains(member);
+			for(declid_t callee : info.callees) {
+				const FunctionInfo& callee_info = m_functions.at(callee);
+				effects |= callee_info.effects;
+				assigned_declarations.insert(
+					callee_info.assigned_declarations.begin(), callee_info.assigned_declarations.end());
+			}
+		}
+		if(is_recursive)
+			effects |= MayDiverge;
+		for(declid_t member : component) {
+			FunctionInfo& info = m_functions.at(member);
+			info.effects = effects;
+			info.is_recursive = is_recursive;
+			// Every call has its own locals, so assigning the ones of a caller (from a nested function) does not reach
+			// further out
+			info.assigned_declarations.clear();
+			for(declid_t declaration : assigned_declarations) {
+				if(!info.owned_declarations.contains(declaration))
+					info.assigned_declarations.insert(declaration);
+			}
+		}
+	};
+
+	for(declid_t function : m_analyzed_functions) {
+		if(!index.contains(function))
+			connect(function);
+	}
+}
+}
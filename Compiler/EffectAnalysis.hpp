@@ -0,0 +1,140 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "TAST.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+class EffectAnalysis : public Typed::TASTVisitor<EffectAnalysis> {
+public:
+	enum Effect : unsigned {
+		None = 0,
+		// The function reads memory it does not own (e.g. top-level declarations)
+		ReadsMemory = 1 << 0,
+		// The function writes memory it does not own
+		WritesMemory = 1 << 1,
+		// The function produces output
+		PerformsIO = 1 << 2,
+		// The function might never return, because it (transitively) calls a recursive function
+		MayDiverge = 1 << 3,
+		// The function (transitively) calls a memoized function. Its table cannot be observed, so the function is still
+		// pure, but it writes memory.
+		Memoizes = 1 << 4,
+		// An index might be out of bounds, so the function might print the error and exit instead of returning. A
+		// memoized function may still do this, it never returns a result that could be stored.
+		MayFail = 1 << 5,
+	};
+
+	struct FunctionInfo {
+		unsigned effects{None};
+		// The function (transitively) calls itself
+		bool is_recursive{false};
+		std::set<declid_t> callees;
+		std::set<declid_t> owned_declarations;
+		// Variables from outside of the function it (transitively) assigns, elements of arrays do not count. Libraries
+		// have no variables, so imported functions never assign any.
+		std::set<declid_t> assigned_declarations;
+	};
+	// What a function does by itself, before the effects of the functions it calls are added. A function whose body is
+	// not checked again (see FunctionCache) is only known by its summary.
+	struct FunctionSummary {
+		unsigned effects{None};
+		std::set<declid_t> callees;
+		// Declarations from outside of the function it reads or writes, and the ones of them it assigns
+		std::set<declid_t> used_declarations;
+		std::set<declid_t> assigned_declarations;
+		// The functions it calls inside of its parallel loops
+		std::set<declid_t> parallel_callees;
+	};
+
+	EffectAnalysis() = default;
+	EffectAnalysis(const EffectAnalysis&) = delete;
+	EffectAnalysis(EffectAnalysis&&) noexcept = default;
+
+	EffectAnalysis& operator=(const EffectAnalysis&) = delete;
+	EffectAnalysis& operator=(EffectAnalysis&&) noexcept = default;
+
+	// If the functions of earlier analyses are kept, e.g. for the next entry of the REPL, the program can call them.
+	// Functions without an implementation that have a summary are analyzed by it.
+	void analyze(const std::vector<RefPtr<Typed::Statement>>& statements, bool keep_earlier_functions = false,
+		const std::map<declid_t, FunctionSummary>& summarized_functions = {});
+
+	// Information is only available for functions that were part of the last analyzed program (or a kept one)
+	const FunctionInfo& get_function_info(declid_t function) const;
+	// Only available for the functions of the last analyzed program that have an implementation or a summary
+	const FunctionSummary& get_function_summary(declid_t function) const;
+	// Top-level values whose initializer can be evaluated at compile time
+	bool is_constant(declid_t declaration) const;
+	// Top-level declarations that are accessed from within a function
+	bool is_used_by_functions(declid_t declaration) const;
+	// Declarations that are assigned inside of a loop they are declared outside of, so they change between iterations
+	bool is_assigned_in_loop(declid_t declaration) const;
+	// Declarations from outside of a parallel loop that its body uses, keyed by the variable of the loop
+	const std::set<declid_t>& get_parallel_captures(declid_t loop_variable) const;
+	// A call inside of a parallel loop to a function that assigns a variable declared outside of the loop, if there is
+	// one. The iterations would race for the variable.
+	std::optional<SourceRange> find_racing_call() const;
+
+	void visit(const Typed::ExpressionStatement& expresion_statement);
+	void visit(const Typed::Declaration& declaration);
+	void visit(const Typed::Function& function);
+	void visit(const Typed::ExternalFunction& external_function);
+	void visit(const Typed::Print& print_statement);
+	void visit(const Typed::Return& return_statement);
+	void visit(const Typed::Block& block);
+	void visit(const Typed::For& for_statement);
+	void visit(const Typed::IntLiteral& literal);
+	void visit(const Typed::ArrayLiteral& array_literal);
+
+	void visit(const Typed::Assignment& assignment);
+	void visit(const Typed::IndexAssignment& index_assignment);
+	void visit(const Typed::BinaryExpression& binary_expression);
+	void visit(const Typed::Call& call);
+	void visit(const Typed::Conversion& conversion);
+	void visit(const Typed::VectorOperation& vector_operation);
+	void visit(const Typed::Index& index);
+	void visit(const Typed::VarQuery& var_query);
+
+private:
+	struct ParallelCall {
+		// The variable of the innermost parallel loop around the call
+		declid_t loop_variable;
+		declid_t function;
+		SourceRange source_range;
+	};
+
+	std::map<declid_t, FunctionInfo> m_functions;
+	std::map<declid_t, FunctionSummary> m_summaries;
+	const std::map<declid_t, FunctionSummary>* m_summarized_functions{nullptr};
+	// The functions of the last analyzed program, the ones of earlier programs are already complete
+	std::set<declid_t> m_analyzed_functions;
+	std::vector<declid_t> m_enclosing_functions;
+	std::set<declid_t> m_constant_declarations;
+	std::set<declid_t> m_declarations_used_by_functions;
+	std::set<declid_t> m_declarations_assigned_in_loops;
+	// The number of loops around every declaration
+	std::map<declid_t, unsigned> m_loop_depths;
+	unsigned m_loop_depth{0};
+	std::map<declid_t, std::set<declid_t>> m_parallel_captures;
+	std::vector<declid_t> m_enclosing_parallel_loops;
+	std::vector<ParallelCall> m_parallel_calls;
+	// The end of loops over literal bounds that are not negative, their variables are always below it
+	std::map<declid_t, uint64_t> m_loop_variable_bounds;
+	bool m_is_constant_expression{false};
+
+	FunctionInfo* current_function();
+	bool is_owned_by_current_function(declid_t declaration);
+	void access_from_current_function(declid_t declaration, Effect effect);
+	void assign(declid_t declaration);
+	void capture(declid_t declaration);
+	void check_index(const Typed::Expression& index, uint64_t length);
+	void add_summarized_function(declid_t function, const FunctionSummary& summary, const SourceRange& source_range);
+	void propagate_effects();
+};
+}
@@ -4,6 +4,7 @@
 #include <optional>
 #include <ostream>
 #include <string_view>
+#include <utility>
 
 #include "SourceRange.hpp"
 
@@ -18,26 +19,38 @@ public:
 	const char* what() const noexcept override;
 	const SourceRange& get_source_range() const;
 
-	void print(std::ostream& stream) const;
+	// The file content is the source of the file the error is located in
+	void print(std::ostream& stream, std::string_view file_content) const;
 
 protected:
 	const std::string m_message;
 	const SourceRange m_source_range;
 };
 
+// Results are moved in and can be moved out again, so the output of a phase is handed on without being copied
 template <typename T>
 class ErrorOr {
 public:
-	ErrorOr(const T& result) : m_result(result) {}
+	ErrorOr(T&& result) : m_result(std::move(result)) {}
 	ErrorOr(const ErrorException& exception) : m_exception(exception) {}
+	ErrorOr(const ErrorOr&) = delete;
+	ErrorOr(ErrorOr&&) noexcept = default;
+
+	ErrorOr& operator=(const ErrorOr&) = delete;
+	ErrorOr& operator=(ErrorOr&&) noexcept = default;
 
 	bool is_error() const { return m_exception.has_value(); }
 
-	const T& get_result() const {
+	const T& get_result() const& {
 		assert(m_result.has_value());
 		return *m_result;
 	}
 
+	T get_result() && {
+		assert(m_result.has_value());
+		return std::move(*m_result);
+	}
+
 	const ErrorException& get_exception() const {
 		assert(m_exception.has_value());
 		return *m_exception;
@@ -0,0 +1,144 @@
+#include "FunctionCache.hpp"
+
+#include <llvm/Support/xxhash.h>
+
+#include "ModuleInterface.hpp"
+
+namespace Kyra {
+
+void FunctionCache::start_compilation(bool allow_reuse) {
+	m_allow_reuse = allow_reuse;
+	m_has_rejected_functions = false;
+	m_reused_functions.clear();
+	m_reused_summaries.clear();
+	m_new_entries.clear();
+}
+
+void FunctionCache::finish_compilation() {
+	std::set<const Entry*> reused_entries;
+	for(const auto& [function, reused_function] : m_reused_functions)
+		reused_entries.insert(&reused_function.entry);
+	std::erase_if(m_entries, [&](const auto& entry) { return !reused_entries.contains(&entry.second); });
+	// Functions that were checked, but not generated (e.g. because they are not reachable) cannot be reused
+	for(auto& [function, new_entry] : m_new_entries) {
+		if(new_entry.second.module != nullptr)
+			m_entries.insert_or_assign(std::move(new_entry.first), std::move(new_entry.second));
+	}
+	m_new_entries.clear();
+}
+
+const EffectAnalysis::FunctionSummary* FunctionCache::reuse_function(
+	declid_t function, const std::string& symbol, std::string_view source, const TypeScope& scope) {
+	if(!m_allow_reuse)
+		return nullptr;
+	const auto it = m_entries.find(symbol);
+	if(it == m_entries.end())
+		return nullptr;
+	const Entry& entry = it->second;
+	if(hash_inputs(source, entry.used_names, scope) != entry.inputs_hash)
+		return nullptr;
+
+	bool is_resolved = true;
+	const auto resolve_all = [&](const std::vector<Reference>& references) {
+		std::set<declid_t> ids;
+		for(const Reference& reference : references) {
+			const std::optional<declid_t> id = resolve(reference, scope);
+			is_resolved &= id.has_value();
+			if(id.has_value())
+				ids.insert(*id);
+		}
+		return ids;
+	};
+	EffectAnalysis::FunctionSummary summary;
+	summary.effects = entry.effects;
+	summary.callees = resolve_all(entry.callees);
+	summary.used_declarations = resolve_all(entry.used_declarations);
+	summary.assigned_declarations = resolve_all(entry.assigned_declarations);
+	summary.parallel_callees = resolve_all(entry.parallel_callees);
+	std::vector<declid_t> externals;
+	for(const External& external : entry.externals) {
+		const std::optional<declid_t> id = resolve(external.reference, scope);
+		is_resolved &= id.has_value();
+		externals.push_back(id.value_or(0));
+	}
+	if(!is_resolved)
+		return nullptr;
+	m_reused_functions.emplace(function, ReusedFunction{entry, std::move(externals)});
+	return &m_reused_summaries.emplace(function, std::move(summary)).first->second;
+}
+
+void FunctionCache::add_checked_function(declid_t function, const std::string& symbol, std::string_view source,
+	std::vector<std::string> used_names, const TypeScope& scope) {
+	Entry entry;
+	entry.inputs_hash = hash_inputs(source, used_names, scope);
+	entry.used_names = std::move(used_names);
+	m_new_entries.insert_or_assign(function, std::pair(symbol, std::move(entry)));
+}
+
+const FunctionCache::ReusedFunction* FunctionCache::find_reused_function(declid_t function) const {
+	const auto it = m_reused_functions.find(function);
+	return it == m_reused_functions.end() ? nullptr : &it->second;
+}
+
+const std::map<declid_t, EffectAnalysis::FunctionSummary>& FunctionCache::get_reused_summaries() const {
+	return m_reused_summaries;
+}
+
+FunctionCache::Entry* FunctionCache::find_new_entry(declid_t function) {
+	const auto it = m_new_entries.find(function);
+	return it == m_new_entries.end() ? nullptr : &it->second.second;
+}
+
+void FunctionCache::reject_reused_function() { m_has_rejected_functions = true; }
+
+bool FunctionCache::has_rejected_functions() const { return m_has_rejected_functions; }
+
+FunctionCache::Reference FunctionCache::make_reference(declid_t declaration, const DeclarationDumpster& declarations) {
+	const DeclarationDumpster::Element& element = declarations.retrieve(declaration);
+	const DeclaredType& type = element.type->get_declared_type();
+	if(type.get_kind() != DeclaredType::Function)
+		return {std::string(element.name), {}};
+	return {std::string(element.name),
+		ModuleInterface::mangle({}, element.name, static_cast<const FunctionType&>(type))};
+}
+
+std::vector<FunctionCache::Reference> FunctionCache::make_references(
+	const std::set<declid_t>& ids, const DeclarationDumpster& declarations) {
+	std::vector<Reference> references;
+	for(declid_t id : ids)
+		references.push_back(make_reference(id, declarations));
+	return references;
+}
+
+std::optional<declid_t> FunctionCache::resolve(const Reference& reference, const TypeScope& scope) {
+	if(reference.signature.empty()) {
+		if(const auto symbol = scope.find_symbol(reference.name); symbol.has_value())
+			return symbol->declid;
+		return {};
+	}
+	for(const TypeScope::Element<FunctionType>& function : scope.find_functions(reference.name)) {
+		if(ModuleInterface::mangle({}, reference.name, *function.type) == reference.signature)
+			return function.declid;
+	}
+	return {};
+}
+
+// Anything a name could resolve to is part of the inputs, even if the function only used one of the overloads
+uint64_t FunctionCache::hash_inputs(
+	std::string_view source, const std::vector<std::string>& used_names, const TypeScope& scope) {
+	std::string inputs(source);
+	for(const std::string& name : used_names) {
+		inputs += '\0';
+		inputs += name;
+		if(const auto symbol = scope.find_symbol(name); symbol.has_value()) {
+			inputs += symbol->type->is_mutable() ? " var " : " val ";
+			inputs += symbol->type->get_declared_type().get_name();
+		}
+		for(const TypeScope::Element<FunctionType>& function : scope.find_functions(name)) {
+			inputs += ' ';
+			inputs += ModuleInterface::mangle({}, name, *function.type);
+		}
+	}
+	return llvm::xxHash64(inputs);
+}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <llvm/IR/Constant.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "EffectAnalysis.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+// Keeps what checking and generating each top-level function of a module produced, so the next compilation of the
+// module (see ModuleCache) can reuse it for the functions that did not change. Checking a function is a query whose
+// inputs are its source and what every name it uses resolved to (the types of symbols and the signatures of all
+// overloads), and an entry is only reused if the hash of these inputs is the same. Declaration ids are handed out anew
+// by every compilation, so entries refer to other declarations by name and signature and are resolved again.
+// Functions that contain functions are never kept, and neither is anything with debug info or instrumentation.
+class FunctionCache {
+public:
+	// A declaration from outside of a function
+	struct Reference {
+		std::string name;
+		// The mangled name of a function (overloads share their name), empty for anything else
+		std::string signature;
+	};
+	// A declaration the generated code of a function uses, and what stands for it in the module of the entry. This is
+	// an external declaration, or the constant the declaration was folded into.
+	struct External {
+		Reference reference;
+		llvm::Constant* value;
+	};
+	struct Entry {
+		uint64_t inputs_hash{0};
+		std::vector<std::string> used_names;
+		// The summary of the function (see EffectAnalysis::FunctionSummary)
+		unsigned effects{EffectAnalysis::None};
+		std::vector<Reference> callees;
+		std::vector<Reference> used_declarations;
+		std::vector<Reference> assigned_declarations;
+		std::vector<Reference> parallel_callees;
+		// The generated code with everything the function brought along, e.g. the table of a memoized function or the
+		// bodies of its parallel loops. Nothing if the function was not generated.
+		OwnPtr<llvm::Module> module;
+		std::vector<External> externals;
+		// The effects belong to the implementation, callers call the entry point. Only memoized functions have both.
+		llvm::Function* implementation{nullptr};
+		llvm::Function* entry_point{nullptr};
+	};
+	// A function of the current compilation that is taken from its entry instead of being checked and generated
+	struct ReusedFunction {
+		const Entry& entry;
+		// What the externals of the entry resolved to
+		std::vector<declid_t> externals;
+	};
+
+	// Entries are only reused if the compilation allows it
+	void start_compilation(bool allow_reuse);
+	// Keeps the entries of the functions the compilation reused or generated, and drops all others. What was reused
+	// stays available until the next compilation starts.
+	void finish_compilation();
+
+	// Returns the summary of the function if its entry can be reused. The scope is the one its body is checked in.
+	const EffectAnalysis::FunctionSummary* reuse_function(
+		declid_t function, const std::string& symbol, std::string_view source, const TypeScope& scope);
+	// Starts the entry of a function that was checked, it is completed once the function is generated
+	void add_checked_function(declid_t function, const std::string& symbol, std::string_view source,
+		std::vector<std::string> used_names, const TypeScope& scope);
+
+	// nullptr unless the function is reused by the current (or last) compilation
+	const ReusedFunction* find_reused_function(declid_t function) const;
+	// The summaries of all reused functions, for the effect analysis
+	const std::map<declid_t, EffectAnalysis::FunctionSummary>& get_reused_summaries() const;
+	// nullptr unless the function was checked by the current compilation
+	Entry* find_new_entry(declid_t function);
+	// The generated code of a reused function does not fit anymore, e.g. because a constant it uses changed its value.
+	// Such a compilation has to be repeated without reusing anything.
+	void reject_reused_function();
+	bool has_rejected_functions() const;
+
+	static Reference make_reference(declid_t declaration, const DeclarationDumpster& declarations);
+	static std::vector<Reference> make_references(
+		const std::set<declid_t>& ids, const DeclarationDumpster& declarations);
+	// Returns nothing if the scope has no such declaration
+	static std::optional<declid_t> resolve(const Reference& reference, const TypeScope& scope);
+
+private:
+	// By the symbol of the function
+	std::map<std::string, Entry> m_entries;
+	bool m_allow_reuse{false};
+	bool m_has_rejected_functions{false};
+	std::map<declid_t, ReusedFunction> m_reused_functions;
+	std::map<declid_t, EffectAnalysis::FunctionSummary> m_reused_summaries;
+	std::map<declid_t, std::pair<std::string, Entry>> m_new_entries;
+
+	static uint64_t hash_inputs(
+		std::string_view source, const std::vector<std::string>& used_names, const TypeScope& scope);
+};
+}
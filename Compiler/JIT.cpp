@@ -0,0 +1,274 @@
+#include "JIT.hpp"
+
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <csetjmp>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace Kyra::JIT {
+namespace {
+// State of a running program that all of its threads share
+struct Program {
+	explicit Program(const Environment& environment) :
+		environment(environment), main_thread(std::this_thread::get_id()) {}
+
+	const Environment& environment;
+	const std::thread::id main_thread;
+	std::mutex mutex;
+	// Signaled whenever a thread the program started finishes
+	std::condition_variable thread_finished;
+	unsigned running_threads{0};
+	// Threads keep running until they finish or call exit themselves, but the program already ended for the outside
+	std::atomic<bool> has_exited{false};
+	int exit_code{0};
+};
+
+thread_local Program* current_program = nullptr;
+// Where exit returns to, see run_main and run_thread
+thread_local std::jmp_buf* current_exit_target = nullptr;
+
+int redirect(int fd) {
+	if(fd == STDOUT_FILENO)
+		return current_program->environment.output_fd;
+	if(fd == STDERR_FILENO)
+		return current_program->environment.error_fd;
+	return fd;
+}
+
+// The runtime only talks to the outside world through these functions, so replacing them is enough to give every
+// program its own output
+ssize_t redirected_write(int fd, const void* buffer, size_t count) {
+	if(current_program->has_exited)
+		return static_cast<ssize_t>(count);
+	return write(redirect(fd), buffer, count);
+}
+
+int redirected_dprintf(int fd, const char* format, ...) {
+	if(current_program->has_exited)
+		return 0;
+	va_list arguments;
+	va_start(arguments, format);
+	const int result = vdprintf(redirect(fd), format, arguments);
+	va_end(arguments);
+	return result;
+}
+
+FILE* redirected_fopen(const char* path, const char* mode) {
+	return fopen((current_program->environment.working_directory / path).c_str(), mode);
+}
+
+// Ending the process would end the compiler as well, so exit only ends the program: every thread of it jumps back to
+// where it was started. Kyra code has nothing to clean up on the way, so jumping over its frames is fine. The first
+// exit code wins.
+[[noreturn]] void redirected_exit(int code) {
+	Program& program = *current_program;
+	{
+		std::unique_lock lock(program.mutex);
+		if(!program.has_exited) {
+			program.exit_code = code;
+			program.has_exited = true;
+		}
+		// Threads of a parallel loop might still use the frames main jumps over
+		if(std::this_thread::get_id() == program.main_thread)
+			program.thread_finished.wait(lock, [&]() { return program.running_threads == 0; });
+	}
+	std::longjmp(*current_exit_target, 1);
+}
+
+int run_main(int (*main)()) {
+	std::jmp_buf exit_target;
+	current_exit_target = &exit_target;
+	if(setjmp(exit_target) != 0)
+		return current_program->exit_code;
+	return main();
+}
+
+struct ThreadStart {
+	Program* program;
+	void* (*function)(void*);
+	void* argument;
+};
+
+void* run_thread_function(const ThreadStart& start) {
+	std::jmp_buf exit_target;
+	current_exit_target = &exit_target;
+	if(setjmp(exit_target) != 0)
+		return nullptr;
+	return start.function(start.argument);
+}
+
+// Threads the program starts belong to it, so they get its environment and can end it with exit as well
+void* run_thread(void* argument) {
+	const ThreadStart start = *static_cast<ThreadStart*>(argument);
+	delete static_cast<ThreadStart*>(argument);
+	current_program = start.program;
+	void* result = run_thread_function(start);
+	const std::scoped_lock lock(start.program->mutex);
+	--start.program->running_threads;
+	start.program->thread_finished.notify_all();
+	return result;
+}
+
+int redirected_pthread_create(
+	pthread_t* thread, const pthread_attr_t* attributes, void* (*function)(void*), void* argument) {
+	Program& program = *current_program;
+	auto* start = new ThreadStart{&program, function, argument};
+	{
+		const std::scoped_lock lock(program.mutex);
+		++program.running_threads;
+	}
+	const int error = pthread_create(thread, attributes, &run_thread, start);
+	if(error != 0) {
+		delete start;
+		const std::scoped_lock lock(program.mutex);
+		--program.running_threads;
+		program.thread_finished.notify_all();
+	}
+	return error;
+}
+
+// If the joined thread ended the program, the joining one ends as well
+int redirected_pthread_join(pthread_t thread, void** result) {
+	const int error = pthread_join(thread, result);
+	// The exit code is set before the program is marked as exited
+	if(current_program->has_exited)
+		redirected_exit(current_program->exit_code);
+	return error;
+}
+
+int report_error(Error error, const Environment& environment) {
+	raw_fd_ostream stream(environment.error_fd, false);
+	logAllUnhandledErrors(std::move(error), stream, "Could not run the program: ");
+	return 1;
+}
+
+// A JIT whose programs talk to the outside world through the redirections and can use everything else the process has
+Expected<std::unique_ptr<orc::LLJIT>> create_jit(CodeGenOpt::Level optimization_level = CodeGenOpt::Default) {
+	Expected<orc::JITTargetMachineBuilder> target_machine = orc::JITTargetMachineBuilder::detectHost();
+	if(!target_machine)
+		return target_machine.takeError();
+	target_machine->setCodeGenOptLevel(optimization_level);
+	Expected<std::unique_ptr<orc::LLJIT>> jit =
+		orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(*target_machine)).create();
+	if(!jit)
+		return jit.takeError();
+	orc::JITDylib& main_library = (*jit)->getMainJITDylib();
+	orc::MangleAndInterner mangle((*jit)->getExecutionSession(), (*jit)->getDataLayout());
+	const orc::SymbolMap redirections = {
+		{mangle("write"), JITEvaluatedSymbol::fromPointer(&redirected_write)},
+		{mangle("dprintf"), JITEvaluatedSymbol::fromPointer(&redirected_dprintf)},
+		{mangle("fopen"), JITEvaluatedSymbol::fromPointer(&redirected_fopen)},
+		{mangle("exit"), JITEvaluatedSymbol::fromPointer(&redirected_exit)},
+		{mangle("pthread_create"), JITEvaluatedSymbol::fromPointer(&redirected_pthread_create)},
+		{mangle("pthread_join"), JITEvaluatedSymbol::fromPointer(&redirected_pthread_join)},
+	};
+	if(Error error = main_library.define(orc::absoluteSymbols(redirections)))
+		return error;
+	Expected<std::unique_ptr<orc::DynamicLibrarySearchGenerator>> process_symbols =
+		orc::DynamicLibrarySearchGenerator::GetForCurrentProcess((*jit)->getDataLayout().getGlobalPrefix());
+	if(!process_symbols)
+		return process_symbols.takeError();
+	main_library.addGenerator(std::move(*process_symbols));
+	return jit;
+}
+
+Error add_modules(orc::LLJIT& jit, std::vector<orc::ThreadSafeModule> modules) {
+	for(orc::ThreadSafeModule& module : modules) {
+		if(Error error = jit.addIRModule(std::move(module)))
+			return error;
+	}
+	return Error::success();
+}
+}
+
+void initialize_native_target() {
+	InitializeNativeTarget();
+	InitializeNativeTargetAsmPrinter();
+	// The runtime detects the features of the CPU with inline assembly
+	InitializeNativeTargetAsmParser();
+}
+
+int run(std::vector<orc::ThreadSafeModule> modules, const Environment& environment) {
+	Expected<std::unique_ptr<orc::LLJIT>> jit = create_jit();
+	if(!jit)
+		return report_error(jit.takeError(), environment);
+	if(Error error = add_modules(**jit, std::move(modules)))
+		return report_error(std::move(error), environment);
+
+	Expected<JITEvaluatedSymbol> main_symbol = (*jit)->lookup("main");
+	if(!main_symbol)
+		return report_error(main_symbol.takeError(), environment);
+	Program program(environment);
+	current_program = &program;
+	int exit_code = 1;
+	// Global constructors and destructors, e.g. the one that flushes the output buffer
+	orc::JITDylib& main_library = (*jit)->getMainJITDylib();
+	if(Error error = (*jit)->initialize(main_library))
+		exit_code = report_error(std::move(error), environment);
+	else {
+		exit_code = run_main(jitTargetAddressToFunction<int (*)()>(main_symbol->getAddress()));
+		if(Error error = (*jit)->deinitialize(main_library))
+			exit_code = report_error(std::move(error), environment);
+	}
+	current_program = nullptr;
+	current_exit_target = nullptr;
+	return exit_code;
+}
+
+Session::Session(std::unique_ptr<orc::LLJIT> jit, const Environment& environment) :
+	m_jit(std::move(jit)), m_environment(environment) {}
+
+Session::Session(Session&& other) noexcept = default;
+
+Session::~Session() = default;
+
+std::optional<Session> Session::create(const Environment& environment) {
+	// Entries of the REPL are small and most of them run once, so they are compiled as fast as possible
+	Expected<std::unique_ptr<orc::LLJIT>> jit = create_jit(CodeGenOpt::None);
+	if(!jit) {
+		report_error(jit.takeError(), environment);
+		return {};
+	}
+	return Session(std::move(*jit), environment);
+}
+
+bool Session::add(std::vector<orc::ThreadSafeModule> modules) {
+	if(Error error = add_modules(*m_jit, std::move(modules))) {
+		report_error(std::move(error), m_environment);
+		return false;
+	}
+	return true;
+}
+
+std::optional<int> Session::run(std::vector<orc::ThreadSafeModule> modules, const std::string& function_name) {
+	if(!add(std::move(modules)))
+		return {};
+	Expected<JITEvaluatedSymbol> symbol = m_jit->lookup(function_name);
+	if(!symbol) {
+		report_error(symbol.takeError(), m_environment);
+		return {};
+	}
+	// Every program starts out without having exited
+	Program program(m_environment);
+	current_program = &program;
+	const int exit_code = run_main(jitTargetAddressToFunction<int (*)()>(symbol->getAddress()));
+	current_program = nullptr;
+	current_exit_target = nullptr;
+	return exit_code;
+}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace llvm::orc {
+class LLJIT;
+}
+
+namespace Kyra::JIT {
+
+// Where a program that runs inside of the compiler process writes to. This allows several programs to run at the same
+// time on different threads, each of them with its own output (see Server).
+struct Environment {
+	int output_fd;
+	int error_fd;
+	// Relative paths the program opens (e.g. the instrumentation profile) are resolved against it
+	std::filesystem::path working_directory;
+};
+
+// Has to be called once before the first program is run
+void initialize_native_target();
+
+// Links the program with all modules it imports, runs main and the global destructors on the calling thread and returns
+// the exit code of main, or the one the program passed to exit
+int run(std::vector<llvm::orc::ThreadSafeModule> modules, const Environment& environment);
+
+// A JIT that is kept between programs, e.g. for the entries of the REPL. Every program can call the functions and use
+// the globals of the modules that were added before it, so they are not compiled again.
+class Session {
+public:
+	// Returns nothing if the JIT could not be set up, the error is written to the environment
+	static std::optional<Session> create(const Environment& environment);
+	Session(const Session&) = delete;
+	Session(Session&& other) noexcept;
+	~Session();
+
+	Session& operator=(const Session&) = delete;
+	Session& operator=(Session&&) = delete;
+
+	// Modules are only compiled once a program uses them. Returns false if they could not be added, the error is
+	// written to the environment.
+	bool add(std::vector<llvm::orc::ThreadSafeModule> modules);
+	// Adds the modules and runs the function with the given name on the calling thread. Returns what the function
+	// returned or the exit code the program passed to exit, or nothing if the modules could not be added. Global
+	// constructors and destructors are not run.
+	std::optional<int> run(std::vector<llvm::orc::ThreadSafeModule> modules, const std::string& function_name);
+
+private:
+	std::unique_ptr<llvm::orc::LLJIT> m_jit;
+	Environment m_environment;
+
+	Session(std::unique_ptr<llvm::orc::LLJIT> jit, const Environment& environment);
+};
+}
@@ -9,6 +9,11 @@ ErrorOr<std::vector<Token>> Lexer::scan_input(std::string_view source, const std
 	m_file_path = file_path;
 	m_source = source;
 	m_tokens.clear();
+	// Tokens are between two and three characters long on average (including whitespace), so this is enough for almost
+	// every input and the tokens do not have to be moved while they are scanned
+	m_tokens.reserve(source.size() / 2 + 1);
+	m_current = {1, 0, 0};
+	m_start = {1, 0, 0};
 
 	try {
 		while(!is_at_end()) {
@@ -20,7 +25,7 @@ ErrorOr<std::vector<Token>> Lexer::scan_input(std::string_view source, const std
 	}
 	add_token(TokenType::END_OF_FILE);
 
-	return m_tokens;
+	return std::move(m_tokens);
 }
 
 void Lexer::scan_token() {
@@ -34,6 +39,8 @@ void Lexer::scan_token() {
 		case ')': add_token(TokenType::RIGHT_PAREN); break;
 		case '{': add_token(TokenType::LEFT_CURLY); break;
 		case '}': add_token(TokenType::RIGHT_CURLY); break;
+		case '[': add_token(TokenType::LEFT_BRACKET); break;
+		case ']': add_token(TokenType::RIGHT_BRACKET); break;
 		case ',': add_token(TokenType::COMMA); break;
 		case ';': add_token(TokenType::SEMICOLON); break;
 		case ':': add_token(TokenType::COLON); break;
@@ -43,6 +50,12 @@ void Lexer::scan_token() {
 		case '/': add_token(TokenType::SLASH); break;
 		case '=': add_token(TokenType::EQUAL); break;
 		case '#': comment(); break;
+		case '.':
+			if(match_and_advance('.')) {
+				add_token(TokenType::DOT_DOT);
+				break;
+			}
+			[[fallthrough]];
 		default:
 			if(is_digit(current))
 				number();
@@ -137,7 +150,10 @@ bool Lexer::is_overridable_operator(char character) const {
 
 std::optional<TokenType> Lexer::is_keyword(std::string_view string) const {
 	static const std::map<std::string_view, TokenType> keywords{{"var", TokenType::VAR}, {"val", TokenType::VAL},
-		{"fun", TokenType::FUN}, {"print", TokenType::PRINT}, {"return", TokenType::RETURN}};
+		{"fun", TokenType::FUN}, {"print", TokenType::PRINT}, {"return", TokenType::RETURN},
+		{"import", TokenType::IMPORT}, {"for", TokenType::FOR}, {"in", TokenType::IN},
+		{"parallel", TokenType::PARALLEL}, {"memo", TokenType::MEMO},
+		{"extern", TokenType::EXTERN}};
 
 	if(const auto& it = keywords.find(string); it != keywords.end())
 		return it->second;
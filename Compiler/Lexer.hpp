@@ -13,11 +13,6 @@ namespace Kyra {
 
 class Lexer {
 public:
-	static Lexer& the() {
-		static Lexer instance;
-		return instance;
-	}
-
 	Lexer() = default;
 	Lexer(const Lexer&) = delete;
 	Lexer(Lexer&&) noexcept = default;
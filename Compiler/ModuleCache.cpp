@@ -0,0 +1,100 @@
+#include "ModuleCache.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+
+namespace Kyra {
+namespace {
+std::optional<std::string> read_file(const std::filesystem::path& path) {
+	std::ifstream input(path);
+	if(!input)
+		return {};
+	return std::string((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+}
+
+std::filesystem::path get_source_path(const std::filesystem::path& interface_path) {
+	return std::filesystem::path(interface_path).replace_extension(".ky");
+}
+}
+
+ModuleCache::ModuleCache(CompilerInstance& instance, std::filesystem::path root_path, const CodeGen::Options& options) :
+	m_instance(instance), m_root_path(std::move(root_path)), m_options(options) {}
+
+bool ModuleCache::update(std::ostream& error_output) {
+	m_source_paths.clear();
+	m_compiled_modules = 0;
+	m_reused_functions = 0;
+	std::set<std::filesystem::path> updated_paths;
+	const bool successful = update_module(m_root_path, updated_paths);
+	for(const std::filesystem::path& path : m_source_paths)
+		error_output << m_modules.at(path).diagnostics;
+	return successful;
+}
+
+const std::vector<std::filesystem::path>& ModuleCache::get_source_paths() const { return m_source_paths; }
+
+unsigned ModuleCache::get_compiled_modules() const { return m_compiled_modules; }
+
+size_t ModuleCache::get_reused_functions() const { return m_reused_functions; }
+
+void ModuleCache::print_root_module(llvm::raw_ostream& output) const {
+	m_modules.at(m_root_path).module->withModuleDo([&](llvm::Module& module) { module.print(output, nullptr); });
+}
+
+std::vector<llvm::orc::ThreadSafeModule> ModuleCache::clone_modules() const {
+	std::vector<llvm::orc::ThreadSafeModule> modules;
+	for(const std::filesystem::path& path : m_source_paths)
+		modules.push_back(llvm::orc::cloneToNewContext(*m_modules.at(path).module));
+	return modules;
+}
+
+bool ModuleCache::update_module(const std::filesystem::path& path, std::set<std::filesystem::path>& updated_paths) {
+	if(!updated_paths.insert(path).second)
+		return m_modules.at(path).module.has_value();
+	m_source_paths.push_back(path);
+	Module& module = m_modules[path];
+	// The modules the last compilation imported come first, so their interfaces are current when they are compared
+	bool imports_successful = true;
+	for(const auto& [interface_path, content] : module.interfaces)
+		imports_successful &= update_module(get_source_path(interface_path), updated_paths);
+
+	std::optional<std::string> source = read_file(path);
+	if(!source.has_value()) {
+		module = {};
+		module.diagnostics = "Could not read the module " + path.string() + '\n';
+		return false;
+	}
+	while(has_changed_inputs(module, *source)) {
+		std::ostringstream diagnostics;
+		module.module = m_instance.generate_module(path, *source, m_options, diagnostics, &module.functions);
+		m_reused_functions += module.functions.get_reused_summaries().size();
+		module.diagnostics = diagnostics.str();
+		module.source = *source;
+		module.interfaces.clear();
+		for(const std::filesystem::path& interface_path : m_instance.get_imported_interfaces())
+			module.interfaces[interface_path] = read_file(interface_path).value_or("");
+		module.is_compiled = true;
+		++m_compiled_modules;
+		// Modules that are imported for the first time are only compiled now. If that changes their interface, the
+		// module is compiled once more.
+		for(const auto& [interface_path, content] : module.interfaces) {
+			const std::filesystem::path source_path = get_source_path(interface_path);
+			if(!updated_paths.contains(source_path))
+				imports_successful &= update_module(source_path, updated_paths);
+		}
+	}
+	return imports_successful && module.module.has_value();
+}
+
+bool ModuleCache::has_changed_inputs(const Module& module, const std::string& source) const {
+	if(!module.is_compiled || module.source != source)
+		return true;
+	for(const auto& [interface_path, content] : module.interfaces) {
+		if(read_file(interface_path) != content)
+			return true;
+	}
+	return false;
+}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "CodeGen.hpp"
+#include "CompilerInstance.hpp"
+#include "FunctionCache.hpp"
+
+namespace Kyra {
+
+// Keeps the results of compiling a program and all modules it imports between edits of their sources (see kyra
+// --watch). Compiling a module is a query whose inputs are its source and the interfaces of the modules it imports,
+// and it only runs again if one of them changed. A library writes its interface whenever it is compiled, but the
+// modules importing it are only compiled again if the content of the interface changed.
+// Within a module that is compiled again, only lexing and parsing always cover the whole source. Every module keeps a
+// FunctionCache, so the top-level functions that did not change are neither checked nor generated again.
+class ModuleCache {
+public:
+	ModuleCache(CompilerInstance& instance, std::filesystem::path root_path, const CodeGen::Options& options);
+	ModuleCache(const ModuleCache&) = delete;
+	ModuleCache(ModuleCache&&) = delete;
+
+	ModuleCache& operator=(const ModuleCache&) = delete;
+	ModuleCache& operator=(ModuleCache&&) = delete;
+
+	// Brings the root module and everything it imports up to date. The diagnostics of all modules that do not compile
+	// go to the error output, even if they were not compiled again. Returns whether all modules compiled.
+	bool update(std::ostream& error_output);
+
+	// The sources of all modules the last update reached, the root module first
+	const std::vector<std::filesystem::path>& get_source_paths() const;
+	// How many modules the last update actually compiled
+	unsigned get_compiled_modules() const;
+	// How many functions the compilations of the last update took from their function caches
+	size_t get_reused_functions() const;
+	// Only valid if the last update was successful
+	void print_root_module(llvm::raw_ostream& output) const;
+	// Copies of all modules for the JIT, which consumes them. Only valid if the last update was successful.
+	std::vector<llvm::orc::ThreadSafeModule> clone_modules() const;
+
+private:
+	struct Module {
+		bool is_compiled{false};
+		std::string source;
+		// The content every imported interface had when the module was compiled
+		std::map<std::filesystem::path, std::string> interfaces;
+		// Nothing if the module did not compile
+		std::optional<llvm::orc::ThreadSafeModule> module;
+		std::string diagnostics;
+		FunctionCache functions;
+	};
+
+	CompilerInstance& m_instance;
+	const std::filesystem::path m_root_path;
+	const CodeGen::Options m_options;
+	std::map<std::filesystem::path, Module> m_modules;
+	std::vector<std::filesystem::path> m_source_paths;
+	unsigned m_compiled_modules{0};
+	size_t m_reused_functions{0};
+
+	bool update_module(const std::filesystem::path& path, std::set<std::filesystem::path>& updated_paths);
+	bool has_changed_inputs(const Module& module, const std::string& source) const;
+};
+}
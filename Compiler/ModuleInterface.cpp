@@ -0,0 +1,220 @@
+#include "ModuleInterface.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+namespace Kyra {
+namespace {
+// An interface file starts with the header, followed by one record per function (each directly followed by the records
+// of its parameters) and all strings. Strings are referenced by their offset from the start of the file. Interfaces are
+// build artifacts for the machine they were built on, so everything is stored in its native byte order.
+constexpr char interface_magic[4] = {'K', 'Y', 'I', 'F'};
+constexpr uint32_t interface_version = 2;
+
+struct StringReference {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	StringReference module_name;
+	uint32_t function_count;
+};
+
+struct FunctionRecord {
+	StringReference name;
+	StringReference return_type;
+	uint32_t effects;
+	uint32_t parameter_count;
+};
+
+struct ParameterRecord {
+	StringReference type;
+	uint32_t is_mutable;
+};
+
+void mangle_type(std::string& mangled_name, const DeclaredType& type, bool is_mutable) {
+	if(is_mutable)
+		mangled_name += 'M';
+	mangled_name += std::to_string(type.get_name().size());
+	mangled_name += type.get_name();
+}
+
+// Reads the records of a mapped file and checks that none of them reaches beyond its end
+class RecordReader {
+public:
+	RecordReader(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+	template <typename Record>
+	const Record* read() {
+		if(m_size - m_position < sizeof(Record))
+			return nullptr;
+		const Record* record = reinterpret_cast<const Record*>(m_data + m_position);
+		m_position += sizeof(Record);
+		return record;
+	}
+
+	std::optional<std::string_view> get_string(const StringReference& reference) const {
+		if(reference.offset > m_size || m_size - reference.offset < reference.length)
+			return {};
+		return std::string_view(m_data + reference.offset, reference.length);
+	}
+
+private:
+	const char* m_data;
+	size_t m_size;
+	size_t m_position{0};
+};
+}
+
+ModuleInterface::ModuleInterface(void* mapping, size_t size) : m_mapping(mapping), m_size(size) {}
+
+ModuleInterface::ModuleInterface(ModuleInterface&& other) noexcept :
+	m_mapping(std::exchange(other.m_mapping, nullptr)), m_size(std::exchange(other.m_size, 0)),
+	m_module_name(other.m_module_name), m_functions(std::move(other.m_functions)) {}
+
+ModuleInterface::~ModuleInterface() {
+	if(m_mapping != nullptr)
+		munmap(m_mapping, m_size);
+}
+
+std::filesystem::path ModuleInterface::get_path_for(const std::filesystem::path& source_file_path) {
+	return std::filesystem::path(source_file_path).replace_extension(".kyi");
+}
+
+bool ModuleInterface::is_library(const std::vector<RefPtr<Typed::Statement>>& statements) {
+	if(statements.empty())
+		return false;
+	for(const RefPtr<Typed::Statement>& statement : statements) {
+		const Typed::TASTNode::NodeKind node_kind = statement->get_node_kind();
+		if(node_kind != Typed::TASTNode::NodeKind::Function && node_kind != Typed::TASTNode::NodeKind::ExternalFunction)
+			return false;
+	}
+	return true;
+}
+
+std::string ModuleInterface::mangle(
+	std::string_view module_name, std::string_view function_name, const FunctionType& type) {
+	std::string mangled_name = "_K";
+	mangled_name += std::to_string(module_name.size());
+	mangled_name += module_name;
+	mangled_name += std::to_string(function_name.size());
+	mangled_name += function_name;
+	mangled_name += 'E';
+	mangle_type(mangled_name, *type.get_returned_type(), false);
+	for(const RefPtr<AppliedType>& parameter : type.get_parameter())
+		mangle_type(mangled_name, parameter->get_declared_type(), parameter->is_mutable());
+	return mangled_name;
+}
+
+bool ModuleInterface::write(
+	const std::filesystem::path& path, std::string_view module_name, const std::vector<Function>& functions) {
+	size_t records_size = sizeof(FileHeader);
+	for(const Function& function : functions)
+		records_size += sizeof(FunctionRecord) + function.type->get_parameter().size() * sizeof(ParameterRecord);
+
+	std::string records;
+	std::string strings;
+	const auto add_string = [&](std::string_view string) {
+		const StringReference reference{static_cast<uint32_t>(records_size + strings.size()),
+			static_cast<uint32_t>(string.size())};
+		strings += string;
+		return reference;
+	};
+	const auto add_record = [&](const auto& record) {
+		records.append(reinterpret_cast<const char*>(&record), sizeof(record));
+	};
+
+	FileHeader header{};
+	std::memcpy(header.magic, interface_magic, sizeof(header.magic));
+	header.version = interface_version;
+	header.module_name = add_string(module_name);
+	header.function_count = functions.size();
+	add_record(header);
+	for(const Function& function : functions) {
+		const std::vector<RefPtr<AppliedType>>& parameters = function.type->get_parameter();
+		add_record(FunctionRecord{add_string(function.name), add_string(function.type->get_returned_type()->get_name()),
+			function.effects, static_cast<uint32_t>(parameters.size())});
+		for(const RefPtr<AppliedType>& parameter : parameters)
+			add_record(ParameterRecord{add_string(parameter->get_declared_type().get_name()), parameter->is_mutable()});
+	}
+
+	// Importers that run at the same time must never see a partially written file
+	std::filesystem::path temporary_path = path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+		output << records << strings;
+		if(!output)
+			return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary_path, path, error);
+	return !error;
+}
+
+std::optional<ModuleInterface> ModuleInterface::load(const std::filesystem::path& path, const TypeScope& scope) {
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return {};
+	struct stat status {};
+	void* mapping = MAP_FAILED;
+	if(fstat(fd, &status) == 0 && status.st_size > 0)
+		mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+		return {};
+	ModuleInterface interface(mapping, status.st_size);
+
+	RecordReader reader(static_cast<const char*>(mapping), status.st_size);
+	const FileHeader* header = reader.read<FileHeader>();
+	if(header == nullptr || std::memcmp(header->magic, interface_magic, sizeof(interface_magic)) != 0 ||
+		header->version != interface_version)
+		return {};
+	const std::optional<std::string_view> module_name = reader.get_string(header->module_name);
+	if(!module_name.has_value())
+		return {};
+	interface.m_module_name = *module_name;
+
+	for(uint32_t i = 0; i < header->function_count; ++i) {
+		const FunctionRecord* function = reader.read<FunctionRecord>();
+		if(function == nullptr)
+			return {};
+		const std::optional<std::string_view> name = reader.get_string(function->name);
+		const std::optional<std::string_view> return_type_name = reader.get_string(function->return_type);
+		if(!name.has_value() || !return_type_name.has_value())
+			return {};
+		RefPtr<DeclaredType> return_type = scope.find_type(*return_type_name);
+		if(return_type == nullptr)
+			return {};
+		std::vector<RefPtr<AppliedType>> parameters;
+		for(uint32_t j = 0; j < function->parameter_count; ++j) {
+			const ParameterRecord* parameter = reader.read<ParameterRecord>();
+			if(parameter == nullptr)
+				return {};
+			const std::optional<std::string_view> type_name = reader.get_string(parameter->type);
+			RefPtr<DeclaredType> type = type_name.has_value() ? scope.find_type(*type_name) : nullptr;
+			if(type == nullptr)
+				return {};
+			parameters.push_back(AppliedType::promote_declared_type(type, parameter->is_mutable != 0));
+		}
+		interface.m_functions.push_back(
+			{*name, mk_ref<FunctionType>(*name, return_type, parameters), function->effects});
+	}
+	return interface;
+}
+
+std::string_view ModuleInterface::get_module_name() const { return m_module_name; }
+
+const std::vector<ModuleInterface::Function>& ModuleInterface::get_functions() const { return m_functions; }
+}
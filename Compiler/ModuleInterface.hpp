@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "TAST.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+// The functions a module exports, as written to <module>.kyi next to its source whenever it is compiled. Importers map
+// that file and read the signatures in place, so imported modules are neither parsed nor type checked again.
+class ModuleInterface {
+public:
+	struct Function {
+		std::string_view name;
+		RefPtr<FunctionType> type;
+		// See EffectAnalysis::Effect
+		unsigned effects;
+	};
+
+	ModuleInterface(const ModuleInterface&) = delete;
+	ModuleInterface(ModuleInterface&& other) noexcept;
+	~ModuleInterface();
+
+	ModuleInterface& operator=(const ModuleInterface&) = delete;
+	ModuleInterface& operator=(ModuleInterface&&) = delete;
+
+	static std::filesystem::path get_path_for(const std::filesystem::path& source_file_path);
+	// A module with nothing but functions and imports on its top-level is a library. It has no entry point and exports
+	// all of its top-level functions.
+	static bool is_library(const std::vector<RefPtr<Typed::Statement>>& statements);
+	// The symbol name of a function, which only depends on its module and signature. E.g. add(var a: i32, b: i32): i32
+	// in math.ky becomes _K4math3addE3i32M3i323i32 (return type, then the parameters, M marks mutable ones).
+	static std::string mangle(std::string_view module_name, std::string_view function_name, const FunctionType& type);
+
+	static bool write(
+		const std::filesystem::path& path, std::string_view module_name, const std::vector<Function>& functions);
+	// Types are looked up in the scope. Returns nothing if the file cannot be read or is not a valid interface.
+	static std::optional<ModuleInterface> load(const std::filesystem::path& path, const TypeScope& scope);
+
+	std::string_view get_module_name() const;
+	const std::vector<Function>& get_functions() const;
+
+private:
+	// All names point into the mapped file
+	void* m_mapping;
+	size_t m_size;
+	std::string_view m_module_name;
+	std::vector<Function> m_functions;
+
+	ModuleInterface(void* mapping, size_t size);
+};
+}
@@ -1,6 +1,8 @@
 #include "Parser.hpp"
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 
 #include "SourceRange.hpp"
 
@@ -13,13 +15,19 @@ ErrorOr<std::vector<RefPtr<Statement>>> Parser::parse_tokens(const std::vector<T
 	m_current_token = m_tokens->begin();
 
 	try {
-		while(!is_at_end())
-			m_statements.push_back(declaration());
+		while(!is_at_end()) {
+			if(match(TokenType::IMPORT))
+				m_statements.push_back(import_declaration());
+			else if(match(TokenType::EXTERN))
+				m_statements.push_back(extern_declaration());
+			else
+				m_statements.push_back(declaration());
+		}
 	} catch(const ErrorException& e) {
 		return e;
 	}
 
-	return m_statements;
+	return std::move(m_statements);
 }
 
 RefPtr<Statement> Parser::statement() {
@@ -29,6 +37,8 @@ RefPtr<Statement> Parser::statement() {
 		return print_statement();
 	if(match(TokenType::RETURN))
 		return return_statement();
+	if(match(TokenType::FOR, TokenType::PARALLEL))
+		return for_statement();
 	return expression_statement();
 }
 
@@ -62,11 +72,31 @@ RefPtr<Statement> Parser::block() {
 	return mk_ref<Block>(SourceRange::unite(begin_curly.get_source_range(), end_curly.get_source_range()), body);
 }
 
+RefPtr<Statement> Parser::for_statement() {
+	const Token& first_keyword = *m_current_token;
+	const bool is_parallel = match_and_advance(TokenType::PARALLEL);
+	consume(TokenType::FOR);
+	const Token& variable = consume(TokenType::NAME);
+	consume(TokenType::IN);
+	RefPtr<Expression> begin = expression();
+	consume(TokenType::DOT_DOT);
+	RefPtr<Expression> end = expression();
+	RefPtr<Block> body = std::static_pointer_cast<Block>(block());
+	return mk_ref<For>(SourceRange::unite(first_keyword.get_source_range(), body->get_source_range()), variable, begin,
+		end, body, is_parallel);
+}
+
 RefPtr<Statement> Parser::declaration() {
 	if(match(TokenType::VAL, TokenType::VAR))
 		return variable_declaration();
-	if(match(TokenType::FUN))
+	if(match(TokenType::FUN, TokenType::MEMO))
 		return function_declaration();
+	if(match(TokenType::IMPORT))
+		throw ErrorException("Imports are only allowed on the top-level", m_current_token->get_source_range());
+	if(match(TokenType::EXTERN)) {
+		throw ErrorException(
+			"External functions can only be declared on the top-level", m_current_token->get_source_range());
+	}
 	return statement();
 }
 
@@ -84,8 +114,18 @@ RefPtr<Statement> Parser::variable_declaration() {
 }
 
 RefPtr<Statement> Parser::function_declaration() {
-	const Token& fun = consume(TokenType::FUN);
+	const Token& first_keyword = *m_current_token;
+	const bool is_memoized = match_and_advance(TokenType::MEMO);
+	consume(TokenType::FUN);
 	const Token& identifier = consume(TokenType::NAME);
+	std::vector<Function::Parameter> params = parameters();
+	RefPtr<TypeIndicator> return_type = std::static_pointer_cast<TypeIndicator>(type());
+	RefPtr<Block> implementation = std::static_pointer_cast<Block>(block());
+	return mk_ref<Function>(SourceRange::unite(first_keyword.get_source_range(), implementation->get_source_range()),
+		identifier, implementation, return_type, params, is_memoized);
+}
+
+std::vector<Function::Parameter> Parser::parameters() {
 	consume(TokenType::LEFT_PAREN);
 	std::vector<Function::Parameter> params;
 	if(!match(TokenType::RIGHT_PAREN)) {
@@ -99,22 +139,42 @@ RefPtr<Statement> Parser::function_declaration() {
 		} while(match_and_advance(TokenType::COMMA));
 	}
 	consume(TokenType::RIGHT_PAREN);
+	return params;
+}
+
+RefPtr<Statement> Parser::extern_declaration() {
+	const Token& extern_keyword = consume(TokenType::EXTERN);
+	consume(TokenType::FUN);
+	const Token& identifier = consume(TokenType::NAME);
+	std::vector<Function::Parameter> params = parameters();
 	RefPtr<TypeIndicator> return_type = std::static_pointer_cast<TypeIndicator>(type());
-	RefPtr<Block> implementation = std::static_pointer_cast<Block>(block());
-	return mk_ref<Function>(SourceRange::unite(fun.get_source_range(), implementation->get_source_range()), identifier,
-		implementation, return_type, params);
+	const Token& semicolon = consume(TokenType::SEMICOLON);
+	return mk_ref<ExternFunction>(SourceRange::unite(extern_keyword.get_source_range(), semicolon.get_source_range()),
+		identifier, return_type, params);
+}
+
+RefPtr<Statement> Parser::import_declaration() {
+	const Token& import = consume(TokenType::IMPORT);
+	const Token& module_name = consume(TokenType::NAME);
+	const Token& semicolon = consume(TokenType::SEMICOLON);
+	return mk_ref<Import>(SourceRange::unite(import.get_source_range(), semicolon.get_source_range()), module_name);
 }
 
 RefPtr<Expression> Parser::expression() { return assignment(); }
 
 RefPtr<Expression> Parser::assignment() {
 	RefPtr<Expression> lhs = term();
-	if(!match_and_advance(TokenType::EQUAL))
+	if(!match(TokenType::EQUAL))
 		return lhs;
-	const Token& identifier = std::static_pointer_cast<VarQuery>(lhs)->get_identifier();
+	if(lhs->get_node_kind() != ASTNode::NodeKind::VarQuery && lhs->get_node_kind() != ASTNode::NodeKind::Index)
+		throw ErrorException("Only variables and array elements can be assigned to", lhs->get_source_range());
+	consume(TokenType::EQUAL);
 	RefPtr<Expression> new_value = expression();
-	return mk_ref<Assignment>(
-		SourceRange::unite(lhs->get_source_range(), new_value->get_source_range()), identifier, new_value);
+	const SourceRange source_range = SourceRange::unite(lhs->get_source_range(), new_value->get_source_range());
+	if(lhs->get_node_kind() == ASTNode::NodeKind::Index)
+		return mk_ref<IndexAssignment>(source_range, std::static_pointer_cast<Index>(lhs), new_value);
+	const Token& identifier = std::static_pointer_cast<VarQuery>(lhs)->get_identifier();
+	return mk_ref<Assignment>(source_range, identifier, new_value);
 }
 
 RefPtr<Expression> Parser::term() {
@@ -131,22 +191,34 @@ RefPtr<Expression> Parser::term() {
 }
 
 RefPtr<Expression> Parser::factor() {
-	RefPtr<Expression> lhs = call();
+	RefPtr<Expression> lhs = index();
 	while(true) {
 		const Token& oper = *m_current_token;
 		if(!match_and_advance(TokenType::SLASH, TokenType::STAR))
 			break;
-		RefPtr<Expression> rhs = call();
+		RefPtr<Expression> rhs = index();
 		lhs = mk_ref<BinaryExpression>(
 			SourceRange::unite(lhs->get_source_range(), rhs->get_source_range()), lhs, rhs, oper);
 	}
 	return lhs;
 }
 
+RefPtr<Expression> Parser::index() {
+	RefPtr<Expression> lhs = call();
+	while(match_and_advance(TokenType::LEFT_BRACKET)) {
+		RefPtr<Expression> index = expression();
+		const Token& right_bracket = consume(TokenType::RIGHT_BRACKET);
+		lhs = mk_ref<Index>(SourceRange::unite(lhs->get_source_range(), right_bracket.get_source_range()), lhs, index);
+	}
+	return lhs;
+}
+
 RefPtr<Expression> Parser::call() {
 	RefPtr<Expression> lhs = primary();
 	if(!match(TokenType::LEFT_PAREN))
 		return lhs;
+	if(lhs->get_node_kind() != ASTNode::NodeKind::VarQuery)
+		throw ErrorException("Only functions can be called", lhs->get_source_range());
 	consume(TokenType::LEFT_PAREN);
 	std::vector<Call::Argument> args;
 	if(!match(TokenType::RIGHT_PAREN)) {
@@ -162,9 +234,11 @@ RefPtr<Expression> Parser::call() {
 
 RefPtr<Expression> Parser::primary() {
 	if(match(TokenType::NUMBER)) {
-		const Token& literal = consume(TokenType::NUMBER);
-		return mk_ref<IntLiteral>(literal.get_source_range(), literal.get_literal_value().as_int());
+		const SourceRange& source_range = m_current_token->get_source_range();
+		return mk_ref<IntLiteral>(source_range, number());
 	}
+	if(match(TokenType::LEFT_BRACKET))
+		return array_literal();
 	if(match(TokenType::NAME)) {
 		const Token& identifier = consume(TokenType::NAME);
 		return mk_ref<VarQuery>(identifier.get_source_range(), identifier);
@@ -176,10 +250,44 @@ RefPtr<Expression> Parser::primary() {
 	return mk_ref<Group>(SourceRange::unite(open_paren.get_source_range(), close_paren.get_source_range()), content);
 }
 
+RefPtr<Expression> Parser::array_literal() {
+	const Token& left_bracket = consume(TokenType::LEFT_BRACKET);
+	std::vector<RefPtr<Expression>> elements;
+	if(!match(TokenType::RIGHT_BRACKET)) {
+		do {
+			elements.push_back(expression());
+		} while(match_and_advance(TokenType::COMMA));
+	}
+	const Token& right_bracket = consume(TokenType::RIGHT_BRACKET);
+	return mk_ref<ArrayLiteral>(
+		SourceRange::unite(left_bracket.get_source_range(), right_bracket.get_source_range()), elements);
+}
+
 RefPtr<Expression> Parser::type() {
 	consume(TokenType::COLON);
-	const Token& identifier = consume(TokenType::NAME);
-	return mk_ref<TypeIndicator>(identifier.get_source_range(), identifier);
+	return type_name();
+}
+
+RefPtr<TypeIndicator> Parser::type_name() {
+	if(!match(TokenType::LEFT_BRACKET)) {
+		const Token& identifier = consume(TokenType::NAME);
+		return mk_ref<TypeIndicator>(identifier.get_source_range(), identifier);
+	}
+	const Token& left_bracket = consume(TokenType::LEFT_BRACKET);
+	RefPtr<TypeIndicator> element_type = type_name();
+	consume(TokenType::SEMICOLON);
+	const uint64_t length = number();
+	const Token& right_bracket = consume(TokenType::RIGHT_BRACKET);
+	return mk_ref<TypeIndicator>(SourceRange::unite(left_bracket.get_source_range(), right_bracket.get_source_range()),
+		left_bracket, element_type, length);
+}
+
+uint64_t Parser::number() {
+	const Token& literal = consume(TokenType::NUMBER);
+	const std::optional<uint64_t> value = literal.get_literal_value().as_int();
+	if(!value.has_value())
+		throw ErrorException("Literal is too large", literal.get_source_range());
+	return *value;
 }
 
 bool Parser::is_at_end() const { return m_current_token->get_type() == TokenType::END_OF_FILE; }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <sstream>
 
 #include "AST.hpp"
@@ -11,11 +12,6 @@ namespace Kyra {
 
 class Parser {
 public:
-	static Parser& the() {
-		static Parser instance;
-		return instance;
-	}
-
 	Parser() = default;
 	Parser(const Parser&) = delete;
 	Parser(Parser&&) noexcept = default;
@@ -35,17 +31,26 @@ private:
 	RefPtr<Untyped::Statement> print_statement();
 	RefPtr<Untyped::Statement> return_statement();
 	RefPtr<Untyped::Statement> block();
+	RefPtr<Untyped::Statement> for_statement();
 	RefPtr<Untyped::Statement> declaration();
 	RefPtr<Untyped::Statement> variable_declaration();
 	RefPtr<Untyped::Statement> function_declaration();
+	// The parenthesized parameter list of a function
+	std::vector<Untyped::Function::Parameter> parameters();
+	RefPtr<Untyped::Statement> extern_declaration();
+	RefPtr<Untyped::Statement> import_declaration();
 
 	RefPtr<Untyped::Expression> expression();
 	RefPtr<Untyped::Expression> assignment();
 	RefPtr<Untyped::Expression> term();
 	RefPtr<Untyped::Expression> factor();
+	RefPtr<Untyped::Expression> index();
 	RefPtr<Untyped::Expression> call();
 	RefPtr<Untyped::Expression> primary();
+	RefPtr<Untyped::Expression> array_literal();
 	RefPtr<Untyped::Expression> type();
+	RefPtr<Untyped::TypeIndicator> type_name();
+	uint64_t number();
 
 	template <typename... Args, typename = All<TokenType, Args...>>
 	bool match(Args... args) const {
@@ -0,0 +1,74 @@
+#include "Repl.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace Kyra {
+namespace {
+void write_to(int fd, std::string_view string) {
+	while(!string.empty()) {
+		const ssize_t written = write(fd, string.data(), string.size());
+		if(written <= 0)
+			return;
+		string.remove_prefix(written);
+	}
+}
+
+// An entry continues on the next line as long as one of its blocks is still open, e.g. the body of a function
+bool is_complete(std::string_view source) {
+	return std::count(source.begin(), source.end(), '{') <= std::count(source.begin(), source.end(), '}');
+}
+}
+
+Repl::Repl(CompilerInstance& instance, const JIT::Environment& environment) :
+	m_instance(instance), m_environment(environment), m_scope(mk_ref<TypeScope>(instance.get_builtin_scope())) {}
+
+int Repl::run(std::istream& input) {
+	std::optional<JIT::Session> session = JIT::Session::create(m_environment);
+	if(!session.has_value())
+		return 1;
+	std::vector<llvm::orc::ThreadSafeModule> runtime;
+	runtime.push_back(m_instance.get_code_gen().generate_runtime());
+	if(!session->add(std::move(runtime)))
+		return 1;
+	// Prompts would only get in the way of piped input
+	const bool is_interactive = isatty(STDIN_FILENO) == 1;
+	std::string source;
+	while(true) {
+		if(is_interactive)
+			write_to(m_environment.output_fd, source.empty() ? "> " : "... ");
+		std::string line;
+		if(!std::getline(input, line))
+			break;
+		source += line;
+		source += '\n';
+		if(!is_complete(source))
+			continue;
+		if(source.find_first_not_of(" \t\r\n") != std::string::npos)
+			evaluate(std::move(source), *session);
+		source.clear();
+	}
+	if(is_interactive)
+		write_to(m_environment.output_fd, "\n");
+	return 0;
+}
+
+void Repl::evaluate(std::string source, JIT::Session& session) {
+	// Every entry is a module of its own, whose name is also the one of its top-level code, see CodeGen::Options::repl
+	const std::filesystem::path file_path = "entry" + std::to_string(++m_entries);
+	std::vector<llvm::orc::ThreadSafeModule> modules;
+	std::ostringstream diagnostics;
+	const bool successful =
+		m_instance.generate_entry(file_path, std::move(source), m_scope, modules, m_generated_paths, diagnostics);
+	write_to(m_environment.error_fd, diagnostics.str());
+	if(!successful)
+		return;
+	// A program that exits (e.g. because an index is out of bounds) only ends the entry
+	session.run(std::move(modules), file_path.string());
+}
+}
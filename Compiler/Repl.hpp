@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <istream>
+#include <set>
+#include <string>
+
+#include "Aliases.hpp"
+#include "CompilerInstance.hpp"
+#include "JIT.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+// Runs declarations and statements as soon as they are entered (see kyra repl). Every entry is checked against a scope
+// that keeps what the earlier entries declared, and it is generated into a small module of its own, which is added to
+// a JIT that lives as long as the REPL. Earlier entries are never compiled again, so an entry only costs as much as its
+// own code, no matter how long the session already is.
+class Repl {
+public:
+	Repl(CompilerInstance& instance, const JIT::Environment& environment);
+	Repl(const Repl&) = delete;
+	Repl(Repl&&) = delete;
+
+	Repl& operator=(const Repl&) = delete;
+	Repl& operator=(Repl&&) = delete;
+
+	// Returns the exit code of kyra once the input ends
+	int run(std::istream& input);
+
+private:
+	CompilerInstance& m_instance;
+	const JIT::Environment m_environment;
+	RefPtr<TypeScope> m_scope;
+	// Imported modules are only added to the JIT once
+	std::set<std::filesystem::path> m_generated_paths;
+	unsigned m_entries{0};
+
+	void evaluate(std::string source, JIT::Session& session);
+};
+}
@@ -0,0 +1,299 @@
+#include "Server.hpp"
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+#include "Driver.hpp"
+#include "JIT.hpp"
+
+namespace Kyra {
+namespace {
+// Sent in front of every request, together with the stdout and stderr of the client. The payload that follows is the
+// working directory of the client and its arguments, each of them terminated by a null byte. The server answers with
+// the exit code as an int32_t.
+struct RequestHeader {
+	uint32_t magic;
+	uint32_t length;
+};
+
+constexpr uint32_t request_magic = 0x4b595241;
+constexpr uint32_t max_payload_length = 1 << 20;
+// Replacing an instance after that many compilations bounds how much its LLVMContext can grow
+constexpr unsigned max_compilations_per_instance = 256;
+
+bool read_exactly(int fd, void* buffer, size_t size) {
+	char* position = static_cast<char*>(buffer);
+	while(size > 0) {
+		const ssize_t result = read(fd, position, size);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			return false;
+		position += result;
+		size -= result;
+	}
+	return true;
+}
+
+bool write_exactly(int fd, const void* buffer, size_t size) {
+	const char* position = static_cast<const char*>(buffer);
+	while(size > 0) {
+		const ssize_t result = send(fd, position, size, MSG_NOSIGNAL);
+		if(result < 0 && errno == EINTR)
+			continue;
+		if(result <= 0)
+			return false;
+		position += result;
+		size -= result;
+	}
+	return true;
+}
+
+std::optional<sockaddr_un> make_address(const std::filesystem::path& socket_path) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	const std::string& path = socket_path.native();
+	if(path.size() >= sizeof(address.sun_path))
+		return {};
+	std::copy(path.begin(), path.end(), address.sun_path);
+	return address;
+}
+
+// Returns -1 if nobody listens on the socket
+int connect_to(const std::filesystem::path& socket_path) {
+	const std::optional<sockaddr_un> address = make_address(socket_path);
+	if(!address.has_value())
+		return -1;
+	const int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(connection < 0)
+		return -1;
+	if(connect(connection, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) != 0) {
+		close(connection);
+		return -1;
+	}
+	return connection;
+}
+}
+
+Server::Server(std::filesystem::path socket_path) :
+	m_socket_path(std::move(socket_path)), m_builtin_scope(TypeScope::create_builtin_scope()) {}
+
+Server::~Server() {
+	if(m_socket < 0)
+		return;
+	close(m_socket);
+	std::error_code error;
+	std::filesystem::remove(m_socket_path, error);
+}
+
+int Server::serve() {
+	const std::optional<sockaddr_un> address = make_address(m_socket_path);
+	if(!address.has_value()) {
+		std::cerr << "The socket path " << m_socket_path << " is too long\n";
+		return 1;
+	}
+	if(const int connection = connect_to(m_socket_path); connection >= 0) {
+		close(connection);
+		std::cerr << "Another server is already listening on " << m_socket_path << '\n';
+		return 1;
+	}
+	// Nobody listens on it, so it was left behind by a server that got killed
+	std::error_code error;
+	std::filesystem::remove(m_socket_path, error);
+
+	m_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	// Whoever can connect gets to run code as this user, so only the owner may. No other thread runs yet, so changing
+	// the umask of the process is safe.
+	const mode_t previous_mask = umask(S_IRWXG | S_IRWXO);
+	const bool is_bound =
+		m_socket >= 0 && bind(m_socket, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) == 0;
+	umask(previous_mask);
+	if(!is_bound || listen(m_socket, SOMAXCONN) != 0) {
+		std::perror("Could not listen on the socket");
+		return 1;
+	}
+	// Clients may go away before their output was written
+	std::signal(SIGPIPE, SIG_IGN);
+	JIT::initialize_native_target();
+	std::cerr << "Listening on " << m_socket_path << '\n';
+
+	while(true) {
+		const int connection = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+		if(connection < 0) {
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			std::perror("Could not accept a connection");
+			return 1;
+		}
+		std::thread([this, connection]() { handle_connection(connection); }).detach();
+	}
+}
+
+std::optional<int> Server::forward(
+	const std::filesystem::path& socket_path, const std::vector<std::string>& arguments) {
+	const int connection = connect_to(socket_path);
+	if(connection < 0)
+		return {};
+	// The server gets the stdout and stderr of this process, so it has to run as the same user. Anybody can create a
+	// socket in the temporary directory.
+	ucred credentials{};
+	socklen_t credentials_length = sizeof(credentials);
+	if(getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_length) != 0 ||
+		credentials.uid != getuid()) {
+		std::cerr << "The server on " << socket_path << " belongs to another user\n";
+		close(connection);
+		return {};
+	}
+
+	std::string payload = std::filesystem::current_path().string();
+	payload += '\0';
+	for(const std::string& argument : arguments) {
+		payload += argument;
+		payload += '\0';
+	}
+	RequestHeader header{request_magic, static_cast<uint32_t>(payload.size())};
+	iovec header_vector{&header, sizeof(header)};
+	const int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+	msghdr message{};
+	message.msg_iov = &header_vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	cmsghdr* control_message = CMSG_FIRSTHDR(&message);
+	control_message->cmsg_level = SOL_SOCKET;
+	control_message->cmsg_type = SCM_RIGHTS;
+	control_message->cmsg_len = CMSG_LEN(sizeof(fds));
+	std::memcpy(CMSG_DATA(control_message), fds, sizeof(fds));
+
+	if(sendmsg(connection, &message, MSG_NOSIGNAL) != sizeof(header) ||
+		!write_exactly(connection, payload.data(), payload.size())) {
+		close(connection);
+		return {};
+	}
+	int32_t exit_code = 1;
+	if(!read_exactly(connection, &exit_code, sizeof(exit_code)))
+		std::cerr << "The server closed the connection before it finished the request\n";
+	close(connection);
+	return exit_code;
+}
+
+std::filesystem::path Server::get_default_socket_path() {
+	if(const char* runtime_directory = std::getenv("XDG_RUNTIME_DIR"); runtime_directory != nullptr)
+		return std::filesystem::path(runtime_directory) / "kyra.sock";
+	return std::filesystem::temp_directory_path() / ("kyra-" + std::to_string(getuid()) + ".sock");
+}
+
+Server::PooledInstance Server::acquire_instance() {
+	{
+		const std::lock_guard lock(m_pool_mutex);
+		if(!m_pool.empty()) {
+			PooledInstance pooled_instance = std::move(m_pool.back());
+			m_pool.pop_back();
+			return pooled_instance;
+		}
+	}
+	return {mk_own<CompilerInstance>(m_builtin_scope)};
+}
+
+void Server::release_instance(PooledInstance pooled_instance) {
+	if(pooled_instance.compilations >= max_compilations_per_instance)
+		return;
+	const std::lock_guard lock(m_pool_mutex);
+	m_pool.push_back(std::move(pooled_instance));
+}
+
+void Server::handle_connection(int connection) {
+	RequestHeader header{};
+	iovec header_vector{&header, sizeof(header)};
+	int fds[2] = {-1, -1};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+	msghdr message{};
+	message.msg_iov = &header_vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	const bool has_header = recvmsg(connection, &message, MSG_CMSG_CLOEXEC) == sizeof(header) &&
+		header.magic == request_magic && header.length <= max_payload_length;
+	if(const cmsghdr* control_message = CMSG_FIRSTHDR(&message); control_message != nullptr &&
+		control_message->cmsg_type == SCM_RIGHTS && control_message->cmsg_len == CMSG_LEN(sizeof(fds)))
+		std::memcpy(fds, CMSG_DATA(control_message), sizeof(fds));
+
+	int32_t exit_code = 1;
+	if(has_header && fds[0] >= 0 && fds[1] >= 0) {
+		std::string payload(header.length, '\0');
+		if(read_exactly(connection, payload.data(), payload.size())) {
+			// The request runs on a detached thread, so anything it throws would terminate the whole server
+			try {
+				exit_code = handle_request(payload, fds[0], fds[1]);
+			} catch(const std::exception& exception) {
+				llvm::raw_fd_ostream(fds[1], false) << "The server could not handle the request: " << exception.what()
+													<< '\n';
+			} catch(...) {
+				llvm::raw_fd_ostream(fds[1], false) << "The server could not handle the request\n";
+			}
+		}
+	}
+	write_exactly(connection, &exit_code, sizeof(exit_code));
+	for(const int fd : fds) {
+		if(fd >= 0)
+			close(fd);
+	}
+	close(connection);
+}
+
+int Server::handle_request(std::string_view payload, int output_fd, int error_fd) {
+	std::vector<std::string> strings;
+	while(!payload.empty()) {
+		const size_t end = std::min(payload.find('\0'), payload.size());
+		strings.emplace_back(payload.substr(0, end));
+		payload.remove_prefix(std::min(end + 1, payload.size()));
+	}
+	if(strings.empty())
+		return 1;
+	const JIT::Environment environment{output_fd, error_fd, strings.front()};
+	strings.erase(strings.begin());
+
+	std::ostringstream errors;
+	const std::optional<Driver::Arguments> arguments =
+		Driver::parse_arguments(strings, errors, environment.working_directory);
+	if(!arguments.has_value()) {
+		llvm::raw_fd_ostream(error_fd, false) << errors.str() << Driver::usage;
+		return 1;
+	}
+	// A watching request would never finish and occupy a thread and an instance forever
+	if(arguments->watch) {
+		llvm::raw_fd_ostream(error_fd, false) << "--watch cannot be used with a server\n";
+		return 1;
+	}
+	// A time trace must only contain this compilation, so it gets an instance of its own
+	if(!arguments->time_trace_path.empty()) {
+		CompilerInstance instance(m_builtin_scope);
+		return Driver::execute(instance, *arguments, environment);
+	}
+	// If the compilation throws, the instance is dropped instead of going back into the pool
+	PooledInstance pooled_instance = acquire_instance();
+	const int exit_code = Driver::execute(*pooled_instance.instance, *arguments, environment);
+	++pooled_instance.compilations;
+	release_instance(std::move(pooled_instance));
+	return exit_code;
+}
+}
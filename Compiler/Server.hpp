@@ -0,0 +1,57 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "CompilerInstance.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+// A long-running kyra process that compiles and runs programs for clients connecting over a Unix domain socket (see
+// kyra --server and --connect). Clients save the startup of a process, and the server keeps LLVM, the builtin types and
+// a pool of compiler instances (each of them with its own LLVMContext) warm between requests. Requests are handled
+// concurrently, each of them on its own thread.
+class Server {
+public:
+	explicit Server(std::filesystem::path socket_path);
+	Server(const Server&) = delete;
+	Server(Server&&) = delete;
+	~Server();
+
+	Server& operator=(const Server&) = delete;
+	Server& operator=(Server&&) = delete;
+
+	// Only returns (with an exit code for kyra) if the socket could not be set up
+	int serve();
+
+	// Lets the server listening on the socket handle the arguments. The server writes to the stdout and stderr of the
+	// calling process directly. Returns the exit code, or nothing if no server could be reached.
+	static std::optional<int> forward(
+		const std::filesystem::path& socket_path, const std::vector<std::string>& arguments);
+	static std::filesystem::path get_default_socket_path();
+
+private:
+	struct PooledInstance {
+		OwnPtr<CompilerInstance> instance;
+		unsigned compilations{0};
+	};
+
+	const std::filesystem::path m_socket_path;
+	const RefPtr<TypeScope> m_builtin_scope;
+	int m_socket{-1};
+	std::mutex m_pool_mutex;
+	std::vector<PooledInstance> m_pool;
+
+	PooledInstance acquire_instance();
+	void release_instance(PooledInstance pooled_instance);
+
+	void handle_connection(int connection);
+	int handle_request(std::string_view payload, int output_fd, int error_fd);
+};
+}
@@ -5,74 +5,126 @@
 namespace Kyra {
 namespace Typed {
 
-Expression::Expression(RefPtr<AppliedType> type) : m_type(std::move(type)) {}
+TASTNode::TASTNode(const SourceRange& source_range, NodeKind node_kind) :
+	m_source_range(source_range), m_node_kind(node_kind) {}
+
+const SourceRange& TASTNode::get_source_range() const { return m_source_range; }
+
+TASTNode::NodeKind TASTNode::get_node_kind() const { return m_node_kind; }
+
+Statement::Statement(const SourceRange& source_range, NodeKind node_kind) : TASTNode(source_range, node_kind) {}
+
+Expression::Expression(const SourceRange& source_range, NodeKind node_kind, RefPtr<AppliedType> type) :
+	TASTNode(source_range, node_kind), m_type(std::move(type)) {}
 
 const AppliedType& Expression::get_type() const { return *m_type; }
 
 RefPtr<AppliedType> Expression::get_type_shared() const { return m_type; }
 
-ExpressionStatement::ExpressionStatement(RefPtr<Expression> expression) : m_expression(std::move(expression)) {}
+ExpressionStatement::ExpressionStatement(const SourceRange& source_range, RefPtr<Expression> expression) :
+	Statement(source_range, NodeKind::ExpressionStatement), m_expression(std::move(expression)) {}
 
 const Expression& ExpressionStatement::get_expression() const { return *m_expression; }
 
-void ExpressionStatement::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
-
-Declaration::Declaration(declid_t declaration_id) : m_declaration_id(declaration_id) {}
+Declaration::Declaration(const SourceRange& source_range, declid_t declaration_id) :
+	Statement(source_range, NodeKind::Declaration), m_declaration_id(declaration_id) {}
 
 declid_t Declaration::get_declaration_id() const { return m_declaration_id; }
 
-void Declaration::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
-
-Block::Block(const std::vector<RefPtr<Statement>>& body) : m_body(body) {}
+Block::Block(const SourceRange& source_range, const std::vector<RefPtr<Statement>>& body) :
+	Statement(source_range, NodeKind::Block), m_body(body) {}
 
 const std::vector<RefPtr<Statement>>& Block::get_body() const { return m_body; }
 
-void Block::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
-
-Function::Function(
-	declid_t function_declaration, RefPtr<Block> implementation, const std::vector<declid_t>& parameters) :
+Function::Function(const SourceRange& source_range, declid_t function_declaration, RefPtr<Block> implementation,
+	const std::vector<declid_t>& parameters, bool is_memoized) :
+	Statement(source_range, NodeKind::Function),
 	m_function_declaration(function_declaration),
-	m_implementation(std::move(implementation)), m_parameters(parameters) {}
+	m_implementation(std::move(implementation)), m_parameters(parameters), m_is_memoized(is_memoized) {}
 
 declid_t Function::get_function_declaration_id() const { return m_function_declaration; }
 
 const Block& Function::get_implementation() const { return *m_implementation; }
 
+bool Function::has_implementation() const { return m_implementation != nullptr; }
+
+void Function::set_implementation(RefPtr<Block> implementation) { m_implementation = std::move(implementation); }
+
 const std::vector<declid_t>& Function::get_parameters() const { return m_parameters; }
 
-void Function::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+bool Function::is_memoized() const { return m_is_memoized; }
 
-Print::Print(RefPtr<Expression> expression) : m_expression(std::move(expression)) {}
+ExternalFunction::ExternalFunction(const SourceRange& source_range, declid_t function_declaration,
+	std::string symbol_name, unsigned effects, bool is_c_function) :
+	Statement(source_range, NodeKind::ExternalFunction),
+	m_function_declaration(function_declaration), m_symbol_name(std::move(symbol_name)), m_effects(effects),
+	m_is_c_function(is_c_function) {}
 
-const Expression& Print::get_expression() const { return *m_expression; }
+declid_t ExternalFunction::get_function_declaration_id() const { return m_function_declaration; }
+
+const std::string& ExternalFunction::get_symbol_name() const { return m_symbol_name; }
+
+unsigned ExternalFunction::get_effects() const { return m_effects; }
+
+bool ExternalFunction::is_c_function() const { return m_is_c_function; }
 
-void Print::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+Print::Print(const SourceRange& source_range, RefPtr<Expression> expression) :
+	Statement(source_range, NodeKind::Print), m_expression(std::move(expression)) {}
 
-Return::Return(RefPtr<Expression> expression) : m_expression(std::move(expression)) {}
+const Expression& Print::get_expression() const { return *m_expression; }
+
+Return::Return(const SourceRange& source_range, RefPtr<Expression> expression) :
+	Statement(source_range, NodeKind::Return), m_expression(std::move(expression)) {}
 
 const Expression& Return::get_expression() const { return *m_expression; }
 
-void Return::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+For::For(const SourceRange& source_range, declid_t variable, RefPtr<Expression> begin, RefPtr<Expression> end,
+	RefPtr<Block> body, bool is_parallel) :
+	Statement(source_range, NodeKind::For),
+	m_variable(variable), m_begin(std::move(begin)), m_end(std::move(end)), m_body(std::move(body)),
+	m_is_parallel(is_parallel) {}
+
+declid_t For::get_variable() const { return m_variable; }
+
+const Expression& For::get_begin() const { return *m_begin; }
 
-IntLiteral::IntLiteral(RefPtr<AppliedType> type, int literal_value) :
-	Expression(std::move(type)), m_value(literal_value) {}
+const Expression& For::get_end() const { return *m_end; }
 
-int IntLiteral::get_value() const { return m_value; }
+const Block& For::get_body() const { return *m_body; }
 
-void IntLiteral::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+bool For::is_parallel() const { return m_is_parallel; }
 
-Assignment::Assignment(RefPtr<AppliedType> type, declid_t lhs, RefPtr<Expression> rhs) :
-	Expression(std::move(type)), m_lhs(lhs), m_rhs(std::move(rhs)) {}
+IntLiteral::IntLiteral(const SourceRange& source_range, RefPtr<AppliedType> type, uint64_t literal_value) :
+	Expression(source_range, NodeKind::IntLiteral, std::move(type)), m_value(literal_value) {}
+
+uint64_t IntLiteral::get_value() const { return m_value; }
+
+ArrayLiteral::ArrayLiteral(
+	const SourceRange& source_range, RefPtr<AppliedType> type, const std::vector<RefPtr<Expression>>& elements) :
+	Expression(source_range, NodeKind::ArrayLiteral, std::move(type)), m_elements(elements) {}
+
+const std::vector<RefPtr<Expression>>& ArrayLiteral::get_elements() const { return m_elements; }
+
+Assignment::Assignment(
+	const SourceRange& source_range, RefPtr<AppliedType> type, declid_t lhs, RefPtr<Expression> rhs) :
+	Expression(source_range, NodeKind::Assignment, std::move(type)), m_lhs(lhs), m_rhs(std::move(rhs)) {}
 
 declid_t Assignment::get_lhs() const { return m_lhs; }
 
 const Expression& Assignment::get_rhs() const { return *m_rhs; }
 
-void Assignment::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+IndexAssignment::IndexAssignment(
+	const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Index> lhs, RefPtr<Expression> rhs) :
+	Expression(source_range, NodeKind::IndexAssignment, std::move(type)),
+	m_lhs(std::move(lhs)), m_rhs(std::move(rhs)) {}
 
-BinaryExpression::BinaryExpression(
-	RefPtr<AppliedType> type, RefPtr<Expression> lhs, RefPtr<Expression> rhs, Token oper) :
-	Expression(std::move(type)),
+const Index& IndexAssignment::get_lhs() const { return *m_lhs; }
+
+const Expression& IndexAssignment::get_rhs() const { return *m_rhs; }
+
+BinaryExpression::BinaryExpression(const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> lhs,
+	RefPtr<Expression> rhs, Token oper) :
+	Expression(source_range, NodeKind::BinaryExpression, std::move(type)),
 	m_lhs(std::move(lhs)), m_rhs(std::move(rhs)), m_operator(oper) {}
 
 const Expression& BinaryExpression::get_lhs() const { return *m_lhs; }
@@ -81,22 +133,42 @@ const Expression& BinaryExpression::get_rhs() const { return *m_rhs; }
 
 const Token& BinaryExpression::get_operator() const { return m_operator; }
 
-void BinaryExpression::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
-
-Call::Call(RefPtr<AppliedType> type, declid_t function_declaration, const std::vector<RefPtr<Expression>>& arguments) :
-	Expression(std::move(type)), m_fuction_declaration(function_declaration), m_arguments(arguments) {}
+Call::Call(const SourceRange& source_range, RefPtr<AppliedType> type, declid_t function_declaration,
+	const std::vector<RefPtr<Expression>>& arguments) :
+	Expression(source_range, NodeKind::Call, std::move(type)),
+	m_fuction_declaration(function_declaration), m_arguments(arguments) {}
 
 declid_t Call::get_function_declaration_id() const { return m_fuction_declaration; }
 
 const std::vector<RefPtr<Expression>>& Call::get_arguments() const { return m_arguments; }
 
-void Call::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+Conversion::Conversion(const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> value) :
+	Expression(source_range, NodeKind::Conversion, std::move(type)), m_value(std::move(value)) {}
 
-VarQuery::VarQuery(RefPtr<AppliedType> type, declid_t declaration) :
-	Expression(std::move(type)), m_declaration(declaration) {}
+const Expression& Conversion::get_value() const { return *m_value; }
 
-declid_t VarQuery::get_declaration_id() const { return m_declaration; }
+VectorOperation::VectorOperation(const SourceRange& source_range, RefPtr<AppliedType> type, Operation operation,
+	const std::vector<RefPtr<Expression>>& operands, const std::vector<int>& mask) :
+	Expression(source_range, NodeKind::VectorOperation, std::move(type)),
+	m_operation(operation), m_operands(operands), m_mask(mask) {}
 
-void VarQuery::accept(TASTVisitor& visitor) const { visitor.visit(*this); }
+VectorOperation::Operation VectorOperation::get_operation() const { return m_operation; }
+
+const std::vector<RefPtr<Expression>>& VectorOperation::get_operands() const { return m_operands; }
+
+const std::vector<int>& VectorOperation::get_mask() const { return m_mask; }
+
+Index::Index(
+	const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> array, RefPtr<Expression> index) :
+	Expression(source_range, NodeKind::Index, std::move(type)), m_array(std::move(array)), m_index(std::move(index)) {}
+
+const Expression& Index::get_array() const { return *m_array; }
+
+const Expression& Index::get_index() const { return *m_index; }
+
+VarQuery::VarQuery(const SourceRange& source_range, RefPtr<AppliedType> type, declid_t declaration) :
+	Expression(source_range, NodeKind::VarQuery, std::move(type)), m_declaration(declaration) {}
+
+declid_t VarQuery::get_declaration_id() const { return m_declaration; }
 }
 }
@@ -1,24 +1,58 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #include "Aliases.hpp"
+#include "SourceRange.hpp"
 #include "Token.hpp"
 #include "Type.hpp"
 
 namespace Kyra {
 namespace Typed {
 
-class TASTVisitor;
-
 class TASTNode {
 public:
+	// Identifies the concrete node, so visitors can dispatch without virtual calls
+	enum class NodeKind {
+		ExpressionStatement,
+		Declaration,
+		Function,
+		ExternalFunction,
+		Print,
+		Return,
+		Block,
+		For,
+		IntLiteral,
+		ArrayLiteral,
+		Assignment,
+		IndexAssignment,
+		BinaryExpression,
+		Call,
+		Conversion,
+		VectorOperation,
+		Index,
+		VarQuery
+	};
+
 	virtual ~TASTNode() = default;
 
-	virtual void accept(TASTVisitor& visitor) const = 0;
+	const SourceRange& get_source_range() const;
+	NodeKind get_node_kind() const;
+
+protected:
+	TASTNode(const SourceRange& source_range, NodeKind node_kind);
+
+private:
+	const SourceRange m_source_range;
+	const NodeKind m_node_kind;
 };
 
-class Statement : public TASTNode {};
+class Statement : public TASTNode {
+protected:
+	Statement(const SourceRange& source_range, NodeKind node_kind);
+};
 
 class Expression : public TASTNode {
 public:
@@ -26,123 +60,177 @@ public:
 	RefPtr<AppliedType> get_type_shared() const;
 
 protected:
-	explicit Expression(RefPtr<AppliedType> type);
+	Expression(const SourceRange& source_range, NodeKind node_kind, RefPtr<AppliedType> type);
 
 	RefPtr<AppliedType> m_type;
 };
 
 class ExpressionStatement : public Statement {
 public:
-	ExpressionStatement(RefPtr<Expression> expression);
+	ExpressionStatement(const SourceRange& source_range, RefPtr<Expression> expression);
 
 	const Expression& get_expression() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
 
 class Declaration : public Statement {
 public:
-	Declaration(declid_t declaration_id);
+	Declaration(const SourceRange& source_range, declid_t declaration_id);
 
 	declid_t get_declaration_id() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	const declid_t m_declaration_id;
 };
 
 class Block : public Statement {
 public:
-	Block(const std::vector<RefPtr<Statement>>& body);
+	Block(const SourceRange& source_range, const std::vector<RefPtr<Statement>>& body);
 
 	const std::vector<RefPtr<Statement>>& get_body() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	const std::vector<RefPtr<Statement>> m_body;
 };
 
 class Function : public Statement {
 public:
-	Function(declid_t function_declaration, RefPtr<Block> implementation, const std::vector<declid_t>& parameters);
+	Function(const SourceRange& source_range, declid_t function_declaration, RefPtr<Block> implementation,
+		const std::vector<declid_t>& parameters, bool is_memoized);
 
 	declid_t get_function_declaration_id() const;
 	const Block& get_implementation() const;
+	// Functions whose bodies were skipped by the type checker have no implementation and are not generated
+	bool has_implementation() const;
+	void set_implementation(RefPtr<Block> implementation);
 	const std::vector<declid_t>& get_parameters() const;
-
-	void accept(TASTVisitor& visitor) const override;
+	bool is_memoized() const;
 
 private:
 	const declid_t m_function_declaration;
 	RefPtr<Block> m_implementation;
 	const std::vector<declid_t> m_parameters;
+	const bool m_is_memoized;
+};
+
+// A function of an imported module or a C function (see extern fun), which is only declared in this module
+class ExternalFunction : public Statement {
+public:
+	ExternalFunction(const SourceRange& source_range, declid_t function_declaration, std::string symbol_name,
+		unsigned effects, bool is_c_function = false);
+
+	declid_t get_function_declaration_id() const;
+	const std::string& get_symbol_name() const;
+	// See EffectAnalysis::Effect
+	unsigned get_effects() const;
+	// C functions are called with the C calling convention and their symbol is not mangled
+	bool is_c_function() const;
+
+private:
+	const declid_t m_function_declaration;
+	const std::string m_symbol_name;
+	const unsigned m_effects;
+	const bool m_is_c_function;
 };
 
 class Print : public Statement {
 public:
-	Print(RefPtr<Expression> expression);
+	Print(const SourceRange& source_range, RefPtr<Expression> expression);
 
 	const Expression& get_expression() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
 
 class Return : public Statement {
 public:
-	Return(RefPtr<Expression> expression);
+	Return(const SourceRange& source_range, RefPtr<Expression> expression);
 
 	const Expression& get_expression() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_expression;
 };
 
+// See Untyped::For. The variable has the type of both bounds.
+class For : public Statement {
+public:
+	For(const SourceRange& source_range, declid_t variable, RefPtr<Expression> begin, RefPtr<Expression> end,
+		RefPtr<Block> body, bool is_parallel);
+
+	declid_t get_variable() const;
+	const Expression& get_begin() const;
+	const Expression& get_end() const;
+	const Block& get_body() const;
+	bool is_parallel() const;
+
+private:
+	const declid_t m_variable;
+	RefPtr<Expression> m_begin;
+	RefPtr<Expression> m_end;
+	RefPtr<Block> m_body;
+	const bool m_is_parallel;
+};
+
 class IntLiteral : public Expression {
 public:
-	IntLiteral(RefPtr<AppliedType> type, int literal_value);
+	IntLiteral(const SourceRange& source_range, RefPtr<AppliedType> type, uint64_t literal_value);
+
+	uint64_t get_value() const;
 
-	int get_value() const;
+private:
+	const uint64_t m_value;
+};
+
+class ArrayLiteral : public Expression {
+public:
+	ArrayLiteral(
+		const SourceRange& source_range, RefPtr<AppliedType> type, const std::vector<RefPtr<Expression>>& elements);
 
-	void accept(TASTVisitor& visitor) const override;
+	const std::vector<RefPtr<Expression>>& get_elements() const;
 
 private:
-	const int m_value;
+	const std::vector<RefPtr<Expression>> m_elements;
 };
 
 class Assignment : public Expression {
 public:
-	Assignment(RefPtr<AppliedType> type, declid_t lhs, RefPtr<Expression> rhs);
+	Assignment(const SourceRange& source_range, RefPtr<AppliedType> type, declid_t lhs, RefPtr<Expression> rhs);
 
 	declid_t get_lhs() const;
 	const Expression& get_rhs() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	const declid_t m_lhs;
 	RefPtr<Expression> m_rhs;
 };
 
+class Index;
+class IndexAssignment : public Expression {
+public:
+	IndexAssignment(
+		const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Index> lhs, RefPtr<Expression> rhs);
+
+	const Index& get_lhs() const;
+	const Expression& get_rhs() const;
+
+private:
+	RefPtr<Index> m_lhs;
+	RefPtr<Expression> m_rhs;
+};
+
 class BinaryExpression : public Expression {
 public:
-	BinaryExpression(RefPtr<AppliedType> type, RefPtr<Expression> lhs, RefPtr<Expression> rhs, Token oper);
+	BinaryExpression(const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> lhs,
+		RefPtr<Expression> rhs, Token oper);
 
 	const Expression& get_lhs() const;
 	const Expression& get_rhs() const;
 	const Token& get_operator() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	RefPtr<Expression> m_lhs;
 	RefPtr<Expression> m_rhs;
@@ -151,46 +239,112 @@ private:
 
 class Call : public Expression {
 public:
-	Call(RefPtr<AppliedType> type, declid_t function_declaration, const std::vector<RefPtr<Expression>>& arguments);
+	Call(const SourceRange& source_range, RefPtr<AppliedType> type, declid_t function_declaration,
+		const std::vector<RefPtr<Expression>>& arguments);
 
 	declid_t get_function_declaration_id() const;
 	const std::vector<RefPtr<Expression>>& get_arguments() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	const declid_t m_fuction_declaration;
 	const std::vector<RefPtr<Expression>> m_arguments;
 };
 
+// An explicit conversion between integer types, e.g. i64(x). The type of the expression is the target type.
+class Conversion : public Expression {
+public:
+	Conversion(const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> value);
+
+	const Expression& get_value() const;
+
+private:
+	RefPtr<Expression> m_value;
+};
+
+// A builtin operation on vectors, e.g. splat(x) or hadd(v). The operands are the arguments of the call, except for the
+// mask of a shuffle, which has to be known at compile time.
+class VectorOperation : public Expression {
+public:
+	enum class Operation { Splat, FromArray, Extract, Insert, Shuffle, ReduceAdd, ReduceMul, ReduceMin, ReduceMax };
+
+	VectorOperation(const SourceRange& source_range, RefPtr<AppliedType> type, Operation operation,
+		const std::vector<RefPtr<Expression>>& operands, const std::vector<int>& mask = {});
+
+	Operation get_operation() const;
+	const std::vector<RefPtr<Expression>>& get_operands() const;
+	const std::vector<int>& get_mask() const;
+
+private:
+	const Operation m_operation;
+	const std::vector<RefPtr<Expression>> m_operands;
+	const std::vector<int> m_mask;
+};
+
+// Reads an element of an array. Indices of any integer type are allowed, they are checked against the length of the
+// array at runtime unless CodeGen can prove that they are in range.
+class Index : public Expression {
+public:
+	Index(const SourceRange& source_range, RefPtr<AppliedType> type, RefPtr<Expression> array,
+		RefPtr<Expression> index);
+
+	const Expression& get_array() const;
+	const Expression& get_index() const;
+
+private:
+	RefPtr<Expression> m_array;
+	RefPtr<Expression> m_index;
+};
+
 class VarQuery : public Expression {
 public:
-	VarQuery(RefPtr<AppliedType> type, declid_t declaration);
+	VarQuery(const SourceRange& source_range, RefPtr<AppliedType> type, declid_t declaration);
 
 	declid_t get_declaration_id() const;
 
-	void accept(TASTVisitor& visitor) const override;
-
 private:
 	const declid_t m_declaration;
 };
 
+// See Untyped::ASTVisitor
+template <typename Derived, typename StatementResult = void, typename ExpressionResult = void>
 class TASTVisitor {
 public:
-	virtual ~TASTVisitor() = default;
-
-	virtual void visit(const ExpressionStatement& expresion_statement) = 0;
-	virtual void visit(const Declaration& declaration) = 0;
-	virtual void visit(const Function& function) = 0;
-	virtual void visit(const Print& print_statement) = 0;
-	virtual void visit(const Return& return_statement) = 0;
-	virtual void visit(const Block& block) = 0;
-	virtual void visit(const IntLiteral& literal) = 0;
-
-	virtual void visit(const Assignment& assignment) = 0;
-	virtual void visit(const BinaryExpression& binary_expression) = 0;
-	virtual void visit(const Call& call) = 0;
-	virtual void visit(const VarQuery& var_query) = 0;
+	StatementResult dispatch(const Statement& statement) {
+		Derived& derived = static_cast<Derived&>(*this);
+		switch(statement.get_node_kind()) {
+			case TASTNode::NodeKind::ExpressionStatement:
+				return derived.visit(static_cast<const ExpressionStatement&>(statement));
+			case TASTNode::NodeKind::Declaration: return derived.visit(static_cast<const Declaration&>(statement));
+			case TASTNode::NodeKind::Function: return derived.visit(static_cast<const Function&>(statement));
+			case TASTNode::NodeKind::ExternalFunction:
+				return derived.visit(static_cast<const ExternalFunction&>(statement));
+			case TASTNode::NodeKind::Print: return derived.visit(static_cast<const Print&>(statement));
+			case TASTNode::NodeKind::Return: return derived.visit(static_cast<const Return&>(statement));
+			case TASTNode::NodeKind::Block: return derived.visit(static_cast<const Block&>(statement));
+			case TASTNode::NodeKind::For: return derived.visit(static_cast<const For&>(statement));
+			default: assert_not_reached();
+		}
+	}
+
+	ExpressionResult dispatch(const Expression& expression) {
+		Derived& derived = static_cast<Derived&>(*this);
+		switch(expression.get_node_kind()) {
+			case TASTNode::NodeKind::IntLiteral: return derived.visit(static_cast<const IntLiteral&>(expression));
+			case TASTNode::NodeKind::ArrayLiteral: return derived.visit(static_cast<const ArrayLiteral&>(expression));
+			case TASTNode::NodeKind::Assignment: return derived.visit(static_cast<const Assignment&>(expression));
+			case TASTNode::NodeKind::IndexAssignment:
+				return derived.visit(static_cast<const IndexAssignment&>(expression));
+			case TASTNode::NodeKind::BinaryExpression:
+				return derived.visit(static_cast<const BinaryExpression&>(expression));
+			case TASTNode::NodeKind::Call: return derived.visit(static_cast<const Call&>(expression));
+			case TASTNode::NodeKind::Conversion: return derived.visit(static_cast<const Conversion&>(expression));
+			case TASTNode::NodeKind::VectorOperation:
+				return derived.visit(static_cast<const VectorOperation&>(expression));
+			case TASTNode::NodeKind::Index: return derived.visit(static_cast<const Index&>(expression));
+			case TASTNode::NodeKind::VarQuery: return derived.visit(static_cast<const VarQuery&>(expression));
+			default: assert_not_reached();
+		}
+	}
 };
 }
 }
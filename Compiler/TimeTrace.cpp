@@ -0,0 +1,185 @@
+#include "TimeTrace.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <new>
+#include <tuple>
+
+namespace {
+// Written by the replaced operator new below. The counters are per thread, so no synchronization is needed and
+// scopes only see the allocations of their own thread. Only the switch is shared, as any thread may enable a trace.
+std::atomic<bool> is_counting_allocations = false;
+thread_local uint64_t allocations = 0;
+thread_local uint64_t allocated_bytes = 0;
+
+// Only the time of the calling thread, as other threads may be compiling something else at the same time
+std::chrono::microseconds get_cpu_time() {
+	timespec time{};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec));
+}
+
+uint64_t get_peak_rss_kib() {
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+void write_json_string(std::ostream& stream, std::string_view string) {
+	stream << '"';
+	for(char character : string) {
+		if(character == '"' || character == '\\')
+			stream << '\\' << character;
+		else if(static_cast<unsigned char>(character) < 0x20) {
+			char escaped[7];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+			stream << escaped;
+		} else
+			stream << character;
+	}
+	stream << '"';
+}
+}
+
+void* operator new(std::size_t size) {
+	if(is_counting_allocations.load(std::memory_order_relaxed)) {
+		++allocations;
+		allocated_bytes += size;
+	}
+	if(void* memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+namespace Kyra {
+
+TimeTrace::Scope::Scope(TimeTrace& trace, std::string_view category, std::string_view name, std::string_view detail) :
+	m_trace(trace.is_enabled() ? &trace : nullptr) {
+	if(m_trace == nullptr)
+		return;
+	m_event_index = m_trace->m_events.size();
+	Event& event = m_trace->m_events.emplace_back();
+	event.category = category;
+	event.name = name;
+	event.detail = detail;
+	event.depth = m_trace->m_depth++;
+	// Measure after the bookkeeping above, so it is not attributed to the scope
+	m_allocations_start = allocations;
+	m_allocated_bytes_start = allocated_bytes;
+	m_cpu_start = get_cpu_time();
+	m_wall_start = std::chrono::steady_clock::now();
+}
+
+TimeTrace::Scope::~Scope() {
+	if(m_trace == nullptr)
+		return;
+	const std::chrono::steady_clock::time_point wall_end = std::chrono::steady_clock::now();
+	const std::chrono::microseconds cpu_end = get_cpu_time();
+	Event& event = m_trace->m_events.at(m_event_index);
+	event.start = std::chrono::duration_cast<std::chrono::microseconds>(m_wall_start - m_trace->m_start);
+	event.wall_time = std::chrono::duration_cast<std::chrono::microseconds>(wall_end - m_wall_start);
+	event.cpu_time = cpu_end - m_cpu_start;
+	event.allocations = allocations - m_allocations_start;
+	event.allocated_bytes = allocated_bytes - m_allocated_bytes_start;
+	event.peak_rss_kib = get_peak_rss_kib();
+	--m_trace->m_depth;
+}
+
+void TimeTrace::enable() {
+	m_is_enabled = true;
+	m_start = std::chrono::steady_clock::now();
+	start_counting_allocations();
+}
+
+const std::vector<TimeTrace::Event>& TimeTrace::get_events() const { return m_events; }
+
+void TimeTrace::start_counting_allocations() { is_counting_allocations = true; }
+
+TimeTrace::AllocationCounters TimeTrace::get_allocation_counters() { return {allocations, allocated_bytes}; }
+
+void TimeTrace::write_chrome_trace(std::ostream& stream) const {
+	stream << "{\"traceEvents\": [";
+	for(unsigned i = 0; i < m_events.size(); ++i) {
+		const Event& event = m_events.at(i);
+		stream << (i == 0 ? "\n" : ",\n") << "{\"ph\": \"X\", \"pid\": 1, \"tid\": 0, \"cat\": ";
+		write_json_string(stream, event.category);
+		stream << ", \"name\": ";
+		write_json_string(stream, event.detail.empty() ? event.name : event.name + ' ' + event.detail);
+		stream << ", \"ts\": " << event.start.count() << ", \"dur\": " << event.wall_time.count()
+			   << ", \"args\": {\"cpu_us\": " << event.cpu_time.count() << ", \"allocations\": " << event.allocations
+			   << ", \"allocated_bytes\": " << event.allocated_bytes << ", \"peak_rss_kib\": " << event.peak_rss_kib
+			   << "}}";
+	}
+	// The memory high-water mark as a counter track
+	for(const Event& event : m_events) {
+		stream << ",\n{\"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"name\": \"Peak RSS (KiB)\", \"ts\": "
+			   << (event.start + event.wall_time).count() << ", \"args\": {\"peak_rss_kib\": " << event.peak_rss_kib
+			   << "}}";
+	}
+	stream << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+void TimeTrace::print_summary(std::ostream& stream) const {
+	static const unsigned shown_details = 10;
+	char row[160];
+	auto print_row = [&](const std::string& label, const Event& event) {
+		std::snprintf(row, sizeof(row), "%12.3f %12.3f %12llu %14.1f %14llu  %s\n", event.wall_time.count() / 1000.0,
+			event.cpu_time.count() / 1000.0, static_cast<unsigned long long>(event.allocations),
+			event.allocated_bytes / 1024.0, static_cast<unsigned long long>(event.peak_rss_kib), label.c_str());
+		stream << row;
+	};
+	const char* const header = "   Wall (ms)     CPU (ms)  Allocations    Alloc (KiB)  Peak RSS (KiB)  Name\n";
+
+	stream << "===" << std::string(73, '-') << "===\n"
+		   << "                          Kyra compilation time report\n"
+		   << "===" << std::string(73, '-') << "===\n"
+		   << header;
+	// Scopes without a detail are phases
+	for(const Event& event : m_events) {
+		if(event.detail.empty())
+			print_row(std::string(2 * event.depth, ' ') + event.name, event);
+	}
+
+	std::map<std::tuple<std::string, std::string>, Event> totals;
+	for(const Event& event : m_events) {
+		if(event.detail.empty())
+			continue;
+		auto [it, inserted] = totals.try_emplace({event.name, event.detail}, event);
+		if(inserted)
+			continue;
+		Event& total = it->second;
+		total.wall_time += event.wall_time;
+		total.cpu_time += event.cpu_time;
+		total.allocations += event.allocations;
+		total.allocated_bytes += event.allocated_bytes;
+		total.peak_rss_kib = std::max(total.peak_rss_kib, event.peak_rss_kib);
+	}
+	if(totals.empty())
+		return;
+	std::vector<const Event*> sorted_totals;
+	for(const auto& [key, total] : totals)
+		sorted_totals.push_back(&total);
+	std::sort(sorted_totals.begin(), sorted_totals.end(),
+		[](const Event* lhs, const Event* rhs) { return lhs->wall_time > rhs->wall_time; });
+	if(sorted_totals.size() > shown_details)
+		sorted_totals.resize(shown_details);
+
+	stream << "\nTop " << sorted_totals.size() << " of " << totals.size() << " functions:\n" << header;
+	for(const Event* total : sorted_totals)
+		print_row(total->name + ' ' + total->detail, *total);
+}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Kyra {
+
+// Records how long the phases of the compiler (and the functions inside of them) take and how much memory they use.
+// Nothing is measured unless the trace was enabled, so scopes can stay in the code unconditionally.
+class TimeTrace {
+public:
+	struct Event {
+		std::string category;
+		std::string name;
+		// e.g. the function a phase is working on
+		std::string detail;
+		unsigned depth{0};
+		std::chrono::microseconds start{0};
+		std::chrono::microseconds wall_time{0};
+		std::chrono::microseconds cpu_time{0};
+		uint64_t allocations{0};
+		uint64_t allocated_bytes{0};
+		// The high-water mark of the whole process when the scope ended
+		uint64_t peak_rss_kib{0};
+	};
+
+	struct AllocationCounters {
+		uint64_t allocations{0};
+		uint64_t allocated_bytes{0};
+	};
+
+	class Scope {
+	public:
+		Scope(TimeTrace& trace, std::string_view category, std::string_view name, std::string_view detail = "");
+		Scope(const Scope&) = delete;
+		Scope(Scope&&) = delete;
+		~Scope();
+
+		Scope& operator=(const Scope&) = delete;
+		Scope& operator=(Scope&&) = delete;
+
+	private:
+		// Only set if the trace is enabled
+		TimeTrace* m_trace;
+		unsigned m_event_index;
+		std::chrono::steady_clock::time_point m_wall_start;
+		std::chrono::microseconds m_cpu_start;
+		uint64_t m_allocations_start;
+		uint64_t m_allocated_bytes_start;
+	};
+
+	TimeTrace() = default;
+	TimeTrace(const TimeTrace&) = delete;
+	TimeTrace(TimeTrace&&) noexcept = default;
+
+	TimeTrace& operator=(const TimeTrace&) = delete;
+	TimeTrace& operator=(TimeTrace&&) noexcept = default;
+
+	void enable();
+	bool is_enabled() const { return m_is_enabled; }
+
+	const std::vector<Event>& get_events() const;
+
+	// Allocations are only counted once the trace was enabled or counting was requested explicitly. The counters
+	// belong to the calling thread.
+	static void start_counting_allocations();
+	static AllocationCounters get_allocation_counters();
+
+	// Chrome's trace event format, which can be loaded into chrome://tracing or https://ui.perfetto.dev
+	void write_chrome_trace(std::ostream& stream) const;
+	// One row per phase, followed by the most expensive details (summed up over all scopes with the same name)
+	void print_summary(std::ostream& stream) const;
+
+private:
+	bool m_is_enabled{false};
+	unsigned m_depth{0};
+	std::chrono::steady_clock::time_point m_start;
+	std::vector<Event> m_events;
+};
+}
@@ -1,7 +1,7 @@
 #include "Token.hpp"
 
-#include <cassert>
-#include <stdexcept>
+#include <charconv>
+#include <system_error>
 
 #include "Aliases.hpp"
 
@@ -11,13 +11,11 @@ Token::LiteralValue::LiteralValue(std::string_view value) : m_value(value) {}
 
 const std::string_view Token::LiteralValue::as_string() const { return m_value; }
 
-int Token::LiteralValue::as_int() const {
-	int res;
-	try {
-		res = std::stoi(std::string(m_value));
-	} catch(const std::exception&) { // std::invalid_argument, std::out_of_range
-		assert_not_reached();
-	}
+std::optional<uint64_t> Token::LiteralValue::as_int() const {
+	uint64_t res = 0;
+	const auto [end, error] = std::from_chars(m_value.data(), m_value.data() + m_value.size(), res);
+	if(error != std::errc() || end != m_value.data() + m_value.size())
+		return {};
 	return res;
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -13,6 +15,8 @@ enum class TokenType {
 	RIGHT_PAREN,
 	LEFT_CURLY,
 	RIGHT_CURLY,
+	LEFT_BRACKET,
+	RIGHT_BRACKET,
 	COMMA,
 	SEMICOLON,
 	COLON,
@@ -22,6 +26,9 @@ enum class TokenType {
 	SLASH,
 	EQUAL,
 
+	// Two-character tokens
+	DOT_DOT,
+
 	// Literals
 	NAME,
 	NUMBER,
@@ -32,6 +39,12 @@ enum class TokenType {
 	FUN,
 	PRINT,
 	RETURN,
+	IMPORT,
+	FOR,
+	IN,
+	PARALLEL,
+	MEMO,
+	EXTERN,
 
 	// Miscellaneous
 	END_OF_FILE
@@ -44,15 +57,17 @@ public:
 		explicit LiteralValue(std::string_view value);
 
 		const std::string_view as_string() const;
-		int as_int() const;
+		// Nothing if the value is not a decimal number or does not fit into 64 bits
+		std::optional<uint64_t> as_int() const;
 
 	private:
 		std::string_view m_value;
 	};
 
 	static std::string get_name_for(const TokenType& type) {
-		static const std::vector<std::string> names{"(", ")", "{", "}", ",", ";", ":", "-", "+", "*", "\\", "=",
-			"Identifier", "Number", "var", "val", "fun", "print", "return", "EOF"};
+		static const std::vector<std::string> names{"(", ")", "{", "}", "[", "]", ",", ";", ":", "-", "+", "*", "\\",
+			"=", "..", "Identifier", "Number", "var", "val", "fun", "print", "return", "import", "for", "in",
+			"parallel", "memo", "extern", "EOF"};
 		return "\"" + names.at(static_cast<unsigned>(type)) + "\"";
 	}
 
@@ -1,5 +1,10 @@
 #include "Type.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <string>
+#include <system_error>
 #include <utility>
 
 namespace Kyra {
@@ -77,14 +82,37 @@ bool FunctionType::operator==(const FunctionType& other) const {
 	return true;
 }
 
-IntType::IntType(std::string_view name, unsigned width) : DeclaredType(name, DeclaredType::Integer), m_width(width) {}
+IntType::IntType(std::string_view name, unsigned width, bool is_signed) :
+	DeclaredType(name, DeclaredType::Integer), m_width(width), m_is_signed(is_signed) {}
 
 unsigned IntType::get_width() const { return m_width; }
 
+bool IntType::is_signed() const { return m_is_signed; }
+
+uint64_t IntType::get_max_value() const {
+	const unsigned value_bits = m_is_signed ? m_width - 1 : m_width;
+	return value_bits == 64 ? UINT64_MAX : (uint64_t(1) << value_bits) - 1;
+}
+
+ArrayType::ArrayType(RefPtr<DeclaredType> element_type, uint64_t length) :
+	DeclaredType(
+		"[" + std::string(element_type->get_name()) + "; " + std::to_string(length) + "]", DeclaredType::Array),
+	m_element_type(std::move(element_type)), m_length(length) {}
+
+RefPtr<DeclaredType> ArrayType::get_element_type() const { return m_element_type; }
+
+uint64_t ArrayType::get_length() const { return m_length; }
+
+VectorType::VectorType(std::string_view name, RefPtr<IntType> element_type, unsigned lanes) :
+	DeclaredType(name, DeclaredType::Vector), m_element_type(std::move(element_type)), m_lanes(lanes) {}
+
+RefPtr<IntType> VectorType::get_element_type() const { return m_element_type; }
+
+unsigned VectorType::get_lanes() const { return m_lanes; }
+
 declid_t DeclarationDumpster::insert(const DeclarationDumpster::Element& element) {
-	static declid_t id = 0;
-	m_transaction.try_emplace(++id, element);
-	return id;
+	m_transaction.try_emplace(++m_next_id, element);
+	return m_next_id;
 }
 
 const DeclarationDumpster::Element& DeclarationDumpster::retrieve(declid_t id) const {
@@ -92,6 +120,18 @@ const DeclarationDumpster::Element& DeclarationDumpster::retrieve(declid_t id) c
 	return m_dumpster.at(id);
 }
 
+declid_t DeclarationDumpster::get_last_id() const { return m_next_id; }
+
+const std::map<declid_t, DeclarationDumpster::Element>& DeclarationDumpster::get_elements() const {
+	return m_dumpster;
+}
+
+void DeclarationDumpster::restore(declid_t id, const Element& element) {
+	// Caches store the declarations in ascending order
+	m_dumpster.emplace_hint(m_dumpster.end(), id, element);
+	m_next_id = std::max(m_next_id, id);
+}
+
 void DeclarationDumpster::commit_transaction() {
 	m_dumpster.insert(m_transaction.begin(), m_transaction.end());
 	m_transaction.clear();
@@ -99,28 +139,52 @@ void DeclarationDumpster::commit_transaction() {
 
 void DeclarationDumpster::abort_transaction() { m_transaction.clear(); }
 
-TypeScope::TypeScope(RefPtr<TypeScope> parent) : m_parent(std::move(parent)) {
-	static RefPtr<IntType> i32_type = nullptr;
-	if(i32_type == nullptr) {
-		i32_type = mk_ref<IntType>("i32", 32);
-		const std::vector<RefPtr<AppliedType>> rhs = {AppliedType::promote_declared_type(i32_type, false)};
-		RefPtr<FunctionType> oper_plus = mk_ref<FunctionType>("operator+", i32_type, rhs);
-		RefPtr<FunctionType> oper_minus = mk_ref<FunctionType>("operator-", i32_type, rhs);
-		RefPtr<FunctionType> oper_mul = mk_ref<FunctionType>("operator*", i32_type, rhs);
-		RefPtr<FunctionType> oper_div = mk_ref<FunctionType>("operator/", i32_type, rhs);
-		i32_type->insert_method_if_non_exists(oper_plus->get_name(), oper_plus);
-		i32_type->insert_method_if_non_exists(oper_minus->get_name(), oper_minus);
-		i32_type->insert_method_if_non_exists(oper_mul->get_name(), oper_mul);
-		i32_type->insert_method_if_non_exists(oper_div->get_name(), oper_div);
+TypeScope::TypeScope(RefPtr<TypeScope> parent, declid_t last_visible_id) :
+	m_parent(std::move(parent)), m_last_visible_id(last_visible_id) {}
+
+RefPtr<TypeScope> TypeScope::create_builtin_scope() {
+	struct IntTypeInfo {
+		const char* name;
+		unsigned width;
+		bool is_signed;
+	};
+	static const IntTypeInfo int_types[] = {{"i8", 8, true}, {"i16", 16, true}, {"i32", 32, true}, {"i64", 64, true},
+		{"u8", 8, false}, {"u16", 16, false}, {"u32", 32, false}, {"u64", 64, false}};
+
+	struct VectorTypeInfo {
+		const char* name;
+		const char* element_type;
+		unsigned lanes;
+	};
+	static const VectorTypeInfo vector_types[] = {{"i32x4", "i32", 4}, {"i32x8", "i32", 8}, {"i32x16", "i32", 16}};
+
+	RefPtr<TypeScope> scope = mk_ref<TypeScope>();
+	// There are no implicit conversions, so both operands always have the same type
+	const auto insert_operators = [](const RefPtr<DeclaredType>& type) {
+		const std::vector<RefPtr<AppliedType>> rhs = {AppliedType::promote_declared_type(type, false)};
+		for(const char* oper : {"operator+", "operator-", "operator*", "operator/"})
+			type->insert_method_if_non_exists(oper, mk_ref<FunctionType>(oper, type, rhs));
+	};
+	for(const IntTypeInfo& info : int_types) {
+		RefPtr<IntType> int_type = mk_ref<IntType>(info.name, info.width, info.is_signed);
+		insert_operators(int_type);
+		scope->insert_type(int_type->get_name(), int_type);
+	}
+	for(const VectorTypeInfo& info : vector_types) {
+		RefPtr<IntType> element_type = std::static_pointer_cast<IntType>(scope->find_type(info.element_type));
+		RefPtr<VectorType> vector_type = mk_ref<VectorType>(info.name, std::move(element_type), info.lanes);
+		insert_operators(vector_type);
+		scope->insert_type(vector_type->get_name(), vector_type);
 	}
-	m_type_scope.try_emplace(i32_type->get_name(), i32_type);
+	return scope;
 }
 
-std::optional<TypeScope::Element<AppliedType>> TypeScope::find_symbol(std::string_view name) const {
-	if(const auto& it = m_symbol_scope.find(name); it != m_symbol_scope.end())
+std::optional<TypeScope::Element<AppliedType>> TypeScope::find_symbol(
+	std::string_view name, declid_t last_visible_id) const {
+	if(const auto& it = m_symbol_scope.find(name); it != m_symbol_scope.end() && it->second.declid <= last_visible_id)
 		return it->second;
 	if(m_parent != nullptr)
-		return m_parent->find_symbol(name);
+		return m_parent->find_symbol(name, std::min(last_visible_id, m_last_visible_id));
 	return {};
 }
 
@@ -132,6 +196,22 @@ bool TypeScope::insert_symbol(std::string_view name, TypeScope::Element<AppliedT
 }
 
 RefPtr<DeclaredType> TypeScope::find_type(std::string_view name) const {
+	if(name.starts_with('[') && name.ends_with(']')) {
+		// The separator of the outermost array is the last one, element types can be arrays themselves
+		const size_t separator = name.rfind("; ");
+		if(separator == std::string_view::npos)
+			return nullptr;
+		const std::string_view length_name = name.substr(separator + 2, name.size() - separator - 3);
+		uint64_t length;
+		const auto [end, error] =
+			std::from_chars(length_name.data(), length_name.data() + length_name.size(), length);
+		if(error != std::errc() || end != length_name.data() + length_name.size() || length == 0)
+			return nullptr;
+		RefPtr<DeclaredType> element_type = find_type(name.substr(1, separator - 1));
+		if(element_type == nullptr)
+			return nullptr;
+		return mk_ref<ArrayType>(std::move(element_type), length);
+	}
 	if(const auto& it = m_type_scope.find(name); it != m_type_scope.end())
 		return it->second;
 	if(m_parent != nullptr)
@@ -146,12 +226,18 @@ bool TypeScope::insert_type(std::string_view name, RefPtr<DeclaredType> type) {
 	return true;
 }
 
-std::vector<TypeScope::Element<FunctionType>> TypeScope::find_functions(std::string_view name) const {
+std::vector<TypeScope::Element<FunctionType>> TypeScope::find_functions(
+	std::string_view name, declid_t last_visible_id) const {
 	// TODO: find functions from all visible scopes
-	if(const auto& it = m_function_scope.find(name); it != m_function_scope.end())
-		return it->second;
+	if(const auto& it = m_function_scope.find(name); it != m_function_scope.end()) {
+		std::vector<Element<FunctionType>> functions;
+		std::copy_if(it->second.begin(), it->second.end(), std::back_inserter(functions),
+			[&](const Element<FunctionType>& function) { return function.declid <= last_visible_id; });
+		if(!functions.empty())
+			return functions;
+	}
 	if(m_parent != nullptr)
-		return m_parent->find_functions(name);
+		return m_parent->find_functions(name, std::min(last_visible_id, m_last_visible_id));
 	return {};
 }
 
@@ -164,4 +250,22 @@ bool TypeScope::insert_function(std::string_view name, const TypeScope::Element<
 	functions.push_back(element);
 	return true;
 }
+
+void TypeScope::merge_into(TypeScope& scope) const {
+	for(const auto& [name, element] : m_symbol_scope)
+		scope.m_symbol_scope.insert_or_assign(name, element);
+	for(const auto& [name, type] : m_type_scope)
+		scope.m_type_scope.insert_or_assign(name, type);
+	for(const auto& [name, functions] : m_function_scope) {
+		std::vector<Element<FunctionType>>& merged_functions = scope.m_function_scope[name];
+		for(const Element<FunctionType>& function : functions) {
+			const auto it = std::find_if(merged_functions.begin(), merged_functions.end(),
+				[&](const Element<FunctionType>& merged_function) { return *merged_function.type == *function.type; });
+			if(it != merged_functions.end())
+				*it = function;
+			else
+				merged_functions.push_back(function);
+		}
+	}
+}
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <map>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -13,7 +16,7 @@ namespace Kyra {
 class FunctionType;
 class DeclaredType {
 public:
-	enum Kind { Integer, Function };
+	enum Kind { Integer, Function, Array, Vector };
 
 	explicit DeclaredType(std::string_view name, Kind kind);
 	virtual ~DeclaredType() = default;
@@ -26,7 +29,8 @@ public:
 	Kind get_kind() const;
 
 protected:
-	const std::string_view m_name;
+	// Owned, because the names of array types are built from their element types
+	const std::string m_name;
 	const Kind m_kind;
 	std::map<std::string_view, std::vector<RefPtr<FunctionType>>> m_methods;
 };
@@ -70,12 +74,43 @@ private:
 
 class IntType : public DeclaredType {
 public:
-	explicit IntType(std::string_view name, unsigned width);
+	IntType(std::string_view name, unsigned width, bool is_signed);
 
 	unsigned get_width() const;
+	bool is_signed() const;
+	// The largest value of the type, literals must not exceed it
+	uint64_t get_max_value() const;
 
 private:
 	const unsigned m_width;
+	const bool m_is_signed;
+};
+
+// A fixed number of elements of the same type, e.g. [i32; 4]. Arrays are values, so they are copied when they are
+// assigned or passed to a function. Array types are equal if their names are.
+class ArrayType : public DeclaredType {
+public:
+	ArrayType(RefPtr<DeclaredType> element_type, uint64_t length);
+
+	RefPtr<DeclaredType> get_element_type() const;
+	uint64_t get_length() const;
+
+private:
+	RefPtr<DeclaredType> m_element_type;
+	const uint64_t m_length;
+};
+
+// A SIMD vector of integers, e.g. i32x4. Operators work on all lanes at once and always lower to vector instructions.
+class VectorType : public DeclaredType {
+public:
+	VectorType(std::string_view name, RefPtr<IntType> element_type, unsigned lanes);
+
+	RefPtr<IntType> get_element_type() const;
+	unsigned get_lanes() const;
+
+private:
+	RefPtr<IntType> m_element_type;
+	const unsigned m_lanes;
 };
 
 using declid_t = unsigned long;
@@ -87,11 +122,6 @@ public:
 		RefPtr<AppliedType> type;
 	};
 
-	static DeclarationDumpster& the() {
-		static DeclarationDumpster instance;
-		return instance;
-	}
-
 	DeclarationDumpster() = default;
 	DeclarationDumpster(const DeclarationDumpster&) = delete;
 	DeclarationDumpster(DeclarationDumpster&&) noexcept = default;
@@ -112,8 +142,15 @@ public:
 
 	declid_t insert(const Element& element);
 	const Element& retrieve(declid_t id) const;
+	// Ids are handed out in ascending order, so everything with a greater id was inserted later
+	declid_t get_last_id() const;
+	// All committed declarations by their id
+	const std::map<declid_t, Element>& get_elements() const;
+	// Inserts a declaration loaded from a TypedASTCache under its original id. Later insertions get greater ids.
+	void restore(declid_t id, const Element& element);
 
 private:
+	declid_t m_next_id{0};
 	std::map<declid_t, Element> m_dumpster;
 	std::map<declid_t, Element> m_transaction;
 
@@ -128,19 +165,32 @@ public:
 		declid_t declid;
 		RefPtr<T> type;
 	};
-	explicit TypeScope(RefPtr<TypeScope> parent = nullptr);
+	// Only the declarations of the enclosing scopes up to the given id are visible. This hides everything that is
+	// declared after a function from its body, even if the body is checked later.
+	explicit TypeScope(
+		RefPtr<TypeScope> parent = nullptr, declid_t last_visible_id = std::numeric_limits<declid_t>::max());
+
+	// The outermost scope that contains the builtin types. It is not modified after its creation.
+	static RefPtr<TypeScope> create_builtin_scope();
 
-	std::optional<Element<AppliedType>> find_symbol(std::string_view name) const;
+	std::optional<Element<AppliedType>> find_symbol(
+		std::string_view name, declid_t last_visible_id = std::numeric_limits<declid_t>::max()) const;
 	bool insert_symbol(std::string_view name, Element<AppliedType> element);
+	// Array types are not stored in any scope, they are created from their names (e.g. "[i32; 4]")
 	RefPtr<DeclaredType> find_type(std::string_view name) const;
 	bool insert_type(std::string_view name, RefPtr<DeclaredType> type);
-	std::vector<Element<FunctionType>> find_functions(std::string_view name) const;
+	std::vector<Element<FunctionType>> find_functions(
+		std::string_view name, declid_t last_visible_id = std::numeric_limits<declid_t>::max()) const;
 	bool insert_function(std::string_view name, const Element<FunctionType>& element);
+	// Adds all declarations of this scope to the other one, e.g. the ones of an entry of the REPL once it compiled.
+	// They replace the declarations with the same name there, functions only replace the ones with the same signature.
+	void merge_into(TypeScope& scope) const;
 
 private:
 	std::map<std::string_view, Element<AppliedType>> m_symbol_scope;
 	std::map<std::string_view, RefPtr<DeclaredType>> m_type_scope;
 	std::map<std::string_view, std::vector<Element<FunctionType>>> m_function_scope;
 	RefPtr<TypeScope> m_parent;
+	declid_t m_last_visible_id;
 };
 }
@@ -1,67 +1,146 @@
 #include "TypeChecker.hpp"
 
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "CompilerInstance.hpp"
+#include "EffectAnalysis.hpp"
+#include "FunctionCache.hpp"
+#include "ModuleInterface.hpp"
+#include "TimeTrace.hpp"
 
 namespace Kyra {
 using namespace Untyped;
 
+namespace {
+// Builtins that are only used if there is no function with the same name
+const std::map<std::string_view, Typed::VectorOperation::Operation> vector_operations = {
+	{"extract", Typed::VectorOperation::Operation::Extract},
+	{"insert", Typed::VectorOperation::Operation::Insert},
+	{"shuffle", Typed::VectorOperation::Operation::Shuffle},
+	{"hadd", Typed::VectorOperation::Operation::ReduceAdd},
+	{"hmul", Typed::VectorOperation::Operation::ReduceMul},
+	{"hmin", Typed::VectorOperation::Operation::ReduceMin},
+	{"hmax", Typed::VectorOperation::Operation::ReduceMax},
+};
+}
+
+TypeChecker::TypeChecker(CompilerInstance& instance) : m_instance(instance) {}
+
 ErrorOr<std::vector<RefPtr<Typed::Statement>>> TypeChecker::check_statements(
-	const std::vector<RefPtr<Statement>>& statements) {
+	std::vector<RefPtr<Statement>> statements, bool only_reachable_functions) {
+	m_only_reachable_functions = only_reachable_functions;
+	m_is_checking_entry = false;
+	return check(std::move(statements), mk_ref<TypeScope>(m_instance.get_builtin_scope()));
+}
+
+ErrorOr<std::vector<RefPtr<Typed::Statement>>> TypeChecker::check_entry(
+	std::vector<RefPtr<Statement>> statements, const RefPtr<TypeScope>& scope) {
+	m_only_reachable_functions = false;
+	m_is_checking_entry = true;
+	// An entry that does not compile must not leave anything behind
+	RefPtr<TypeScope> entry_scope = mk_ref<TypeScope>(scope);
+	ErrorOr<std::vector<RefPtr<Typed::Statement>>> result = check(std::move(statements), entry_scope);
+	if(!result.is_error())
+		entry_scope->merge_into(*scope);
+	return result;
+}
+
+ErrorOr<std::vector<RefPtr<Typed::Statement>>> TypeChecker::check(
+	std::vector<RefPtr<Statement>> statements, RefPtr<TypeScope> scope) {
+	m_pending_functions.clear();
+	m_reachable_functions.clear();
 	m_typed_statements.clear();
+	m_current_scope = std::move(scope);
+	m_module_scope = m_current_scope;
+	m_context = {};
+	m_expected_type = nullptr;
+	m_imported_modules.clear();
+	m_c_functions.clear();
+	m_memoized_functions.clear();
+	m_has_parallel_loops = false;
+	m_used_names = nullptr;
 	try {
 		for(const RefPtr<Statement>& statement : statements)
-			statement->accept(*this);
+			dispatch(*statement);
+		// Libraries are called from other modules, so all of their functions are reachable
+		if(ModuleInterface::is_library(m_typed_statements)) {
+			for(auto& [id, pending_function] : m_pending_functions)
+				m_reachable_functions.push_back(std::move(pending_function));
+			m_pending_functions.clear();
+		}
+		// Checking a body can reach further functions
+		while(!m_reachable_functions.empty()) {
+			const PendingFunction pending_function = std::move(m_reachable_functions.back());
+			m_reachable_functions.pop_back();
+			check_function_body(pending_function);
+		}
+		check_effects();
 	} catch(const ErrorException& e) {
 		return e;
 	}
-	return m_typed_statements;
+	return std::move(m_typed_statements);
 }
 
 void TypeChecker::visit(const ExpressionStatement& expresion_statement) {
-	RefPtr<Typed::Expression> expr = visit_with_return(expresion_statement.get_expression()).expression;
-	m_typed_statements.push_back(mk_ref<Typed::ExpressionStatement>(expr));
+	RefPtr<Typed::Expression> expr = dispatch(expresion_statement.get_expression()).expression;
+	m_typed_statements.push_back(mk_ref<Typed::ExpressionStatement>(expresion_statement.get_source_range(), expr));
 }
 
 void TypeChecker::visit(const Declaration& declaration) {
 	const std::string_view name = declaration.get_identifier().get_lexeme();
-	RefPtr<DeclaredType> declared_type = visit_with_return(declaration.get_type()).type->get_declared_type_shared();
+	RefPtr<DeclaredType> declared_type = dispatch(declaration.get_type()).type->get_declared_type_shared();
 	bool is_mutable = declaration.get_declaration_kind() == Declaration::Kind::VAR;
 	RefPtr<AppliedType> applied_type = AppliedType::promote_declared_type(declared_type, is_mutable);
 	RefPtr<Typed::Expression> init_expr = nullptr;
 	if(const Expression* init = declaration.get_initializer(); init != nullptr) {
-		auto [init_type, expr] = visit_with_return(*init);
+		auto [init_type, expr] = check_expression(*init, declared_type);
 		init_expr = expr;
 		if(!init_type->can_be_assigned_to(*applied_type))
 			throw ErrorException("Initializer type does not match declaration type", init->get_source_range());
 	} else if(!is_mutable)
 		throw ErrorException("Values have to be initialized during declaration", declaration.get_source_range());
 
-	DeclarationDumpster::the().abort_on_exception([&]() {
-		declid_t decl_id = DeclarationDumpster::the().insert({name, applied_type});
+	m_instance.get_declarations().abort_on_exception([&]() {
+		declid_t decl_id = m_instance.get_declarations().insert({name, applied_type});
 		bool successful = m_current_scope->insert_symbol(name, {decl_id, applied_type});
 		if(!successful)
 			throw ErrorException("Symbol already declared", declaration.get_identifier().get_source_range());
-		m_typed_statements.push_back(mk_ref<Typed::Declaration>(decl_id));
+		m_typed_statements.push_back(mk_ref<Typed::Declaration>(declaration.get_source_range(), decl_id));
 		// TODO: generate assignment with default init if no initializer is specified
 		if(declaration.get_initializer() != nullptr) {
-			m_typed_statements.push_back(
-				mk_ref<Typed::ExpressionStatement>(mk_ref<Typed::Assignment>(applied_type, decl_id, init_expr)));
+			const SourceRange& source_range = declaration.get_source_range();
+			m_typed_statements.push_back(mk_ref<Typed::ExpressionStatement>(
+				source_range, mk_ref<Typed::Assignment>(source_range, applied_type, decl_id, init_expr)));
 		}
 	});
 }
 
 void TypeChecker::visit(const Function& function) {
-	RefPtr<TypeScope> function_scope = mk_ref<TypeScope>(m_current_scope);
+	// A function inside of another one is not kept on its own, and the one around it is checked again every time
+	if(m_context.enclosing_function != nullptr)
+		m_used_names = nullptr;
+	// The body sees everything that was declared before the function, but neither the function itself nor what comes
+	// after it. This stays true if the body is only checked later.
+	RefPtr<TypeScope> function_scope =
+		mk_ref<TypeScope>(m_current_scope, m_instance.get_declarations().get_last_id());
 	std::vector<RefPtr<AppliedType>> parameters;
 	std::vector<declid_t> typed_parameters;
 	for(const Function::Parameter& parameter : function.get_parameters()) {
-		RefPtr<DeclaredType> param_type = visit_with_return(*parameter.type).type->get_declared_type_shared();
+		RefPtr<DeclaredType> param_type = dispatch(*parameter.type).type->get_declared_type_shared();
+		// The arguments are the key of the table the results are remembered in
+		if(function.is_memoized() && param_type->get_kind() != DeclaredType::Integer)
+			throw ErrorException("Memoized functions can only take integers", parameter.identifier.get_source_range());
 		bool is_mutable = parameter.kind == Declaration::Kind::VAR;
 		RefPtr<AppliedType> applied_param_type = AppliedType::promote_declared_type(param_type, is_mutable);
-		DeclarationDumpster::the().abort_on_exception([&]() {
+		m_instance.get_declarations().abort_on_exception([&]() {
 			declid_t param_decl_id =
-				DeclarationDumpster::the().insert({parameter.identifier.get_lexeme(), applied_param_type});
+				m_instance.get_declarations().insert({parameter.identifier.get_lexeme(), applied_param_type});
 			typed_parameters.push_back(param_decl_id);
 			bool successful =
 				function_scope->insert_symbol(parameter.identifier.get_lexeme(), {param_decl_id, applied_param_type});
@@ -70,43 +149,110 @@ void TypeChecker::visit(const Function& function) {
 			parameters.push_back(applied_param_type);
 		});
 	}
-	RefPtr<DeclaredType> return_type = visit_with_return(function.get_return_type()).type->get_declared_type_shared();
+	RefPtr<DeclaredType> return_type = dispatch(function.get_return_type()).type->get_declared_type_shared();
 	RefPtr<FunctionType> function_type =
 		mk_ref<FunctionType>(function.get_identifier().get_lexeme(), return_type, parameters);
-	m_context.enclosing_function = function_type;
-	execute_on_scope(function_scope, [&]() { function.get_implementation().accept(*this); });
-	m_context.enclosing_function = nullptr;
-	if(!m_context.had_return)
-		throw ErrorException("Missing return statement", function.get_implementation().get_source_range());
-	DeclarationDumpster::the().abort_on_exception([&]() {
-		declid_t fun_decl_id = DeclarationDumpster::the().insert(
+	declid_t fun_decl_id = 0;
+	m_instance.get_declarations().abort_on_exception([&]() {
+		fun_decl_id = m_instance.get_declarations().insert(
 			{function.get_identifier().get_lexeme(), AppliedType::promote_declared_type(function_type, false)});
 		if(!m_current_scope->insert_function(function.get_identifier().get_lexeme(), {fun_decl_id, function_type}))
 			throw ErrorException("Redefinition of function", function.get_identifier().get_source_range());
-		RefPtr<Typed::Block> impl = std::static_pointer_cast<Typed::Block>(m_typed_statements.back());
-		// The block statement does not belong on the top-level, but should only be nested inside the function
-		m_typed_statements.erase(m_typed_statements.end());
-		m_typed_statements.push_back(mk_ref<Typed::Function>(fun_decl_id, impl, typed_parameters));
 	});
-	m_context.had_return = false;
+	// The function keeps its place, so it is still generated before the code that calls it
+	RefPtr<Typed::Function> typed_function = mk_ref<Typed::Function>(
+		function.get_source_range(), fun_decl_id, nullptr, typed_parameters, function.is_memoized());
+	m_typed_statements.push_back(typed_function);
+	PendingFunction pending_function{
+		function, function_scope, function_type, typed_function, m_current_scope == m_module_scope};
+	if(m_only_reachable_functions)
+		m_pending_functions.emplace(fun_decl_id, std::move(pending_function));
+	else
+		check_function_body(pending_function);
+}
+
+void TypeChecker::visit(const ExternFunction& extern_function) {
+	const std::string_view name = extern_function.get_identifier().get_lexeme();
+	// Kyra names cannot collide with the runtime, but the top-level code is generated as main
+	if(name == "main")
+		throw ErrorException(
+			"The name is reserved for the program", extern_function.get_identifier().get_source_range());
+	if(!m_c_functions.insert(name).second)
+		throw ErrorException("C functions cannot be overloaded", extern_function.get_identifier().get_source_range());
+	// Only integers are passed the same way in Kyra and C
+	std::vector<RefPtr<AppliedType>> parameters;
+	for(const Function::Parameter& parameter : extern_function.get_parameters()) {
+		RefPtr<DeclaredType> param_type = dispatch(*parameter.type).type->get_declared_type_shared();
+		if(param_type->get_kind() != DeclaredType::Integer)
+			throw ErrorException("C functions can only take integers", parameter.type->get_source_range());
+		parameters.push_back(
+			AppliedType::promote_declared_type(param_type, parameter.kind == Declaration::Kind::VAR));
+	}
+	RefPtr<DeclaredType> return_type = dispatch(extern_function.get_return_type()).type->get_declared_type_shared();
+	if(return_type->get_kind() != DeclaredType::Integer) {
+		throw ErrorException(
+			"C functions can only return integers", extern_function.get_return_type().get_source_range());
+	}
+	RefPtr<FunctionType> function_type = mk_ref<FunctionType>(name, return_type, parameters);
+
+	m_instance.get_declarations().abort_on_exception([&]() {
+		declid_t fun_decl_id = m_instance.get_declarations().insert(
+			{name, AppliedType::promote_declared_type(function_type, false)});
+		if(!m_current_scope->insert_function(name, {fun_decl_id, function_type}))
+			throw ErrorException("Redefinition of function", extern_function.get_identifier().get_source_range());
+		// Nothing is known about what the function does
+		const unsigned effects = EffectAnalysis::ReadsMemory | EffectAnalysis::WritesMemory |
+			EffectAnalysis::PerformsIO | EffectAnalysis::MayDiverge | EffectAnalysis::MayFail;
+		m_typed_statements.push_back(mk_ref<Typed::ExternalFunction>(
+			extern_function.get_source_range(), fun_decl_id, std::string(name), effects, true));
+	});
+}
+
+void TypeChecker::visit(const Import& import) {
+	const Token& module_name = import.get_module_name();
+	const std::filesystem::path interface_path = ModuleInterface::get_path_for(
+		import.get_source_range().get_file_path().parent_path() / module_name.get_lexeme());
+	if(!m_imported_modules.insert(interface_path).second)
+		throw ErrorException("Module was already imported", module_name.get_source_range());
+	const ModuleInterface* interface = m_instance.load_interface(interface_path);
+	if(interface == nullptr)
+		throw ErrorException(
+			"Module has no valid interface, it has to be compiled first", module_name.get_source_range());
+	for(const ModuleInterface::Function& function : interface->get_functions()) {
+		m_instance.get_declarations().abort_on_exception([&]() {
+			declid_t fun_decl_id = m_instance.get_declarations().insert(
+				{function.name, AppliedType::promote_declared_type(function.type, false)});
+			if(!m_current_scope->insert_function(function.name, {fun_decl_id, function.type}))
+				throw ErrorException("Redefinition of function", module_name.get_source_range());
+			std::string symbol_name =
+				ModuleInterface::mangle(interface->get_module_name(), function.name, *function.type);
+			m_typed_statements.push_back(mk_ref<Typed::ExternalFunction>(
+				import.get_source_range(), fun_decl_id, std::move(symbol_name), function.effects));
+		});
+	}
 }
 
 void TypeChecker::visit(const Print& print_statement) {
-	RefPtr<Typed::Expression> return_expr = visit_with_return(print_statement.get_expression()).expression;
-	m_typed_statements.push_back(mk_ref<Typed::Print>(return_expr));
+	auto [type, return_expr] = dispatch(print_statement.get_expression());
+	if(type->get_declared_type().get_kind() != DeclaredType::Integer)
+		throw ErrorException("Only integers can be printed", print_statement.get_expression().get_source_range());
+	m_typed_statements.push_back(mk_ref<Typed::Print>(print_statement.get_source_range(), return_expr));
 }
 
 void TypeChecker::visit(const Return& return_statement) {
 	RefPtr<FunctionType> function = m_context.enclosing_function;
 	if(function == nullptr)
 		throw ErrorException("Return can only be used inside a function", return_statement.get_source_range());
+	if(m_context.parallel_loop_variable != 0)
+		throw ErrorException("Cannot return from a parallel loop", return_statement.get_source_range());
 
-	auto [actual_return_type, return_expr] = visit_with_return(return_statement.get_expression());
+	auto [actual_return_type, return_expr] =
+		check_expression(return_statement.get_expression(), function->get_returned_type());
 	if(!actual_return_type->can_be_assigned_to(
 		   *AppliedType::promote_declared_type(function->get_returned_type(), true))) {
 		throw ErrorException("Wrong return type", return_statement.get_expression().get_source_range());
 	}
-	m_typed_statements.push_back(mk_ref<Typed::Return>(return_expr));
+	m_typed_statements.push_back(mk_ref<Typed::Return>(return_statement.get_source_range(), return_expr));
 	m_context.had_return = true;
 }
 
@@ -114,40 +260,130 @@ void TypeChecker::visit(const Block& block) {
 	unsigned start_index = m_typed_statements.size();
 	execute_on_new_scope([&]() {
 		for(const RefPtr<Statement>& statement : block.get_body())
-			statement->accept(*this);
+			dispatch(*statement);
 	});
-	std::vector<RefPtr<Typed::Statement>> statements(
-		m_typed_statements.begin() + start_index, m_typed_statements.end());
+	std::vector<RefPtr<Typed::Statement>> statements(std::make_move_iterator(m_typed_statements.begin() + start_index),
+		std::make_move_iterator(m_typed_statements.end()));
 	// All statements in the block don't belong on the top level, but should only be nested inside the block statement
 	m_typed_statements.erase(m_typed_statements.begin() + start_index, m_typed_statements.end());
-	m_typed_statements.push_back(mk_ref<Typed::Block>(statements));
+	m_typed_statements.push_back(mk_ref<Typed::Block>(block.get_source_range(), statements));
 }
 
-void TypeChecker::visit(const IntLiteral& literal) {
-	RefPtr<DeclaredType> i32_type = m_current_scope->find_type("i32");
-	RefPtr<AppliedType> type = AppliedType::promote_declared_type(i32_type, true);
-	return_from_visit_emplace(type, mk_ref<Typed::IntLiteral>(type, literal.get_literal_value()));
+void TypeChecker::visit(const For& for_statement) {
+	auto [begin, end] = check_operands(for_statement.get_begin(), for_statement.get_end(), nullptr);
+	if(begin.type->get_declared_type().get_kind() != DeclaredType::Integer)
+		throw ErrorException("The bounds of a loop have to be integers", for_statement.get_begin().get_source_range());
+	if(!end.type->get_declared_type().can_be_assigned_to(begin.type->get_declared_type()))
+		throw ErrorException("Both bounds of a loop need the same type", for_statement.get_end().get_source_range());
+
+	const Token& variable = for_statement.get_variable();
+	RefPtr<AppliedType> variable_type =
+		AppliedType::promote_declared_type(begin.type->get_declared_type_shared(), false);
+	declid_t variable_id = 0;
+	m_instance.get_declarations().abort_on_exception(
+		[&]() { variable_id = m_instance.get_declarations().insert({variable.get_lexeme(), variable_type}); });
+	// The body might not be executed at all, so a return inside of it does not count
+	const bool had_return = m_context.had_return;
+	const declid_t parallel_loop_variable = m_context.parallel_loop_variable;
+	if(for_statement.is_parallel()) {
+		m_context.parallel_loop_variable = variable_id;
+		m_has_parallel_loops = true;
+	}
+	execute_on_new_scope([&]() {
+		m_current_scope->insert_symbol(variable.get_lexeme(), {variable_id, variable_type});
+		dispatch(for_statement.get_body());
+	});
+	m_context.parallel_loop_variable = parallel_loop_variable;
+	m_context.had_return = had_return;
+	RefPtr<Typed::Block> body = std::static_pointer_cast<Typed::Block>(std::move(m_typed_statements.back()));
+	m_typed_statements.pop_back();
+	m_typed_statements.push_back(mk_ref<Typed::For>(for_statement.get_source_range(), variable_id, begin.expression,
+		end.expression, std::move(body), for_statement.is_parallel()));
 }
 
-void TypeChecker::visit(const Assignment& assignment) {
+CheckedExpression TypeChecker::visit(const IntLiteral& literal) {
+	RefPtr<DeclaredType> declared_type = m_expected_type;
+	if(declared_type == nullptr || declared_type->get_kind() != DeclaredType::Integer)
+		declared_type = m_current_scope->find_type("i32");
+	const auto& int_type = static_cast<const IntType&>(*declared_type);
+	if(literal.get_literal_value() > int_type.get_max_value()) {
+		throw ErrorException(
+			"Literal does not fit into " + std::string(int_type.get_name()), literal.get_source_range());
+	}
+	RefPtr<AppliedType> type = AppliedType::promote_declared_type(declared_type, true);
+	return {type, mk_ref<Typed::IntLiteral>(literal.get_source_range(), type, literal.get_literal_value())};
+}
+
+CheckedExpression TypeChecker::visit(const ArrayLiteral& array_literal) {
+	const std::vector<RefPtr<Expression>>& elements = array_literal.get_elements();
+	if(elements.empty())
+		throw ErrorException("Arrays need at least one element", array_literal.get_source_range());
+	// The elements take the element type of the expected array, otherwise the first element determines it
+	RefPtr<DeclaredType> element_type = nullptr;
+	if(m_expected_type != nullptr && m_expected_type->get_kind() == DeclaredType::Array)
+		element_type = static_cast<const ArrayType&>(*m_expected_type).get_element_type();
+	std::vector<RefPtr<Typed::Expression>> typed_elements;
+	for(const RefPtr<Expression>& element : elements) {
+		auto [type, expr] = check_expression(*element, element_type);
+		if(element_type == nullptr)
+			element_type = type->get_declared_type_shared();
+		else if(!type->get_declared_type().can_be_assigned_to(*element_type))
+			throw ErrorException("All elements of an array need the same type", element->get_source_range());
+		typed_elements.push_back(expr);
+	}
+	RefPtr<AppliedType> type =
+		AppliedType::promote_declared_type(mk_ref<ArrayType>(element_type, elements.size()), true);
+	return {type, mk_ref<Typed::ArrayLiteral>(array_literal.get_source_range(), type, typed_elements)};
+}
+
+CheckedExpression TypeChecker::visit(const Assignment& assignment) {
+	if(m_used_names != nullptr)
+		m_used_names->insert(assignment.get_lhs().get_lexeme());
 	auto element_or_none = m_current_scope->find_symbol(assignment.get_lhs().get_lexeme());
 	if(!element_or_none.has_value())
 		throw ErrorException("Undefined symbol", assignment.get_lhs().get_source_range());
 	auto [decl_id, type] = element_or_none.value();
 	if(!type->is_mutable())
 		throw ErrorException("Cannot assign to a value", assignment.get_source_range());
-	auto [rhs_type, rhs_expr] = visit_with_return(assignment.get_rhs());
+	// Iterations of a parallel loop run at the same time, so they would race for the variable. Elements of arrays can
+	// still be assigned, each iteration is expected to write its own elements.
+	if(decl_id < m_context.parallel_loop_variable) {
+		throw ErrorException(
+			"Cannot assign to a variable declared outside of a parallel loop", assignment.get_source_range());
+	}
+	auto [rhs_type, rhs_expr] = check_expression(assignment.get_rhs(), type->get_declared_type_shared());
 	if(!rhs_type->can_be_assigned_to(*type))
 		throw ErrorException("Wrong type", assignment.get_rhs().get_source_range());
-	return_from_visit_emplace(type, mk_ref<Typed::Assignment>(type, decl_id, rhs_expr));
+	return {type, mk_ref<Typed::Assignment>(assignment.get_source_range(), type, decl_id, rhs_expr)};
+}
+
+CheckedExpression TypeChecker::visit(const IndexAssignment& index_assignment) {
+	// Only elements of variables can be assigned, e.g. a[i] or a[i][j]
+	const Expression* root = &index_assignment.get_lhs();
+	while(root->get_node_kind() == ASTNode::NodeKind::Index)
+		root = &static_cast<const Index*>(root)->get_array();
+	if(root->get_node_kind() != ASTNode::NodeKind::VarQuery)
+		throw ErrorException(
+			"Only elements of variables can be assigned to", index_assignment.get_lhs().get_source_range());
+	auto [type, lhs_expr] = check_expression(index_assignment.get_lhs(), nullptr);
+	if(!type->is_mutable())
+		throw ErrorException("Cannot assign to an element of a value", index_assignment.get_source_range());
+	auto [rhs_type, rhs_expr] = check_expression(index_assignment.get_rhs(), type->get_declared_type_shared());
+	if(!rhs_type->can_be_assigned_to(*type))
+		throw ErrorException("Wrong type", index_assignment.get_rhs().get_source_range());
+	return {type, mk_ref<Typed::IndexAssignment>(index_assignment.get_source_range(), type,
+					  std::static_pointer_cast<Typed::Index>(lhs_expr), rhs_expr)};
 }
 
-void TypeChecker::visit(const BinaryExpression& binary_expression) {
+CheckedExpression TypeChecker::visit(const BinaryExpression& binary_expression) {
 	std::stringstream function_name;
 	const Token& oper = binary_expression.get_operator();
 	function_name << "operator" << oper.get_lexeme();
-	auto [lhs_type, lhs_expr] = visit_with_return(binary_expression.get_lhs());
-	auto [rhs_type, rhs_expr] = visit_with_return(binary_expression.get_rhs());
+	// Operators of builtin types take and return their own type, so the expected type is passed on to the operands
+	auto [checked_lhs, checked_rhs] =
+		check_operands(binary_expression.get_lhs(), binary_expression.get_rhs(), m_expected_type);
+	auto [lhs_type, lhs_expr] = checked_lhs;
+	auto [rhs_type, rhs_expr] = checked_rhs;
 	const std::vector<RefPtr<FunctionType>> methods = lhs_type->get_declared_type().find_methods(function_name.str());
 	if(methods.empty())
 		throw ErrorException("Undefined operator", binary_expression.get_operator().get_source_range());
@@ -163,25 +399,46 @@ void TypeChecker::visit(const BinaryExpression& binary_expression) {
 	RefPtr<AppliedType> type = AppliedType::promote_declared_type(candidate->get_returned_type(), true);
 	// Note: Only generate bin. exprs. for native binary expressions. For everything else, generate calls to operator
 	// function
-	return_from_visit_emplace(type, mk_ref<Typed::BinaryExpression>(type, lhs_expr, rhs_expr, oper));
+	return {type,
+		mk_ref<Typed::BinaryExpression>(binary_expression.get_source_range(), type, lhs_expr, rhs_expr, oper)};
 }
 
-void TypeChecker::visit(const TypeIndicator& type) {
+CheckedExpression TypeChecker::visit(const TypeIndicator& type) {
+	// TypeIndicatior does not exist in the Typed namespace, so no Typed::Expression is created here
+	if(const TypeIndicator* element_type = type.get_element_type(); element_type != nullptr) {
+		if(type.get_length() == 0)
+			throw ErrorException("Arrays need at least one element", type.get_source_range());
+		RefPtr<DeclaredType> element = dispatch(*element_type).type->get_declared_type_shared();
+		return {AppliedType::promote_declared_type(mk_ref<ArrayType>(element, type.get_length()), true), nullptr};
+	}
 	RefPtr<DeclaredType> found_type = m_current_scope->find_type(type.get_type().get_lexeme());
 	if(found_type == nullptr)
 		throw ErrorException("Undefined type", type.get_source_range());
-	// TypeIndicatior does not exist in the Typed namespace, so no Typed::Expression is created here
-	return_from_visit_emplace(AppliedType::promote_declared_type(found_type, true), nullptr);
+	return {AppliedType::promote_declared_type(found_type, true), nullptr};
 }
 
-void TypeChecker::visit(const Call& call) {
-	const auto& functions = m_current_scope->find_functions(call.get_function_name().get_lexeme());
-	if(functions.empty())
+CheckedExpression TypeChecker::visit(const Call& call) {
+	const std::string_view name = call.get_function_name().get_lexeme();
+	if(m_used_names != nullptr)
+		m_used_names->insert(name);
+	const auto& functions = m_current_scope->find_functions(name);
+	if(functions.empty()) {
+		// Calling an integer type converts the argument to it, e.g. i64(x). Calling a vector type builds a vector.
+		if(RefPtr<DeclaredType> type = m_current_scope->find_type(name); type != nullptr) {
+			if(type->get_kind() == DeclaredType::Integer)
+				return check_conversion(call, type);
+			if(type->get_kind() == DeclaredType::Vector)
+				return check_vector_construction(call, std::static_pointer_cast<VectorType>(type));
+		}
+		if(const auto it = vector_operations.find(name); it != vector_operations.end())
+			return check_vector_operation(call, it->second);
 		throw ErrorException("Undefined function", call.get_function_name().get_source_range());
+	}
+	const std::vector<Call::Argument>& args = call.get_arguments();
 	std::vector<RefPtr<AppliedType>> arg_types;
 	std::vector<RefPtr<Typed::Expression>> arg_exprs;
-	for(const Call::Argument& arg : call.get_arguments()) {
-		auto [type, expr] = visit_with_return(*arg.value);
+	for(unsigned i = 0; i < args.size(); ++i) {
+		auto [type, expr] = check_expression(*args.at(i).value, find_common_parameter_type(functions, args.size(), i));
 		arg_types.push_back(type);
 		arg_exprs.push_back(expr);
 	}
@@ -193,19 +450,278 @@ void TypeChecker::visit(const Call& call) {
 	}
 	if(candidate.type == nullptr)
 		throw ErrorException("No candidate matched", call.get_function_name().get_source_range());
+	if(auto it = m_pending_functions.find(candidate.declid); it != m_pending_functions.end()) {
+		m_reachable_functions.push_back(std::move(it->second));
+		m_pending_functions.erase(it);
+	}
 	RefPtr<AppliedType> type = AppliedType::promote_declared_type(candidate.type->get_returned_type(), true);
-	return_from_visit_emplace(type, mk_ref<Typed::Call>(type, candidate.declid, arg_exprs));
+	return {type, mk_ref<Typed::Call>(call.get_source_range(), type, candidate.declid, arg_exprs)};
+}
+
+CheckedExpression TypeChecker::visit(const Index& index) {
+	auto [array_type, array_expr] = check_expression(index.get_array(), nullptr);
+	if(array_type->get_declared_type().get_kind() != DeclaredType::Array)
+		throw ErrorException("Only arrays can be indexed", index.get_array().get_source_range());
+	const auto& declared_type = static_cast<const ArrayType&>(array_type->get_declared_type());
+	auto [index_type, index_expr] = check_expression(index.get_index(), nullptr);
+	if(index_type->get_declared_type().get_kind() != DeclaredType::Integer)
+		throw ErrorException("Indices have to be integers", index.get_index().get_source_range());
+	if(index_expr->get_node_kind() == Typed::TASTNode::NodeKind::IntLiteral &&
+		static_cast<const Typed::IntLiteral&>(*index_expr).get_value() >= declared_type.get_length())
+		throw ErrorException("Index is out of bounds", index.get_index().get_source_range());
+	// Elements of a variable can be modified, elements of a value cannot
+	RefPtr<AppliedType> type =
+		AppliedType::promote_declared_type(declared_type.get_element_type(), array_type->is_mutable());
+	return {type, mk_ref<Typed::Index>(index.get_source_range(), type, array_expr, index_expr)};
 }
 
-void TypeChecker::visit(const Group& group) { return_from_visit(visit_with_return(group.get_content())); }
+CheckedExpression TypeChecker::visit(const Group& group) { return dispatch(group.get_content()); }
 
-void TypeChecker::visit(const VarQuery& var_query) {
+CheckedExpression TypeChecker::visit(const VarQuery& var_query) {
 	const std::string_view name = var_query.get_identifier().get_lexeme();
+	if(m_used_names != nullptr)
+		m_used_names->insert(name);
 	auto element_or_none = m_current_scope->find_symbol(name);
 	if(!element_or_none.has_value())
 		throw ErrorException("Undefined symbol", var_query.get_source_range());
 	auto [decl_id, type] = element_or_none.value();
-	return_from_visit_emplace(type, mk_ref<Typed::VarQuery>(type, decl_id));
+	return {type, mk_ref<Typed::VarQuery>(var_query.get_source_range(), type, decl_id)};
+}
+
+CheckedExpression TypeChecker::check_expression(const Expression& expression, RefPtr<DeclaredType> expected_type) {
+	RefPtr<DeclaredType> backup = std::move(m_expected_type);
+	m_expected_type = std::move(expected_type);
+	CheckedExpression checked_expression = dispatch(expression);
+	m_expected_type = std::move(backup);
+	return checked_expression;
+}
+
+CheckedExpression TypeChecker::check_conversion(const Call& call, RefPtr<DeclaredType> target_type) {
+	if(call.get_arguments().size() != 1)
+		throw ErrorException("A conversion takes exactly one argument", call.get_source_range());
+	// A literal gets the target type right away, so it can use the whole range of the type
+	const Expression& argument = *call.get_arguments().front().value;
+	auto [value_type, value] = check_expression(argument, target_type);
+	if(value_type->get_declared_type().get_kind() != DeclaredType::Integer)
+		throw ErrorException("Only integers can be converted", argument.get_source_range());
+	RefPtr<AppliedType> type = AppliedType::promote_declared_type(target_type, true);
+	return {type, mk_ref<Typed::Conversion>(call.get_source_range(), type, value)};
+}
+
+CheckedExpression TypeChecker::check_vector_construction(const Call& call, RefPtr<VectorType> vector_type) {
+	if(call.get_arguments().size() != 1)
+		throw ErrorException("A vector is built from exactly one argument", call.get_source_range());
+	const Expression& argument = *call.get_arguments().front().value;
+	RefPtr<DeclaredType> element_type = vector_type->get_element_type();
+	RefPtr<DeclaredType> array_type = mk_ref<ArrayType>(element_type, vector_type->get_lanes());
+	// A value of the element type is copied into all lanes, an array fills the lanes with its elements
+	const bool is_array_literal = argument.get_node_kind() == ASTNode::NodeKind::ArrayLiteral;
+	auto [argument_type, value] = check_expression(argument, is_array_literal ? array_type : element_type);
+	Typed::VectorOperation::Operation operation = Typed::VectorOperation::Operation::Splat;
+	if(argument_type->get_declared_type().can_be_assigned_to(*array_type))
+		operation = Typed::VectorOperation::Operation::FromArray;
+	else if(!argument_type->get_declared_type().can_be_assigned_to(*element_type)) {
+		throw ErrorException("A vector can only be built from its element type or an array of it",
+			argument.get_source_range());
+	}
+	RefPtr<AppliedType> type = AppliedType::promote_declared_type(vector_type, true);
+	return {type, mk_ref<Typed::VectorOperation>(call.get_source_range(), type, operation, std::vector{value})};
+}
+
+CheckedExpression TypeChecker::check_vector_operation(const Call& call, Typed::VectorOperation::Operation operation) {
+	using Operation = Typed::VectorOperation::Operation;
+	const std::vector<Call::Argument>& arguments = call.get_arguments();
+	size_t expected_arguments = 1;
+	if(operation == Operation::Extract)
+		expected_arguments = 2;
+	else if(operation == Operation::Insert || (operation == Operation::Shuffle && arguments.size() == 3))
+		expected_arguments = 3;
+	else if(operation == Operation::Shuffle)
+		expected_arguments = 2;
+	if(arguments.size() != expected_arguments)
+		throw ErrorException("Wrong number of arguments", call.get_source_range());
+
+	auto [vector_type, vector] = check_vector(*arguments.front().value);
+	const auto& declared_type = static_cast<const VectorType&>(vector_type->get_declared_type());
+	RefPtr<DeclaredType> result_type = declared_type.get_element_type();
+	std::vector<RefPtr<Typed::Expression>> operands = {vector};
+	std::vector<int> mask;
+	switch(operation) {
+		case Operation::Extract: operands.push_back(check_lane(*arguments.at(1).value, declared_type)); break;
+		case Operation::Insert: {
+			operands.push_back(check_lane(*arguments.at(1).value, declared_type));
+			const Expression& argument = *arguments.at(2).value;
+			auto [element_type, element] = check_expression(argument, declared_type.get_element_type());
+			if(!element_type->get_declared_type().can_be_assigned_to(*declared_type.get_element_type()))
+				throw ErrorException("Wrong type", argument.get_source_range());
+			operands.push_back(element);
+			result_type = vector_type->get_declared_type_shared();
+			break;
+		}
+		case Operation::Shuffle: {
+			// Lanes of the second vector follow the ones of the first vector
+			if(arguments.size() == 3) {
+				auto [second_type, second] = check_vector(*arguments.at(1).value);
+				if(!second_type->get_declared_type().can_be_assigned_to(declared_type))
+					throw ErrorException("Both vectors need the same type", arguments.at(1).value->get_source_range());
+				operands.push_back(second);
+			}
+			const Expression& mask_argument = *arguments.back().value;
+			if(mask_argument.get_node_kind() != ASTNode::NodeKind::ArrayLiteral)
+				throw ErrorException("The mask has to be an array of literals", mask_argument.get_source_range());
+			for(const RefPtr<Expression>& lane : static_cast<const ArrayLiteral&>(mask_argument).get_elements()) {
+				if(lane->get_node_kind() != ASTNode::NodeKind::IntLiteral)
+					throw ErrorException("The mask has to be an array of literals", lane->get_source_range());
+				const uint64_t value = static_cast<const IntLiteral&>(*lane).get_literal_value();
+				if(value >= declared_type.get_lanes() * operands.size())
+					throw ErrorException("Lane is out of bounds", lane->get_source_range());
+				mask.push_back(static_cast<int>(value));
+			}
+			const std::string name =
+				std::string(declared_type.get_element_type()->get_name()) + 'x' + std::to_string(mask.size());
+			result_type = m_current_scope->find_type(name);
+			if(result_type == nullptr || result_type->get_kind() != DeclaredType::Vector)
+				throw ErrorException("There is no vector type with this many lanes", mask_argument.get_source_range());
+			break;
+		}
+		default: break;
+	}
+	RefPtr<AppliedType> type = AppliedType::promote_declared_type(result_type, true);
+	return {type, mk_ref<Typed::VectorOperation>(call.get_source_range(), type, operation, operands, mask)};
+}
+
+CheckedExpression TypeChecker::check_vector(const Expression& expression) {
+	CheckedExpression checked_expression = check_expression(expression, nullptr);
+	if(checked_expression.type->get_declared_type().get_kind() != DeclaredType::Vector)
+		throw ErrorException("Expected a vector", expression.get_source_range());
+	return checked_expression;
+}
+
+RefPtr<Typed::Expression> TypeChecker::check_lane(const Expression& lane, const VectorType& vector_type) {
+	auto [type, expr] = check_expression(lane, nullptr);
+	if(type->get_declared_type().get_kind() != DeclaredType::Integer)
+		throw ErrorException("Lanes have to be integers", lane.get_source_range());
+	if(expr->get_node_kind() == Typed::TASTNode::NodeKind::IntLiteral &&
+		static_cast<const Typed::IntLiteral&>(*expr).get_value() >= vector_type.get_lanes())
+		throw ErrorException("Lane is out of bounds", lane.get_source_range());
+	return expr;
+}
+
+void TypeChecker::check_function_body(const PendingFunction& pending_function) {
+	const Function& function = pending_function.function;
+	const TimeTrace::Scope scope(
+		m_instance.get_time_trace(), "Function", "Type checking", function.get_identifier().get_lexeme());
+	const declid_t id = pending_function.typed_function->get_function_declaration_id();
+	FunctionCache* function_cache = pending_function.is_top_level ? m_instance.get_function_cache() : nullptr;
+	std::string symbol;
+	std::string_view source;
+	if(function_cache != nullptr) {
+		symbol = ModuleInterface::mangle(function.get_source_range().get_file_path().stem().string(),
+			function.get_identifier().get_lexeme(), *pending_function.type);
+		source = m_instance.get_source_text(function.get_source_range());
+		if(reuse_function(pending_function, *function_cache, symbol, source))
+			return;
+	}
+	// Bodies can be checked in the middle of other code, e.g. nested functions or the ones reached lazily
+	const Context context = std::exchange(m_context, {});
+	const RefPtr<DeclaredType> expected_type = std::exchange(m_expected_type, nullptr);
+	m_context.enclosing_function = pending_function.type;
+	// Every name the body looks up is an input of its entry in the cache
+	std::set<std::string_view> used_names;
+	m_used_names = function_cache != nullptr ? &used_names : nullptr;
+	execute_on_scope(pending_function.scope, [&]() { dispatch(function.get_implementation()); });
+	if(!m_context.had_return)
+		throw ErrorException("Missing return statement", function.get_implementation().get_source_range());
+	// The block statement does not belong where the function is checked, but should only be nested inside the function
+	pending_function.typed_function->set_implementation(
+		std::static_pointer_cast<Typed::Block>(std::move(m_typed_statements.back())));
+	m_typed_statements.pop_back();
+	if(function.is_memoized())
+		m_memoized_functions.emplace_back(id, function.get_identifier().get_source_range());
+	if(m_used_names != nullptr) {
+		function_cache->add_checked_function(id, symbol, source,
+			std::vector<std::string>(used_names.begin(), used_names.end()), *pending_function.scope);
+	}
+	m_used_names = nullptr;
+	m_context = context;
+	m_expected_type = expected_type;
+}
+
+bool TypeChecker::reuse_function(const PendingFunction& pending_function, FunctionCache& function_cache,
+	const std::string& symbol, std::string_view source) {
+	const Function& function = pending_function.function;
+	const declid_t id = pending_function.typed_function->get_function_declaration_id();
+	const EffectAnalysis::FunctionSummary* summary =
+		function_cache.reuse_function(id, symbol, source, *pending_function.scope);
+	if(summary == nullptr)
+		return false;
+	// The body is not checked again, but the functions it calls are still reached
+	for(declid_t callee : summary->callees) {
+		if(auto it = m_pending_functions.find(callee); it != m_pending_functions.end()) {
+			m_reachable_functions.push_back(std::move(it->second));
+			m_pending_functions.erase(it);
+		}
+	}
+	if(function.is_memoized())
+		m_memoized_functions.emplace_back(id, function.get_identifier().get_source_range());
+	m_has_parallel_loops |= !summary->parallel_callees.empty();
+	return true;
+}
+
+void TypeChecker::check_effects() const {
+	if(m_memoized_functions.empty() && !m_has_parallel_loops)
+		return;
+	EffectAnalysis& effect_analysis = m_instance.get_effect_analysis();
+	// Functions taken from the cache are only known by their summaries
+	if(const FunctionCache* function_cache = m_instance.get_function_cache(); function_cache != nullptr)
+		effect_analysis.analyze(m_typed_statements, m_is_checking_entry, function_cache->get_reused_summaries());
+	else
+		effect_analysis.analyze(m_typed_statements, m_is_checking_entry);
+	for(const auto& [function, source_range] : m_memoized_functions) {
+		// Constants are folded, so reading them does not count as reading memory
+		const unsigned effects = effect_analysis.get_function_info(function).effects;
+		if(effects & EffectAnalysis::PerformsIO)
+			throw ErrorException(
+				"A memoized function cannot print, not even through a function it calls", source_range);
+		if(effects & EffectAnalysis::WritesMemory)
+			throw ErrorException("A memoized function cannot assign to declarations from outside of it", source_range);
+		if(effects & EffectAnalysis::ReadsMemory)
+			throw ErrorException(
+				"A memoized function can only read declarations from outside of it that are constant", source_range);
+	}
+	// Assignments directly inside of a parallel loop are already rejected when they are checked
+	if(const std::optional<SourceRange> call = effect_analysis.find_racing_call(); call.has_value()) {
+		throw ErrorException(
+			"Cannot call a function that assigns a variable declared outside of a parallel loop", *call);
+	}
+}
+
+std::pair<CheckedExpression, CheckedExpression> TypeChecker::check_operands(
+	const Expression& lhs, const Expression& rhs, RefPtr<DeclaredType> expected_type) {
+	// A literal on the left takes the type of the right operand, otherwise the left operand determines the type
+	if(lhs.get_node_kind() == ASTNode::NodeKind::IntLiteral) {
+		CheckedExpression checked_rhs = check_expression(rhs, std::move(expected_type));
+		CheckedExpression checked_lhs = check_expression(lhs, checked_rhs.type->get_declared_type_shared());
+		return {std::move(checked_lhs), std::move(checked_rhs)};
+	}
+	CheckedExpression checked_lhs = check_expression(lhs, std::move(expected_type));
+	CheckedExpression checked_rhs = check_expression(rhs, checked_lhs.type->get_declared_type_shared());
+	return {std::move(checked_lhs), std::move(checked_rhs)};
+}
+
+RefPtr<DeclaredType> TypeChecker::find_common_parameter_type(
+	const std::vector<TypeScope::Element<FunctionType>>& functions, size_t parameter_count, size_t index) {
+	RefPtr<DeclaredType> common_type = nullptr;
+	for(const TypeScope::Element<FunctionType>& function : functions) {
+		const std::vector<RefPtr<AppliedType>>& parameters = function.type->get_parameter();
+		if(parameters.size() != parameter_count)
+			continue;
+		RefPtr<DeclaredType> type = parameters.at(index)->get_declared_type_shared();
+		if(common_type != nullptr && !type->can_be_assigned_to(*common_type))
+			return nullptr;
+		common_type = std::move(type);
+	}
+	return common_type;
 }
 
 template <typename Callback>
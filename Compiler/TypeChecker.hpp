@@ -1,7 +1,10 @@
 #pragma once
 
+#include <filesystem>
 #include <map>
 #include <optional>
+#include <set>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -13,60 +16,118 @@
 #include "Type.hpp"
 
 namespace Kyra {
+class CompilerInstance;
+class FunctionCache;
 
-class TypeChecker : public Untyped::ASTVisitor {
-private:
-	struct VisitResult {
-		VisitResult(RefPtr<AppliedType> type, RefPtr<Typed::Expression> expression) :
-			type(std::move(type)), expression(std::move(expression)) {}
-		VisitResult() : VisitResult(nullptr, nullptr) {}
-
-		RefPtr<AppliedType> type;
-		RefPtr<Typed::Expression> expression;
-	};
-
-	VISIT_RETURN_TYPE(VisitResult)
+// The result of checking an expression. Type indicators only have a type.
+struct CheckedExpression {
+	RefPtr<AppliedType> type;
+	RefPtr<Typed::Expression> expression;
+};
 
+class TypeChecker : public Untyped::ASTVisitor<TypeChecker, void, CheckedExpression> {
 public:
 	struct Context {
 		RefPtr<FunctionType> enclosing_function{nullptr};
 		bool had_return{false};
+		// Declarations are numbered in the order they are checked, so everything with a smaller id than the variable of
+		// the innermost parallel loop is declared outside of it. 0 outside of parallel loops.
+		declid_t parallel_loop_variable{0};
 	};
 
-	static TypeChecker& the() {
-		static TypeChecker instance;
-		return instance;
-	}
-
-	TypeChecker() = default;
+	explicit TypeChecker(CompilerInstance& instance);
 	TypeChecker(const TypeChecker&) = delete;
-	TypeChecker(TypeChecker&&) noexcept = default;
+	TypeChecker(TypeChecker&&) = delete;
 
 	TypeChecker& operator=(const TypeChecker&) = delete;
-	TypeChecker& operator=(TypeChecker&&) noexcept = default;
+	TypeChecker& operator=(TypeChecker&&) = delete;
 
+	// Takes ownership of the untyped AST, so it is freed as soon as it is checked. If only reachable functions are
+	// checked, the bodies of functions that the top-level code never (transitively) calls are skipped. Their
+	// signatures are still checked and their typed functions have no implementation.
 	ErrorOr<std::vector<RefPtr<Typed::Statement>>> check_statements(
-		const std::vector<RefPtr<Untyped::Statement>>& statements);
+		std::vector<RefPtr<Untyped::Statement>> statements, bool only_reachable_functions = false);
+	// Checks an entry of the REPL, which can use everything the earlier entries declared in the scope. What the entry
+	// declares is only added to the scope if all of it is valid, and it hides earlier declarations with the same name.
+	ErrorOr<std::vector<RefPtr<Typed::Statement>>> check_entry(
+		std::vector<RefPtr<Untyped::Statement>> statements, const RefPtr<TypeScope>& scope);
 
-	void visit(const Untyped::ExpressionStatement& expresion_statement) override;
-	void visit(const Untyped::Declaration& declaration) override;
-	void visit(const Untyped::Function& function) override;
-	void visit(const Untyped::Print& print_statement) override;
-	void visit(const Untyped::Return& return_statement) override;
-	void visit(const Untyped::Block& block) override;
-	void visit(const Untyped::IntLiteral& literal) override;
+	void visit(const Untyped::ExpressionStatement& expresion_statement);
+	void visit(const Untyped::Declaration& declaration);
+	void visit(const Untyped::Function& function);
+	void visit(const Untyped::ExternFunction& extern_function);
+	void visit(const Untyped::Import& import);
+	void visit(const Untyped::Print& print_statement);
+	void visit(const Untyped::Return& return_statement);
+	void visit(const Untyped::Block& block);
+	void visit(const Untyped::For& for_statement);
+	CheckedExpression visit(const Untyped::IntLiteral& literal);
+	CheckedExpression visit(const Untyped::ArrayLiteral& array_literal);
 
-	void visit(const Untyped::Assignment& assignment) override;
-	void visit(const Untyped::BinaryExpression& binary_expression) override;
-	void visit(const Untyped::TypeIndicator& type) override;
-	void visit(const Untyped::Call& call) override;
-	void visit(const Untyped::Group& group) override;
-	void visit(const Untyped::VarQuery& var_query) override;
+	CheckedExpression visit(const Untyped::Assignment& assignment);
+	CheckedExpression visit(const Untyped::IndexAssignment& index_assignment);
+	CheckedExpression visit(const Untyped::BinaryExpression& binary_expression);
+	CheckedExpression visit(const Untyped::TypeIndicator& type);
+	CheckedExpression visit(const Untyped::Call& call);
+	CheckedExpression visit(const Untyped::Index& index);
+	CheckedExpression visit(const Untyped::Group& group);
+	CheckedExpression visit(const Untyped::VarQuery& var_query);
 
 private:
+	// A function whose signature is checked, but whose body is not (yet)
+	struct PendingFunction {
+		const Untyped::Function& function;
+		RefPtr<TypeScope> scope;
+		RefPtr<FunctionType> type;
+		RefPtr<Typed::Function> typed_function;
+		// Only top-level functions can be kept in the FunctionCache
+		bool is_top_level;
+	};
+
+	CompilerInstance& m_instance;
 	std::vector<RefPtr<Typed::Statement>> m_typed_statements;
-	RefPtr<TypeScope> m_current_scope{mk_ref<TypeScope>()};
+	RefPtr<TypeScope> m_current_scope;
+	RefPtr<TypeScope> m_module_scope;
 	Context m_context;
+	// The type the currently checked expression should have, if it is known from its context. Literals take this type.
+	RefPtr<DeclaredType> m_expected_type;
+	std::set<std::filesystem::path> m_imported_modules;
+	// C has no overloading, so every C function can only be declared once
+	std::set<std::string_view> m_c_functions;
+	bool m_only_reachable_functions{false};
+	// The functions of earlier entries are only known to the effect analysis of the instance, see check_entry
+	bool m_is_checking_entry{false};
+	std::map<declid_t, PendingFunction> m_pending_functions;
+	// Called by checked code, but not checked themselves yet
+	std::vector<PendingFunction> m_reachable_functions;
+	// Where each memoized function was declared, so an impure one can be reported
+	std::vector<std::pair<declid_t, SourceRange>> m_memoized_functions;
+	bool m_has_parallel_loops{false};
+	// The names the body of the checked function looks up, nullptr if it is not kept in the FunctionCache
+	std::set<std::string_view>* m_used_names{nullptr};
+
+	ErrorOr<std::vector<RefPtr<Typed::Statement>>> check(
+		std::vector<RefPtr<Untyped::Statement>> statements, RefPtr<TypeScope> scope);
+	CheckedExpression check_expression(const Untyped::Expression& expression, RefPtr<DeclaredType> expected_type);
+	// Checks two operands that need the same type, e.g. of a binary expression
+	std::pair<CheckedExpression, CheckedExpression> check_operands(
+		const Untyped::Expression& lhs, const Untyped::Expression& rhs, RefPtr<DeclaredType> expected_type);
+	CheckedExpression check_conversion(const Untyped::Call& call, RefPtr<DeclaredType> target_type);
+	CheckedExpression check_vector_construction(const Untyped::Call& call, RefPtr<VectorType> vector_type);
+	CheckedExpression check_vector_operation(const Untyped::Call& call, Typed::VectorOperation::Operation operation);
+	CheckedExpression check_vector(const Untyped::Expression& expression);
+	RefPtr<Typed::Expression> check_lane(const Untyped::Expression& lane, const VectorType& vector_type);
+	void check_function_body(const PendingFunction& pending_function);
+	// Takes the function from the FunctionCache instead of checking its body. Returns false if its entry cannot be
+	// reused.
+	bool reuse_function(const PendingFunction& pending_function, FunctionCache& function_cache,
+		const std::string& symbol, std::string_view source);
+	// Whether a function is pure or assigns variables depends on all functions it calls, so this can only be checked
+	// for the whole program
+	void check_effects() const;
+	// The type of the parameter if all functions with the given number of parameters agree on it, nullptr otherwise
+	static RefPtr<DeclaredType> find_common_parameter_type(
+		const std::vector<TypeScope::Element<FunctionType>>& functions, size_t parameter_count, size_t index);
 
 	template <typename Callback>
 	void execute_on_scope(RefPtr<TypeScope> scope, Callback callback);
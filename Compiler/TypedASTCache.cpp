@@ -0,0 +1,760 @@
+#include "TypedASTCache.hpp"
+
+#include <fcntl.h>
+#include <llvm/Support/xxhash.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace Kyra {
+namespace {
+// A cache starts with the header, followed by the imported interfaces, the declared types (each directly followed by
+// its parameters), the applied types, the declarations and the statements, and ends with all strings. Strings are
+// referenced by their offset from the start of the strings. Nodes are stored in pre-order: every node is followed by
+// its extra values (e.g. the parameters of a function) and then by its children. The last eight bytes are the hash of
+// everything in front of them, so a damaged file is never loaded. Like interfaces, caches are stored in native byte
+// order. Records are padded to a multiple of eight bytes, so all of them can be read in place.
+constexpr char cache_magic[4] = {'K', 'Y', 'T', 'C'};
+// Has to be increased whenever the format or the typed AST changes
+constexpr uint32_t cache_version = 4;
+// Marks an external function as a C function, the other flags are its effects
+constexpr uint16_t c_function_flag = 1 << 15;
+constexpr uint32_t no_type = std::numeric_limits<uint32_t>::max();
+constexpr size_t record_alignment = 8;
+
+struct StringReference {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t source_hash;
+	uint32_t source_size;
+	uint32_t is_lazy;
+	uint32_t strings_offset;
+	uint32_t interface_count;
+	uint32_t declared_type_count;
+	uint32_t applied_type_count;
+	uint32_t declaration_count;
+	uint32_t statement_count;
+};
+
+struct InterfaceRecord {
+	uint64_t hash;
+	StringReference path;
+};
+
+// Builtin and array types are found by their names. Only function types have a return type and parameters.
+struct DeclaredTypeRecord {
+	StringReference name;
+	uint32_t kind;
+	uint32_t return_type;
+	uint32_t parameter_count;
+};
+
+struct ParameterRecord {
+	uint32_t declared_type;
+	uint32_t is_mutable;
+};
+
+struct AppliedTypeRecord {
+	uint32_t declared_type;
+	uint32_t is_mutable;
+};
+
+struct DeclarationRecord {
+	StringReference name;
+	uint32_t id;
+	uint32_t applied_type;
+};
+
+struct RangeRecord {
+	uint32_t start_line;
+	uint32_t start_index;
+	uint32_t start_line_start_index;
+	uint32_t end_line;
+	uint32_t end_index;
+	uint32_t end_line_start_index;
+};
+
+// What value, flags and text mean depends on the kind of the node, see CacheWriter
+struct NodeRecord {
+	uint64_t value;
+	RangeRecord range;
+	StringReference text;
+	uint16_t kind;
+	uint16_t flags;
+	uint32_t applied_type;
+	uint32_t child_count;
+	uint32_t extra_count;
+};
+
+uint64_t hash_file(const std::filesystem::path& path) {
+	std::ifstream input(path, std::ios::binary);
+	const std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	return llvm::xxHash64(content);
+}
+
+RangeRecord to_record(const SourceRange& source_range) {
+	const SourceRange::Position& start = source_range.get_start();
+	const SourceRange::Position& end = source_range.get_end();
+	return {start.line, start.index, start.line_start_index, end.line, end.index, end.line_start_index};
+}
+
+class CacheWriter : public Typed::TASTVisitor<CacheWriter> {
+public:
+	bool write(const std::filesystem::path& path, std::string_view source, bool is_lazy,
+		const std::vector<std::filesystem::path>& interface_paths,
+		const std::vector<RefPtr<Typed::Statement>>& statements, const DeclarationDumpster& declarations) {
+		for(const std::filesystem::path& interface_path : interface_paths)
+			add_record(m_interfaces, InterfaceRecord{hash_file(interface_path), add_string(interface_path.native())});
+		for(const auto& [id, declaration] : declarations.get_elements()) {
+			if(id > std::numeric_limits<uint32_t>::max())
+				return false;
+			add_record(m_declarations, DeclarationRecord{add_string(declaration.name), static_cast<uint32_t>(id),
+										   add_applied_type(declaration.type)});
+		}
+		for(const RefPtr<Typed::Statement>& statement : statements)
+			dispatch(*statement);
+
+		FileHeader header{};
+		std::memcpy(header.magic, cache_magic, sizeof(header.magic));
+		header.version = cache_version;
+		header.source_hash = llvm::xxHash64(source);
+		header.source_size = source.size();
+		header.is_lazy = is_lazy;
+		header.strings_offset = sizeof(FileHeader) + m_interfaces.size() + m_declared_types.size() +
+			m_applied_types.size() + m_declarations.size() + m_nodes.size();
+		header.interface_count = interface_paths.size();
+		header.declared_type_count = m_declared_type_indices.size();
+		header.applied_type_count = m_applied_type_indices.size();
+		header.declaration_count = declarations.get_elements().size();
+		header.statement_count = statements.size();
+		std::string file;
+		add_record(file, header);
+		file += m_interfaces;
+		file += m_declared_types;
+		file += m_applied_types;
+		file += m_declarations;
+		file += m_nodes;
+		file += m_strings;
+		const uint64_t checksum = llvm::xxHash64(file);
+		file.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+
+		// Compilations that run at the same time must never see a partially written file
+		std::filesystem::path temporary_path = path;
+		temporary_path += ".tmp";
+		{
+			std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+			output << file;
+			if(!output)
+				return false;
+		}
+		std::error_code error;
+		std::filesystem::rename(temporary_path, path, error);
+		return !error;
+	}
+
+	void visit(const Typed::ExpressionStatement& expression_statement) {
+		add_node(create_record(expression_statement, 1));
+		dispatch(expression_statement.get_expression());
+	}
+
+	void visit(const Typed::Declaration& declaration) {
+		NodeRecord record = create_record(declaration, 0);
+		record.value = declaration.get_declaration_id();
+		add_node(record);
+	}
+
+	// A function without an implementation has no children
+	void visit(const Typed::Function& function) {
+		NodeRecord record = create_record(function, function.has_implementation() ? 1 : 0);
+		record.value = function.get_function_declaration_id();
+		record.flags = function.is_memoized();
+		add_node(record, {function.get_parameters().begin(), function.get_parameters().end()});
+		if(function.has_implementation())
+			dispatch(function.get_implementation());
+	}
+
+	void visit(const Typed::ExternalFunction& external_function) {
+		NodeRecord record = create_record(external_function, 0);
+		record.value = external_function.get_function_declaration_id();
+		record.flags = external_function.get_effects() | (external_function.is_c_function() ? c_function_flag : 0);
+		record.text = add_string(external_function.get_symbol_name());
+		add_node(record);
+	}
+
+	void visit(const Typed::Print& print) {
+		add_node(create_record(print, 1));
+		dispatch(print.get_expression());
+	}
+
+	void visit(const Typed::Return& return_statement) {
+		add_node(create_record(return_statement, 1));
+		dispatch(return_statement.get_expression());
+	}
+
+	void visit(const Typed::Block& block) {
+		add_node(create_record(block, block.get_body().size()));
+		for(const RefPtr<Typed::Statement>& statement : block.get_body())
+			dispatch(*statement);
+	}
+
+	void visit(const Typed::For& for_statement) {
+		NodeRecord record = create_record(for_statement, 3);
+		record.value = for_statement.get_variable();
+		record.flags = for_statement.is_parallel();
+		add_node(record);
+		dispatch(for_statement.get_begin());
+		dispatch(for_statement.get_end());
+		dispatch(for_statement.get_body());
+	}
+
+	void visit(const Typed::IntLiteral& int_literal) {
+		NodeRecord record = create_record(int_literal, 0);
+		record.value = int_literal.get_value();
+		add_node(record);
+	}
+
+	void visit(const Typed::ArrayLiteral& array_literal) {
+		add_node(create_record(array_literal, array_literal.get_elements().size()));
+		for(const RefPtr<Typed::Expression>& element : array_literal.get_elements())
+			dispatch(*element);
+	}
+
+	void visit(const Typed::Assignment& assignment) {
+		NodeRecord record = create_record(assignment, 1);
+		record.value = assignment.get_lhs();
+		add_node(record);
+		dispatch(assignment.get_rhs());
+	}
+
+	void visit(const Typed::IndexAssignment& index_assignment) {
+		add_node(create_record(index_assignment, 2));
+		dispatch(index_assignment.get_lhs());
+		dispatch(index_assignment.get_rhs());
+	}
+
+	// The source range of the operator follows the node
+	void visit(const Typed::BinaryExpression& binary_expression) {
+		const Token& oper = binary_expression.get_operator();
+		NodeRecord record = create_record(binary_expression, 2);
+		record.value = static_cast<uint64_t>(oper.get_type());
+		record.text = add_string(oper.get_lexeme());
+		add_node(record);
+		add_record(m_nodes, to_record(oper.get_source_range()));
+		dispatch(binary_expression.get_lhs());
+		dispatch(binary_expression.get_rhs());
+	}
+
+	void visit(const Typed::Call& call) {
+		NodeRecord record = create_record(call, call.get_arguments().size());
+		record.value = call.get_function_declaration_id();
+		add_node(record);
+		for(const RefPtr<Typed::Expression>& argument : call.get_arguments())
+			dispatch(*argument);
+	}
+
+	void visit(const Typed::Conversion& conversion) {
+		add_node(create_record(conversion, 1));
+		dispatch(conversion.get_value());
+	}
+
+	void visit(const Typed::VectorOperation& vector_operation) {
+		NodeRecord record = create_record(vector_operation, vector_operation.get_operands().size());
+		record.value = static_cast<uint64_t>(vector_operation.get_operation());
+		add_node(record, {vector_operation.get_mask().begin(), vector_operation.get_mask().end()});
+		for(const RefPtr<Typed::Expression>& operand : vector_operation.get_operands())
+			dispatch(*operand);
+	}
+
+	void visit(const Typed::Index& index) {
+		add_node(create_record(index, 2));
+		dispatch(index.get_array());
+		dispatch(index.get_index());
+	}
+
+	void visit(const Typed::VarQuery& var_query) {
+		NodeRecord record = create_record(var_query, 0);
+		record.value = var_query.get_declaration_id();
+		add_node(record);
+	}
+
+private:
+	std::string m_interfaces;
+	std::string m_declared_types;
+	std::string m_applied_types;
+	std::string m_declarations;
+	std::string m_nodes;
+	std::string m_strings;
+	// Strings and types are stored once, no matter how often they are used
+	std::map<std::string_view, StringReference> m_string_references;
+	std::map<const DeclaredType*, uint32_t> m_declared_type_indices;
+	std::map<const AppliedType*, uint32_t> m_applied_type_indices;
+
+	template <typename Record>
+	static void add_record(std::string& section, const Record& record) {
+		section.append(reinterpret_cast<const char*>(&record), sizeof(record));
+		section.resize((section.size() + record_alignment - 1) / record_alignment * record_alignment, '\0');
+	}
+
+	StringReference add_string(std::string_view string) {
+		if(auto it = m_string_references.find(string); it != m_string_references.end())
+			return it->second;
+		const StringReference reference{static_cast<uint32_t>(m_strings.size()), static_cast<uint32_t>(string.size())};
+		m_strings += string;
+		m_string_references.try_emplace(string, reference);
+		return reference;
+	}
+
+	// Function types refer to other types, which are added first
+	uint32_t add_declared_type(const RefPtr<DeclaredType>& type) {
+		if(auto it = m_declared_type_indices.find(type.get()); it != m_declared_type_indices.end())
+			return it->second;
+		uint32_t return_type = no_type;
+		std::vector<ParameterRecord> parameters;
+		if(type->get_kind() == DeclaredType::Function) {
+			const FunctionType& function_type = static_cast<const FunctionType&>(*type);
+			return_type = add_declared_type(function_type.get_returned_type());
+			for(const RefPtr<AppliedType>& parameter : function_type.get_parameter()) {
+				const uint32_t parameter_type = add_declared_type(parameter->get_declared_type_shared());
+				parameters.push_back({parameter_type, parameter->is_mutable()});
+			}
+		}
+		const uint32_t index = m_declared_type_indices.size();
+		m_declared_type_indices.try_emplace(type.get(), index);
+		add_record(m_declared_types, DeclaredTypeRecord{add_string(type->get_name()), type->get_kind(), return_type,
+										 static_cast<uint32_t>(parameters.size())});
+		for(const ParameterRecord& parameter : parameters)
+			add_record(m_declared_types, parameter);
+		return index;
+	}
+
+	uint32_t add_applied_type(const RefPtr<AppliedType>& type) {
+		if(auto it = m_applied_type_indices.find(type.get()); it != m_applied_type_indices.end())
+			return it->second;
+		const AppliedTypeRecord record{add_declared_type(type->get_declared_type_shared()), type->is_mutable()};
+		const uint32_t index = m_applied_type_indices.size();
+		m_applied_type_indices.try_emplace(type.get(), index);
+		add_record(m_applied_types, record);
+		return index;
+	}
+
+	NodeRecord create_record(const Typed::TASTNode& node, size_t child_count) {
+		NodeRecord record{};
+		record.range = to_record(node.get_source_range());
+		record.kind = static_cast<uint16_t>(node.get_node_kind());
+		record.applied_type = no_type;
+		record.child_count = child_count;
+		return record;
+	}
+
+	NodeRecord create_record(const Typed::Expression& expression, size_t child_count) {
+		NodeRecord record = create_record(static_cast<const Typed::TASTNode&>(expression), child_count);
+		record.applied_type = add_applied_type(expression.get_type_shared());
+		return record;
+	}
+
+	void add_node(NodeRecord record, const std::vector<uint64_t>& extras = {}) {
+		record.extra_count = extras.size();
+		add_record(m_nodes, record);
+		for(const uint64_t extra : extras)
+			add_record(m_nodes, extra);
+	}
+};
+
+// Reads the records of a mapped file and checks that none of them reaches into the strings
+class RecordReader {
+public:
+	RecordReader(const char* data, size_t size, std::string_view strings) :
+		m_data(data), m_size(size), m_strings(strings) {}
+
+	template <typename Record>
+	const Record* read() {
+		if(m_size - m_position < sizeof(Record))
+			return nullptr;
+		const Record* record = reinterpret_cast<const Record*>(m_data + m_position);
+		m_position += (sizeof(Record) + record_alignment - 1) / record_alignment * record_alignment;
+		m_position = std::min(m_position, m_size);
+		return record;
+	}
+
+	std::optional<std::string_view> get_string(const StringReference& reference) const {
+		if(reference.offset > m_strings.size() || m_strings.size() - reference.offset < reference.length)
+			return {};
+		return m_strings.substr(reference.offset, reference.length);
+	}
+
+	bool is_at_end() const { return m_position == m_size; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+	std::string_view m_strings;
+	size_t m_position{0};
+};
+
+// Rebuilds the types, declarations and nodes in the order they were written. Everything that refers to a type, a
+// declaration or another node is checked, so a damaged cache is rejected instead of being compiled.
+class CacheReader {
+public:
+	CacheReader(RecordReader& reader, const std::filesystem::path& file_path, const TypeScope& scope,
+		DeclarationDumpster& declarations) :
+		m_reader(reader), m_file_path(file_path), m_scope(scope), m_declarations(declarations) {}
+
+	// Fails if one of the interfaces changed since the cache was written
+	bool read_interfaces(uint32_t count, std::vector<std::filesystem::path>& interface_paths) {
+		for(uint32_t i = 0; i < count; ++i) {
+			const InterfaceRecord* record = m_reader.read<InterfaceRecord>();
+			const std::optional<std::string_view> path =
+				record != nullptr ? m_reader.get_string(record->path) : std::nullopt;
+			if(!path.has_value() || hash_file(*path) != record->hash)
+				return false;
+			interface_paths.emplace_back(*path);
+		}
+		return true;
+	}
+
+	bool read_declared_types(uint32_t count) {
+		for(uint32_t i = 0; i < count; ++i) {
+			const DeclaredTypeRecord* record = m_reader.read<DeclaredTypeRecord>();
+			const std::optional<std::string_view> name =
+				record != nullptr ? m_reader.get_string(record->name) : std::nullopt;
+			if(!name.has_value())
+				return false;
+			RefPtr<DeclaredType> type;
+			if(record->kind == DeclaredType::Function) {
+				RefPtr<DeclaredType> return_type = get_declared_type(record->return_type);
+				std::vector<RefPtr<AppliedType>> parameters;
+				for(uint32_t j = 0; j < record->parameter_count; ++j) {
+					const ParameterRecord* parameter = m_reader.read<ParameterRecord>();
+					RefPtr<DeclaredType> parameter_type =
+						parameter != nullptr ? get_declared_type(parameter->declared_type) : nullptr;
+					if(parameter_type == nullptr)
+						return false;
+					const bool is_mutable = parameter->is_mutable != 0;
+					parameters.push_back(AppliedType::promote_declared_type(parameter_type, is_mutable));
+				}
+				if(return_type != nullptr)
+					type = mk_ref<FunctionType>(*name, return_type, parameters);
+			} else
+				type = m_scope.find_type(*name);
+			if(type == nullptr || type->get_kind() != record->kind)
+				return false;
+			m_declared_types.push_back(type);
+		}
+		return true;
+	}
+
+	bool read_applied_types(uint32_t count) {
+		for(uint32_t i = 0; i < count; ++i) {
+			const AppliedTypeRecord* record = m_reader.read<AppliedTypeRecord>();
+			RefPtr<DeclaredType> type = record != nullptr ? get_declared_type(record->declared_type) : nullptr;
+			if(type == nullptr)
+				return false;
+			m_applied_types.push_back(AppliedType::promote_declared_type(type, record->is_mutable != 0));
+		}
+		return true;
+	}
+
+	bool read_declarations(uint32_t count) {
+		for(uint32_t i = 0; i < count; ++i) {
+			const DeclarationRecord* record = m_reader.read<DeclarationRecord>();
+			const std::optional<std::string_view> name =
+				record != nullptr ? m_reader.get_string(record->name) : std::nullopt;
+			RefPtr<AppliedType> type = name.has_value() ? get_applied_type(record->applied_type) : nullptr;
+			if(type == nullptr)
+				return false;
+			m_declarations.restore(record->id, {*name, type});
+		}
+		return true;
+	}
+
+	RefPtr<Typed::Statement> read_statement() {
+		using enum Typed::TASTNode::NodeKind;
+		const NodeRecord* record = m_reader.read<NodeRecord>();
+		if(record == nullptr)
+			return nullptr;
+		const SourceRange source_range = to_source_range(record->range);
+		const std::optional<std::vector<uint64_t>> extras = read_extras(record->extra_count);
+		if(!extras.has_value())
+			return nullptr;
+		switch(static_cast<Typed::TASTNode::NodeKind>(record->kind)) {
+			case ExpressionStatement: {
+				RefPtr<Typed::Expression> expression = record->child_count == 1 ? read_expression() : nullptr;
+				return expression != nullptr ? mk_ref<Typed::ExpressionStatement>(source_range, expression) : nullptr;
+			}
+			case Declaration:
+				if(record->child_count != 0 || !is_declared(record->value))
+					return nullptr;
+				return mk_ref<Typed::Declaration>(source_range, record->value);
+			case Function: {
+				if(record->child_count > 1 || !is_declared(record->value))
+					return nullptr;
+				for(const uint64_t parameter : *extras) {
+					if(!is_declared(parameter))
+						return nullptr;
+				}
+				RefPtr<Typed::Block> implementation;
+				if(record->child_count == 1 && (implementation = read_block()) == nullptr)
+					return nullptr;
+				return mk_ref<Typed::Function>(source_range, record->value, implementation,
+					std::vector<declid_t>(extras->begin(), extras->end()), record->flags != 0);
+			}
+			case ExternalFunction: {
+				const std::optional<std::string_view> symbol_name = m_reader.get_string(record->text);
+				if(record->child_count != 0 || !is_declared(record->value) || !symbol_name.has_value())
+					return nullptr;
+				return mk_ref<Typed::ExternalFunction>(source_range, record->value, std::string(*symbol_name),
+					record->flags & ~c_function_flag, (record->flags & c_function_flag) != 0);
+			}
+			case Print: {
+				RefPtr<Typed::Expression> expression = record->child_count == 1 ? read_expression() : nullptr;
+				return expression != nullptr ? mk_ref<Typed::Print>(source_range, expression) : nullptr;
+			}
+			case Return: {
+				RefPtr<Typed::Expression> expression = record->child_count == 1 ? read_expression() : nullptr;
+				return expression != nullptr ? mk_ref<Typed::Return>(source_range, expression) : nullptr;
+			}
+			case Block: {
+				std::vector<RefPtr<Typed::Statement>> body;
+				for(uint32_t i = 0; i < record->child_count; ++i) {
+					if(body.emplace_back(read_statement()) == nullptr)
+						return nullptr;
+				}
+				return mk_ref<Typed::Block>(source_range, body);
+			}
+			case For: {
+				if(record->child_count != 3 || !is_declared(record->value))
+					return nullptr;
+				RefPtr<Typed::Expression> begin = read_expression();
+				RefPtr<Typed::Expression> end = begin != nullptr ? read_expression() : nullptr;
+				RefPtr<Typed::Block> body = end != nullptr ? read_block() : nullptr;
+				if(body == nullptr)
+					return nullptr;
+				return mk_ref<Typed::For>(source_range, record->value, begin, end, body, record->flags != 0);
+			}
+			default: return nullptr;
+		}
+	}
+
+	RefPtr<Typed::Expression> read_expression() {
+		using enum Typed::TASTNode::NodeKind;
+		const NodeRecord* record = m_reader.read<NodeRecord>();
+		if(record == nullptr)
+			return nullptr;
+		const SourceRange source_range = to_source_range(record->range);
+		const std::optional<std::vector<uint64_t>> extras = read_extras(record->extra_count);
+		RefPtr<AppliedType> type = get_applied_type(record->applied_type);
+		if(!extras.has_value() || type == nullptr)
+			return nullptr;
+		switch(static_cast<Typed::TASTNode::NodeKind>(record->kind)) {
+			case IntLiteral:
+				if(record->child_count != 0)
+					return nullptr;
+				return mk_ref<Typed::IntLiteral>(source_range, type, record->value);
+			case ArrayLiteral: {
+				std::vector<RefPtr<Typed::Expression>> elements;
+				if(!read_expressions(record->child_count, elements))
+					return nullptr;
+				return mk_ref<Typed::ArrayLiteral>(source_range, type, elements);
+			}
+			case Assignment: {
+				if(record->child_count != 1 || !is_declared(record->value))
+					return nullptr;
+				RefPtr<Typed::Expression> rhs = read_expression();
+				return rhs != nullptr ? mk_ref<Typed::Assignment>(source_range, type, record->value, rhs) : nullptr;
+			}
+			case IndexAssignment: {
+				if(record->child_count != 2)
+					return nullptr;
+				RefPtr<Typed::Expression> lhs = read_expression();
+				if(lhs == nullptr || lhs->get_node_kind() != Index)
+					return nullptr;
+				RefPtr<Typed::Expression> rhs = read_expression();
+				if(rhs == nullptr)
+					return nullptr;
+				return mk_ref<Typed::IndexAssignment>(
+					source_range, type, std::static_pointer_cast<Typed::Index>(lhs), rhs);
+			}
+			case BinaryExpression: {
+				const RangeRecord* operator_range = m_reader.read<RangeRecord>();
+				const std::optional<std::string_view> lexeme = m_reader.get_string(record->text);
+				if(record->child_count != 2 || operator_range == nullptr || !lexeme.has_value())
+					return nullptr;
+				RefPtr<Typed::Expression> lhs = read_expression();
+				RefPtr<Typed::Expression> rhs = lhs != nullptr ? read_expression() : nullptr;
+				if(rhs == nullptr)
+					return nullptr;
+				const Token oper(static_cast<TokenType>(record->value), *lexeme, {}, to_source_range(*operator_range));
+				return mk_ref<Typed::BinaryExpression>(source_range, type, lhs, rhs, oper);
+			}
+			case Call: {
+				std::vector<RefPtr<Typed::Expression>> arguments;
+				if(!is_declared(record->value) || !read_expressions(record->child_count, arguments))
+					return nullptr;
+				return mk_ref<Typed::Call>(source_range, type, record->value, arguments);
+			}
+			case Conversion: {
+				RefPtr<Typed::Expression> value = record->child_count == 1 ? read_expression() : nullptr;
+				return value != nullptr ? mk_ref<Typed::Conversion>(source_range, type, value) : nullptr;
+			}
+			case VectorOperation: {
+				std::vector<RefPtr<Typed::Expression>> operands;
+				if(!read_expressions(record->child_count, operands))
+					return nullptr;
+				return mk_ref<Typed::VectorOperation>(source_range, type,
+					static_cast<Typed::VectorOperation::Operation>(record->value), operands,
+					std::vector<int>(extras->begin(), extras->end()));
+			}
+			case Index: {
+				if(record->child_count != 2)
+					return nullptr;
+				RefPtr<Typed::Expression> array = read_expression();
+				RefPtr<Typed::Expression> index = array != nullptr ? read_expression() : nullptr;
+				return index != nullptr ? mk_ref<Typed::Index>(source_range, type, array, index) : nullptr;
+			}
+			case VarQuery:
+				if(record->child_count != 0 || !is_declared(record->value))
+					return nullptr;
+				return mk_ref<Typed::VarQuery>(source_range, type, record->value);
+			default: return nullptr;
+		}
+	}
+
+private:
+	RecordReader& m_reader;
+	const std::filesystem::path& m_file_path;
+	const TypeScope& m_scope;
+	DeclarationDumpster& m_declarations;
+	std::vector<RefPtr<DeclaredType>> m_declared_types;
+	std::vector<RefPtr<AppliedType>> m_applied_types;
+
+	SourceRange to_source_range(const RangeRecord& record) const {
+		return SourceRange({record.start_line, record.start_index, record.start_line_start_index},
+			{record.end_line, record.end_index, record.end_line_start_index}, m_file_path);
+	}
+
+	RefPtr<DeclaredType> get_declared_type(uint32_t index) const {
+		return index < m_declared_types.size() ? m_declared_types.at(index) : nullptr;
+	}
+
+	RefPtr<AppliedType> get_applied_type(uint32_t index) const {
+		return index < m_applied_types.size() ? m_applied_types.at(index) : nullptr;
+	}
+
+	bool is_declared(uint64_t id) const { return m_declarations.get_elements().contains(id); }
+
+	std::optional<std::vector<uint64_t>> read_extras(uint32_t count) {
+		std::vector<uint64_t> extras;
+		for(uint32_t i = 0; i < count; ++i) {
+			const uint64_t* extra = m_reader.read<uint64_t>();
+			if(extra == nullptr)
+				return {};
+			extras.push_back(*extra);
+		}
+		return extras;
+	}
+
+	RefPtr<Typed::Block> read_block() {
+		RefPtr<Typed::Statement> statement = read_statement();
+		if(statement == nullptr || statement->get_node_kind() != Typed::TASTNode::NodeKind::Block)
+			return nullptr;
+		return std::static_pointer_cast<Typed::Block>(statement);
+	}
+
+	bool read_expressions(uint32_t count, std::vector<RefPtr<Typed::Expression>>& expressions) {
+		for(uint32_t i = 0; i < count; ++i) {
+			if(expressions.emplace_back(read_expression()) == nullptr)
+				return false;
+		}
+		return true;
+	}
+};
+}
+
+TypedASTCache::TypedASTCache(void* mapping, size_t size) : m_mapping(mapping), m_size(size) {}
+
+TypedASTCache::TypedASTCache(TypedASTCache&& other) noexcept :
+	m_mapping(std::exchange(other.m_mapping, nullptr)), m_size(std::exchange(other.m_size, 0)),
+	m_interface_paths(std::move(other.m_interface_paths)), m_statements(std::move(other.m_statements)),
+	m_declarations(std::move(other.m_declarations)) {}
+
+TypedASTCache::~TypedASTCache() {
+	if(m_mapping != nullptr)
+		munmap(m_mapping, m_size);
+}
+
+std::filesystem::path TypedASTCache::get_path_for(const std::filesystem::path& source_file_path) {
+	return std::filesystem::path(source_file_path).replace_extension(".kyc");
+}
+
+bool TypedASTCache::write(const std::filesystem::path& path, std::string_view source, bool is_lazy,
+	const std::vector<std::filesystem::path>& interface_paths, const std::vector<RefPtr<Typed::Statement>>& statements,
+	const DeclarationDumpster& declarations) {
+	return CacheWriter().write(path, source, is_lazy, interface_paths, statements, declarations);
+}
+
+std::optional<TypedASTCache> TypedASTCache::load(const std::filesystem::path& path, std::string_view source,
+	bool is_lazy, const std::filesystem::path& file_path, const TypeScope& scope) {
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return {};
+	struct stat status {};
+	void* mapping = MAP_FAILED;
+	if(fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(FileHeader) + sizeof(uint64_t))
+		mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED)
+		return {};
+	TypedASTCache cache(mapping, status.st_size);
+
+	// The source and the file are hashed last, the other checks are cheaper
+	const char* data = static_cast<const char*>(mapping);
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(data);
+	const size_t checksum_offset = cache.m_size - sizeof(uint64_t);
+	uint64_t checksum = 0;
+	std::memcpy(&checksum, data + checksum_offset, sizeof(checksum));
+	if(std::memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 || header->version != cache_version ||
+		header->is_lazy != is_lazy || header->source_size != source.size() ||
+		header->strings_offset < sizeof(FileHeader) || header->strings_offset > checksum_offset ||
+		header->source_hash != llvm::xxHash64(source) ||
+		checksum != llvm::xxHash64(llvm::StringRef(data, checksum_offset)))
+		return {};
+
+	RecordReader reader(data, header->strings_offset,
+		std::string_view(data + header->strings_offset, checksum_offset - header->strings_offset));
+	reader.read<FileHeader>();
+	CacheReader cache_reader(reader, file_path, scope, cache.m_declarations);
+	if(!cache_reader.read_interfaces(header->interface_count, cache.m_interface_paths) ||
+		!cache_reader.read_declared_types(header->declared_type_count) ||
+		!cache_reader.read_applied_types(header->applied_type_count) ||
+		!cache_reader.read_declarations(header->declaration_count))
+		return {};
+	for(uint32_t i = 0; i < header->statement_count; ++i) {
+		if(cache.m_statements.emplace_back(cache_reader.read_statement()) == nullptr)
+			return {};
+	}
+	if(!reader.is_at_end())
+		return {};
+	return cache;
+}
+
+const std::vector<std::filesystem::path>& TypedASTCache::get_interface_paths() const { return m_interface_paths; }
+
+std::vector<RefPtr<Typed::Statement>> TypedASTCache::take_statements() { return std::move(m_statements); }
+
+DeclarationDumpster TypedASTCache::take_declarations() { return std::move(m_declarations); }
+}
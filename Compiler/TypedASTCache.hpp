@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Aliases.hpp"
+#include "TAST.hpp"
+#include "Type.hpp"
+
+namespace Kyra {
+
+// The typed AST of a module and all of its declarations, as written to <module>.kyc next to its source (see kyra
+// --ast-cache). If neither the source nor the interfaces the module imports changed, loading it replaces lexing,
+// parsing and type checking. All names point into the mapped file, so the cache has to outlive everything loaded from
+// it.
+class TypedASTCache {
+public:
+	TypedASTCache(const TypedASTCache&) = delete;
+	TypedASTCache(TypedASTCache&& other) noexcept;
+	~TypedASTCache();
+
+	TypedASTCache& operator=(const TypedASTCache&) = delete;
+	TypedASTCache& operator=(TypedASTCache&&) = delete;
+
+	static std::filesystem::path get_path_for(const std::filesystem::path& source_file_path);
+
+	// The interfaces are the ones the module imported, the cache is only valid as long as they do not change
+	static bool write(const std::filesystem::path& path, std::string_view source, bool is_lazy,
+		const std::vector<std::filesystem::path>& interface_paths,
+		const std::vector<RefPtr<Typed::Statement>>& statements, const DeclarationDumpster& declarations);
+	// Returns nothing if the file cannot be read, is not a valid cache, or was written for another source, another
+	// lazy setting or other interfaces. Types are looked up in the scope, and all source ranges refer to the file path.
+	static std::optional<TypedASTCache> load(const std::filesystem::path& path, std::string_view source, bool is_lazy,
+		const std::filesystem::path& file_path, const TypeScope& scope);
+
+	const std::vector<std::filesystem::path>& get_interface_paths() const;
+	// The loaded AST and declarations are handed over, but still point into the cache
+	std::vector<RefPtr<Typed::Statement>> take_statements();
+	DeclarationDumpster take_declarations();
+
+private:
+	void* m_mapping;
+	size_t m_size;
+	std::vector<std::filesystem::path> m_interface_paths;
+	std::vector<RefPtr<Typed::Statement>> m_statements;
+	DeclarationDumpster m_declarations;
+
+	TypedASTCache(void* mapping, size_t size);
+};
+}
@@ -0,0 +1,64 @@
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace Kyra {
+namespace {
+struct Worker {
+	std::mutex mutex;
+	std::deque<size_t> tasks;
+};
+
+std::optional<size_t> take_task(std::vector<Worker>& workers, unsigned self) {
+	{
+		Worker& worker = workers[self];
+		const std::scoped_lock lock(worker.mutex);
+		if(!worker.tasks.empty()) {
+			const size_t task = worker.tasks.front();
+			worker.tasks.pop_front();
+			return task;
+		}
+	}
+	// Stealing from the back keeps out of the way of the owner, which takes from the front
+	for(unsigned offset = 1; offset < workers.size(); ++offset) {
+		Worker& victim = workers[(self + offset) % workers.size()];
+		const std::scoped_lock lock(victim.mutex);
+		if(!victim.tasks.empty()) {
+			const size_t task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return task;
+		}
+	}
+	// Tasks never spawn new tasks, so once all queues are empty there is nothing left to do
+	return {};
+}
+}
+
+WorkStealingPool::WorkStealingPool(unsigned thread_count) : m_thread_count(std::max(thread_count, 1u)) {}
+
+void WorkStealingPool::run(size_t task_count, const Task& task) const {
+	if(task_count == 0)
+		return;
+	const unsigned thread_count = std::min<size_t>(m_thread_count, task_count);
+	std::vector<Worker> workers(thread_count);
+	for(size_t index = 0; index < task_count; ++index)
+		workers[index * thread_count / task_count].tasks.push_back(index);
+
+	const auto work = [&](unsigned self) {
+		while(const std::optional<size_t> index = take_task(workers, self))
+			task(*index);
+	};
+	std::vector<std::thread> threads;
+	for(unsigned self = 1; self < thread_count; ++self)
+		threads.emplace_back(work, self);
+	// The calling thread is the first worker
+	work(0);
+	for(std::thread& thread : threads)
+		thread.join();
+}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace Kyra {
+
+// Runs independent tasks on a fixed number of threads. Every thread starts with an equal share of the tasks and steals
+// from the others once it runs out, so a few expensive tasks do not hold up all the cheap ones behind them.
+class WorkStealingPool {
+public:
+	using Task = std::function<void(size_t index)>;
+
+	explicit WorkStealingPool(unsigned thread_count);
+
+	// Calls the task once for every index in [0, task_count) and returns once all of them are done. Each thread works
+	// through its own share in order, so earlier indices tend to finish first.
+	void run(size_t task_count, const Task& task) const;
+
+private:
+	const unsigned m_thread_count;
+};
+}
@@ -1,56 +1,70 @@
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unistd.h>
 #include <vector>
 
-#include "AST.hpp"
-#include "ASTPrinter.hpp"
-#include "Aliases.hpp"
 #include "CodeGen.hpp"
-#include "Lexer.hpp"
-#include "Parser.hpp"
-#include "SourceRange.hpp"
-#include "TAST.hpp"
-#include "Token.hpp"
-#include "TypeChecker.hpp"
+#include "CompilerInstance.hpp"
+#include "Driver.hpp"
+#include "JIT.hpp"
+#include "Repl.hpp"
+#include "Server.hpp"
 
 using namespace Kyra;
 
-int main(int argc, char** argv) {
-	if(argc != 2)
-		return 1;
-
-	std::filesystem::path source_file_path(argv[1]);
-	if(!std::filesystem::exists(source_file_path))
-		return 1;
-
-	std::ifstream input_file_stream(source_file_path);
-	std::string source_code((std::istreambuf_iterator<char>(input_file_stream)), (std::istreambuf_iterator<char>()));
-	input_file_stream.close();
+std::filesystem::path get_socket_path(std::string_view argument) {
+	if(const size_t equals = argument.find('='); equals != std::string_view::npos)
+		return argument.substr(equals + 1);
+	return Server::get_default_socket_path();
+}
 
-	const ErrorOr<std::vector<Token>>& error_or_tokens = Lexer::the().scan_input(source_code, source_file_path);
-	if(error_or_tokens.is_error()) {
-		error_or_tokens.get_exception().print(std::cout);
-		return 1;
+int main(int argc, char** argv) {
+	std::vector<std::string> arguments(argv + 1, argv + argc);
+	// Every architecture can be compiled for, see --march
+	CodeGen::initialize_targets();
+	// repl, --server and --connect have to come first, as all other arguments are handled by the server
+	const std::string mode = arguments.empty() ? "" : arguments.front();
+	if(mode == "repl") {
+		if(arguments.size() > 1) {
+			std::cerr << Driver::usage;
+			return 1;
+		}
+		JIT::initialize_native_target();
+		CompilerInstance instance;
+		Repl repl(instance, {STDOUT_FILENO, STDERR_FILENO, {}});
+		return repl.run(std::cin);
 	}
-
-	const ErrorOr<std::vector<RefPtr<Untyped::Statement>>>& error_or_statements =
-		Parser::the().parse_tokens(error_or_tokens.get_result());
-	if(error_or_statements.is_error()) {
-		error_or_statements.get_exception().print(std::cout);
-		return 1;
+	if(mode == "--server" || mode.starts_with("--server=")) {
+		if(arguments.size() > 1) {
+			std::cerr << Driver::usage;
+			return 1;
+		}
+		Server server(get_socket_path(mode));
+		return server.serve();
+	}
+	std::optional<std::filesystem::path> socket_path;
+	if(mode == "--connect" || mode.starts_with("--connect=")) {
+		socket_path = get_socket_path(mode);
+		arguments.erase(arguments.begin());
 	}
 
-	const ErrorOr<std::vector<RefPtr<Typed::Statement>>>& error_or_typed_statements =
-		TypeChecker::the().check_statements(error_or_statements.get_result());
-	if(error_or_typed_statements.is_error()) {
-		error_or_typed_statements.get_exception().print(std::cout);
+	const std::optional<Driver::Arguments> parsed_arguments = Driver::parse_arguments(arguments, std::cerr);
+	if(!parsed_arguments.has_value()) {
+		std::cerr << Driver::usage;
 		return 1;
 	}
+	// A watching process keeps its results between compilations itself, and it would occupy the server forever
+	if(socket_path.has_value() && !parsed_arguments->watch) {
+		if(const std::optional<int> exit_code = Server::forward(*socket_path, arguments); exit_code.has_value())
+			return *exit_code;
+		// Without a server the file is compiled by this process
+	}
 
-	CodeGen::the().gen_code(error_or_typed_statements.get_result());
-
-	return 0;
+	if(parsed_arguments->run)
+		JIT::initialize_native_target();
+	CompilerInstance instance;
+	return Driver::execute(instance, *parsed_arguments, {STDOUT_FILENO, STDERR_FILENO, {}});
 }
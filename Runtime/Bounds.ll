@@ -0,0 +1,22 @@
+; Bounds checks of array accesses.
+;
+; CodeGen compares every index it cannot prove to be in bounds against the length of the array and calls
+; kyra_index_out_of_bounds if the comparison fails. The call is cold and never returns, so the check costs a compare
+; and a branch that is predicted to be not taken.
+
+@kyra.bounds.message = internal unnamed_addr constant [57 x i8] c"Index %lld is out of bounds for an array of length %llu\0A\00"
+
+declare void @kyra_flush()
+declare i32 @dprintf(i32, i8*, ...)
+declare void @exit(i32) noreturn nounwind
+
+; Reports the access to stderr and ends the program with exit code 1. Everything that was printed before the access is
+; written out first.
+define void @kyra_index_out_of_bounds(i64 %index, i64 %length) noinline cold noreturn nounwind {
+entry:
+	call void @kyra_flush()
+	%message = getelementptr inbounds [57 x i8], [57 x i8]* @kyra.bounds.message, i64 0, i64 0
+	call i32 (i32, i8*, ...) @dprintf(i32 2, i8* %message, i64 %index, i64 %length)
+	call void @exit(i32 1)
+	unreachable
+}
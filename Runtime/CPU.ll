@@ -0,0 +1,67 @@
+; Detection of the x86-64 feature levels CodeGen clones hot functions for (see kyra --multiversion).
+;
+; The levels are 0 for the baseline, 1 for SSE4.2, 2 for AVX2 and 3 for AVX-512. A level is only reported if the CPU
+; supports every feature CodeGen enables for it and all levels below, and if the operating system saves the wider
+; registers of AVX2 and AVX-512 on a context switch. Only modules that are compiled for x86-64 ever pull this in.
+
+define internal { i32, i32, i32, i32 } @kyra.cpu.cpuid(i32 %leaf, i32 %subleaf) alwaysinline nounwind {
+entry:
+	%registers = call { i32, i32, i32, i32 } asm "cpuid", "={ax},={bx},={cx},={dx},{ax},{cx}"(i32 %leaf, i32 %subleaf)
+	ret { i32, i32, i32, i32 } %registers
+}
+
+define i32 @kyra_cpu_level() nounwind {
+entry:
+	%leaf0 = call { i32, i32, i32, i32 } @kyra.cpu.cpuid(i32 0, i32 0)
+	%max_leaf = extractvalue { i32, i32, i32, i32 } %leaf0, 0
+	%leaf1 = call { i32, i32, i32, i32 } @kyra.cpu.cpuid(i32 1, i32 0)
+	%ecx1 = extractvalue { i32, i32, i32, i32 } %leaf1, 2
+	; SSE4.2 (bit 20) and POPCNT (bit 23)
+	%sse42_bits = and i32 %ecx1, 9437184
+	%has_sse42 = icmp eq i32 %sse42_bits, 9437184
+	br i1 %has_sse42, label %check_avx, label %baseline
+
+check_avx:
+	; FMA (bit 12), OSXSAVE (bit 27) and AVX (bit 28). Leaf 7 holds the rest.
+	%avx_bits = and i32 %ecx1, 402657280
+	%has_avx = icmp eq i32 %avx_bits, 402657280
+	%has_leaf7 = icmp uge i32 %max_leaf, 7
+	%can_check_avx2 = and i1 %has_avx, %has_leaf7
+	br i1 %can_check_avx2, label %check_avx2, label %sse42
+
+check_avx2:
+	%xcr0_registers = call { i32, i32 } asm "xgetbv", "={ax},={dx},{cx}"(i32 0)
+	%xcr0 = extractvalue { i32, i32 } %xcr0_registers, 0
+	; The operating system saves the XMM and YMM registers
+	%ymm_bits = and i32 %xcr0, 6
+	%saves_ymm = icmp eq i32 %ymm_bits, 6
+	%leaf7 = call { i32, i32, i32, i32 } @kyra.cpu.cpuid(i32 7, i32 0)
+	%ebx7 = extractvalue { i32, i32, i32, i32 } %leaf7, 1
+	; BMI1 (bit 3), AVX2 (bit 5) and BMI2 (bit 8)
+	%avx2_bits = and i32 %ebx7, 296
+	%has_avx2_bits = icmp eq i32 %avx2_bits, 296
+	%has_avx2 = and i1 %saves_ymm, %has_avx2_bits
+	br i1 %has_avx2, label %check_avx512, label %sse42
+
+check_avx512:
+	; The operating system also saves the opmask registers and the upper halves of all ZMM registers
+	%zmm_bits = and i32 %xcr0, 230
+	%saves_zmm = icmp eq i32 %zmm_bits, 230
+	; AVX512F (bit 16), AVX512DQ (bit 17), AVX512BW (bit 30) and AVX512VL (bit 31)
+	%avx512_bits = and i32 %ebx7, 3221422080
+	%has_avx512_bits = icmp eq i32 %avx512_bits, 3221422080
+	%has_avx512 = and i1 %saves_zmm, %has_avx512_bits
+	br i1 %has_avx512, label %avx512, label %avx2
+
+baseline:
+	ret i32 0
+
+sse42:
+	ret i32 1
+
+avx2:
+	ret i32 2
+
+avx512:
+	ret i32 3
+}
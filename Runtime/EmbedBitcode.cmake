@@ -0,0 +1,10 @@
+# Turns the runtime bitcode file INPUT into a C++ translation unit OUTPUT that defines the symbols declared in
+# RuntimeBitcode.hpp.
+file(READ ${INPUT} content HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "'\\\\x\\1'," content "${content}")
+file(WRITE ${OUTPUT}
+	"#include \"RuntimeBitcode.hpp\"\n\n"
+	"namespace Kyra::Runtime {\n"
+	"static const char bitcode[] = {${content}};\n\n"
+	"std::string_view get_bitcode() { return {bitcode, sizeof(bitcode)}; }\n"
+	"}\n")
@@ -0,0 +1,239 @@
+; Function level instrumentation (kyra --instrument=functions).
+;
+; CodeGen numbers the instrumented functions, announces them with kyra_instrument_start and brackets every execution
+; of a function with kyra_instrument_enter and kyra_instrument_exit. Every thread keeps a shadow stack of the active
+; functions, so the time spent in callees can be subtracted from the caller's time. kyra_instrument_report is
+; registered as a global destructor and prints the collected numbers, sorted by self time, as text to stderr and as
+; JSON to the file named by $KYRA_PROFILE (kyra-profile.json by default).
+
+; The cycle counter at entry and the cycles spent in callees
+%kyra.instrument.frame = type { i64, i64 }
+
+@kyra.instrument.function_count = internal global i32 0, align 4
+@kyra.instrument.names = internal global i8** null, align 8
+; Calls, total cycles and self cycles for every function
+@kyra.instrument.counters = internal global i64* null, align 8
+
+; Deeper calls are counted, but not timed
+@kyra.instrument.stack = internal thread_local global [256 x %kyra.instrument.frame] zeroinitializer, align 16
+@kyra.instrument.depth = internal thread_local global i32 0, align 4
+
+@kyra.instrument.default_path = internal unnamed_addr constant [18 x i8] c"kyra-profile.json\00"
+@kyra.instrument.path_variable = internal unnamed_addr constant [13 x i8] c"KYRA_PROFILE\00"
+@kyra.instrument.write_mode = internal unnamed_addr constant [2 x i8] c"w\00"
+@kyra.instrument.text_header = internal unnamed_addr constant [71 x i8] c"       calls     total cycles      self cycles  cycles/call  function\0A\00"
+@kyra.instrument.text_row = internal unnamed_addr constant [30 x i8] c"%12llu %16llu %16llu %12llu  \00"
+@kyra.instrument.text_name = internal unnamed_addr constant [4 x i8] c"%s\0A\00"
+@kyra.instrument.json_header = internal unnamed_addr constant [39 x i8] c"{\0A  \22unit\22: \22cycles\22,\0A  \22functions\22: [\00"
+@kyra.instrument.json_row = internal unnamed_addr constant [101 x i8] c"%s\0A    {\22name\22: \22%s\22, \22calls\22: %llu, \22total_cycles\22: %llu, \22self_cycles\22: %llu, \22mean_cycles\22: %llu}\00"
+@kyra.instrument.json_footer = internal unnamed_addr constant [8 x i8] c"\0A  ]\0A}\0A\00"
+@kyra.instrument.no_separator = internal unnamed_addr constant [1 x i8] zeroinitializer
+@kyra.instrument.separator = internal unnamed_addr constant [2 x i8] c",\00"
+
+declare i8* @calloc(i64, i64)
+declare void @free(i8*)
+declare void @qsort(i8*, i64, i64, i32 (i8*, i8*)*)
+declare i8* @getenv(i8*)
+declare i32 @dprintf(i32, i8*, ...)
+declare i8* @fopen(i8*, i8*)
+declare i32 @fprintf(i8*, i8*, ...)
+declare i32 @fclose(i8*)
+declare i64 @llvm.readcyclecounter()
+
+define void @kyra_instrument_start(i32 %count, i8** %names) nounwind {
+entry:
+	store i32 %count, i32* @kyra.instrument.function_count, align 4
+	store i8** %names, i8*** @kyra.instrument.names, align 8
+	%function_count = zext i32 %count to i64
+	%counter_count = mul nuw i64 %function_count, 3
+	%memory = call i8* @calloc(i64 %counter_count, i64 8)
+	%counters = bitcast i8* %memory to i64*
+	store i64* %counters, i64** @kyra.instrument.counters, align 8
+	ret void
+}
+
+define void @kyra_instrument_enter(i32 %function) inlinehint nounwind {
+entry:
+	%counters = load i64*, i64** @kyra.instrument.counters, align 8
+	%function_index = zext i32 %function to i64
+	%calls_index = mul nuw i64 %function_index, 3
+	%calls = getelementptr inbounds i64, i64* %counters, i64 %calls_index
+	%previous_calls = atomicrmw add i64* %calls, i64 1 monotonic
+	%depth = load i32, i32* @kyra.instrument.depth, align 4
+	%new_depth = add i32 %depth, 1
+	store i32 %new_depth, i32* @kyra.instrument.depth, align 4
+	%is_tracked = icmp ult i32 %depth, 256
+	br i1 %is_tracked, label %push, label %done
+
+push:
+	%start = call i64 @llvm.readcyclecounter()
+	%frame_index = zext i32 %depth to i64
+	%frame_start = getelementptr inbounds [256 x %kyra.instrument.frame], [256 x %kyra.instrument.frame]* @kyra.instrument.stack, i64 0, i64 %frame_index, i32 0
+	store i64 %start, i64* %frame_start, align 8
+	%frame_children = getelementptr inbounds [256 x %kyra.instrument.frame], [256 x %kyra.instrument.frame]* @kyra.instrument.stack, i64 0, i64 %frame_index, i32 1
+	store i64 0, i64* %frame_children, align 8
+	br label %done
+
+done:
+	ret void
+}
+
+define void @kyra_instrument_exit(i32 %function) inlinehint nounwind {
+entry:
+	%now = call i64 @llvm.readcyclecounter()
+	%depth = load i32, i32* @kyra.instrument.depth, align 4
+	%frame_depth = sub i32 %depth, 1
+	store i32 %frame_depth, i32* @kyra.instrument.depth, align 4
+	%is_tracked = icmp ult i32 %frame_depth, 256
+	br i1 %is_tracked, label %pop, label %done
+
+pop:
+	%frame_index = zext i32 %frame_depth to i64
+	%frame_start = getelementptr inbounds [256 x %kyra.instrument.frame], [256 x %kyra.instrument.frame]* @kyra.instrument.stack, i64 0, i64 %frame_index, i32 0
+	%start = load i64, i64* %frame_start, align 8
+	%frame_children = getelementptr inbounds [256 x %kyra.instrument.frame], [256 x %kyra.instrument.frame]* @kyra.instrument.stack, i64 0, i64 %frame_index, i32 1
+	%children = load i64, i64* %frame_children, align 8
+	%elapsed = sub i64 %now, %start
+	%self = sub i64 %elapsed, %children
+	%counters = load i64*, i64** @kyra.instrument.counters, align 8
+	%function_index = zext i32 %function to i64
+	%calls_index = mul nuw i64 %function_index, 3
+	%total_index = add nuw i64 %calls_index, 1
+	%self_index = add nuw i64 %calls_index, 2
+	%total_cycles = getelementptr inbounds i64, i64* %counters, i64 %total_index
+	%self_cycles = getelementptr inbounds i64, i64* %counters, i64 %self_index
+	%previous_total = atomicrmw add i64* %total_cycles, i64 %elapsed monotonic
+	%previous_self = atomicrmw add i64* %self_cycles, i64 %self monotonic
+	%has_caller = icmp ugt i32 %frame_depth, 0
+	br i1 %has_caller, label %charge_caller, label %done
+
+charge_caller:
+	%caller_index = sub nuw i64 %frame_index, 1
+	%caller_children = getelementptr inbounds [256 x %kyra.instrument.frame], [256 x %kyra.instrument.frame]* @kyra.instrument.stack, i64 0, i64 %caller_index, i32 1
+	%previous_children = load i64, i64* %caller_children, align 8
+	%new_children = add i64 %previous_children, %elapsed
+	store i64 %new_children, i64* %caller_children, align 8
+	br label %done
+
+done:
+	ret void
+}
+
+define internal i64 @kyra.instrument.counter(i32 %function, i64 %offset) nounwind readonly {
+entry:
+	%counters = load i64*, i64** @kyra.instrument.counters, align 8
+	%function_index = zext i32 %function to i64
+	%base_index = mul nuw i64 %function_index, 3
+	%index = add nuw i64 %base_index, %offset
+	%counter = getelementptr inbounds i64, i64* %counters, i64 %index
+	%value = load i64, i64* %counter, align 8
+	ret i64 %value
+}
+
+; Orders function indices by descending self time
+define internal i32 @kyra.instrument.compare(i8* %lhs, i8* %rhs) nounwind readonly {
+entry:
+	%lhs_index_ptr = bitcast i8* %lhs to i32*
+	%lhs_index = load i32, i32* %lhs_index_ptr, align 4
+	%rhs_index_ptr = bitcast i8* %rhs to i32*
+	%rhs_index = load i32, i32* %rhs_index_ptr, align 4
+	%lhs_self = call i64 @kyra.instrument.counter(i32 %lhs_index, i64 2)
+	%rhs_self = call i64 @kyra.instrument.counter(i32 %rhs_index, i64 2)
+	%is_greater = icmp ugt i64 %lhs_self, %rhs_self
+	%is_less = icmp ult i64 %lhs_self, %rhs_self
+	%less_result = select i1 %is_less, i32 1, i32 0
+	%result = select i1 %is_greater, i32 -1, i32 %less_result
+	ret i32 %result
+}
+
+define void @kyra_instrument_report() nounwind {
+entry:
+	%count = load i32, i32* @kyra.instrument.function_count, align 4
+	%is_empty = icmp eq i32 %count, 0
+	br i1 %is_empty, label %exit, label %sort
+
+sort:
+	%function_count = zext i32 %count to i64
+	%order_memory = call i8* @calloc(i64 %function_count, i64 4)
+	%order = bitcast i8* %order_memory to i32*
+	br label %fill
+
+fill:
+	%fill_index = phi i32 [ 0, %sort ], [ %next_fill_index, %fill ]
+	%fill_index_ext = zext i32 %fill_index to i64
+	%fill_slot = getelementptr inbounds i32, i32* %order, i64 %fill_index_ext
+	store i32 %fill_index, i32* %fill_slot, align 4
+	%next_fill_index = add nuw i32 %fill_index, 1
+	%is_filled = icmp eq i32 %next_fill_index, %count
+	br i1 %is_filled, label %open, label %fill
+
+open:
+	call void @qsort(i8* %order_memory, i64 %function_count, i64 4, i32 (i8*, i8*)* @kyra.instrument.compare)
+	%text_header = getelementptr inbounds [71 x i8], [71 x i8]* @kyra.instrument.text_header, i64 0, i64 0
+	%header_result = call i32 (i32, i8*, ...) @dprintf(i32 2, i8* %text_header)
+	%path_variable = getelementptr inbounds [13 x i8], [13 x i8]* @kyra.instrument.path_variable, i64 0, i64 0
+	%custom_path = call i8* @getenv(i8* %path_variable)
+	%has_custom_path = icmp ne i8* %custom_path, null
+	%default_path = getelementptr inbounds [18 x i8], [18 x i8]* @kyra.instrument.default_path, i64 0, i64 0
+	%path = select i1 %has_custom_path, i8* %custom_path, i8* %default_path
+	%write_mode = getelementptr inbounds [2 x i8], [2 x i8]* @kyra.instrument.write_mode, i64 0, i64 0
+	%file = call i8* @fopen(i8* %path, i8* %write_mode)
+	%has_file = icmp ne i8* %file, null
+	br i1 %has_file, label %json_header, label %rows
+
+json_header:
+	%json_header_format = getelementptr inbounds [39 x i8], [39 x i8]* @kyra.instrument.json_header, i64 0, i64 0
+	%json_header_result = call i32 (i8*, i8*, ...) @fprintf(i8* %file, i8* %json_header_format)
+	br label %rows
+
+rows:
+	%row = phi i32 [ 0, %open ], [ 0, %json_header ], [ %next_row, %next ]
+	%has_written_row = phi i1 [ false, %open ], [ false, %json_header ], [ %next_has_written_row, %next ]
+	%row_ext = zext i32 %row to i64
+	%row_slot = getelementptr inbounds i32, i32* %order, i64 %row_ext
+	%function = load i32, i32* %row_slot, align 4
+	%calls = call i64 @kyra.instrument.counter(i32 %function, i64 0)
+	%was_called = icmp ne i64 %calls, 0
+	br i1 %was_called, label %print_row, label %next
+
+print_row:
+	%total = call i64 @kyra.instrument.counter(i32 %function, i64 1)
+	%self = call i64 @kyra.instrument.counter(i32 %function, i64 2)
+	%mean = udiv i64 %total, %calls
+	%names = load i8**, i8*** @kyra.instrument.names, align 8
+	%function_ext = zext i32 %function to i64
+	%name_slot = getelementptr inbounds i8*, i8** %names, i64 %function_ext
+	%name = load i8*, i8** %name_slot, align 8
+	%text_row = getelementptr inbounds [30 x i8], [30 x i8]* @kyra.instrument.text_row, i64 0, i64 0
+	%text_row_result = call i32 (i32, i8*, ...) @dprintf(i32 2, i8* %text_row, i64 %calls, i64 %total, i64 %self, i64 %mean)
+	%text_name = getelementptr inbounds [4 x i8], [4 x i8]* @kyra.instrument.text_name, i64 0, i64 0
+	%text_name_result = call i32 (i32, i8*, ...) @dprintf(i32 2, i8* %text_name, i8* %name)
+	br i1 %has_file, label %json_row, label %next
+
+json_row:
+	%separator = getelementptr inbounds [2 x i8], [2 x i8]* @kyra.instrument.separator, i64 0, i64 0
+	%no_separator = getelementptr inbounds [1 x i8], [1 x i8]* @kyra.instrument.no_separator, i64 0, i64 0
+	%row_separator = select i1 %has_written_row, i8* %separator, i8* %no_separator
+	%json_row_format = getelementptr inbounds [101 x i8], [101 x i8]* @kyra.instrument.json_row, i64 0, i64 0
+	%json_row_result = call i32 (i8*, i8*, ...) @fprintf(i8* %file, i8* %json_row_format, i8* %row_separator, i8* %name, i64 %calls, i64 %total, i64 %self, i64 %mean)
+	br label %next
+
+next:
+	%next_has_written_row = phi i1 [ %has_written_row, %rows ], [ %has_written_row, %print_row ], [ true, %json_row ]
+	%next_row = add nuw i32 %row, 1
+	%is_done = icmp eq i32 %next_row, %count
+	br i1 %is_done, label %close, label %rows
+
+close:
+	call void @free(i8* %order_memory)
+	br i1 %has_file, label %json_footer, label %exit
+
+json_footer:
+	%json_footer_format = getelementptr inbounds [8 x i8], [8 x i8]* @kyra.instrument.json_footer, i64 0, i64 0
+	%json_footer_result = call i32 (i8*, i8*, ...) @fprintf(i8* %file, i8* %json_footer_format)
+	%close_result = call i32 @fclose(i8* %file)
+	br label %exit
+
+exit:
+	ret void
+}
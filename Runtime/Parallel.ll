@@ -0,0 +1,368 @@
+; Work-stealing scheduler for parallel loops.
+;
+; CodeGen outlines the body of a parallel loop into a function that runs the iterations [first, last) and passes the
+; number of iterations to kyra_parallel_for. Every worker owns a deque of ranges and starts with an equal share of the
+; iterations. It takes the newest range from the bottom of its own deque and splits it in half until it is small
+; enough to run, pushing the upper halves back. Idle workers steal the oldest (and thus largest) range from the top of
+; another deque, so an uneven load is balanced by splitting instead of by handing out many small chunks up front.
+; The calling thread is the first worker, the others are started for the loop and joined before it returns. Loops that
+; are nested into a parallel loop run serially on their worker.
+
+%kyra.parallel.range = type { i64, i64 }
+; The lock guards top, bottom and the ranges, the ranges in [top, bottom) are queued. Every deque fills whole cache
+; lines, so workers do not share the lines they lock.
+%kyra.parallel.deque = type { i32, i64, i64, [5 x i64], [64 x %kyra.parallel.range] }
+; Iterations that were not claimed by a worker yet, the size up to which ranges are run without splitting them, the
+; number of workers, the body with its context and the deques of all workers
+%kyra.parallel.loop = type { i64, i64, i64, void (i64, i64, i8*)*, i8*, %kyra.parallel.deque* }
+; The loop, the index of the worker, its thread and whether the thread was started
+%kyra.parallel.worker = type { %kyra.parallel.loop*, i64, i64, i1 }
+
+@kyra.parallel.is_worker = linkonce_odr thread_local global i1 false, align 1
+@kyra.parallel.threads_variable = internal unnamed_addr constant [13 x i8] c"KYRA_THREADS\00"
+
+declare void @kyra_flush()
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare i32 @sched_yield()
+declare i64 @sysconf(i32)
+declare i8* @getenv(i8*)
+declare i64 @strtol(i8*, i8**, i32)
+declare i8* @aligned_alloc(i64, i64)
+declare void @free(i8*)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)
+
+define internal void @kyra.parallel.lock(%kyra.parallel.deque* %deque) nounwind {
+entry:
+	%lock = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 0
+	br label %acquire
+
+acquire:
+	%previous = atomicrmw xchg i32* %lock, i32 1 acquire
+	%is_acquired = icmp eq i32 %previous, 0
+	br i1 %is_acquired, label %exit, label %wait
+
+; Waiting only reads the lock, so the cache line is not taken away from the worker that holds it
+wait:
+	%state = load atomic i32, i32* %lock monotonic, align 4
+	%is_free = icmp eq i32 %state, 0
+	br i1 %is_free, label %acquire, label %wait
+
+exit:
+	ret void
+}
+
+define internal void @kyra.parallel.unlock(%kyra.parallel.deque* %deque) nounwind {
+entry:
+	%lock = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 0
+	store atomic i32 0, i32* %lock release, align 4
+	ret void
+}
+
+; Queues the range at the bottom. Fails if the deque is full.
+define internal i1 @kyra.parallel.push(%kyra.parallel.deque* %deque, i64 %first, i64 %last) nounwind {
+entry:
+	call void @kyra.parallel.lock(%kyra.parallel.deque* %deque)
+	%top_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 1
+	%bottom_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 2
+	%top = load i64, i64* %top_pointer, align 8
+	%bottom = load i64, i64* %bottom_pointer, align 8
+	%size = sub i64 %bottom, %top
+	%is_full = icmp uge i64 %size, 64
+	br i1 %is_full, label %exit, label %push
+
+push:
+	%slot = and i64 %bottom, 63
+	%first_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 4, i64 %slot, i32 0
+	%last_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 4, i64 %slot, i32 1
+	store i64 %first, i64* %first_pointer, align 8
+	store i64 %last, i64* %last_pointer, align 8
+	%next_bottom = add i64 %bottom, 1
+	store i64 %next_bottom, i64* %bottom_pointer, align 8
+	br label %exit
+
+exit:
+	%is_pushed = phi i1 [ false, %entry ], [ true, %push ]
+	call void @kyra.parallel.unlock(%kyra.parallel.deque* %deque)
+	ret i1 %is_pushed
+}
+
+; Takes the newest range from the bottom, or the oldest one from the top if it is stolen. Fails if the deque is empty.
+define internal i1 @kyra.parallel.take(%kyra.parallel.deque* %deque, %kyra.parallel.range* %range, i1 %is_steal) nounwind {
+entry:
+	call void @kyra.parallel.lock(%kyra.parallel.deque* %deque)
+	%top_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 1
+	%bottom_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 2
+	%top = load i64, i64* %top_pointer, align 8
+	%bottom = load i64, i64* %bottom_pointer, align 8
+	%is_empty = icmp eq i64 %top, %bottom
+	br i1 %is_empty, label %exit, label %take
+
+take:
+	%last_index = sub i64 %bottom, 1
+	%index = select i1 %is_steal, i64 %top, i64 %last_index
+	%slot = and i64 %index, 63
+	%first_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 4, i64 %slot, i32 0
+	%last_pointer = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deque, i64 0, i32 4, i64 %slot, i32 1
+	%first = load i64, i64* %first_pointer, align 8
+	%last = load i64, i64* %last_pointer, align 8
+	%range_first = getelementptr inbounds %kyra.parallel.range, %kyra.parallel.range* %range, i64 0, i32 0
+	%range_last = getelementptr inbounds %kyra.parallel.range, %kyra.parallel.range* %range, i64 0, i32 1
+	store i64 %first, i64* %range_first, align 8
+	store i64 %last, i64* %range_last, align 8
+	br i1 %is_steal, label %take_top, label %take_bottom
+
+take_top:
+	%next_top = add i64 %top, 1
+	store i64 %next_top, i64* %top_pointer, align 8
+	br label %exit
+
+take_bottom:
+	store i64 %last_index, i64* %bottom_pointer, align 8
+	br label %exit
+
+exit:
+	%is_taken = phi i1 [ false, %entry ], [ true, %take_top ], [ true, %take_bottom ]
+	call void @kyra.parallel.unlock(%kyra.parallel.deque* %deque)
+	ret i1 %is_taken
+}
+
+; Runs ranges until all iterations of the loop are claimed
+define internal void @kyra.parallel.work(%kyra.parallel.loop* %loop, i64 %self) nounwind {
+entry:
+	%range = alloca %kyra.parallel.range, align 8
+	%remaining_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 0
+	%grain_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 1
+	%workers_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 2
+	%body_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 3
+	%context_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 4
+	%deques_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 5
+	%grain = load i64, i64* %grain_pointer, align 8
+	%workers = load i64, i64* %workers_pointer, align 8
+	%body = load void (i64, i64, i8*)*, void (i64, i64, i8*)** %body_pointer, align 8
+	%context = load i8*, i8** %context_pointer, align 8
+	%deques = load %kyra.parallel.deque*, %kyra.parallel.deque** %deques_pointer, align 8
+	%own = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deques, i64 %self
+	%range_first = getelementptr inbounds %kyra.parallel.range, %kyra.parallel.range* %range, i64 0, i32 0
+	%range_last = getelementptr inbounds %kyra.parallel.range, %kyra.parallel.range* %range, i64 0, i32 1
+	br label %take
+
+take:
+	%is_taken = call i1 @kyra.parallel.take(%kyra.parallel.deque* %own, %kyra.parallel.range* %range, i1 false)
+	br i1 %is_taken, label %split, label %steal
+
+; The other workers are tried in turn, starting with the next one
+steal:
+	%offset = phi i64 [ 1, %take ], [ %next_offset, %steal_next ]
+	%tried_all = icmp uge i64 %offset, %workers
+	br i1 %tried_all, label %idle, label %steal_from
+
+steal_from:
+	%victim_sum = add i64 %self, %offset
+	%victim_index = urem i64 %victim_sum, %workers
+	%victim = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deques, i64 %victim_index
+	%is_stolen = call i1 @kyra.parallel.take(%kyra.parallel.deque* %victim, %kyra.parallel.range* %range, i1 true)
+	br i1 %is_stolen, label %split, label %steal_next
+
+steal_next:
+	%next_offset = add i64 %offset, 1
+	br label %steal
+
+; Iterations are claimed right before they run, so the loop is done once nothing remains. Until then another worker
+; might still push the upper half of a range it is splitting.
+idle:
+	%remaining = load atomic i64, i64* %remaining_pointer acquire, align 8
+	%is_done = icmp eq i64 %remaining, 0
+	br i1 %is_done, label %exit, label %yield
+
+yield:
+	call i32 @sched_yield()
+	br label %take
+
+split:
+	%first = load i64, i64* %range_first, align 8
+	%taken_last = load i64, i64* %range_last, align 8
+	br label %split_range
+
+split_range:
+	%last = phi i64 [ %taken_last, %split ], [ %middle, %push ]
+	%size = sub i64 %last, %first
+	%is_small = icmp ule i64 %size, %grain
+	br i1 %is_small, label %run, label %push
+
+; Keeps the lower half, so the worker continues with the iterations next to the ones it ran before
+push:
+	%half = lshr i64 %size, 1
+	%middle = add i64 %first, %half
+	%is_pushed = call i1 @kyra.parallel.push(%kyra.parallel.deque* %own, i64 %middle, i64 %last)
+	br i1 %is_pushed, label %split_range, label %run
+
+run:
+	%chunk_size = sub i64 %last, %first
+	%claimed = atomicrmw sub i64* %remaining_pointer, i64 %chunk_size acq_rel
+	call void %body(i64 %first, i64 %last, i8* %context)
+	br label %take
+
+exit:
+	ret void
+}
+
+define internal i8* @kyra.parallel.thread(i8* %argument) nounwind {
+entry:
+	store i1 true, i1* @kyra.parallel.is_worker, align 1
+	%worker = bitcast i8* %argument to %kyra.parallel.worker*
+	%loop_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %worker, i64 0, i32 0
+	%index_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %worker, i64 0, i32 1
+	%loop = load %kyra.parallel.loop*, %kyra.parallel.loop** %loop_pointer, align 8
+	%index = load i64, i64* %index_pointer, align 8
+	call void @kyra.parallel.work(%kyra.parallel.loop* %loop, i64 %index)
+	; The print buffer belongs to the thread and goes away with it
+	call void @kyra_flush()
+	ret i8* null
+}
+
+; $KYRA_THREADS if it is set to a positive number, otherwise the number of online processors
+define internal i64 @kyra.parallel.thread_count() nounwind {
+entry:
+	%name = getelementptr inbounds [13 x i8], [13 x i8]* @kyra.parallel.threads_variable, i64 0, i64 0
+	%value = call i8* @getenv(i8* %name)
+	%is_set = icmp ne i8* %value, null
+	br i1 %is_set, label %parse, label %processors
+
+parse:
+	%count = call i64 @strtol(i8* %value, i8** null, i32 10)
+	%is_valid = icmp sgt i64 %count, 0
+	br i1 %is_valid, label %exit, label %processors
+
+; _SC_NPROCESSORS_ONLN on Linux
+processors:
+	%online = call i64 @sysconf(i32 84)
+	br label %exit
+
+exit:
+	%threads = phi i64 [ %count, %parse ], [ %online, %processors ]
+	ret i64 %threads
+}
+
+; Runs body(first, last, context) for chunks that cover [0, count) exactly once. The chunks of one worker run in
+; ascending order, but the workers run at the same time.
+define void @kyra_parallel_for(i64 %count, void (i64, i64, i8*)* %body, i8* %context) nounwind {
+entry:
+	%is_nested = load i1, i1* @kyra.parallel.is_worker, align 1
+	br i1 %is_nested, label %serial, label %count_threads
+
+; No more than 64 workers, and none without iterations
+count_threads:
+	%threads = call i64 @kyra.parallel.thread_count()
+	%is_above_limit = icmp sgt i64 %threads, 64
+	%limited_threads = select i1 %is_above_limit, i64 64, i64 %threads
+	%is_single = icmp sle i64 %limited_threads, 1
+	br i1 %is_single, label %serial, label %count_workers
+
+count_workers:
+	%has_few_iterations = icmp ult i64 %count, %limited_threads
+	%workers = select i1 %has_few_iterations, i64 %count, i64 %limited_threads
+	%is_serial = icmp ule i64 %workers, 1
+	br i1 %is_serial, label %serial, label %allocate
+
+serial:
+	call void %body(i64 0, i64 %count, i8* %context)
+	ret void
+
+allocate:
+	%deque_size = ptrtoint %kyra.parallel.deque* getelementptr (%kyra.parallel.deque, %kyra.parallel.deque* null, i64 1) to i64
+	%deques_size = mul i64 %deque_size, %workers
+	%memory = call i8* @aligned_alloc(i64 64, i64 %deques_size)
+	%is_allocated = icmp ne i8* %memory, null
+	br i1 %is_allocated, label %parallel, label %serial
+
+; A range is not split below an eighth of an equal share. Every worker can still hand off parts of its share, but
+; ranges stay large enough to keep the overhead of splitting low.
+parallel:
+	; Every worker flushes its own output when it is done, so whatever the caller printed before has to come first
+	call void @kyra_flush()
+	call void @llvm.memset.p0i8.i64(i8* align 64 %memory, i8 0, i64 %deques_size, i1 false)
+	%deques = bitcast i8* %memory to %kyra.parallel.deque*
+	%workers_times_eight = mul i64 %workers, 8
+	%grain_quotient = udiv i64 %count, %workers_times_eight
+	%is_grain_zero = icmp eq i64 %grain_quotient, 0
+	%grain = select i1 %is_grain_zero, i64 1, i64 %grain_quotient
+	%loop = alloca %kyra.parallel.loop, align 8
+	%remaining_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 0
+	%grain_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 1
+	%workers_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 2
+	%body_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 3
+	%context_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 4
+	%deques_pointer = getelementptr inbounds %kyra.parallel.loop, %kyra.parallel.loop* %loop, i64 0, i32 5
+	store i64 %count, i64* %remaining_pointer, align 8
+	store i64 %grain, i64* %grain_pointer, align 8
+	store i64 %workers, i64* %workers_pointer, align 8
+	store void (i64, i64, i8*)* %body, void (i64, i64, i8*)** %body_pointer, align 8
+	store i8* %context, i8** %context_pointer, align 8
+	store %kyra.parallel.deque* %deques, %kyra.parallel.deque** %deques_pointer, align 8
+	%worker_array = alloca [64 x %kyra.parallel.worker], align 8
+	%share_size = udiv i64 %count, %workers
+	%share_remainder = urem i64 %count, %workers
+	br label %share
+
+; The first count % workers workers get one iteration more
+share:
+	%index = phi i64 [ 0, %parallel ], [ %next_index, %share ]
+	%share_first = phi i64 [ 0, %parallel ], [ %share_last, %share ]
+	%gets_extra = icmp ult i64 %index, %share_remainder
+	%extra = zext i1 %gets_extra to i64
+	%size = add i64 %share_size, %extra
+	%share_last = add i64 %share_first, %size
+	%deque = getelementptr inbounds %kyra.parallel.deque, %kyra.parallel.deque* %deques, i64 %index
+	%is_shared = call i1 @kyra.parallel.push(%kyra.parallel.deque* %deque, i64 %share_first, i64 %share_last)
+	%worker_loop = getelementptr inbounds [64 x %kyra.parallel.worker], [64 x %kyra.parallel.worker]* %worker_array, i64 0, i64 %index, i32 0
+	%worker_index = getelementptr inbounds [64 x %kyra.parallel.worker], [64 x %kyra.parallel.worker]* %worker_array, i64 0, i64 %index, i32 1
+	store %kyra.parallel.loop* %loop, %kyra.parallel.loop** %worker_loop, align 8
+	store i64 %index, i64* %worker_index, align 8
+	%next_index = add i64 %index, 1
+	%is_shared_out = icmp eq i64 %next_index, %workers
+	br i1 %is_shared_out, label %start, label %share
+
+; The share of a thread that could not be started is stolen by the others
+start:
+	%thread_index = phi i64 [ 1, %share ], [ %next_thread_index, %start ]
+	%worker = getelementptr inbounds [64 x %kyra.parallel.worker], [64 x %kyra.parallel.worker]* %worker_array, i64 0, i64 %thread_index
+	%thread_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %worker, i64 0, i32 2
+	%started_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %worker, i64 0, i32 3
+	%argument = bitcast %kyra.parallel.worker* %worker to i8*
+	%result = call i32 @pthread_create(i64* %thread_pointer, i8* null, i8* (i8*)* @kyra.parallel.thread, i8* %argument)
+	%is_started = icmp eq i32 %result, 0
+	store i1 %is_started, i1* %started_pointer, align 1
+	%next_thread_index = add i64 %thread_index, 1
+	%is_started_all = icmp eq i64 %next_thread_index, %workers
+	br i1 %is_started_all, label %run, label %start
+
+; The calling thread is the first worker
+run:
+	store i1 true, i1* @kyra.parallel.is_worker, align 1
+	call void @kyra.parallel.work(%kyra.parallel.loop* %loop, i64 0)
+	store i1 false, i1* @kyra.parallel.is_worker, align 1
+	br label %join
+
+join:
+	%join_index = phi i64 [ 1, %run ], [ %next_join_index, %join_next ]
+	%joined_worker = getelementptr inbounds [64 x %kyra.parallel.worker], [64 x %kyra.parallel.worker]* %worker_array, i64 0, i64 %join_index
+	%joined_started_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %joined_worker, i64 0, i32 3
+	%was_started = load i1, i1* %joined_started_pointer, align 1
+	br i1 %was_started, label %join_thread, label %join_next
+
+join_thread:
+	%joined_thread_pointer = getelementptr inbounds %kyra.parallel.worker, %kyra.parallel.worker* %joined_worker, i64 0, i32 2
+	%joined_thread = load i64, i64* %joined_thread_pointer, align 8
+	call i32 @pthread_join(i64 %joined_thread, i8** null)
+	br label %join_next
+
+join_next:
+	%next_join_index = add i64 %join_index, 1
+	%is_joined_all = icmp eq i64 %next_join_index, %workers
+	br i1 %is_joined_all, label %exit, label %join
+
+exit:
+	call void @free(i8* %memory)
+	ret void
+}
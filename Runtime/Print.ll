@@ -0,0 +1,257 @@
+; Buffered output for the print statement.
+;
+; Every thread owns a buffer that is only handed to write(2) once it is full or the program exits (CodeGen registers
+; kyra_flush as a global destructor). Integers are formatted two digits at a time using a lookup table, so printing
+; needs neither a format string nor a lock.
+
+@kyra.print.digit_pairs = internal unnamed_addr constant [200 x i8] c"00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899"
+
+; 64 KiB buffer per thread, the position is the number of buffered bytes. Modules that are linked together share them,
+; so their output stays in order.
+@kyra.print.buffer = linkonce_odr thread_local global [65536 x i8] zeroinitializer, align 64
+@kyra.print.position = linkonce_odr thread_local global i64 0, align 8
+
+declare i64 @write(i32, i8*, i64)
+declare i16 @llvm.bswap.i16(i16)
+declare i128 @llvm.bswap.i128(i128)
+
+; Writes all buffered bytes to stdout
+define void @kyra_flush() noinline cold nounwind {
+entry:
+	%length = load i64, i64* @kyra.print.position, align 8
+	br label %loop
+
+loop:
+	%written = phi i64 [ 0, %entry ], [ %next_written, %write_more ]
+	%remaining = sub i64 %length, %written
+	%is_done = icmp sle i64 %remaining, 0
+	br i1 %is_done, label %exit, label %write
+
+write:
+	%chunk = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %written
+	%result = call i64 @write(i32 1, i8* %chunk, i64 %remaining)
+	; Give up instead of spinning if nothing could be written
+	%failed = icmp sle i64 %result, 0
+	br i1 %failed, label %exit, label %write_more
+
+write_more:
+	%next_written = add i64 %written, %result
+	br label %loop
+
+exit:
+	store i64 0, i64* @kyra.print.position, align 8
+	ret void
+}
+
+; Appends the decimal representation of the value and a line break to the buffer. All ten digits are formatted with
+; leading zeros and shifted into place, so no branch depends on the value.
+define void @kyra_print_i32(i32 %value) inlinehint nounwind {
+entry:
+	%position = load i64, i64* @kyra.print.position, align 8
+	; a sign and the 16 bytes the digits are stored with
+	%is_full = icmp ugt i64 %position, 65519
+	br i1 %is_full, label %flush, label %format
+
+flush:
+	call void @kyra_flush()
+	br label %format
+
+format:
+	%start = phi i64 [ %position, %entry ], [ 0, %flush ]
+	%is_negative = icmp slt i32 %value, 0
+	%negated = sub i32 0, %value
+	%magnitude = select i1 %is_negative, i32 %negated, i32 %value
+	; The sign is written unconditionally and overwritten by the first digit if the value is positive
+	%sign_ptr = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %start
+	store i8 45, i8* %sign_ptr, align 1
+	%sign_length = zext i1 %is_negative to i64
+	%digits_start = add i64 %start, %sign_length
+	; The digits are loaded and stored as integers in the byte order of a little-endian target, so they are swapped on
+	; big-endian ones. The probe is a constant once the target is known, so the swaps are folded away.
+	%byte_order_probe = bitcast i16 1 to <2 x i8>
+	%lowest_byte = extractelement <2 x i8> %byte_order_probe, i32 0
+	%is_little_endian = icmp eq i8 %lowest_byte, 1
+
+	%ge_1e1 = icmp uge i32 %magnitude, 10
+	%ge_1e2 = icmp uge i32 %magnitude, 100
+	%ge_1e3 = icmp uge i32 %magnitude, 1000
+	%ge_1e4 = icmp uge i32 %magnitude, 10000
+	%ge_1e5 = icmp uge i32 %magnitude, 100000
+	%ge_1e6 = icmp uge i32 %magnitude, 1000000
+	%ge_1e7 = icmp uge i32 %magnitude, 10000000
+	%ge_1e8 = icmp uge i32 %magnitude, 100000000
+	%ge_1e9 = icmp uge i32 %magnitude, 1000000000
+	%d1 = zext i1 %ge_1e1 to i64
+	%d2 = zext i1 %ge_1e2 to i64
+	%d3 = zext i1 %ge_1e3 to i64
+	%d4 = zext i1 %ge_1e4 to i64
+	%d5 = zext i1 %ge_1e5 to i64
+	%d6 = zext i1 %ge_1e6 to i64
+	%d7 = zext i1 %ge_1e7 to i64
+	%d8 = zext i1 %ge_1e8 to i64
+	%d9 = zext i1 %ge_1e9 to i64
+	%s1 = add i64 %d1, %d2
+	%s2 = add i64 %d3, %d4
+	%s3 = add i64 %d5, %d6
+	%s4 = add i64 %d7, %d8
+	%s5 = add i64 %s1, %s2
+	%s6 = add i64 %s3, %s4
+	%s7 = add i64 %s5, %s6
+	%s8 = add i64 %s7, %d9
+	%digit_count = add i64 %s8, 1
+
+	; The pairs from the back, the first one is at most 42
+	%q1 = udiv i32 %magnitude, 100
+	%q1_hundreds = mul i32 %q1, 100
+	%p0 = sub i32 %magnitude, %q1_hundreds
+	%q2 = udiv i32 %q1, 100
+	%q2_hundreds = mul i32 %q2, 100
+	%p1 = sub i32 %q1, %q2_hundreds
+	%q3 = udiv i32 %q2, 100
+	%q3_hundreds = mul i32 %q3, 100
+	%p2 = sub i32 %q2, %q3_hundreds
+	%p4 = udiv i32 %q3, 100
+	%p4_hundreds = mul i32 %p4, 100
+	%p3 = sub i32 %q3, %p4_hundreds
+	%index0 = shl nuw nsw i32 %p0, 1
+	%index0_ext = zext i32 %index0 to i64
+	%src0_byte = getelementptr inbounds [200 x i8], [200 x i8]* @kyra.print.digit_pairs, i64 0, i64 %index0_ext
+	%src0 = bitcast i8* %src0_byte to i16*
+	%chars0 = load i16, i16* %src0, align 1
+	%chars0_swapped = call i16 @llvm.bswap.i16(i16 %chars0)
+	%chars0_ordered = select i1 %is_little_endian, i16 %chars0, i16 %chars0_swapped
+	%c0 = zext i16 %chars0_ordered to i128
+	%index1 = shl nuw nsw i32 %p1, 1
+	%index1_ext = zext i32 %index1 to i64
+	%src1_byte = getelementptr inbounds [200 x i8], [200 x i8]* @kyra.print.digit_pairs, i64 0, i64 %index1_ext
+	%src1 = bitcast i8* %src1_byte to i16*
+	%chars1 = load i16, i16* %src1, align 1
+	%chars1_swapped = call i16 @llvm.bswap.i16(i16 %chars1)
+	%chars1_ordered = select i1 %is_little_endian, i16 %chars1, i16 %chars1_swapped
+	%c1 = zext i16 %chars1_ordered to i128
+	%index2 = shl nuw nsw i32 %p2, 1
+	%index2_ext = zext i32 %index2 to i64
+	%src2_byte = getelementptr inbounds [200 x i8], [200 x i8]* @kyra.print.digit_pairs, i64 0, i64 %index2_ext
+	%src2 = bitcast i8* %src2_byte to i16*
+	%chars2 = load i16, i16* %src2, align 1
+	%chars2_swapped = call i16 @llvm.bswap.i16(i16 %chars2)
+	%chars2_ordered = select i1 %is_little_endian, i16 %chars2, i16 %chars2_swapped
+	%c2 = zext i16 %chars2_ordered to i128
+	%index3 = shl nuw nsw i32 %p3, 1
+	%index3_ext = zext i32 %index3 to i64
+	%src3_byte = getelementptr inbounds [200 x i8], [200 x i8]* @kyra.print.digit_pairs, i64 0, i64 %index3_ext
+	%src3 = bitcast i8* %src3_byte to i16*
+	%chars3 = load i16, i16* %src3, align 1
+	%chars3_swapped = call i16 @llvm.bswap.i16(i16 %chars3)
+	%chars3_ordered = select i1 %is_little_endian, i16 %chars3, i16 %chars3_swapped
+	%c3 = zext i16 %chars3_ordered to i128
+	%index4 = shl nuw nsw i32 %p4, 1
+	%index4_ext = zext i32 %index4 to i64
+	%src4_byte = getelementptr inbounds [200 x i8], [200 x i8]* @kyra.print.digit_pairs, i64 0, i64 %index4_ext
+	%src4 = bitcast i8* %src4_byte to i16*
+	%chars4 = load i16, i16* %src4, align 1
+	%chars4_swapped = call i16 @llvm.bswap.i16(i16 %chars4)
+	%chars4_ordered = select i1 %is_little_endian, i16 %chars4, i16 %chars4_swapped
+	%c4 = zext i16 %chars4_ordered to i128
+	; The first character is the lowest byte
+	%c3_shifted = shl i128 %c3, 16
+	%c2_shifted = shl i128 %c2, 32
+	%c1_shifted = shl i128 %c1, 48
+	%c0_shifted = shl i128 %c0, 64
+	%or1 = or i128 %c4, %c3_shifted
+	%or2 = or i128 %c2_shifted, %c1_shifted
+	%or3 = or i128 %or1, %or2
+	%padded = or i128 %or3, %c0_shifted
+	%leading_zeros = sub i64 10, %digit_count
+	%leading_bits = shl i64 %leading_zeros, 3
+	%leading_bits_wide = zext i64 %leading_bits to i128
+	%digits = lshr i128 %padded, %leading_bits_wide
+	%digits_swapped = call i128 @llvm.bswap.i128(i128 %digits)
+	%digits_ordered = select i1 %is_little_endian, i128 %digits, i128 %digits_swapped
+	%digits_byte = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %digits_start
+	%digits_dst = bitcast i8* %digits_byte to i128*
+	store i128 %digits_ordered, i128* %digits_dst, align 1
+
+	; The store above may write past the digits, so the line break comes after it
+	%end = add i64 %digits_start, %digit_count
+	%line_break_ptr = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %end
+	store i8 10, i8* %line_break_ptr, align 1
+	%new_position = add i64 %end, 1
+	store i64 %new_position, i64* @kyra.print.position, align 8
+	ret void
+}
+
+; Appends the decimal representation of the value and a line break to the buffer. Values that are wider than 32 bits
+; are rare, so their digits are simply counted in a loop.
+define void @kyra_print_i64(i64 %value) inlinehint nounwind {
+entry:
+	%is_negative = icmp slt i64 %value, 0
+	%negated = sub i64 0, %value
+	%magnitude = select i1 %is_negative, i64 %negated, i64 %value
+	call void @kyra.print.digits(i64 %magnitude, i1 %is_negative)
+	ret void
+}
+
+define void @kyra_print_u64(i64 %value) inlinehint nounwind {
+entry:
+	call void @kyra.print.digits(i64 %value, i1 false)
+	ret void
+}
+
+; The magnitude is unsigned, so the magnitude of the smallest i64 is still correct
+define internal void @kyra.print.digits(i64 %magnitude, i1 %is_negative) nounwind {
+entry:
+	%position = load i64, i64* @kyra.print.position, align 8
+	; a sign, twenty digits and the line break
+	%is_full = icmp ugt i64 %position, 65514
+	br i1 %is_full, label %flush, label %format
+
+flush:
+	call void @kyra_flush()
+	br label %format
+
+format:
+	%start = phi i64 [ %position, %entry ], [ 0, %flush ]
+	%sign_ptr = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %start
+	store i8 45, i8* %sign_ptr, align 1
+	%sign_length = zext i1 %is_negative to i64
+	%digits_start = add i64 %start, %sign_length
+	br label %count
+
+count:
+	%digit_count = phi i64 [ 1, %format ], [ %next_digit_count, %count_more ]
+	%count_rest = phi i64 [ %magnitude, %format ], [ %count_quotient, %count_more ]
+	%has_more = icmp uge i64 %count_rest, 10
+	br i1 %has_more, label %count_more, label %counted
+
+count_more:
+	%count_quotient = udiv i64 %count_rest, 10
+	%next_digit_count = add i64 %digit_count, 1
+	br label %count
+
+counted:
+	%end = add i64 %digits_start, %digit_count
+	%line_break_ptr = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %end
+	store i8 10, i8* %line_break_ptr, align 1
+	br label %digits
+
+	; Digits are written from the back
+digits:
+	%rest = phi i64 [ %magnitude, %counted ], [ %quotient, %digits ]
+	%digit_end = phi i64 [ %end, %counted ], [ %digit_pos, %digits ]
+	%quotient = udiv i64 %rest, 10
+	%quotient_tens = mul i64 %quotient, 10
+	%digit = sub i64 %rest, %quotient_tens
+	%digit_byte = trunc i64 %digit to i8
+	%digit_char = add i8 %digit_byte, 48
+	%digit_pos = sub i64 %digit_end, 1
+	%digit_dst = getelementptr inbounds [65536 x i8], [65536 x i8]* @kyra.print.buffer, i64 0, i64 %digit_pos
+	store i8 %digit_char, i8* %digit_dst, align 1
+	%is_done = icmp eq i64 %quotient, 0
+	br i1 %is_done, label %done, label %digits
+
+done:
+	%new_position = add i64 %end, 1
+	store i64 %new_position, i64* @kyra.print.position, align 8
+	ret void
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string_view>
+
+namespace Kyra::Runtime {
+// Returns the bitcode of the Kyra runtime (see Runtime/*.ll), which gets linked into every generated module
+std::string_view get_bitcode();
+}